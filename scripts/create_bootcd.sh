@@ -18,6 +18,9 @@ mkdir -p $BUILD_DIR/bootfs/drivers
 cp $ACE_ROOT/src/kernel/driver_id.txt $BUILD_DIR/bootfs
 cp /usr/src/build-bash/bash $BUILD_DIR/bootfs/app
 cp $BUILD_DIR/app/hello.exe $BUILD_DIR/bootfs/app
+cp $BUILD_DIR/app/readbench.exe $BUILD_DIR/bootfs/app
+cp $BUILD_DIR/app/syscallbench.exe $BUILD_DIR/bootfs/app
+cp $BUILD_DIR/app/ioringtest.exe $BUILD_DIR/bootfs/app
 cp $BUILD_DIR/drivers/pci_bus.sys $BUILD_DIR/bootfs/drivers
 cp $BUILD_DIR/drivers/acpi.sys $BUILD_DIR/bootfs/drivers
 cp $BUILD_DIR/drivers/console.sys $BUILD_DIR/bootfs/drivers
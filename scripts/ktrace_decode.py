@@ -0,0 +1,174 @@
+#! /usr/bin/env python
+"""Decodes the binary ktrace records written to the debug serial port.
+
+Boot the kernel with ktrace_buffer_records=<n> and capture the serial port to a file, then
+	ktrace_decode.py <kernel.sys> <serial capture>
+Text written before the switch to binary records is copied as it is. Format strings are read
+from the kernel image. %s arguments are taken from the strings copied into the record, the others
+from the kernel image; a string found in neither is shown as <address>.
+"""
+import struct
+import sys
+
+RECORD_MAGIC = b'\xac\xe1'
+RECORD_ARGS = 8
+RECORD_STRING_SIZE = 64
+# header of the record - followed by string_length bytes of copied strings
+RECORD_FORMAT = '<2sBBIQ%dIHH' % RECORD_ARGS
+RECORD_SIZE = struct.calcsize(RECORD_FORMAT)
+
+SHT_NOBITS = 8
+SHF_ALLOC = 2
+
+
+class KernelImage:
+	"""Reads strings from the allocated sections of the kernel ELF image"""
+	def __init__(self, path):
+		self.data = open(path, 'rb').read()
+		if self.data[:4] != b'\x7fELF':
+			raise ValueError('%s is not an ELF file' % path)
+		shoff, = struct.unpack_from('<I', self.data, 32)
+		shentsize, shnum = struct.unpack_from('<HH', self.data, 46)
+		self.sections = []
+		for i in range(shnum):
+			name, type, flags, addr, offset, size = struct.unpack_from('<IIIIII', self.data, shoff + i * shentsize)
+			if flags & SHF_ALLOC and type != SHT_NOBITS and size:
+				self.sections.append((addr, offset, size))
+
+	def string(self, address):
+		for addr, offset, size in self.sections:
+			if addr <= address < addr + size:
+				start = offset + address - addr
+				end = self.data.find(b'\0', start, offset + size)
+				if end < 0:
+					end = offset + size
+				return self.data[start:end].decode('latin-1')
+		return None
+
+
+def format_record(image, fmt, args, string_args=0, strings=()):
+	"""Formats the arguments the way _doprint() in kernel/printf.c does
+	Bit n of string_args is set if the string of args[n] was copied into the record, strings holds
+	the copied strings in argument order."""
+	out = []
+	args = list(args)
+	strings = list(strings)
+	used = [0]
+
+	def next_arg():
+		if not args:
+			raise IndexError
+		used[0] += 1
+		return args.pop(0)
+
+	i = 0
+	try:
+		while i < len(fmt):
+			ch = fmt[i]
+			i += 1
+			if ch != '%':
+				out.append(ch)
+				continue
+			spec = '%'
+			longlong = False
+			while i < len(fmt) and fmt[i] in ' #+-0123456789.*hlL':
+				if fmt[i] == '*':
+					spec += str(next_arg())
+				elif fmt[i] == 'l' and i + 1 < len(fmt) and fmt[i + 1] == 'l':
+					longlong = True
+					i += 1
+				elif fmt[i] not in 'hlL':
+					spec += fmt[i]
+				i += 1
+			if i >= len(fmt):
+				break
+			conv = fmt[i]
+			i += 1
+			if conv in 'diuoxXDOUp':
+				value = next_arg()
+				if longlong:
+					value |= next_arg() << 32
+				if conv in 'diD':
+					bits = 64 if longlong else 32
+					if value >= 1 << (bits - 1):
+						value -= 1 << bits
+					out.append((spec + 'd') % value)
+				elif conv == 'p':
+					out.append('%x' % value)
+				else:
+					out.append((spec + {'D': 'd', 'O': 'o', 'U': 'd', 'u': 'd'}.get(conv, conv)) % value)
+			elif conv == 'c':
+				out.append((spec + 'c') % chr(next_arg() & 0xFF))
+			elif conv == 's':
+				copied = string_args & (1 << used[0])
+				address = next_arg()
+				if copied and strings:
+					string = strings.pop(0)
+				else:
+					string = image.string(address) if address else '(null)'
+				out.append((spec + 's') % (string if string is not None else '<%x>' % address))
+			elif conv == '%':
+				out.append('%')
+			else:
+				out.append(spec + conv)
+	except IndexError:
+		out.append('<truncated>')
+	return ''.join(out)
+
+
+def decode(image, stream, output):
+	first_timestamp = None
+	position = 0
+	line_start = {}
+	while True:
+		index = stream.find(RECORD_MAGIC, position)
+		if index < 0:
+			output.write(stream[position:].decode('latin-1'))
+			return
+		output.write(stream[position:index].decode('latin-1'))
+		if index + RECORD_SIZE > len(stream):
+			return
+		record = struct.unpack_from(RECORD_FORMAT, stream, index)
+		magic, processor_id, arg_count, fmt, timestamp = record[:5]
+		args = record[5:5 + min(arg_count, RECORD_ARGS)]
+		string_args, string_length = record[5 + RECORD_ARGS:]
+		end = index + RECORD_SIZE + string_length
+		if string_length > RECORD_STRING_SIZE or end > len(stream):
+			# not a record - copy one byte and search again
+			output.write(stream[index:index + 1].decode('latin-1'))
+			position = index + 1
+			continue
+		strings = stream[index + RECORD_SIZE:end].decode('latin-1').split('\0')[:-1]
+		if first_timestamp is None:
+			first_timestamp = timestamp
+		if fmt == 0:
+			output.write('[cpu %d] *** %d ktrace records dropped\n' % (processor_id, args[0]))
+			position = end
+			continue
+		fmt_string = image.string(fmt)
+		if fmt_string is None:
+			# not a record - copy one byte and search again
+			output.write(stream[index:index + 1].decode('latin-1'))
+			position = index + 1
+			continue
+		text = format_record(image, fmt_string, args, string_args, strings)
+		# KTRACE() logs the location and the message as two records, prefix only the start of a line
+		if line_start.get(processor_id, True):
+			output.write('[cpu %d %12d] ' % (processor_id, timestamp - first_timestamp))
+		output.write(text)
+		line_start[processor_id] = text.endswith('\n')
+		position = end
+
+
+def main():
+	if len(sys.argv) != 3:
+		sys.stderr.write('Usage: %s <kernel.sys> <serial capture>\n' % sys.argv[0])
+		return 1
+	image = KernelImage(sys.argv[1])
+	stream = open(sys.argv[2], 'rb').read()
+	decode(image, stream, sys.stdout)
+	return 0
+
+
+if __name__ == '__main__':
+	sys.exit(main())
@@ -0,0 +1,184 @@
+/*!
+	\file	app/ioringtest/ioringtest.c
+	\brief	Checks asynchronous file reads through the io ring against plain read()
+	
+	Usage: ioringtest.exe [file] [entries]
+	Reads the file in page sized chunks through io_ring_setup()/io_ring_enter() and compares every chunk with the data read() returns.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <malloc.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define PAGE_SIZE			4096
+#define DEFAULT_FILE		"/boot/app/bash"
+#define DEFAULT_ENTRIES		16
+
+/*operations and shared memory layout - must match kernel/vfs/io_ring.h*/
+#define IO_RING_OPCODE_NOP		0
+#define IO_RING_OPCODE_READ		1
+
+typedef struct
+{
+	volatile unsigned long	submission_head;
+	volatile unsigned long	submission_tail;
+	volatile unsigned long	completion_head;
+	volatile unsigned long	completion_tail;
+	unsigned long			submission_entries;
+	unsigned long			completion_entries;
+	unsigned long			submission_offset;
+	unsigned long			completion_offset;
+}IO_RING_HEADER;
+
+typedef struct
+{
+	unsigned long			opcode;
+	int						file_id;
+	unsigned long			offset;
+	void *					buffer;
+	unsigned long			length;
+	unsigned long			user_data;
+}IO_RING_SUBMISSION_ENTRY;
+
+typedef struct
+{
+	unsigned long			user_data;
+	int						result;
+}IO_RING_COMPLETION_ENTRY;
+
+void * io_ring_setup(unsigned entries);
+int io_ring_enter(unsigned to_submit, unsigned min_complete);
+
+static IO_RING_HEADER * header;
+static IO_RING_SUBMISSION_ENTRY * submissions;
+static IO_RING_COMPLETION_ENTRY * completions;
+
+/*! Queues a submission entry - the caller makes sure the ring has room*/
+static void queue_entry(unsigned long opcode, int fd, unsigned long offset, void * buffer, unsigned long length, unsigned long user_data)
+{
+	IO_RING_SUBMISSION_ENTRY * entry;
+	
+	entry = &submissions[ header->submission_tail & (header->submission_entries-1) ];
+	entry->opcode = opcode;
+	entry->file_id = fd;
+	entry->offset = offset;
+	entry->buffer = buffer;
+	entry->length = length;
+	entry->user_data = user_data;
+	/*publish the entry only after it is filled*/
+	asm volatile("" : : : "memory");
+	header->submission_tail++;
+}
+
+/*! Takes the next completion entry - returns 0 if the completion ring is empty*/
+static int reap_entry(IO_RING_COMPLETION_ENTRY * completion)
+{
+	if ( header->completion_head == header->completion_tail )
+		return 0;
+	asm volatile("" : : : "memory");
+	*completion = completions[ header->completion_head & (header->completion_entries-1) ];
+	asm volatile("" : : : "memory");
+	header->completion_head++;
+	return 1;
+}
+
+int main(int argc, char * argv[])
+{
+	char * file = DEFAULT_FILE, * buffers, * expected;
+	int entries = DEFAULT_ENTRIES, fd, i, count, submitted, failures = 0;
+	unsigned long offset = 0, chunk;
+	long total = 0;
+	IO_RING_COMPLETION_ENTRY completion;
+	
+	if ( argc > 1 )
+		file = argv[1];
+	if ( argc > 2 )
+		entries = atoi(argv[2]);
+	if ( entries <= 0 )
+		entries = DEFAULT_ENTRIES;
+	
+	if ( io_ring_enter( 0, 0 ) != -1 || errno != EINVAL )
+	{
+		printf("io_ring_enter() without a ring did not fail with EINVAL\n");
+		return 1;
+	}
+	header = io_ring_setup( entries );
+	if ( header == (void *)-1 )
+	{
+		printf("io_ring_setup(%d) failed - errno %d\n", entries, errno);
+		return 1;
+	}
+	if ( io_ring_setup( entries ) != (void *)-1 || errno != EBUSY )
+	{
+		printf("second io_ring_setup() did not fail with EBUSY\n");
+		return 1;
+	}
+	submissions = (IO_RING_SUBMISSION_ENTRY *)((char *)header + header->submission_offset);
+	completions = (IO_RING_COMPLETION_ENTRY *)((char *)header + header->completion_offset);
+	entries = header->submission_entries;
+	
+	/*a nop completes with 0 and carries the user data back*/
+	queue_entry( IO_RING_OPCODE_NOP, -1, 0, NULL, 0, 0x1234 );
+	if ( io_ring_enter( 1, 1 ) != 1 || !reap_entry( &completion ) || completion.user_data != 0x1234 || completion.result != 0 )
+	{
+		printf("nop request failed\n");
+		return 1;
+	}
+	
+	buffers = memalign( PAGE_SIZE, entries * PAGE_SIZE );
+	expected = malloc( PAGE_SIZE );
+	if ( buffers == NULL || expected == NULL )
+	{
+		printf("Unable to allocate %d buffers\n", entries);
+		return 1;
+	}
+	fd = open( file, O_RDONLY );
+	if ( fd < 0 )
+	{
+		printf("Unable to open %s\n", file);
+		return 1;
+	}
+	
+	/*read a full ring of chunks, then check each chunk against read() at the same offset*/
+	do
+	{
+		for(i=0; i<entries; i++)
+			queue_entry( IO_RING_OPCODE_READ, fd, offset + i * PAGE_SIZE, buffers + i * PAGE_SIZE, PAGE_SIZE, i );
+		submitted = io_ring_enter( entries, entries );
+		if ( submitted != entries )
+		{
+			printf("io_ring_enter() took %d of %d entries - errno %d\n", submitted, entries, errno);
+			return 1;
+		}
+		count = 0;
+		for(i=0; i<entries; i++)
+		{
+			if ( !reap_entry( &completion ) || completion.user_data >= (unsigned long)entries )
+			{
+				printf("missing or bad completion %d\n", i);
+				return 1;
+			}
+			chunk = offset + completion.user_data * PAGE_SIZE;
+			lseek( fd, chunk, SEEK_SET );
+			if ( read( fd, expected, PAGE_SIZE ) != completion.result ||
+				( completion.result > 0 && memcmp( expected, buffers + completion.user_data * PAGE_SIZE, completion.result ) != 0 ) )
+			{
+				printf("chunk at %lu does not match read() - result %d\n", chunk, completion.result);
+				failures++;
+			}
+			if ( completion.result > 0 )
+			{
+				total += completion.result;
+				count++;
+			}
+		}
+		offset += entries * PAGE_SIZE;
+	}while( count == entries );
+	close( fd );
+	
+	printf("%s: %ld bytes read through a %d entry io ring - %s\n", file, total, entries, failures ? "FAILED" : "passed");
+	return failures ? 1 : 0;
+}
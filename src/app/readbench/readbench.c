@@ -0,0 +1,66 @@
+/*!
+	\file	app/readbench/readbench.c
+	\brief	Measures sequential read throughput of a file
+	
+	Usage: readbench.exe [file] [buffer size in KB]
+	The buffer is page aligned so that whole pages can be shared with the file cache.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <malloc.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/time.h>
+
+#define PAGE_SIZE			4096
+#define DEFAULT_FILE		"/boot/app/bash"
+#define DEFAULT_BUFFER_KB	64
+#define PASSES				4
+
+int main(int argc, char * argv[])
+{
+	char * file = DEFAULT_FILE, * buffer;
+	int buffer_size = DEFAULT_BUFFER_KB * 1024, fd, pass, count;
+	long total;
+	struct timeval start, end;
+	long usec;
+	
+	if ( argc > 1 )
+		file = argv[1];
+	if ( argc > 2 )
+		buffer_size = atoi(argv[2]) * 1024;
+	if ( buffer_size < PAGE_SIZE )
+		buffer_size = PAGE_SIZE;
+	
+	buffer = memalign( PAGE_SIZE, buffer_size );
+	if ( buffer == NULL )
+	{
+		printf("Unable to allocate %d bytes\n", buffer_size);
+		return 1;
+	}
+	
+	/*first pass loads the file cache, the rest are served from it*/
+	for(pass=0; pass<PASSES; pass++)
+	{
+		fd = open( file, O_RDONLY );
+		if ( fd < 0 )
+		{
+			printf("Unable to open %s\n", file);
+			return 1;
+		}
+		total = 0;
+		gettimeofday( &start, NULL );
+		while ( (count = read(fd, buffer, buffer_size)) > 0 )
+			total += count;
+		gettimeofday( &end, NULL );
+		close( fd );
+		
+		usec = (end.tv_sec - start.tv_sec) * 1000000 + (end.tv_usec - start.tv_usec);
+		if ( usec <= 0 )
+			usec = 1;
+		printf("pass %d: %ld bytes in %ld us - %ld KB/s\n", pass, total, usec, (long)(((long long)total * 1000000 / usec) / 1024) );
+	}
+	
+	free( buffer );
+	return 0;
+}
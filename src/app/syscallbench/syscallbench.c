@@ -0,0 +1,63 @@
+/*!
+	\file	app/syscallbench/syscallbench.c
+	\brief	Measures the cost of a null system call through int 0x80 and sysenter
+	
+	Usage: syscallbench.exe [iterations]
+	getpid() does no work in the kernel, so the time is the entry/exit cost of each path.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <sys/time.h>
+#include <syscall.h>
+
+#define DEFAULT_ITERATIONS	1000000
+#define PASSES				3
+
+typedef unsigned long (*SYSCALL_ENTRY)(int syscall_number, ulong arg1, ulong arg2, ulong arg3, ulong arg4, ulong arg5, int * error_number);
+
+/*! Returns the time taken by the given number of null system calls in micro seconds*/
+static long measure(SYSCALL_ENTRY entry, int iterations)
+{
+	struct timeval start, end;
+	long usec;
+	int i, error_no;
+	
+	gettimeofday( &start, NULL );
+	for(i=0; i<iterations; i++)
+		entry( SYS_GETPID, 0, 0, 0, 0, 0, &error_no );
+	gettimeofday( &end, NULL );
+	
+	usec = (end.tv_sec - start.tv_sec) * 1000000 + (end.tv_usec - start.tv_usec);
+	return usec > 0 ? usec : 1;
+}
+
+int main(int argc, char * argv[])
+{
+	int iterations = DEFAULT_ITERATIONS, pass;
+	long trap, fast;
+	unsigned long eax = 1, edx;
+	
+	if ( argc > 1 )
+		iterations = atoi(argv[1]);
+	if ( iterations <= 0 )
+		iterations = DEFAULT_ITERATIONS;
+	
+	/*sysenter raises #UD on a processor without it*/
+	asm volatile("pushl %%ebx; cpuid; popl %%ebx" : "+a"(eax), "=d"(edx) : : "%ecx");
+	if ( !(edx & (1<<11)) )
+	{
+		printf("sysenter is not supported by the processor\n");
+		return 1;
+	}
+	
+	for(pass=0; pass<PASSES; pass++)
+	{
+		trap = measure( syscall_trap, iterations );
+		fast = measure( syscall_sysenter, iterations );
+		printf("pass %d: %d calls - int 0x80 %ld us (%ld ns/call) sysenter %ld us (%ld ns/call)\n", pass, iterations,
+			trap, (long)((long long)trap * 1000 / iterations), fast, (long)((long long)fast * 1000 / iterations) );
+	}
+	
+	return 0;
+}
@@ -9,6 +9,7 @@
 #include <kernel/iom/iom.h>
 #include <kernel/interrupt.h>
 #include <kernel/debug.h>
+#include <kernel/printf.h>
 
 
 static ERROR_CODE AddDevice(DRIVER_OBJECT_PTR drv_obj, DEVICE_OBJECT_PTR parent_dev_obj);
@@ -16,6 +17,9 @@ static ERROR_CODE MajorFunctionPnP(DEVICE_OBJECT_PTR dev_obj, IRP_PTR irp);
 static ERROR_CODE MajorFunctionRead(DEVICE_OBJECT_PTR dev_obj, IRP_PTR irp);
 static ERROR_CODE MajorFunctionWrite(DEVICE_OBJECT_PTR dev_obj, IRP_PTR irp);
 
+/*! device which discards everything written to it*/
+static DEVICE_OBJECT_PTR null_device = NULL;
+
 /*!	Entry point - called during driver initialization
  * \param	drv_obj	Driver object pointer which should be initialised
  * Returns standard error code.
@@ -46,13 +50,19 @@ static ERROR_CODE AddDevice(DRIVER_OBJECT_PTR drv_obj, DEVICE_OBJECT_PTR parent_
 	DEVICE_OBJECT_PTR dev_obj;
 	ERROR_CODE err;
 
-	err = CreateDevice(drv_obj, 0, &dev_obj, "Console", DO_BUFFERED_IO);
+	/* Writes are large and only read by the driver, so lock the caller's buffer instead of copying it */
+	err = CreateDevice(drv_obj, 0, &dev_obj, "Console", DO_DIRECT_IO);
 	KTRACE("console device object %p\n", dev_obj);
 	if( err != ERROR_SUCCESS )
 		return err;
 		
 	/* Now establish the hierarchy between parent_dev_obj and dev_obj */
 	(void)AttachDeviceToDeviceStack(dev_obj, parent_dev_obj);
+	
+	err = CreateDevice(drv_obj, 0, &null_device, "Null", DO_DIRECT_IO);
+	if( err != ERROR_SUCCESS )
+		return err;
+	(void)AttachDeviceToDeviceStack(null_device, parent_dev_obj);
 
 	return ERROR_SUCCESS;
 }
@@ -68,14 +78,40 @@ static ERROR_CODE MajorFunctionPnP(DEVICE_OBJECT_PTR dev_obj, IRP_PTR irp)
 	return ERROR_SUCCESS;
 }
 
+/*!	Console input is not supported yet - completes the read with zero bytes
+ * \param	dev_obj	Device for which request is made.
+ * \param	irp		Interrupt request packet pointer containing user request details
+ */
 static ERROR_CODE MajorFunctionRead(DEVICE_OBJECT_PTR dev_obj, IRP_PTR irp)
 {
 	KTRACE("Read called");
+	CompleteIrp( irp, ERROR_SUCCESS, (void *)0 );
 	return ERROR_SUCCESS;
 }
+
+/*!	Writes the caller's buffer to the screen
+ * \param	dev_obj	Device for which request is made.
+ * \param	irp		Interrupt request packet pointer - mdl_address describes the buffer to write
+ */
 static ERROR_CODE MajorFunctionWrite(DEVICE_OBJECT_PTR dev_obj, IRP_PTR irp)
 {
-	KTRACE("Write called");
+	char * buffer;
+	UINT32 i, length;
+	
+	length = irp->current_stack_location->parameters.read_write.length;
+	/* null device consumes the data without touching it */
+	if ( dev_obj != null_device )
+	{
+		buffer = GetSystemAddressForMdl( irp->mdl_address );
+		if ( buffer == NULL )
+		{
+			CompleteIrp( irp, ERROR_NOT_ENOUGH_MEMORY, (void *)0 );
+			return ERROR_NOT_ENOUGH_MEMORY;
+		}
+		for(i=0; i<length; i++)
+			kprintf_putc( NULL, buffer[i] );
+	}
+	CompleteIrp( irp, ERROR_SUCCESS, (void *)length );
 	return ERROR_SUCCESS;
 }
 	
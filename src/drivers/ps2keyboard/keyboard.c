@@ -17,6 +17,11 @@ KEYBOARD_BUFFER kbd_buf[MAX_KEYBOARD_BUFFER_SIZE];
 int cur_kbd_buf_read_index=0;
 int cur_kbd_buf_write_index=0;
 
+/* Scancodes read by the interrupt handler - translated later by the keyboard DPC */
+static volatile unsigned char pending_scancodes[MAX_PENDING_SCANCODES];
+static volatile UINT32 pending_scancode_head=0, pending_scancode_tail=0;
+static DPC keyboard_dpc;
+
 /* www.microsoft.com/whdc/archive/scancode.mspx
  * http://www.osdever.net/bkerndev/Docs/keyboard.htm
  */
@@ -126,8 +131,9 @@ ERROR_CODE DriverEntry(DRIVER_OBJECT_PTR drv_obj)
 	drv_obj->fn.MajorFunctions[IRP_MJ_PNP] = MajorFunctionPnP;
 	drv_obj->fn.MajorFunctions[IRP_MJ_FLUSH_BUFFERS] = MajorFunctionFlush;
 
-	/* Register keyboard interrupt handler */
-	InstallInterruptHandler( KEYBOARD_INTERRUPT_NUMBER, KeyboardInterruptHandler, 0);
+	/* Register keyboard interrupt handler - scancode translation is done in the DPC */
+	InitDpc( &keyboard_dpc, KeyboardDpcRoutine, NULL );
+	InstallInterruptHandlerWithDpc( KEYBOARD_INTERRUPT_NUMBER, KeyboardInterruptHandler, 0, &keyboard_dpc );
 	return ERROR_SUCCESS;
 }
 
@@ -243,12 +249,44 @@ static ERROR_CODE MajorFunctionFlush(DEVICE_OBJECT_PTR dev_obj, IRP_PTR irp)
 
 /*!
  * \brief	Handles all interrupts from keyboard device.
+ *			Only reads the scancode from the controller, the translation is done by KeyboardDpcRoutine()
  * \brief	interrupt_info	Contains details on this interrupt: number, device, priority level
  * \brief	arg				Contains optional arguments. It's NULL for keyboard device.
  */
 static ISR_RETURN_CODE KeyboardInterruptHandler(INTERRUPT_INFO_PTR interrupt_info, void * arg)
 {
 	unsigned char scancode;
+
+	scancode = _inp(KEYBOARD_CONTROLLER_DATA_PORT);
+	/* drop the scancode if the DPC is too far behind */
+	if ( pending_scancode_tail - pending_scancode_head >= MAX_PENDING_SCANCODES )
+		return ISR_END_PROCESSING;
+	pending_scancodes[pending_scancode_tail & (MAX_PENDING_SCANCODES-1)] = scancode;
+	pending_scancode_tail++;
+
+	return ISR_QUEUE_DPC;
+}
+
+/*!
+ * \brief	Bottom half of the keyboard interrupt - translates the captured scancodes.
+ * \brief	dpc		Keyboard DPC
+ * \brief	arg		NULL for keyboard device.
+ */
+static void KeyboardDpcRoutine(DPC_PTR dpc, void * arg)
+{
+	while( pending_scancode_head != pending_scancode_tail )
+	{
+		TranslateScancode( pending_scancodes[pending_scancode_head & (MAX_PENDING_SCANCODES-1)] );
+		pending_scancode_head++;
+	}
+}
+
+/*!
+ * \brief	Translates a scancode and writes the key to the keyboard buffer.
+ * \brief	scancode	Scancode read from the keyboard controller
+ */
+static void TranslateScancode(unsigned char scancode)
+{
 	unsigned char ascii_value=0;
 	static BYTE key_e0=0;
 	static unsigned char scancode_buffer[MAX_SCANCODE_BYTES]; /*Usage of this variable is incomplete. Somebody do it! */
@@ -264,12 +302,10 @@ static ISR_RETURN_CODE KeyboardInterruptHandler(INTERRUPT_INFO_PTR interrupt_inf
 #define CAPS_LOCK_BIT	64
 #define NUM_LOCK_BIT	128
 
-	scancode = _inp(KEYBOARD_CONTROLLER_DATA_PORT);
-	
 	if(scancode == 0xE0)
 	{
 		key_e0 = 1;
-		return ISR_END_PROCESSING;
+		return;
 	}
 
 	if(key_e0 == 1)
@@ -301,7 +337,7 @@ static ISR_RETURN_CODE KeyboardInterruptHandler(INTERRUPT_INFO_PTR interrupt_inf
 			case SCANCODE_CTRL_RELEASE: modifier_keys &= ~(RIGHT_CTRL_BIT); goto modifier_keys_only; 
 			default:
 				/* Unknown key typed.. so skip it */
-				return ISR_END_PROCESSING;
+				return;
 		}
 		scancode_buffer[0] = scancode;
 		scancode_buffer[1] = 0xE0;
@@ -353,7 +389,7 @@ static ISR_RETURN_CODE KeyboardInterruptHandler(INTERRUPT_INFO_PTR interrupt_inf
 	}
 
 modifier_keys_only:
-	return ISR_END_PROCESSING; /* Return if scan code is a modifier key */
+	return; /* Return if scan code is a modifier key */
 
 find_ascii:
 	ascii_value = 0;
@@ -397,13 +433,13 @@ find_ascii:
 		
 	}
 	else
-		return ISR_END_PROCESSING;
+		return;
 
 send_buffer:
 	/* if ascii_value > 127, then user should check for keycode also. That would show that it's one of NUMERIC keys. */
 	WriteToKeyboardBuffer(scancode_buffer, keycode, ascii_value);
 	kprintf("Wrote to keyboard buffer\n");
 	
-	return ISR_END_PROCESSING; 
+	return; 
 }
 
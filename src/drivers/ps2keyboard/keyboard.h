@@ -15,6 +15,8 @@
 #define KEYBOARD_CONTROLLER_DATA_PORT		0x60
 #define KEYBOARD_CONTROLLER_CONTROL_PORT	0x64
 #define MAX_SCANCODE_BYTES	6
+/*! raw scancodes captured by the interrupt handler and not yet translated by the DPC - power of 2*/
+#define MAX_PENDING_SCANCODES	64
 
 typedef struct keyboard_buffer
 {
@@ -28,6 +30,8 @@ static ERROR_CODE MajorFunctionPnP(DEVICE_OBJECT_PTR dev_obj, IRP_PTR irp);
 static ERROR_CODE MajorFunctionRead(DEVICE_OBJECT_PTR dev_obj, IRP_PTR irp);
 static ERROR_CODE MajorFunctionFlush(DEVICE_OBJECT_PTR dev_obj, IRP_PTR irp);
 static ISR_RETURN_CODE KeyboardInterruptHandler(INTERRUPT_INFO_PTR interrupt_info, void * arg);
+static void KeyboardDpcRoutine(DPC_PTR dpc, void * arg);
+static void TranslateScancode(unsigned char scancode);
 static ERROR_CODE ReadFromKeyboardBuffer(unsigned char **scancode, unsigned char *keycode, unsigned char *ascii_value);
 static void WriteToKeyboardBuffer(unsigned char* scancode, unsigned char keycode, unsigned char ascii_value);
 
@@ -36,6 +36,8 @@
 	typedef UINT32 VADDR;
 	#define BITS_PER_BYTE	(8)
 	#define BITS_PER_LONG	(32)
+	/*! size of a processor cache line*/
+	#define CACHE_LINE_SIZE	(64)
 #endif
 
 
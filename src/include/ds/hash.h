@@ -0,0 +1,22 @@
+/*!
+	\file	ds/hash.h
+	\brief	String and buffer hash functions
+*/
+
+#ifndef HASH__H
+#define HASH__H
+
+#include <ace.h>
+
+#ifdef __cplusplus
+    extern "C" {
+#endif
+
+UINT32 HashString(char * string);
+UINT32 HashBuffer(void * buffer, UINT32 length);
+
+#ifdef __cplusplus
+	}
+#endif
+
+#endif
@@ -0,0 +1,70 @@
+/*!
+	\file 	ds/radix_tree.h
+	\brief 	Radix tree indexed by a 32 bit key with per slot tags
+*/
+
+#ifndef RADIX_TREE__H
+#define RADIX_TREE__H
+
+#include <ace.h>
+
+/*! number of key bits consumed by each level of the tree*/
+#define RADIX_TREE_MAP_SHIFT		6
+/*! number of slots in a node*/
+#define RADIX_TREE_MAP_SIZE			(1 << RADIX_TREE_MAP_SHIFT)
+#define RADIX_TREE_MAP_MASK			(RADIX_TREE_MAP_SIZE - 1)
+/*! maximum height of the tree required to cover 32 bit key*/
+#define RADIX_TREE_MAX_HEIGHT		((BITS_PER_LONG + RADIX_TREE_MAP_SHIFT - 1) / RADIX_TREE_MAP_SHIFT)
+/*! largest index supported*/
+#define RADIX_TREE_MAX_INDEX		(0xFFFFFFFFUL)
+
+/*! number of tags supported per slot*/
+#define RADIX_TREE_MAX_TAGS			2
+/*! number of longs required to hold a tag bitmap of a node*/
+#define RADIX_TREE_TAG_LONGS		((RADIX_TREE_MAP_SIZE + BITS_PER_LONG - 1) / BITS_PER_LONG)
+
+/*! tag value that matches any item during gang lookup*/
+#define RADIX_TREE_TAG_ANY			(-1)
+
+typedef struct radix_tree_node RADIX_TREE_NODE, * RADIX_TREE_NODE_PTR;
+
+/*! interior/leaf node of radix tree*/
+struct radix_tree_node
+{
+	UINT32		count;												/*! number of non-empty slots*/
+	void *		slots[RADIX_TREE_MAP_SIZE];							/*! child nodes or items(in leaf nodes)*/
+	UINT32		tags[RADIX_TREE_MAX_TAGS][RADIX_TREE_TAG_LONGS];	/*! tag bitmap - a bit is set if the slot or any item below it is tagged*/
+};
+
+/*! radix tree root*/
+typedef struct radix_tree
+{
+	UINT32					height;							/*! current height of the tree - 0 means empty*/
+	RADIX_TREE_NODE_PTR		root;							/*! root node*/
+
+	RADIX_TREE_NODE_PTR		(*AllocateNode)();				/*! function pointer to allocate a new node*/
+	void					(*FreeNode)(RADIX_TREE_NODE_PTR node);/*! function pointer to free a node*/
+}RADIX_TREE, * RADIX_TREE_PTR;
+
+#ifdef __cplusplus
+    extern "C" {
+#endif
+
+void InitRadixTree(RADIX_TREE_PTR tree, RADIX_TREE_NODE_PTR (*AllocateNode)(), void (*FreeNode)(RADIX_TREE_NODE_PTR node));
+int InsertRadixTreeItem(RADIX_TREE_PTR tree, UINT32 index, void * item);
+void * LookupRadixTreeItem(RADIX_TREE_PTR tree, UINT32 index);
+void * RemoveRadixTreeItem(RADIX_TREE_PTR tree, UINT32 index);
+
+void * SetRadixTreeTag(RADIX_TREE_PTR tree, UINT32 index, int tag);
+void * ClearRadixTreeTag(RADIX_TREE_PTR tree, UINT32 index, int tag);
+int GetRadixTreeTag(RADIX_TREE_PTR tree, UINT32 index, int tag);
+int IsRadixTreeTagged(RADIX_TREE_PTR tree, int tag);
+
+UINT32 GangLookupRadixTree(RADIX_TREE_PTR tree, UINT32 first_index, void ** results, UINT32 * indexes, UINT32 max_items, int tag);
+UINT32 GangLookupRadixTreeContiguous(RADIX_TREE_PTR tree, UINT32 first_index, void ** results, UINT32 max_items, int tag);
+
+#ifdef __cplusplus
+	}
+#endif
+
+#endif
@@ -39,6 +39,9 @@ void ArchHalt();
 void ArchShutdown();
 
 void MaskInterrupt(BYTE interrupt_number);
+UINT32 DisableInterrupts();
+void EnableInterrupts();
+void RestoreInterrupts(UINT32 flags);
 
 void StartTimer(UINT32 frequency, BYTE periodic);
 void StopTimer();
@@ -23,6 +23,32 @@
     #define KTRACE( ... ) 
 #endif
 
+/*! number of argument words copied into a binary ktrace record - a format needing more is truncated*/
+#define KTRACE_RECORD_ARGS		8
+/*! bytes of %s arguments copied into a binary ktrace record - a longer string is truncated*/
+#define KTRACE_RECORD_STRING_SIZE	64
+/*! first two bytes of a binary ktrace record - not ASCII, so the decoder can tell records from text*/
+#define KTRACE_RECORD_MAGIC0	0xAC
+#define KTRACE_RECORD_MAGIC1	0xE1
+
+/*! Binary ktrace record - written as it is to the debug port
+	The format string is not copied; the decoder reads it from the kernel image. A %s argument outside the kernel's
+	read only sections is copied into strings[] while there is room, the others are decoded from the kernel image.
+	Only the bytes up to strings[string_length] are written to the debug port.
+	A record with a NULL format reports args[0] records dropped by the processor.*/
+typedef struct ktrace_record
+{
+	BYTE		magic[2];					/*! KTRACE_RECORD_MAGIC0, KTRACE_RECORD_MAGIC1*/
+	BYTE		processor_id;				/*! processor which logged the record*/
+	BYTE		arg_count;					/*! valid words in args[]*/
+	UINT32		format;						/*! address of the format string*/
+	UINT64		timestamp;					/*! time stamp counter of the processor*/
+	UINT32		args[KTRACE_RECORD_ARGS];	/*! raw argument words as passed on the stack*/
+	UINT16		string_args;				/*! bit n is set if the string of args[n] is in strings[]*/
+	UINT16		string_length;				/*! used bytes in strings[]*/
+	char		strings[KTRACE_RECORD_STRING_SIZE];	/*! copied %s arguments in argument order, each NUL terminated*/
+}KTRACE_RECORD, * KTRACE_RECORD_PTR;
+
 #define KPRINTF( ... )	\
 			kprintf("%s:%d: ", __PRETTY_FUNCTION__ , __LINE__); \
 			kprintf(__VA_ARGS__);
@@ -32,13 +58,17 @@
 #endif
 
 extern void (*ktrace_putc)(void * arg, char ch);
+extern UINT32 ktrace_buffer_records;	/* Kernel parameter - binary ktrace records per processor, 0 means synchronous text */
 
 int ktrace(const char *fmt, ...);
+void InitKtraceLog();
+void FlushKtraceLog();
 
 void panic(char * message);
 
 /*architecture depended function declarations*/
 void KtracePrint(void * arg, char ch);
+void KtraceWrite(void * data, UINT32 length);
 void InitKtrace();
 
 #ifdef __cplusplus
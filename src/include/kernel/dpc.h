@@ -0,0 +1,72 @@
+/*!
+\file	kernel/dpc.h
+\brief	Deferred procedure calls - bottom half of the interrupt handlers
+*/
+
+#ifndef DPC_H
+#define DPC_H
+
+#include <ace.h>
+#include <ds/list.h>
+#include <sync/spinlock.h>
+#include <kernel/error.h>
+
+/*! maximum number of DPCs executed by one drain - the rest waits for the next interrupt on the processor*/
+#define DPC_DRAIN_BUDGET	16
+
+typedef struct dpc DPC, * DPC_PTR;
+typedef struct dpc_queue DPC_QUEUE, * DPC_QUEUE_PTR;
+typedef struct dpc_statistics DPC_STATISTICS, * DPC_STATISTICS_PTR;
+
+typedef void (*DPC_ROUTINE)(DPC_PTR dpc, void * argument);
+
+/*! Deferred procedure call - owned by the caller and can be queued from interrupt context
+	A DPC is queued at most once, queuing an already queued DPC is a no op.*/
+struct dpc
+{
+	LIST				list;					/*! links the DPC in the processor's queue*/
+	DPC_ROUTINE			routine;				/*! function to call*/
+	void *				argument;				/*! second argument to the routine*/
+	volatile UINT32		queued;					/*! 1 while the DPC is waiting in a queue*/
+};
+
+/*! Per processor DPC queue*/
+struct dpc_queue
+{
+	SPIN_LOCK			lock;					/*! protects the list*/
+	LIST				list;					/*! DPCs waiting to run*/
+	volatile UINT32		pending;				/*! number of DPCs in the list*/
+	volatile BOOLEAN	draining;				/*! set while the processor is executing DPCs*/
+
+	UINT32				queued_count;			/*! total DPCs queued to this processor*/
+	UINT32				executed_count;			/*! total DPCs executed by this processor*/
+	UINT32				budget_exhausted_count;	/*! number of drains stopped by DPC_DRAIN_BUDGET*/
+	UINT64				max_drain_time;			/*! longest drain in time stamp counter ticks*/
+};
+
+/*! Snapshot of a processor's DPC queue counters*/
+struct dpc_statistics
+{
+	UINT32				pending;
+	UINT32				queued_count;
+	UINT32				executed_count;
+	UINT32				budget_exhausted_count;
+	UINT64				max_drain_time;
+};
+
+#ifdef __cplusplus
+    extern "C" {
+#endif
+
+void InitDpcQueue(DPC_QUEUE_PTR queue);
+void InitDpc(DPC_PTR dpc, DPC_ROUTINE routine, void * argument);
+BOOLEAN QueueDpc(DPC_PTR dpc);
+void DrainDpcQueue();
+BOOLEAN IsDpcQueueDraining();
+ERROR_CODE GetDpcStatistics(int processor_id, DPC_STATISTICS_PTR statistics);
+
+#ifdef __cplusplus
+	}
+#endif
+
+#endif
@@ -8,6 +8,7 @@
 #define _INTERRUPT_H_
 
 #include <ds/list.h>
+#include <kernel/dpc.h>
 #if	ARCH == i386
 	#include <kernel/i386/exception.h>
 	#define MAX_INTERRUPTS	256
@@ -29,7 +30,8 @@ typedef enum isr_return_code
 {
 	ISR_CONTINUE_PROCESSING=0,
 	ISR_END_PROCESSING,
-	ISR_ERROR
+	ISR_ERROR,
+	ISR_QUEUE_DPC					/*! interrupt is handled - queue the handler's DPC to finish the work*/
 }ISR_RETURN_CODE;
 
 typedef ISR_RETURN_CODE (*ISR_HANDLER) (INTERRUPT_INFO_PTR interrupt_info, void * arg);
@@ -40,6 +42,7 @@ typedef struct interrupt_handler
 {
 	ISR_HANDLER 	isr;			//interrrupt service routine for this irq
 	void *			isr_argument;	//custom data registered by the isr
+	DPC_PTR			dpc;			//queued when the isr returns ISR_QUEUE_DPC
 	
 	LIST			next_isr;		//next isr sharing the same interrupt line
 }INTERRUPT_HANDLER, *INTERRUPT_HANDLER_PTR;
@@ -63,6 +66,7 @@ typedef enum irq_priority_levels
 extern INTERRUPT_HANDLER interrupt_handlers[MAX_INTERRUPTS];
 
 void InstallInterruptHandler(int interrupt_number, ISR_HANDLER isr_handler, void * custom_argument);
+void InstallInterruptHandlerWithDpc(int interrupt_number, ISR_HANDLER isr_handler, void * custom_argument, DPC_PTR dpc);
 void UninstallInterruptHandler(int interrupt_number, ISR_HANDLER isr_handler);
 
 void SendEndOfInterrupt(int int_no);
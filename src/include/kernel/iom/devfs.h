@@ -24,13 +24,16 @@ typedef struct devfs_metadata
 }DEVFS_METADATA, * DEVFS_METADATA_PTR;
 
 extern AVL_TREE_PTR	devfs_root;
+extern UINT32 device_io_benchmark_bytes;	/* Number of bytes to write in the boot time device IO benchmark */
 
 #ifdef __cplusplus
     extern "C" {
 #endif
 
 ERROR_CODE CreateDeviceNode(const char * filename, DEVICE_OBJECT_PTR device);
+DEVICE_OBJECT_PTR GetDeviceNode(const char * filename);
 ERROR_CODE ReadWriteDevice(DEVICE_OBJECT_PTR device_object, void * user_buffer, long offset, long length, int is_write, int * result_count, IO_COMPLETION_ROUTINE completion_rountine, void * completion_rountine_context);
+void BenchmarkDeviceIo(UINT32 total_bytes);
 
 #ifdef __cplusplus
 	}
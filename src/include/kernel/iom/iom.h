@@ -13,6 +13,7 @@
 #include <kernel/error.h>
 #include <kernel/mm/kmem.h>
 #include <kernel/vfs/vfs.h>
+#include <kernel/iom/mdl.h>
 
 /*! maximum characters in driver name including spaces*/
 #define DRIVER_NAME_MAX		50
@@ -28,6 +29,17 @@ typedef enum
 }DO_FLAG;
 
 
+/*! IRPs with up to this many stack locations are allocated from the small IRP cache with the stack locations embedded*/
+#define IRP_EMBEDDED_STACK_COUNT	4
+
+/*! maximum free small IRPs kept on a processor's lookaside list*/
+#define IRP_LOOKASIDE_DEPTH			32
+
+typedef enum
+{
+	IRP_FLAG_EMBEDDED_STACK = 1,						/*! stack locations follow the IRP in the same buffer*/
+}IRP_FLAG;
+
 typedef enum
 {
 	IRP_COMPLETION_INVOKE_ON_SUCCESS=1,
@@ -118,6 +130,7 @@ struct driver_object
 	SPIN_LOCK			lock;								/*! For mp sync*/
 	int					reference_count;					/*! For garbage collection*/
 	LIST				driver_list;						/*! List of loaded drivers in the system*/
+	LIST				hash_list;							/*! Links the driver in the loaded driver hash table*/
 
 	DEVICE_OBJECT_PTR	device_object_head;					/*! Head to list of devices this driver handles*/
 
@@ -154,12 +167,13 @@ struct io_status_block{
 
 struct irp
 {
-	UINT32					flags;
+	UINT32					flags;							/*! IRP_FLAG*/
+	IRP_PTR					lookaside_next;					/*! next free IRP while the IRP is on a lookaside list*/
 	
 	/*addresses used during read, write and ioctl calls
 	 * \todo - try to put the following things in a union*/
 	void *					user_buffer;					/*! user buffer address - driver has to take care of locking and translating the page to kernel address - valid in DO_NEITHER_IO*/
-	void *					mdl_address;					/*! memory page descriptor list - iom will lock user buffer and create a list of pages associated with the buffer - valid in DO_DIRECT_IO*/
+	MDL_PTR					mdl_address;					/*! memory page descriptor list - iom will lock user buffer and create a list of pages associated with the buffer - valid in DO_DIRECT_IO*/
 	void *					system_buffer;					/*! system buffer address - iom will allocate kernel memory and copy the user buffer content here - valid in DO_BUFFERED_IO */
 	
 	IO_STATUS_BLOCK			io_status;						/*! Status of the IRP*/
@@ -251,6 +265,9 @@ extern DRIVER_OBJECT_PTR root_bus_driver_object;
 
 extern CACHE driver_object_cache;
 extern CACHE device_object_cache;
+extern CACHE irp_cache;
+extern CACHE small_irp_cache;
+extern UINT32 irp_benchmark_count;	/* Number of IRPs to allocate in the boot time IRP benchmark */
 
 void InitIoManager();
 
@@ -267,7 +284,9 @@ ERROR_CODE SetIrpCompletionRoutine(IRP_PTR irp, IO_COMPLETION_ROUTINE completion
 IRP_PTR AllocateIrp(BYTE stack_size);
 void ReuseIrp(IRP_PTR irp, ERROR_CODE error_code);
 void FreeIrp(IRP_PTR irp);
+void BenchmarkIrpAllocation(UINT32 count);
 ERROR_CODE CallDriver(DEVICE_OBJECT_PTR device_object, IRP_PTR irp);
+void CompleteIrp(IRP_PTR irp, ERROR_CODE status, void * information);
 
 DRIVER_OBJECT_PTR LoadRootBusDriver();
 ERROR_CODE RootBusDriverEntry(DRIVER_OBJECT_PTR pDriverObject);
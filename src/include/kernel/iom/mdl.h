@@ -0,0 +1,61 @@
+/*!
+  \file		kernel/iom/mdl.h
+  \brief	Memory descriptor list - describes a buffer as a list of locked physical pages for direct IO
+*/
+
+#ifndef _MDL_H_
+#define _MDL_H_
+
+#include <ace.h>
+#include <kernel/error.h>
+#include <kernel/mm/vm_types.h>
+
+/*! maximum length of a buffer described by a single MDL*/
+#define MDL_MAX_LENGTH				(16*1024*1024)
+
+typedef enum
+{
+	MDL_PAGES_LOCKED = 1,			/*! pages are probed, wired and pages[] is valid*/
+	MDL_MAPPED_TO_SYSTEM_VA = 2,	/*! pages are mapped into the kernel map by GetSystemAddressForMdl()*/
+	MDL_SOURCE_IS_KERNEL = 4,		/*! buffer is kernel memory - it is visible in every address space and never paged out*/
+	MDL_WRITE_OPERATION = 8,		/*! pages were locked for write access(device read)*/
+}MDL_FLAG;
+
+typedef struct mdl MDL, * MDL_PTR;
+
+struct mdl
+{
+	UINT32				flags;				/*! MDL_FLAG*/
+	VIRTUAL_MAP_PTR		virtual_map;		/*! address space of the buffer*/
+
+	VADDR				start_va;			/*! page aligned start of the buffer*/
+	UINT32				byte_offset;		/*! offset of the buffer in the first page*/
+	UINT32				byte_count;			/*! length of the buffer*/
+
+	VADDR				system_va;			/*! kernel mapping of the pages(page aligned) - valid if MDL_MAPPED_TO_SYSTEM_VA*/
+
+	UINT32				page_count;			/*! number of entries in pages[]*/
+	VIRTUAL_PAGE_PTR	pages[0];			/*! physical pages of the buffer in order - valid if MDL_PAGES_LOCKED*/
+};
+
+/*! Physical address of the given byte in a locked MDL*/
+#define MDL_BYTE_PHYSICAL_ADDRESS(mdl, offset)	\
+	( VP_TO_PHYS( (mdl)->pages[ ((mdl)->byte_offset + (offset)) >> PAGE_SHIFT ] ) + ( ((mdl)->byte_offset + (offset)) & (PAGE_SIZE-1) ) )
+
+#ifdef __cplusplus
+    extern "C" {
+#endif
+
+MDL_PTR AllocateMdl(void * va, UINT32 length);
+void FreeMdl(MDL_PTR mdl);
+
+ERROR_CODE ProbeAndLockPages(MDL_PTR mdl, VIRTUAL_MAP_PTR virtual_map, BOOLEAN write);
+void UnlockPages(MDL_PTR mdl);
+
+void * GetSystemAddressForMdl(MDL_PTR mdl);
+
+#ifdef __cplusplus
+	}
+#endif
+
+#endif
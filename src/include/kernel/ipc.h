@@ -15,16 +15,53 @@
 
 #define MESSAGE_QUEUE_NO_WAIT -1
 
+/*! number of preallocated message slots in a message queue - should be power of 2*/
+#define MESSAGE_RING_SIZE		16
+#define MESSAGE_RING_MASK		(MESSAGE_RING_SIZE-1)
+
+/*! total number of messages waiting in a message queue*/
+#define MESSAGE_QUEUE_LENGTH(mq)	( ((mq)->ring ? (mq)->ring->tail - (mq)->ring->head : 0) + (mq)->buf_count )
+
 extern UINT32 max_message_queue_length;	/* System wide tunable to control the size of message queue in task structure */
+extern UINT32 max_messages_per_sender;	/* System wide tunable to control the number of messages an user task can have in the message queues */
+extern UINT32 ipc_benchmark_messages;	/* Number of messages to send in the boot time IPC benchmark */
+extern UINT32 ipc_test;					/* Non zero to run the boot time IPC test */
 
 typedef enum message_type
 {
 	MESSAGE_TYPE_VALUE,
 	MESSAGE_TYPE_REFERENCE,
 	MESSAGE_TYPE_SHARE,
-	MESSAGE_TYPE_SHARE_PA
+	MESSAGE_TYPE_SHARE_PA,
+	MESSAGE_TYPE_VECTOR
 }MESSAGE_TYPE, * MESSAGE_TYPE_PTR;
 
+/*! priority of a message - each priority has its own lane in the message queue and the lower values are received first*/
+typedef enum message_priority
+{
+	MESSAGE_PRIORITY_INHERIT=-1,					/*! derive the priority from the sender's scheduler class*/
+	MESSAGE_PRIORITY_URGENT,						/*! paging IO - not limited by the queue length or the sender credits*/
+	MESSAGE_PRIORITY_HIGH,
+	MESSAGE_PRIORITY_NORMAL,						/*! only this priority uses the message ring*/
+	MESSAGE_PRIORITY_LOW,							/*! bulk and background IO*/
+	MESSAGE_PRIORITY_LANES
+}MESSAGE_PRIORITY;
+
+/*! maximum number of ranges in a MESSAGE_TYPE_VECTOR message*/
+#define IPC_MAX_IOVEC_COUNT		16
+/*! maximum total length of a MESSAGE_TYPE_VECTOR message*/
+#define IPC_MAX_VECTOR_LENGTH	(64 * PAGE_SIZE)
+
+/*! one range of a MESSAGE_TYPE_VECTOR message*/
+typedef struct ipc_iovec
+{
+	void *				base;						/*! start address of the range*/
+	UINT32				length;						/*! length of the range in bytes*/
+}IPC_IOVEC, * IPC_IOVEC_PTR;
+
+/*! kernel copy of a MESSAGE_TYPE_VECTOR message payload(see kernel/ipc/ipc_vector.c)*/
+typedef struct ipc_vector_buffer IPC_VECTOR_BUFFER, * IPC_VECTOR_BUFFER_PTR;
+
 typedef enum
 {
 	IPC_ARG_INDEX_1,
@@ -49,34 +86,82 @@ typedef enum
 typedef void * IPC_ARG_TYPE;
 typedef IPC_ARG_TYPE * IPC_ARG_TYPE_PTR;
 
+/*! maximum number of queues WaitForMessageQueues() can wait on*/
+#define IPC_MAX_WAIT_QUEUES		16
+
+/*! a message sent by SendMessageBatch() or received by ReceiveMessageBatch()*/
+typedef struct ipc_message
+{
+	TASK_PTR			task;						/*! receiver task(send only)*/
+	MESSAGE_QUEUE_PTR	queue;						/*! receiver message queue(send only)*/
+	MESSAGE_TYPE		type;						/*! type of the message*/
+	IPC_ARG_TYPE		args[IPC_ARG_COUNT];		/*! arguments - for received MESSAGE_TYPE_VECTOR messages args[4] and args[5] should hold the receive buffer(see ReceiveMessageBatch())*/
+	THREAD_PTR			sender_thread;				/*! thread to reply(receive only, see ReplyToMessage())*/
+	ERROR_CODE			status;						/*! result of the send, or of copying a received MESSAGE_TYPE_VECTOR payload*/
+}IPC_MESSAGE, * IPC_MESSAGE_PTR;
+
 typedef struct message_buffer
 {
 	LIST				message_buffer_queue;		/*! link list of message buffers in this message queue*/
 	MESSAGE_TYPE		type;						/*! type of this message*/
 	IPC_ARG_TYPE		args[IPC_ARG_COUNT];		/*! argmuents to this message*/
+	MESSAGE_PRIORITY	priority;					/*! lane of this message*/
 	
 	THREAD_PTR			sender_thread;				/*! thread which initiated this message*/
+	TASK_PTR			credit_task;				/*! task charged for this message until it is received - NULL if it is not charged*/
 }MESSAGE_BUFFER, *MESSAGE_BUFFER_PTR;
 
+/*! preallocated single producer/single consumer message ring
+	Only the sender advances tail and only the receiver advances head, so they never share a lock.
+	Each side claims its end with the end lock and a second sender finding it busy uses the message list instead.
+*/
+typedef struct message_ring
+{
+	volatile UINT32		head __attribute__ ((aligned(CACHE_LINE_SIZE)));	/*! next slot to receive - written only by the receiver*/
+	SPIN_LOCK			consumer_lock;				/*! serializes receivers*/
+	volatile UINT32		tail __attribute__ ((aligned(CACHE_LINE_SIZE)));	/*! next slot to fill - written only by the sender*/
+	SPIN_LOCK			producer_lock;				/*! claimed by the sender which owns tail*/
+	MESSAGE_BUFFER		slots[MESSAGE_RING_SIZE] __attribute__ ((aligned(CACHE_LINE_SIZE)));	/*! message slots*/
+}MESSAGE_RING, * MESSAGE_RING_PTR;
+
 struct message_queue
 {
-	SPIN_LOCK			lock;						/*! Lock to guard the entire mesage queue */
-	UINT32				buf_count;					/*! Number of message buffers that are present in this queue */
-	MESSAGE_BUFFER_PTR	msg_queue;					/*! Pointer to head of the message buffer queue */
-	WAIT_EVENT_PTR		wait_event_msg_queue;		/*! Pointer to wait event queue for message_queue variable */
-	SPIN_LOCK			wait_event_msg_queue_lock;	/*! lock for the wait event */
+	MESSAGE_RING_PTR	ring;						/*! Messages are queued here if the ring is free and the message list is empty - allocated by the first sender */
+	
+	SPIN_LOCK			lock;						/*! Lock to guard the message buffer lists */
+	UINT32				buf_count;					/*! Number of message buffers that are present in all the lists */
+	MESSAGE_BUFFER_PTR	msg_queue[MESSAGE_PRIORITY_LANES];	/*! Head of the message buffer list of each priority */
+	UINT32				lane_count[MESSAGE_PRIORITY_LANES];	/*! Number of message buffers in each list */
+	UINT32				overflow_count;				/*! Number of messages queued in the list because the ring was full or busy */
+	WAIT_QUEUE			wait_queue;					/*! Senders and receivers waiting for the queue to change */
 };
 
 void InitMessageQueue(MESSAGE_QUEUE_PTR message_queue);
+void DestroyMessageQueue(MESSAGE_QUEUE_PTR message_queue);
 ERROR_CODE SendMessage(UINT32 pid_target_task, UINT8 queue_no, MESSAGE_TYPE type, IPC_ARG_TYPE arg1, IPC_ARG_TYPE arg2, IPC_ARG_TYPE arg3, IPC_ARG_TYPE arg4, IPC_ARG_TYPE arg5, IPC_ARG_TYPE arg6, UINT32 wait_time);
 ERROR_CODE SendMessageCore(TASK_PTR target_task, MESSAGE_QUEUE_PTR message_queue, MESSAGE_TYPE type, IPC_ARG_TYPE arg1, IPC_ARG_TYPE arg2, IPC_ARG_TYPE arg3, IPC_ARG_TYPE arg4, IPC_ARG_TYPE arg5, IPC_ARG_TYPE arg6, UINT32 wait_time);
 
 ERROR_CODE ReceiveMessage(UINT8 queue_no, IPC_ARG_TYPE arg1, IPC_ARG_TYPE arg2, IPC_ARG_TYPE arg3, IPC_ARG_TYPE arg4, IPC_ARG_TYPE arg5, IPC_ARG_TYPE arg6, UINT32 wait_time);
 ERROR_CODE ReceiveMessageCore(MESSAGE_QUEUE_PTR message_queue, IPC_ARG_TYPE arg1, IPC_ARG_TYPE arg2, IPC_ARG_TYPE arg3, IPC_ARG_TYPE arg4, IPC_ARG_TYPE arg5, IPC_ARG_TYPE arg6, UINT32 wait_time);
 
+ERROR_CODE ReceiveMessageBatch(MESSAGE_QUEUE_PTR message_queue, IPC_MESSAGE_PTR messages, UINT32 max_count, UINT32 * count, UINT32 wait_time);
+UINT32 SendMessageBatch(IPC_MESSAGE_PTR messages, UINT32 count, UINT32 wait_time);
+ERROR_CODE WaitForMessageQueues(MESSAGE_QUEUE_PTR * queues, UINT32 queue_count, WAIT_QUEUE_PTR * wait_queues, UINT32 wait_queue_count, UINT32 * ready, int wait_time);
+
+ERROR_CODE ReplyToMessage(THREAD_PTR to_thread, MESSAGE_TYPE type, IPC_ARG_TYPE arg1, IPC_ARG_TYPE arg2, IPC_ARG_TYPE arg3, IPC_ARG_TYPE arg4, IPC_ARG_TYPE arg5, IPC_ARG_TYPE arg6);
 ERROR_CODE ReplyToLastMessage(MESSAGE_TYPE type, IPC_ARG_TYPE arg1, IPC_ARG_TYPE arg2, IPC_ARG_TYPE arg3, IPC_ARG_TYPE arg4, IPC_ARG_TYPE arg5, IPC_ARG_TYPE arg6);
 ERROR_CODE WaitForReply(MESSAGE_TYPE type, IPC_ARG_TYPE arg1, IPC_ARG_TYPE arg2, IPC_ARG_TYPE arg3, IPC_ARG_TYPE arg4, IPC_ARG_TYPE arg5, IPC_ARG_TYPE arg6, int timeout);
+ERROR_CODE CallMessage(TASK_PTR target_task, MESSAGE_QUEUE_PTR message_queue, MESSAGE_TYPE type, IPC_ARG_TYPE arg1, IPC_ARG_TYPE arg2, IPC_ARG_TYPE arg3, IPC_ARG_TYPE arg4, IPC_ARG_TYPE arg5, IPC_ARG_TYPE arg6, 
+		MESSAGE_TYPE reply_type, IPC_ARG_TYPE reply_arg1, IPC_ARG_TYPE reply_arg2, IPC_ARG_TYPE reply_arg3, IPC_ARG_TYPE reply_arg4, IPC_ARG_TYPE reply_arg5, IPC_ARG_TYPE reply_arg6, int timeout);
 void SkipMessage(MESSAGE_QUEUE_PTR msg_queue);
+MESSAGE_PRIORITY SetMessagePriority(MESSAGE_PRIORITY priority);
 ERROR_CODE GetNextMessageInfo(MESSAGE_QUEUE_PTR message_queue, MESSAGE_TYPE *type, UINT32 *length, int wait_time);
 
+void BenchmarkMessageQueue(UINT32 count);
+void VerifyMessageQueue();
+
+ERROR_CODE CreateIpcVectorBuffer(IPC_IOVEC_PTR iov, UINT32 count, IPC_VECTOR_BUFFER_PTR * vector, UINT32 * length);
+ERROR_CODE CopyIpcVectorBuffer(IPC_VECTOR_BUFFER_PTR vector, IPC_IOVEC_PTR iov, UINT32 count);
+void FreeIpcVectorBuffer(IPC_VECTOR_BUFFER_PTR vector);
+
 #endif
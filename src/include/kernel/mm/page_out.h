@@ -0,0 +1,60 @@
+/*!
+	\file	kernel/mm/page_out.h
+	\brief	page out daemon and swap management
+*/
+
+#ifndef __PAGE_OUT__H
+#define __PAGE_OUT__H
+
+#include <ace.h>
+#include <kernel/error.h>
+#include <kernel/mm/vm_types.h>
+#include <kernel/vfs/vfs_types.h>
+
+/*! how long a thread waits for the page out daemon to free pages(in milliseconds)*/
+#define PAGE_OUT_WAIT_TIME			1000
+
+/*! page out daemon statistics*/
+typedef struct page_out_statistics
+{
+	UINT32	scans;					/*! total clock passes*/
+	UINT32	pages_scanned;			/*! total pages examined*/
+	UINT32	pages_activated;		/*! pages moved back to active list because they were referenced*/
+	UINT32	pages_deactivated;		/*! pages moved to inactive list*/
+	UINT32	ubc_pages_written;		/*! modified ubc pages written back to file*/
+	UINT32	ubc_pages_freed;		/*! ubc pages freed*/
+	UINT32	pages_swapped_out;		/*! anonymous pages written to swap*/
+	UINT32	pages_swapped_in;		/*! anonymous pages read from swap*/
+	UINT32	page_out_failures;		/*! eviction attempts failed due to IO error or page reuse*/
+}PAGE_OUT_STATISTICS, * PAGE_OUT_STATISTICS_PTR;
+
+extern UINT32 page_out_free_target;
+extern UINT32 page_out_interval;
+extern UINT32 page_out_scan_batch;
+extern UINT32 swap_memory_size;
+extern UINT32 page_out_test;
+
+extern PAGE_OUT_STATISTICS page_out_statistics;
+
+#ifdef __cplusplus
+    extern "C" {
+#endif
+
+void InitPageOutDaemon();
+void WakeUpPageOutDaemon();
+ERROR_CODE WaitForFreeVirtualPages(UINT32 timeout);
+UINT32 PageOutVirtualPages(UINT32 target);
+void VerifyPageOut();
+
+ERROR_CODE AddSwapVnode(VNODE_PTR vnode, UINT32 size);
+VNODE_PTR CreateMemorySwapVnode(UINT32 size);
+
+ERROR_CODE SwapInVirtualPage(VNODE_PTR vnode, UINT32 offset, VIRTUAL_PAGE_PTR vp);
+void ReferenceSwapSlot(VNODE_PTR vnode, UINT32 offset);
+void ReleaseSwapSlot(VNODE_PTR vnode, UINT32 offset);
+
+#ifdef __cplusplus
+	}
+#endif
+
+#endif
@@ -48,6 +48,11 @@ typedef struct memory_area
 	PHYSICAL_MEMORY_REGION 	physical_memory_regions[MAX_PHYSICAL_REGIONS];
 }MEMORY_AREA, * MEMORY_AREA_PTR;
 
+/*! the page was accessed after the last time the status was cleared*/
+#define PAGE_STATUS_ACCESSED		0x1
+/*! the page was written after the last time the status was cleared*/
+#define PAGE_STATUS_DIRTY			0x2
+
 typedef enum
 {
 	VA_NOT_EXISTS=0,
@@ -75,6 +80,15 @@ ERROR_CODE MapVirtualAddressRange(PHYSICAL_MAP_PTR pmap, UINT32 va, UINT32 size,
 
 ERROR_CODE MarkPageForCOW(VIRTUAL_PAGE_PTR vp);
 
+UINT32 GetPhysicalMappingStatus(PHYSICAL_MAP_PTR pmap, VADDR va, UINT32 clear_status);
+UINT32 RevokePhysicalMapping(PHYSICAL_MAP_PTR pmap, VADDR va);
+
+void InitPhysicalPageWindow();
+void * MapPhysicalPageWindow(UINT32 pa);
+void UnmapPhysicalPageWindow();
+void * MapPhysicalPageCopyWindow(UINT32 pa);
+void UnmapPhysicalPageCopyWindow(void * window);
+
 VA_STATUS GetVirtualRangeStatus(VADDR va, UINT32 size);
 VA_STATUS TranslatePaFromVa(VADDR va, VADDR * pa);
 
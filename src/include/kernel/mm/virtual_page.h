@@ -9,6 +9,7 @@
 #include <ace.h>
 #include <ds/list.h>
 #include <sync/spinlock.h>
+#include <kernel/error.h>
 #include <kernel/mm/vm_types.h>
 
 /*! Virtual Page to Physical address*/
@@ -28,6 +29,7 @@ struct virtual_page
 				bad:1,				/*! if set page is bad*/
 				busy:1,				/*! if set page is busy due to IO*/
 				error:1,			/*! if set a page error occurred during last IO*/
+				inactive:1,			/*! if set page is in inactive LRU list*/
 				reserved;
 #ifdef DOIT_LATER
 	union
@@ -52,9 +54,8 @@ struct virtual_page
 		/*the following structure is used when the page is controlled by ubc*/
 		struct
 		{
-			AVL_TREE			tree;				/*! tree of all pages in a vnode - for faster search*/
 			VNODE_PTR			vnode;				/*! back pointer to vnode - neccessary?*/
-			VADDR				offset;				/*! file offset this page maps - key to the above tree*/
+			VADDR				offset;				/*! file offset this page maps - key to the vnode page tree*/
 			BYTE				loaded:1,			/*! set to 1 if the page is loaded from file*/
 								modified:1;			/*! set to 1 if the page is modified after load*/
 		}ubc_info;
@@ -75,6 +76,9 @@ struct va_map
 	UINT32				va;					/*! virtual address for the mapping*/
 	PHYSICAL_MAP_PTR	physical_map;		/*! pointer to the physical map for va*/
 	
+	VM_UNIT_PTR			unit;				/*! vm unit which references the page through this mapping*/
+	UINT32				vtop_index;			/*! index of the page in the unit's vtop array*/
+	
 	LIST				list;				/*! list of all va_map for the virtual page*/
 }__attribute__ ((packed));;
 
@@ -95,5 +99,14 @@ VIRTUAL_PAGE_PTR PhysicalToVirtualPage(UINT32 physical_address);
 UINT32 LockVirtualPages(VIRTUAL_PAGE_PTR first_vp, int pages);
 UINT32 ReserveVirtualPages(VIRTUAL_PAGE_PTR first_vp, int pages);
 
+void ActivateVirtualPage(VIRTUAL_PAGE_PTR vp);
+void DeactivateVirtualPage(VIRTUAL_PAGE_PTR vp);
+
+ERROR_CODE AddVaMapToVirtualPage(VIRTUAL_PAGE_PTR vp, PHYSICAL_MAP_PTR pmap, VADDR va, VM_UNIT_PTR unit, UINT32 vtop_index);
+void LinkVaMapToVirtualPage(VIRTUAL_PAGE_PTR vp, VA_MAP_PTR va_map, PHYSICAL_MAP_PTR pmap, VADDR va, VM_UNIT_PTR unit, UINT32 vtop_index);
+void RemoveVaMapFromVirtualPage(VIRTUAL_PAGE_PTR vp, VA_MAP_PTR va_map);
+void RemoveVirtualPageMapping(VIRTUAL_PAGE_PTR vp, PHYSICAL_MAP_PTR pmap, VADDR va);
+UINT32 GetVirtualPageMappingStatus(VIRTUAL_PAGE_PTR vp, UINT32 clear_status);
+
 extern UINT32 limit_physical_memory;
 #endif
@@ -41,6 +41,11 @@
 /*! Total number pages required by given size in bytes*/
 #define NUMBER_OF_PAGES(size)		(PAGE_ALIGN_UP(size) >> PAGE_SHIFT)
 
+/*! Returns non zero if the vtop entry points to a virtual page in memory*/
+#define VTOP_IN_MEMORY(vtop)		( ((VADDR)(vtop)->vpage) & 1 )
+/*! Returns the virtual page pointed by an in memory vtop entry*/
+#define VTOP_TO_VIRTUAL_PAGE(vtop)	( (VIRTUAL_PAGE_PTR)( ((VADDR)(vtop)->vpage) & ~1 ) )
+
 /*! When searching for free virtual range start from 0*/
 #define VA_RANGE_SEARCH_FROM_TOP	1
 
@@ -60,7 +65,8 @@ typedef enum
 typedef enum
 {
 	VM_UNIT_FLAG_SHARED=1,
-	VM_UNIT_FLAG_PRIVATE
+	VM_UNIT_FLAG_PRIVATE,
+	VM_UNIT_FLAG_FOREIGN_PAGES=4		/*pages are owned by somebody else(ubc, io buffer, device) and are not freed with the unit*/
 }VM_UNIT_FLAG;
 
 /*! structure to contain VM data for a NUMA node*/
@@ -75,8 +81,11 @@ struct vm_data
 	AVL_TREE_PTR		free_tree_1M;			/*! free virtual page ranges under 1 M*/
 	AVL_TREE_PTR		free_tree_16M;			/*! free virtual page ranges under 16 M*/
 	
+	SPIN_LOCK			lru_lock;				/*! lock for active and inactive lists*/
 	VIRTUAL_PAGE_PTR	active_list;			/*! points to the first page in the active list*/
-	VIRTUAL_PAGE_PTR	inactive_list;			/*! points to the first page in the active list*/
+	VIRTUAL_PAGE_PTR	inactive_list;			/*! points to the first page in the inactive list*/
+	UINT32				active_count;			/*! total pages in the active list*/
+	UINT32				inactive_count;			/*! total pages in the inactive list*/
 };
 
 struct vm_protection 
@@ -149,6 +158,7 @@ struct vm_vtop
 		VIRTUAL_PAGE_PTR	vpage;			/*! pointer to the virtual page if the page is in memory*/
 		VNODE_PTR			vnode;			/*! pointer to the vnode if the page is in filesystem/swap*/
 	};
+	UINT32					swap_offset;	/*! offset in the swap vnode - valid only if the page is swapped out*/
 };
 
 /*! kernel_reserve_range - Virtual and physical address ranges reserved by kernel
@@ -206,11 +216,13 @@ VIRTUAL_MAP_PTR CreateVirtualMap(VADDR start, VADDR end);
 void InitVmDescriptor(VM_DESCRIPTOR_PTR descriptor, VIRTUAL_MAP_PTR vmap, VADDR start, VADDR end, VM_UNIT_PTR vm_unit, VM_PROTECTION_PTR protection);
 VM_DESCRIPTOR_PTR CreateVmDescriptor(VIRTUAL_MAP_PTR vmap, VADDR start, VADDR end, VM_UNIT_PTR vm_unit, VM_PROTECTION_PTR protection);
 VM_DESCRIPTOR_PTR GetVmDescriptor(VIRTUAL_MAP_PTR vmap, VADDR va, UINT32 size);
+void FreeVmDescriptor(VM_DESCRIPTOR_PTR vd);
 void * FindFreeVmRange(VIRTUAL_MAP_PTR vmap, VADDR start, UINT32 size, UINT32 option);
 void PrintVmDescriptors(VIRTUAL_MAP_PTR vmap);
 
 VM_UNIT_PTR CreateVmUnit(VM_UNIT_TYPE type, VM_UNIT_FLAG flag, UINT32 size);
 VM_UNIT_PTR CopyVmUnit(VM_UNIT_PTR unit, VADDR start, VADDR end);
+void FreeVmUnit(VM_UNIT_PTR unit);
 void SetVmUnitPage(VM_UNIT_PTR unit, VIRTUAL_PAGE_PTR vp, UINT32 vtop_index);
 
 ERROR_CODE AllocateVirtualMemory(VIRTUAL_MAP_PTR vmap, VADDR * va_ptr, VADDR preferred_start, UINT32 size, UINT32 protection, UINT32 flags, VM_UNIT_PTR unit);
@@ -221,6 +233,12 @@ ERROR_CODE ReadFileIntoAddressSpace(int file_id, offset_t offset, size_t size, V
 ERROR_CODE CopyVirtualAddressRange(VIRTUAL_MAP_PTR src_vmap, VADDR src_va, UINT32 src_size, VIRTUAL_MAP_PTR dest_vmap, VADDR *dest_preferred_va, UINT32 dest_size, UINT32 protection, UINT32 flags);
 
 VADDR MapPhysicalMemory(VIRTUAL_MAP_PTR vmap, UINT32 pa, UINT32 size, VADDR preferred_va, UINT32 protection);
+VADDR MapVirtualPages(VIRTUAL_MAP_PTR vmap, VIRTUAL_PAGE_PTR * vps, UINT32 count, UINT32 protection);
+ERROR_CODE MapVirtualPageCopyOnWrite(VIRTUAL_MAP_PTR vmap, VADDR va, VIRTUAL_PAGE_PTR vp);
+VIRTUAL_PAGE_PTR DuplicateVirtualPage(VIRTUAL_PAGE_PTR vp);
+ERROR_CODE UnshareVirtualPage(VIRTUAL_PAGE_PTR vp);
+VIRTUAL_PAGE_PTR ShareVirtualPageCopyOnWrite(VIRTUAL_MAP_PTR vmap, VADDR va);
+void ReleaseVirtualPageCopyOnWrite(VIRTUAL_PAGE_PTR vp);
 
 void AddVmunitToVnodeList(VNODE_PTR vnode, VM_UNIT_PTR unit, offset_t offset);
 
@@ -1556,7 +1556,12 @@ extern UINT32 kernel_string_table_size;
 
 ERROR_CODE LoadElfImage(char *elf_file_path, char * start_symbol_name, VADDR * start_entry);
 
+extern UINT32 kernel_symbol_test;
+
+void InitKernelSymbolIndex();
 char * FindKernelSymbolByAddress(VADDR address, int * offset);
+ELF_SYMBOL_PTR FindKernelSymbolByName(char * symbol_name);
+void VerifyKernelSymbolIndex();
 
 #endif	/*! elf.h */
 
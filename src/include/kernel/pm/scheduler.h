@@ -66,4 +66,7 @@ void InvokeScheduler();
 void InitScheduler();
 ERROR_CODE BindThreadToProcessor(THREAD_PTR thread, int cpu_no);
 
+void SetHandoffThread(THREAD_PTR thread);
+void FlushHandoffThread();
+
 #endif
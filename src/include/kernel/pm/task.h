@@ -12,6 +12,7 @@
 #include <kernel/wait_event.h>
 #include <kernel/mm/vm.h>
 #include <kernel/vfs/vfs.h>
+#include <kernel/vfs/io_ring.h>
 #include <kernel/mm/kmem.h>
 #include <kernel/pm/pm_types.h>
 #include <kernel/pm/thread.h>
@@ -37,8 +38,11 @@ struct task
 	THREAD_PTR			thread_head;										/*! threads in the same task */
 
 	MESSAGE_QUEUE		message_queue[MESSAGE_QUEUES_PER_TASK];				/*! Pointer to message queue containing IPC messages */
+	UINT32				ipc_messages_queued;								/*! Messages sent by this task and not yet received(limited by max_messages_per_sender) */
+	WAIT_QUEUE			ipc_credit_wait_queue;								/*! Senders of this task waiting for a queued message to be received */
 	
 	PROCESS_FILE_INFO	process_file_info;									/*! open file info */
+	IO_RING_PTR			io_ring;											/*! asynchronous io ring - NULL if not created */
 	
 	char *				kva_command_line;									/*! kernel virtual address of command line*/
 	char *				uva_command_line;									/*! user virtual address of command line - once user va is created kva will be freed*/
@@ -74,6 +78,7 @@ int TaskCacheDestructor(void * buffer);
 void InitKernelTask();
 TASK_PTR CreateTask(char * exe_file_path, IMAGE_TYPE image_type, UINT32 creation_flag, VADDR * entry_point, char * command_line, char * environment);
 inline TASK_PTR GetCurrentTask();
+void DetachThreadFromTask(THREAD_PTR thread);
 
 TASK_PTR PidToTask(int pid);
 
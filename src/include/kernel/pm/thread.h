@@ -14,6 +14,7 @@
 #include <kernel/pm/pm_types.h>
 #include <kernel/pm/scheduler.h>
 #include <kernel/pm/timeout_queue.h>
+#include <kernel/wait_event.h>
 
 /*\todo remove these macros and put it as tunable*/
 #define THREAD_CACHE_FREE_SLABS_THRESHOLD	100 
@@ -52,8 +53,9 @@ struct thread
 	UINT8					time_slice;				/*! Time quantum for which the thread can be run */
 	PRIORITY_QUEUE_PTR		priority_queue;			/*! Pointer to priority queue in either of active or dormant ready queue */
 	SCHEDULER_CLASS_LEVELS	priority;				/*! External priority assigned by the user. This is used to select one of the scheduler classes */
+	THREAD_PTR				handoff_thread;			/*! Thread to switch to when this thread blocks next, without going through the ready queue */
 	
-	WAIT_EVENT_PTR			thread_event;			/*! Wait for this thread to finish*/
+	WAIT_QUEUE				thread_event;			/*! Wait for this thread to finish*/
 
 	/* Timeout queue */
 	TIMEOUT_QUEUE			timeout_queue;
@@ -63,8 +65,10 @@ struct thread
 	
 	/*ipc reply*/
 	THREAD_PTR				ipc_reply_to_thread;	/*! Last message came from which thread(ie to which thread i have to reply)*/
-	WAIT_EVENT_PTR			ipc_reply_event;		/*! Waitevent to wait to receive message(reply)*/
+	WAIT_QUEUE				ipc_reply_event;		/*! Waitevent to wait to receive message(reply)*/
 	MESSAGE_BUFFER			ipc_reply_message;		/*! buffer to receive reply data*/
+	BYTE					ipc_call_pending;		/*! Thread is blocked in CallMessage() - the replier can switch to it directly*/
+	MESSAGE_PRIORITY		ipc_priority;			/*! Priority of the messages sent by this thread(see SetMessagePriority())*/
 	
 	void *					arch_data;				/*! architecture depended data*/
 	
@@ -14,6 +14,7 @@
 typedef struct processor *PROCESSOR_PTR;
 #include <kernel/pm/pm_types.h>
 #include <kernel/pm/scheduler.h>
+#include <kernel/dpc.h>
 
 #ifdef CONFIG_SMP
 	#define MAX_PROCESSORS	64		/*! Maximum processors supported by Ace*/
@@ -43,6 +44,8 @@ typedef struct processor
 	char				loaded;					/*! indicates if this processor is heavily loaded(1) or not(0). */
 	
 	THREAD_PTR			idle_thread;			/*! idle thread for this processor */
+	
+	DPC_QUEUE			dpc_queue;				/*! deferred procedure calls queued by interrupt handlers on this processor */
 }PROCESSOR;
 
 
@@ -0,0 +1,66 @@
+/*!
+\file	kernel/profiler.h
+\brief	Statistical sampling profiler driven by the scheduler timer
+*/
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <ace.h>
+#include <kernel/error.h>
+#include <kernel/processor.h>
+#include <kernel/pm/pm_types.h>
+
+/*! default number of samples a processor can hold before samples are dropped*/
+#define PROFILER_DEFAULT_BUFFER_SAMPLES	8192
+
+/*! number of symbols printed by DumpProfile() when the caller does not specify*/
+#define PROFILER_DEFAULT_TOP_SYMBOLS	20
+
+typedef enum
+{
+	PROFILER_SAMPLE_USER_MODE = 1,		/*! the processor was running user code - eip is a user address*/
+}PROFILER_SAMPLE_FLAG;
+
+typedef struct profiler_sample PROFILER_SAMPLE, * PROFILER_SAMPLE_PTR;
+typedef struct profiler_buffer PROFILER_BUFFER, * PROFILER_BUFFER_PTR;
+
+/*! State of the processor captured by a timer interrupt*/
+struct profiler_sample
+{
+	VADDR				eip;					/*! interrupted instruction*/
+	THREAD_PTR			thread;					/*! thread which was running*/
+	BYTE				processor_id;			/*! processor which took the sample*/
+	BYTE				flags;					/*! PROFILER_SAMPLE_FLAG*/
+};
+
+/*! Per processor sample buffer
+	Only the timer interrupt of the owning processor writes to the buffer, so no lock is required. A sample
+	is filled before count is incremented - samples below count never change until the profiler is restarted.*/
+struct profiler_buffer
+{
+	PROFILER_SAMPLE_PTR	samples;				/*! sample array - allocated on the first start*/
+	UINT32				size;					/*! number of entries in the sample array*/
+	volatile UINT32		count;					/*! number of valid samples*/
+	volatile UINT32		dropped;				/*! samples lost because the buffer was full*/
+};
+
+extern volatile BOOLEAN profiler_enabled;
+extern UINT32 profiler_buffer_samples;		/* Kernel parameter - samples per processor buffer */
+extern UINT32 profiler_boot_seconds;		/* Kernel parameter - profile the system for this many seconds after boot */
+
+#ifdef __cplusplus
+    extern "C" {
+#endif
+
+ERROR_CODE StartProfiler();
+void StopProfiler();
+void RecordProfilerSample(VADDR eip, BOOLEAN user_mode);
+void DumpProfile(UINT32 top);
+ERROR_CODE ProfileSystem(UINT32 seconds);
+
+#ifdef __cplusplus
+	}
+#endif
+
+#endif
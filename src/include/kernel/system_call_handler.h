@@ -20,6 +20,7 @@ typedef struct system_call_args {
 }SYSTEM_CALL_ARGS, *SYSTEM_CALL_ARGS_PTR;
 
 void SetupSystemCallHandler(void);
+void SetupFastSystemCall(void);
 
 /* Below definitions in kernel/system_calls.c */
 int SystemCallCacheConstructor(void *buffer);
@@ -6,30 +6,52 @@
 #define DIR_ENTRY_H
 
 #include <kernel/vfs/vfs.h>
+#include <sync/spinlock.h>
 
-/*! Directory entry for faster file name access*/
+/*! number of buckets in the directory entry hash table - should be power of 2*/
+#define DIR_ENTRY_HASH_TABLE_SIZE	256
+
+/*! Directory entry for faster file name access - caches one component of a path*/
 struct directory_entry
 {
-	char * 					name;							/*! full path of the vnode*/
+	char * 					name;							/*! name of the path component*/
+	UINT32					name_hash;						/*! hash of the name and the parent*/
+	DIRECTORY_ENTRY_PTR		parent;							/*! parent directory entry - NULL for the root*/
+	
+	SPIN_LOCK				lock;							/*! protects the reference count*/
+	int						reference_count;				/*! number of child entries and path walks using this entry*/
 	
 	LIST					lru;							/*! lru list for space management*/
-	AVL_TREE				name_tree;						/*! tree for faster search*/
+	LIST					hash_list;						/*! link in the hash bucket*/
+	BYTE					referenced;						/*! entry was used after the last lru scan*/
+	BYTE					negative;						/*! file system reported that the path does not exist*/
+	UINT32					generation;						/*! fs_control.dir_entry_generation when the entry became negative or got attributes*/
+	FILE_STAT_PARAM_PTR		attributes;						/*! attributes returned by a directory read - used to create the vnode without asking the FS*/
+	UINT32					attribute_expire_ticks;			/*! attributes are not used after this tick*/
 	
 	UINT32					inode_number;					/*! inode number */
 	MOUNTED_FILE_SYSTEM_PTR	mounted_fs;						/*! mounted file system*/
 	void * 					fs_data;						/*! file system specific data*/
-	VNODE_PTR				vnode;							/*! associated vnode if any*/
+	VNODE_PTR				vnode;							/*! associated vnode if any - the entry holds a reference on it*/
 };
 
-LIST_PTR AllocateDirEntryLruNode();
-void ReuseDirEntryLru(LIST_PTR node);
-void FreeDirEntryLru(LIST_PTR node);
+/*! hash bucket of the directory entry cache*/
+typedef struct dir_entry_hash_bucket
+{
+	SPIN_LOCK				lock;							/*! protects the bucket list*/
+	LIST					head;							/*! directory entries in this bucket*/
+}DIR_ENTRY_HASH_BUCKET, * DIR_ENTRY_HASH_BUCKET_PTR;
 
+void InitDirectoryEntryCache();
 ERROR_CODE GetDirectoryEntry(char * file_path, DIRECTORY_ENTRY_PTR * result);
+void ReferenceDirectoryEntry(DIRECTORY_ENTRY_PTR de);
+void ReleaseDirectoryEntry(DIRECTORY_ENTRY_PTR de);
+void InvalidateNegativeDirectoryEntries();
+void CacheDirectoryEntryAttributes(char * directory_path, FILE_STAT_PARAM_PTR entries, int count);
+FILE_STAT_PARAM_PTR TakeDirectoryEntryAttributes(DIRECTORY_ENTRY_PTR de);
 
 int DirEntryCacheConstructor(void * buffer);
 int DirEntryCacheDestructor(void * buffer);
 
 
 #endif
-
@@ -0,0 +1,116 @@
+/*! \file 	kernel/vfs/io_ring.h
+    \brief 	asynchronous file io through submission/completion rings shared with the task
+*/
+
+#ifndef IO_RING_H
+#define IO_RING_H
+
+#include <ace.h>
+#include <ds/list.h>
+#include <sync/spinlock.h>
+#include <kernel/wait_event.h>
+#include <kernel/pm/pm_types.h>
+
+/*! maximum number of entries in the submission ring*/
+#define IO_RING_MAX_ENTRIES			256
+/*! completion ring is bigger than the submission ring so that a full submission ring can be in flight while completions are not reaped*/
+#define IO_RING_COMPLETION_FACTOR	2
+/*! maximum number of kernel threads executing the requests of a ring*/
+#define IO_RING_MAX_WORKERS			8
+
+/*! operations supported by a submission entry*/
+typedef enum
+{
+	IO_RING_OPCODE_NOP=0,
+	IO_RING_OPCODE_READ,
+	IO_RING_OPCODE_WRITE,
+	IO_RING_OPCODE_FSYNC,
+	IO_RING_OPCODE_MAXIMUM
+}IO_RING_OPCODE;
+
+typedef struct io_ring_header IO_RING_HEADER, * IO_RING_HEADER_PTR;
+typedef struct io_ring_submission_entry IO_RING_SUBMISSION_ENTRY, * IO_RING_SUBMISSION_ENTRY_PTR;
+typedef struct io_ring_completion_entry IO_RING_COMPLETION_ENTRY, * IO_RING_COMPLETION_ENTRY_PTR;
+typedef struct io_ring_request IO_RING_REQUEST, * IO_RING_REQUEST_PTR;
+typedef struct io_ring IO_RING, * IO_RING_PTR;
+
+/*! An io request queued by the task*/
+struct io_ring_submission_entry
+{
+	UINT32					opcode;							/*! IO_RING_OPCODE*/
+	int						file_id;						/*! file to operate on*/
+	UINT32					offset;							/*! file offset - the file pointer is not used or moved*/
+	void *					buffer;							/*! user buffer for read/write*/
+	UINT32					length;							/*! number of bytes to read/write*/
+	UINT32					user_data;						/*! copied as it is to the completion entry*/
+};
+
+/*! Result of a finished request*/
+struct io_ring_completion_entry
+{
+	UINT32					user_data;						/*! user_data of the submission entry*/
+	int						result;							/*! number of bytes transferred or -errno*/
+};
+
+/*! Start of the ring memory shared with the task
+	The task produces at submission_tail and consumes at completion_head, the kernel does the reverse. Indexes run freely
+	and are masked with the ring size, so head == tail means empty.
+*/
+struct io_ring_header
+{
+	volatile UINT32			submission_head;				/*! next submission entry the kernel takes - written by kernel*/
+	volatile UINT32			submission_tail;				/*! next free submission entry - written by task*/
+	volatile UINT32			completion_head;				/*! next completion entry the task reaps - written by task*/
+	volatile UINT32			completion_tail;				/*! next free completion entry - written by kernel*/
+
+	UINT32					submission_entries;				/*! number of entries in the submission ring - power of 2*/
+	UINT32					completion_entries;				/*! number of entries in the completion ring - power of 2*/
+	UINT32					submission_offset;				/*! offset of the submission entries from the header*/
+	UINT32					completion_offset;				/*! offset of the completion entries from the header*/
+};
+
+/*! Kernel side of a submission entry while it is waiting for or being served by a worker*/
+struct io_ring_request
+{
+	LIST					list;							/*! links the request in the ring's pending list*/
+	IO_RING_SUBMISSION_ENTRY entry;							/*! copy of the submission entry - the task can reuse its slot*/
+};
+
+/*! Kernel side of an io ring*/
+struct io_ring
+{
+	SPIN_LOCK				lock;							/*! protects the ring indexes and the lists*/
+	TASK_PTR				task;							/*! owner of the ring*/
+
+	IO_RING_HEADER_PTR		header;							/*! kernel mapping of the shared ring memory*/
+	IO_RING_SUBMISSION_ENTRY_PTR submissions;				/*! kernel address of the submission entries*/
+	IO_RING_COMPLETION_ENTRY_PTR completions;				/*! kernel address of the completion entries*/
+	VADDR					user_va;						/*! task mapping of the shared ring memory*/
+	UINT32					size;							/*! size of the shared ring memory*/
+
+	UINT32					submission_head;				/*! kernel copy of the index - the shared header is only a mirror, the task can scribble on it*/
+	UINT32					submission_mask;				/*! number of submission entries - 1*/
+	UINT32					completion_tail;				/*! kernel copy of the index*/
+	UINT32					completion_mask;				/*! number of completion entries - 1*/
+
+	UINT32					in_flight;						/*! requests taken from the submission ring and not yet completed*/
+	LIST					pending_list;					/*! requests waiting for a worker*/
+	UINT32					pending_count;					/*! number of requests in the pending list*/
+	UINT32					worker_count;					/*! number of worker threads created*/
+	UINT32					idle_workers;					/*! number of worker threads waiting for a request*/
+	WAIT_QUEUE				worker_wait_queue;				/*! idle workers wait here*/
+	WAIT_QUEUE				completion_wait_queue;			/*! task threads waiting for completions wait here*/
+};
+
+#ifdef __cplusplus
+    extern "C" {
+#endif
+
+ERROR_CODE CreateIoRing(TASK_PTR task, UINT32 entries, VADDR * user_va);
+ERROR_CODE EnterIoRing(TASK_PTR task, UINT32 to_submit, UINT32 min_complete, UINT32 * submitted);
+
+#ifdef __cplusplus
+	}
+#endif
+
+#endif
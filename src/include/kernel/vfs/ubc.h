@@ -5,8 +5,63 @@
 #ifndef UBC_H
 #define UBC_H
 
+/*! tags used on vnode page tree*/
+#define UBC_TAG_DIRTY				0	/*! page is modified and not yet written back*/
+#define UBC_TAG_WRITEBACK			1	/*! page is being written to the file*/
+
+/*! converts a file offset into vnode page tree index*/
+#define UBC_PAGE_INDEX(offset)		( (UINT32)(offset) >> PAGE_SHIFT )
+
+/*! maximum pages written back in single file system request*/
+#define UBC_FLUSH_BATCH_MAX			64
+/*! how long a throttled writer waits for the flusher in one attempt(in milliseconds)*/
+#define UBC_THROTTLE_WAIT_TIME		100
+/*! maximum attempts a writer is throttled before it is allowed to dirty more pages*/
+#define UBC_THROTTLE_RETRIES		10
+
+/*! ubc write back statistics*/
+typedef struct ubc_statistics
+{
+	UINT32	pages_dirtied;			/*! pages marked modified*/
+	UINT32	pages_written;			/*! modified pages written back to file*/
+	UINT32	write_requests;			/*! write requests sent to file systems*/
+	UINT32	write_failures;			/*! write requests failed - pages are marked modified again*/
+	UINT32	writers_throttled;		/*! writers waited because of too many modified pages*/
+	UINT32	flusher_wakeups;		/*! flusher woken up before its interval*/
+	UINT32	pages_remapped;			/*! pages mapped copy-on-write into the reader instead of copying*/
+}UBC_STATISTICS, * UBC_STATISTICS_PTR;
+
+extern UINT32 ubc_dirty_background_ratio;
+extern UINT32 ubc_dirty_ratio;
+extern UINT32 ubc_flush_interval;
+extern UINT32 ubc_flush_max_pages;
+
+extern UINT32 ubc_dirty_pages;
+extern UBC_STATISTICS ubc_statistics;
+
+void InitUbc();
+void InitVnodePageTree(VNODE_PTR vnode);
 VIRTUAL_PAGE_PTR GetVnodePage(VNODE_PTR vnode, VADDR offset);
+VIRTUAL_PAGE_PTR PinVnodePage(VNODE_PTR vnode, VADDR offset);
 ERROR_CODE FillUbcPage(VNODE_PTR vnode, VADDR offset, VIRTUAL_PAGE_PTR vp);
+ERROR_CODE WriteUbcPage(VNODE_PTR vnode, VADDR offset, VIRTUAL_PAGE_PTR vp);
+ERROR_CODE TransferVnodePage(VNODE_PTR vnode, VADDR offset, UINT32 physical_address, BOOLEAN write);
+ERROR_CODE RemoveVnodePage(VNODE_PTR vnode, VIRTUAL_PAGE_PTR vp);
 ERROR_CODE ReleaseVnodePages(VNODE_PTR vnode);
 
+UINT32 FindVnodePages(VNODE_PTR vnode, VADDR offset, VIRTUAL_PAGE_PTR * vps, UINT32 count, int tag);
+UINT32 FindContiguousVnodePages(VNODE_PTR vnode, VADDR offset, VIRTUAL_PAGE_PTR * vps, UINT32 count, int tag);
+void PutVnodePages(VIRTUAL_PAGE_PTR * vps, UINT32 count);
+void SetVnodePageTag(VNODE_PTR vnode, VIRTUAL_PAGE_PTR vp, int tag);
+void ClearVnodePageTag(VNODE_PTR vnode, VIRTUAL_PAGE_PTR vp, int tag);
+
+void MarkVnodePageDirty(VNODE_PTR vnode, VIRTUAL_PAGE_PTR vp);
+ERROR_CODE WriteVnodePages(VNODE_PTR vnode, VIRTUAL_PAGE_PTR * vps, UINT32 count);
+ERROR_CODE FlushVnodePages(VNODE_PTR vnode);
+ERROR_CODE SyncVnodePages(VNODE_PTR vnode);
+ERROR_CODE FlushMountPages(MOUNTED_FILE_SYSTEM_PTR mount);
+void StopMountFlusher(MOUNTED_FILE_SYSTEM_PTR mount);
+
+ERROR_CODE ReadWriteVnode(VNODE_PTR vnode, UINT32 offset, long count, void * buffer, int is_write, UINT32 * result);
+
 #endif
@@ -9,6 +9,7 @@
 #include <ds/avl_tree.h>
 #include <ds/list.h>
 #include <ds/lrulist.h>
+#include <sync/seqlock.h>
 #include <heap/slab_allocator.h>
 #include <kernel/time.h>
 #include <kernel/error.h>
@@ -25,7 +26,11 @@
 /*! Maximum lenght of a mount*/
 #define MAX_MOUNT_NAME			20
 /*! Maximum open file per process*/
-#define	MAX_OPEN_FILE			25
+#define	MAX_OPEN_FILE			1024
+/*! number of file ids in a second level file table - allocated only when the lower file ids are used up*/
+#define FILE_TABLE_CHUNK_SIZE	32
+/*! number of second level file tables*/
+#define FILE_TABLE_CHUNKS		(MAX_OPEN_FILE/FILE_TABLE_CHUNK_SIZE)
 
 #define PATH_SEPARATOR			'/'
 #define DEVICE_NAME_SIZE		10
@@ -36,12 +41,20 @@
 /*! Maximum characters in a path - yea it looks too small*/
 #define MAX_FILE_PATH			200
 
-/*! how many elements in the vnode hash table*/
-#define VNODE_HASH_TABLE_SIZE	100
+/*! initial number of buckets in the vnode hash table - should be power of 2*/
+#define VNODE_HASH_TABLE_SIZE		64
+/*! the vnode hash table is not grown beyond this*/
+#define VNODE_HASH_TABLE_MAX_SIZE	4096
 
 #define VFS_MOUNT_TIME_OUT	1000
 #define VFS_TIME_OUT		1000
 
+/*! mount flags*/
+#define MOUNT_FLAG_NO_CACHE		1		/*! file read/write bypass the ubc and go directly to the file system*/
+
+/*! returns TRUE if the file read/write on the vnode should go through ubc*/
+#define IS_VNODE_CACHED(vnode)	( (vnode)->mounted_fs != NULL && !((vnode)->mounted_fs->flags & MOUNT_FLAG_NO_CACHE) )
+
 /*! \todo - move these enums to usr visible include directory*/
 typedef enum
 {		
@@ -118,20 +131,38 @@ struct mounted_file_system
 	
 	void * 					fs_data;						/*! file system specific data*/
 	
+	SPIN_LOCK				flush_lock;						/*! protects dirty vnode list and flusher state*/
+	LIST					dirty_vnode_list;				/*! vnodes having modified ubc pages*/
+	THREAD_PTR				flusher_thread;					/*! thread which writes back modified pages of this mount*/
+	WAIT_QUEUE				flusher_wait_queue;				/*! flusher thread waits here for work*/
+	LIST					flusher_start_list;				/*! links the mount to the list of mounts waiting for a flusher*/
+	BYTE					flusher_started:1,				/*! flusher thread is created*/
+							flusher_stop:1;					/*! flusher thread should exit*/
+	
 	LIST					list;							/*! links all mounts*/
 };
 
 /*!  Opened file info
 	1) Multiple open file info can reference same file with different offset
+	2) Multiple file ids(dup or inherited by another process) can share the same open file info and its offset
 */
 struct open_file_info
 {
+	SPIN_LOCK				lock;							/*! protects the reference count and file offset*/
+	int						reference_count;				/*! number of file ids referring this open file info*/
 	UINT32					mode;							/*! file open mode*/
 	
 	VNODE_PTR				vnode;							/*! associated vnode*/
 	UINT32					file_offset;					/*! file pointer position*/
 };
 
+/*! Second level of the process file table*/
+struct file_table_chunk
+{
+	UINT32					bitmap;							/*! bitmap of used file ids in this chunk*/
+	OPEN_FILE_INFO_PTR		open_file_info[FILE_TABLE_CHUNK_SIZE];/*! open file info of each file id*/
+};
+
 /*! Process specific opened file  and other informations
 	Just grouping of file information stored in task structure.
 */
@@ -139,8 +170,9 @@ struct process_file_info
 {
 	UINT32					umask;							/*! default permission for new file - set by umask call*/
 	VNODE_PTR				working_directory;				/*! current working directory*/
-	OPEN_FILE_INFO			open_file_info[MAX_OPEN_FILE];	/*! max files per process*/
-	char					bitmap[MAX_OPEN_FILE/BITS_PER_BYTE];/*! bitmap to maintain free open file info*/
+	SPIN_LOCK				lock;							/*! protects the file table*/
+	FILE_TABLE_CHUNK_PTR	chunks[FILE_TABLE_CHUNKS];		/*! second level file tables - allocated on demand*/
+	char					full_bitmap[FILE_TABLE_CHUNKS/BITS_PER_BYTE];/*! bit is set if all file ids in the chunk are used - finds the lowest free file id without scanning the chunks*/
 };
 
 /*! FS fills this datastructures and returns to VFS during VFS_FILE_STAT ipc*/
@@ -173,10 +205,19 @@ struct fs_control
 	FILE_SYSTEM_PTR 		registered_file_systems;					/*! list of registered file systems*/
 	MOUNTED_FILE_SYSTEM_PTR	mounted_file_system_head; 					/*! list of mounted file systems*/
 		
-	LRU_LIST				dir_entry_lru_list;							/*! directory entry lru list*/
-	AVL_TREE_PTR			dir_entry_root;								/*! directory entry tree root*/
+	DIRECTORY_ENTRY			dir_entry_root;								/*! directory entry of "/"*/
+	DIR_ENTRY_HASH_BUCKET	dir_entry_hash_table[DIR_ENTRY_HASH_TABLE_SIZE];	/*! directory entries hashed by parent and name*/
+	SPIN_LOCK				dir_entry_lru_lock;							/*! protects the lru list and count*/
+	LIST					dir_entry_lru_list;							/*! directory entry lru list - recently used first*/
+	int						dir_entry_count;							/*! number of directory entries in the lru list*/
+	UINT32					dir_entry_generation;						/*! incremented on mount/unmount - invalidates negative entries*/
 	
-	LIST					vnode_hash_table[VNODE_HASH_TABLE_SIZE];	/*! vnode hash table*/
+	SEQ_LOCK				vnode_hash_lock;							/*! serializes vnode hash table updates - lookups are lockless*/
+	LIST_PTR				vnode_hash_table;							/*! vnode hash table - hashed by mount and inode*/
+	UINT32					vnode_hash_size;							/*! number of buckets in the vnode hash table*/
+	int						vnode_count;								/*! number of vnodes in the hash table*/
+	SPIN_LOCK				vnode_lru_lock;								/*! protects the vnode lru list*/
+	LIST					vnode_lru_list;								/*! unreferenced vnodes - recently used first*/
 };
 
 struct fs_param
@@ -193,7 +234,8 @@ struct fs_param
 	{
 		int					free_slabs_threshold;				/*! vnode cache - free slab limit*/
 		int					min_buffers;						/*! vnode cache - minimum buffers*/
-		int					max_buffers;						/*! vnode cache - maximum buffers*/
+		int					max_buffers;						/*! vnode cache - maximum buffers, unreferenced vnodes are reclaimed beyond this*/
+		int					attribute_cache_time;				/*! milliseconds the file attributes are used without asking the FS*/
 	}vnode;
 };
 
@@ -219,9 +261,18 @@ MOUNTED_FILE_SYSTEM_PTR GetMount(char * mount_path);
 ERROR_CODE OpenFile(TASK_PTR task, char * file_path, VFS_ACCESS_TYPE access, VFS_OPEN_FLAG open_flag, int * file_id);
 ERROR_CODE GetFileSize(TASK_PTR task, int file_id, long * result);
 ERROR_CODE CloseFile(TASK_PTR task, int file_id);
+ERROR_CODE DuplicateFile(TASK_PTR task, int file_id, int new_file_id, int * result);
+ERROR_CODE InheritFiles(TASK_PTR parent, TASK_PTR child);
+void CloseAllFiles(TASK_PTR task);
+void InitProcessFileInfo(PROCESS_FILE_INFO_PTR pf_info);
+OPEN_FILE_INFO_PTR GetOpenFileInfo(TASK_PTR task, int file_id);
+void ReleaseOpenFileInfo(OPEN_FILE_INFO_PTR op);
+ERROR_CODE SyncFile(TASK_PTR task, int file_id);
+ERROR_CODE SyncFileSystems();
 
 ERROR_CODE ReadDirectory(char * directory_path, FILE_STAT_PARAM_PTR buffer, int max_entries, int * total_entries);
 ERROR_CODE ReadWriteFile(int file_id, long count, void * buffer, int is_write, UINT32 * result);
+ERROR_CODE ReadWriteFileAt(int file_id, UINT32 offset, long count, void * buffer, int is_write, UINT32 * result);
 
 ERROR_CODE GetVfsMessage(MESSAGE_QUEUE_PTR message_queue, UINT32 wait_time, MESSAGE_TYPE_PTR type, IPC_ARG_TYPE_PTR arg1, IPC_ARG_TYPE_PTR arg2, IPC_ARG_TYPE_PTR arg3, IPC_ARG_TYPE_PTR arg4, IPC_ARG_TYPE_PTR arg5, IPC_ARG_TYPE_PTR arg6);
 
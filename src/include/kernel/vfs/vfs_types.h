@@ -11,6 +11,7 @@ typedef struct vnode VNODE, * VNODE_PTR;
 typedef struct directory_entry DIRECTORY_ENTRY, * DIRECTORY_ENTRY_PTR;
 typedef struct open_file_info OPEN_FILE_INFO, * OPEN_FILE_INFO_PTR;
 typedef struct process_file_info PROCESS_FILE_INFO, * PROCESS_FILE_INFO_PTR;
+typedef struct file_table_chunk FILE_TABLE_CHUNK, * FILE_TABLE_CHUNK_PTR;
 typedef struct file_stat_param FILE_STAT_PARAM, * FILE_STAT_PARAM_PTR;
 typedef struct fs_control FS_CONTROL, * FS_CONTROL_PTR;
 typedef struct fs_param FS_PARAM, * FS_PARAM_PTR;
@@ -5,6 +5,7 @@
 #ifndef VNODE_H
 #define VNODE_H
 
+#include <ds/radix_tree.h>
 #include <kernel/vfs/vfs.h>
 
 /*! Abstraction of FS specific inode structure*/
@@ -17,8 +18,11 @@ struct vnode
 	UINT32					mode;							/*! type, protection*/
 	SYSTEM_TIME				created_time;					/*! file creation time*/
 	SYSTEM_TIME				modified_time;					/*! file last modification time*/
+	UINT32					attribute_expire_ticks;			/*! attributes are fetched again from the FS after this tick*/
 	
 	LIST					hash_table_list;				/*! list for hash table - for faster retrieval*/
+	BYTE					hashed;							/*! vnode is in the hash table - protected by the vnode lock and hash lock*/
+	LIST					lru_list;						/*! links unreferenced vnodes in the vnode lru*/
 
 	UINT32					inode_number;					/*! inode number */
 	MOUNTED_FILE_SYSTEM_PTR	mounted_fs;						/*! mounted file system*/
@@ -27,14 +31,21 @@ struct vnode
 	
 	VM_UNIT_PTR				unit_head;						/*! head of link list of all the vm units associated with this vnode*/
 	
-	AVL_TREE_PTR			page_tree_head;					/*! head of tree of all the virtual pages associated with this vnode*/
+	RADIX_TREE				page_tree;						/*! radix tree of all the virtual pages associated with this vnode - indexed by page offset*/
+	UINT32					dirty_pages;					/*! number of modified pages in the page tree*/
+	LIST					dirty_list;						/*! links vnodes having modified pages in the mount - protected by mount flush lock*/
 };
 
 VNODE_PTR AllocateVnode();
 void ReleaseVnode(VNODE_PTR vnode);
 void ReferenceVnode(VNODE_PTR vnode, DIRECTORY_ENTRY_PTR de);
-void AddVnodeToHashTable(VNODE_PTR vnode);
-ERROR_CODE GetVnode(DIRECTORY_ENTRY_PTR de, VNODE_PTR * result);
+void InitVnodeHashTable();
+VNODE_PTR AddVnodeToHashTable(VNODE_PTR vnode);
+void PurgeMountVnodes(MOUNTED_FILE_SYSTEM_PTR mount);
+ERROR_CODE RevalidateVnodeAttributes(VNODE_PTR vnode);
+void UpdateVnodeAttributes(MOUNTED_FILE_SYSTEM_PTR mount, FILE_STAT_PARAM_PTR fsp);
+void InvalidateVnodeAttributes(VNODE_PTR vnode);
+ERROR_CODE GetVnode(DIRECTORY_ENTRY_PTR de, char * file_path, VNODE_PTR * result);
 VNODE_PTR GetVnodeFromFile(int file_id);
 
 int VnodeCacheConstructor(void * buffer);
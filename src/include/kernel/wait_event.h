@@ -8,12 +8,19 @@
 
 #include <ace.h>
 #include <ds/list.h>
+#include <sync/spinlock.h>
+#include <kernel/error.h>
 #include <kernel/pm/pm_types.h>
 
 #define WAIT_EVENT_WAKE_UP_ALL 1
 
-/*This is to make a list of related events */
-#define ADD_MULTIPLE_WAIT_EVENTS(event_head, new_event) AddToListTail( &(event_head->thread_events), &(new_event->thread_events) );
+/*This is to make a list of related events - should be done before the events are added to any queue */
+#define ADD_MULTIPLE_WAIT_EVENTS(event_head, new_event) AddToListTail( &((event_head)->thread_events), &((new_event)->thread_events) );
+
+/*! returns true if nobody is waiting on the given WAIT_QUEUE - a hint only, unless the queue lock is held*/
+#define IS_WAIT_QUEUE_EMPTY(wait_queue)	((wait_queue)->head == NULL)
+
+typedef struct wait_queue WAIT_QUEUE, * WAIT_QUEUE_PTR;
 
 struct wait_event
 {
@@ -21,11 +28,23 @@ struct wait_event
 	BYTE			fired;			/* Indicates if this event got fired(1) or just got removedi(0) because soe other related event fired */
 	LIST			in_queue;		/* List of events in this queue bucket. Each of these events will point to different threads. */
 	LIST			thread_events;	/* List of events which belong to same thread */
+	WAIT_QUEUE_PTR	queue;			/* WAIT_QUEUE in which this event is queued, NULL once the event is removed from it */
+};
+
+/*! Wait queue head with its own lock. 
+ * Events queued here are owned by the waiter and can be in its stack(see InitWaitEventOnStack())*/
+struct wait_queue
+{
+	SPIN_LOCK		lock;			/* Protects the queue and the events in it */
+	WAIT_EVENT_PTR	head;			/* First event in the queue */
 };
 
-WAIT_EVENT_PTR AddToEventQueue(WAIT_EVENT_PTR *wait_queue);
-UINT32 WaitForEvent(WAIT_EVENT_PTR event, UINT32 timeout);
-void WakeUpEvent(WAIT_EVENT_PTR *event, int flag);
-void RemoveEventFromQueue(WAIT_EVENT_PTR search_wait_event, WAIT_EVENT_PTR *wait_queue);
+void InitWaitQueue(WAIT_QUEUE_PTR wait_queue);
+void InitWaitEventOnStack(WAIT_EVENT_PTR event);
+void AddWaitEventToQueue(WAIT_QUEUE_PTR wait_queue, WAIT_EVENT_PTR event);
+ERROR_CODE WaitForWaitEvent(WAIT_EVENT_PTR event, UINT32 timeout);
+BOOLEAN RemoveWaitEvent(WAIT_EVENT_PTR event);
+void WakeUpWaitQueue(WAIT_QUEUE_PTR wait_queue, int flag);
+THREAD_PTR WakeUpWaitQueueForHandoff(WAIT_QUEUE_PTR wait_queue, int flag);
 
 #endif
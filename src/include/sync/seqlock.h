@@ -0,0 +1,34 @@
+/*!
+	\file		seqlock.h
+	\brief		sequence lock - architecture independ header
+	
+	Writers serialize on a spinlock and bump the sequence before and after the update. Readers dont take
+	any lock, they sample the sequence before reading and retry if it changed(or was odd) afterwards.
+*/
+
+#ifndef SEQLOCK__H
+#define SEQLOCK__H
+
+#include <sync/spinlock.h>
+
+typedef struct seqlock
+{
+	SPIN_LOCK				lock;				/*! serializes the writers*/
+	volatile unsigned long	sequence;			/*! odd while a writer is updating*/
+}SEQ_LOCK, * SEQ_LOCK_PTR;
+
+#ifdef __cplusplus
+    extern "C" {
+#endif
+
+void InitSeqLock(SEQ_LOCK_PTR seq_lock);
+void WriteSeqLock(SEQ_LOCK_PTR seq_lock);
+void WriteSeqUnlock(SEQ_LOCK_PTR seq_lock);
+unsigned long ReadSeqBegin(SEQ_LOCK_PTR seq_lock);
+int ReadSeqRetry(SEQ_LOCK_PTR seq_lock, unsigned long sequence);
+
+#ifdef __cplusplus
+	}
+#endif
+
+#endif
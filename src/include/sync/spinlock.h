@@ -12,6 +12,9 @@
 #define BIT_LOCK_SUCCESS 0
 #define BIT_LOCK_FAILURE 1
 
+/*! prevents the compiler from moving memory accesses across this point*/
+#define COMPILER_BARRIER()	asm volatile("" : : : "memory")
+
 typedef struct spinlock
 {
 	void * 			last_locker;		/*! address of the last locker*/
@@ -24,12 +27,15 @@ typedef struct spinlock
 
 inline void InitSpinLock(SPIN_LOCK_PTR pLockData);
 inline int SpinLock(SPIN_LOCK_PTR pLockData);
+inline int TrySpinLock(SPIN_LOCK_PTR pLockData);
 inline void SpinUnlock(SPIN_LOCK_PTR pLockData);
 
 inline int BitSpinLock(void * pLockData, int iPos);
 inline void BitSpinUnlock(void * pLockData, int iPos);
 inline int BitSpinLockTry(void * pLockData, int iPos);
 
+void MemoryBarrier();
+
 /*This function is called during spinlock timeout*/
 void SpinLockTimeout(SPIN_LOCK_PTR pLockData, void * caller);
 
@@ -0,0 +1,184 @@
+/*!
+\file	kernel/dpc.c
+\brief	Deferred procedure calls
+
+	Interrupt service routines should only acknowledge the device and capture its state. The rest of the
+	work is queued as a DPC on the interrupted processor and executed after the end of interrupt is sent,
+	with interrupts enabled, before the interrupted thread resumes. A processor drains its queue only once
+	at a time and the scheduler timer does not preempt a drain, so DPCs never run concurrently on a
+	processor and always run on the processor that queued them.
+*/
+
+#include <ace.h>
+#include <ds/list.h>
+#include <kernel/arch.h>
+#include <kernel/debug.h>
+#include <kernel/dpc.h>
+#include <kernel/processor.h>
+#include <kernel/pm/thread.h>
+
+extern inline UINT64 rdtsc();
+
+/*! Returns the current processor's DPC queue - interrupts should be disabled by the caller*/
+static DPC_QUEUE_PTR GetCurrentDpcQueue()
+{
+	PROCESSOR_PTR p = GET_CURRENT_PROCESSOR;
+	if ( p == NULL )
+		p = &processor[GetCurrentProcessorId()];
+	return &p->dpc_queue;
+}
+
+/*! Initializes a processor's DPC queue
+	\param queue - queue to initialize
+*/
+void InitDpcQueue(DPC_QUEUE_PTR queue)
+{
+	InitSpinLock( &queue->lock );
+	InitList( &queue->list );
+	queue->pending = 0;
+	queue->draining = FALSE;
+	queue->queued_count = 0;
+	queue->executed_count = 0;
+	queue->budget_exhausted_count = 0;
+	queue->max_drain_time = 0;
+}
+
+/*! Initializes a DPC
+	\param dpc - DPC to initialize
+	\param routine - function to call when the DPC runs
+	\param argument - argument passed to the routine
+*/
+void InitDpc(DPC_PTR dpc, DPC_ROUTINE routine, void * argument)
+{
+	assert( dpc != NULL && routine != NULL );
+	InitList( &dpc->list );
+	dpc->routine = routine;
+	dpc->argument = argument;
+	dpc->queued = 0;
+}
+
+/*! Queues a DPC on the current processor
+	Can be called from an interrupt service routine or a thread. The DPC runs when the current interrupt
+	returns or, if called from a thread, on the next interrupt on this processor.
+	\param dpc - DPC to queue
+	\return TRUE if queued, FALSE if the DPC was already waiting in a queue
+*/
+BOOLEAN QueueDpc(DPC_PTR dpc)
+{
+	DPC_QUEUE_PTR queue;
+	UINT32 flags, queued = 1;
+
+	assert( dpc != NULL && dpc->routine != NULL );
+	/*xchg with memory operand is always locked - only one caller can queue the DPC*/
+	asm volatile("xchgl %0, %1"
+				:"+r"(queued), "+m"(dpc->queued)
+				:
+				:"memory");
+	if ( queued )
+		return FALSE;
+
+	flags = DisableInterrupts();
+	queue = GetCurrentDpcQueue();
+	SpinLock( &queue->lock );
+	AddToListTail( &queue->list, &dpc->list );
+	queue->pending++;
+	queue->queued_count++;
+	SpinUnlock( &queue->lock );
+	RestoreInterrupts( flags );
+
+	return TRUE;
+}
+
+/*! Executes the DPCs queued on the current processor
+	Called by the interrupt handlers after the end of interrupt is sent. At most DPC_DRAIN_BUDGET DPCs
+	are executed, the remaining are left for the next interrupt so that a DPC storm can not starve the
+	interrupted thread. Interrupts are enabled while a DPC runs; a nested interrupt does not drain again.
+*/
+void DrainDpcQueue()
+{
+	DPC_QUEUE_PTR queue;
+	DPC_PTR dpc;
+	DPC_ROUTINE routine;
+	void * argument;
+	UINT32 flags, executed = 0;
+	UINT64 start, elapsed;
+
+	flags = DisableInterrupts();
+	queue = GetCurrentDpcQueue();
+	if ( queue->pending == 0 || queue->draining )
+	{
+		RestoreInterrupts( flags );
+		return;
+	}
+	queue->draining = TRUE;
+	start = rdtsc();
+
+	while( queue->pending && executed < DPC_DRAIN_BUDGET )
+	{
+		SpinLock( &queue->lock );
+		dpc = STRUCT_ADDRESS_FROM_MEMBER( queue->list.next, DPC, list );
+		RemoveFromList( &dpc->list );
+		queue->pending--;
+		SpinUnlock( &queue->lock );
+
+		/*the routine can queue the DPC again or free it*/
+		routine = dpc->routine;
+		argument = dpc->argument;
+		COMPILER_BARRIER();
+		dpc->queued = 0;
+
+		EnableInterrupts();
+		routine( dpc, argument );
+		DisableInterrupts();
+		executed++;
+	}
+
+	queue->executed_count += executed;
+	if ( queue->pending )
+		queue->budget_exhausted_count++;
+	elapsed = rdtsc() - start;
+	if ( elapsed > queue->max_drain_time )
+		queue->max_drain_time = elapsed;
+	queue->draining = FALSE;
+
+	RestoreInterrupts( flags );
+}
+
+/*! Returns TRUE if the current processor is executing DPCs*/
+BOOLEAN IsDpcQueueDraining()
+{
+	BOOLEAN draining;
+	UINT32 flags;
+
+	flags = DisableInterrupts();
+	draining = GetCurrentDpcQueue()->draining;
+	RestoreInterrupts( flags );
+	return draining;
+}
+
+/*! Returns the DPC counters of a processor
+	\param processor_id - processor to query
+	\param statistics - counters are copied here
+*/
+ERROR_CODE GetDpcStatistics(int processor_id, DPC_STATISTICS_PTR statistics)
+{
+	DPC_QUEUE_PTR queue;
+	UINT32 flags;
+
+	if ( processor_id < 0 || processor_id >= MAX_PROCESSORS || statistics == NULL )
+		return ERROR_INVALID_PARAMETER;
+	queue = &processor[processor_id].dpc_queue;
+
+	/*the processor's interrupt handlers take the same lock*/
+	flags = DisableInterrupts();
+	SpinLock( &queue->lock );
+	statistics->pending = queue->pending;
+	statistics->queued_count = queue->queued_count;
+	statistics->executed_count = queue->executed_count;
+	statistics->budget_exhausted_count = queue->budget_exhausted_count;
+	statistics->max_drain_time = queue->max_drain_time;
+	SpinUnlock( &queue->lock );
+	RestoreInterrupts( flags );
+
+	return ERROR_SUCCESS;
+}
@@ -6,6 +6,7 @@
 #include <kernel/arch.h>
 #include <kernel/parameter.h>
 #include <kernel/pm/thread.h>
+#include <kernel/system_call_handler.h>
 #include <kernel/i386/i386.h>
 
 extern void InitInterruptControllers();
@@ -86,4 +87,7 @@ void InitArchPhase2(MULTIBOOT_INFO_PTR mbi)
 	
 	/* Load TSS so that we can switch to user mode*/
 	LoadTss();
+	
+	/* Enable sysenter - uses the TSS for the kernel stack*/
+	SetupFastSystemCall();
 }
@@ -43,6 +43,27 @@ void KtracePrint(void * arg, char ch)
 	#endif
 }
 
+/*! Writes binary ktrace data to the serial/parallel port
+	VGA is skipped because the data is not printable.
+	\param data - bytes to write
+	\param length - number of bytes
+*/
+void KtraceWrite(void * data, UINT32 length)
+{
+	BYTE * ch = (BYTE *)data;
+
+	while( length-- )
+	{
+		#ifdef KTRACE_PRINT_PARALLEL
+			WriteParallelPort(KTRACE_PARALLEL_PORT, *ch);
+		#endif
+		#ifdef KTRACE_PRINT_SERIAL
+			SerialWriteCharacter(KTRACE_SERIAL_PORT, *ch);
+		#endif
+		ch++;
+	}
+}
+
 /*! Intialize the ktrace functionality
 */
 void InitKtrace()
@@ -103,3 +103,28 @@ void SendEndOfInterrupt(int int_no)
 	else
 		SendEndOfInterruptToLapic(int_no);
 }
+
+/*! Disables interrupts on the current processor
+	\return eflags before disabling - pass it to RestoreInterrupts()
+*/
+UINT32 DisableInterrupts()
+{
+	UINT32 flags;
+	asm volatile("pushfl; popl %0; cli" : "=r"(flags) : : "memory");
+	return flags;
+}
+
+/*! Enables interrupts on the current processor*/
+void EnableInterrupts()
+{
+	asm volatile("sti" : : : "memory");
+}
+
+/*! Restores the interrupt flag saved by DisableInterrupts()
+	\param flags - eflags returned by DisableInterrupts()
+*/
+void RestoreInterrupts(UINT32 flags)
+{
+	if ( flags & EFLAG_IF )
+		asm volatile("sti" : : : "memory");
+}
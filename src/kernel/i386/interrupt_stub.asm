@@ -6,9 +6,11 @@ extern ExceptionHandler
 extern PageFaultHandler
 extern GeneralProtectionFaultHandler
 extern InterruptHandler
+extern FastSystemCallHandler
 extern SetIdtGate
 extern SetIdtTaskGate
 global ReturnFromInterruptContext
+global SysenterEntry
 
 global SetupInterruptStubs
 global SetupExceptionStubs
@@ -76,6 +78,65 @@ ReturnFromInterruptContext:
 	iret													; return from interrupt context - pops 5 things at once: CS, EIP, EFLAGS, SS, and ESP!
 	
 
+;SYSENTER entry point - IA32_SYSENTER_ESP points to the esp0 field of the processor's TSS, so the first instruction switches
+;to the current thread's kernel stack. The user stub pushes its return address and passes the stack pointer in ebp.
+;The same frame as int 0x80 is built, so REGS based code works unchanged; FastSystemCallHandler fills the user eip/esp.
+SysenterEntry:
+	mov esp, [esp]											; Kernel stack of the current thread
+	
+	push dword USER_DATA_SELECTOR | USER_PRIVILEGE_LEVEL	; Build the frame the processor pushes for int 0x80 - ss
+	push ebp												; user esp
+	pushfd													; eflags - sysenter clears IF, the user had it set
+	or dword [esp], EFLAG_IF
+	and dword [esp], ~EFLAG_TF
+	push dword USER_CODE_SELECTOR | USER_PRIVILEGE_LEVEL	; cs
+	push dword 0											; eip
+	push dword 0											; error code
+	push dword SYSTEM_CALL_VECTOR							; interrupt number
+	
+	pusha													; Save the same state as IsrStubMacro
+	push ds
+	push es
+	push fs
+	push gs
+	mov eax, cr3
+	push eax
+	mov eax, cr2
+	push eax
+	push dword 0
+	mov eax, cr0
+	push eax
+	
+	mov ax, KERNEL_DATA_SELECTOR
+	mov ds, ax
+	mov es, ax
+	mov fs, ax
+	mov gs, ax
+	sti
+	
+	mov eax, esp
+	push eax
+	call FastSystemCallHandler
+	
+	cli														; Nothing can interrupt between restoring the user state and sysexit
+	add esp, 16												; Clean up the pushed stack pointer and cr0, cr1, cr2
+	pop eax													; The page directory does not change across a system call
+	
+	pop gs
+	pop fs
+	pop es
+	pop ds
+	popa
+	
+	add esp, 8												; Pop interrupt number and error code
+	mov edx, [esp]											; sysexit returns to edx with the stack pointer in ecx
+	mov ecx, [esp+12]
+	add esp, 8
+	and dword [esp], ~EFLAG_IF								; eflags of the user - interrupts are enabled by sti, whose
+	popfd													; one instruction delay covers the sysexit
+	sti
+	sysexit
+
 ;Install the stub as interrupt gates
 ;Parameters
 %macro SetIdtGateMacro 4
@@ -7,6 +7,7 @@
 #include <kernel/multiboot.h>
 #include <kernel/debug.h>
 #include <kernel/arch.h>
+#include <kernel/wait_event.h>
 #include <kernel/mm/vm.h>
 #include <kernel/mm/virtual_page.h>
 #include <kernel/mm/pmem.h>
@@ -26,7 +27,24 @@ PHYSICAL_MAP kernel_physical_map;
 
 CACHE physical_map_cache;
 
+/*! kernel va used to access a physical page which is not mapped in the current address space*/
+static VADDR physical_page_window = NULL;
+/*! serializes the users of the physical page window*/
+static SPIN_LOCK physical_page_window_lock;
+
+/*! number of copy windows - unlike the physical page window a copy window can be held across a page fault*/
+#define PHYSICAL_COPY_WINDOWS	16
+/*! kernel va range of the copy windows*/
+static VADDR physical_copy_windows = NULL;
+/*! bitmap of the copy windows in use*/
+static UINT32 physical_copy_windows_used = 0;
+/*! protects physical_copy_windows_used*/
+static SPIN_LOCK physical_copy_window_lock;
+/*! threads waiting for a copy window*/
+static WAIT_QUEUE physical_copy_window_wait_queue;
+
 static void CreatePageTable(PHYSICAL_MAP_PTR pmap, UINT32 va );
+static PAGE_TABLE_ENTRY_PTR MapPageTableEntry(PHYSICAL_MAP_PTR pmap, VADDR va, BOOLEAN * window_used);
 
 /*! Creates a new physical map and allocate page directory for it
 	\param vmap - Virtual map for which physical map needs to be created
@@ -403,6 +421,230 @@ ERROR_CODE MarkPageForCOW(VIRTUAL_PAGE_PTR vp)
 	return ERROR_SUCCESS;
 }
 
+/*! Reserves a kernel virtual page which is used to temporarily access any physical page
+	\note This function should be called in kernel map context(boot thread or kernel thread) before any user map is created, 
+	because the page table created here should be shared by all physical maps.
+*/
+void InitPhysicalPageWindow()
+{
+	VADDR pa;
+	int i;
+	
+	InitSpinLock( &physical_page_window_lock );
+	if ( AllocateVirtualMemory(&kernel_map, &physical_page_window, 0, PAGE_SIZE, PROT_READ|PROT_WRITE, VM_UNIT_FLAG_PRIVATE, NULL) != ERROR_SUCCESS )
+		panic("Unable to allocate physical page window");
+	
+	/*create the page table for the window now, later the window is remapped without allocating anything*/
+	if ( TranslatePaFromVa( (VADDR)kernel_page_directory, &pa ) == VA_NOT_EXISTS )
+		panic("kernel page directory is not mapped");
+	CreatePhysicalMapping( &kernel_physical_map, physical_page_window, pa, PROT_READ );
+	PT_SELF_MAP_PAGE_TABLE1_PTE(physical_page_window)->all = 0;
+	InvalidateTlb( (void *)physical_page_window );
+	
+	/*same for the copy windows*/
+	InitSpinLock( &physical_copy_window_lock );
+	InitWaitQueue( &physical_copy_window_wait_queue );
+	if ( AllocateVirtualMemory(&kernel_map, &physical_copy_windows, 0, PHYSICAL_COPY_WINDOWS * PAGE_SIZE, PROT_READ|PROT_WRITE, VM_UNIT_FLAG_PRIVATE, NULL) != ERROR_SUCCESS )
+		panic("Unable to allocate physical copy windows");
+	for(i=0; i<PHYSICAL_COPY_WINDOWS; i++)
+	{
+		VADDR window = physical_copy_windows + i * PAGE_SIZE;
+		CreatePhysicalMapping( &kernel_physical_map, window, pa, PROT_READ );
+		PT_SELF_MAP_PAGE_TABLE1_PTE(window)->all = 0;
+		InvalidateTlb( (void *)window );
+	}
+}
+
+/*! Maps the given physical page at the physical page window and returns the window address
+	\param pa - physical address of the page
+	\return kernel virtual address where the page is mapped
+	\note The window should be released by calling UnmapPhysicalPageWindow() and the caller should not sleep in between.
+*/
+void * MapPhysicalPageWindow(UINT32 pa)
+{
+	PAGE_TABLE_ENTRY_PTR pte;
+	
+	assert( physical_page_window != NULL );
+	SpinLock( &physical_page_window_lock );
+	
+	pte = PT_SELF_MAP_PAGE_TABLE1_PTE(physical_page_window);
+	assert( !pte->present );
+	pte->all = PAGE_ALIGN(pa) | KERNEL_PTE_FLAG;
+	InvalidateTlb( (void *)physical_page_window );
+	
+	return (void *)physical_page_window;
+}
+
+/*! Unmaps the physical page window which was mapped by MapPhysicalPageWindow()
+*/
+void UnmapPhysicalPageWindow()
+{
+	PAGE_TABLE_ENTRY_PTR pte;
+	
+	pte = PT_SELF_MAP_PAGE_TABLE1_PTE(physical_page_window);
+	pte->all = 0;
+	InvalidateTlb( (void *)physical_page_window );
+	
+	SpinUnlock( &physical_page_window_lock );
+}
+
+/*! Maps the given physical page at a free copy window and returns the window address
+	\param pa - physical address of the page
+	\return kernel virtual address where the page is mapped
+	\note No lock is held while the window is mapped, so the caller can copy between the page and memory which may fault.
+		The window should be released by calling UnmapPhysicalPageCopyWindow(). If all the windows are in use the caller waits.
+	\todo - the window is invalidated only in the current processor's TLB like the other kernel mappings
+*/
+void * MapPhysicalPageCopyWindow(UINT32 pa)
+{
+	PAGE_TABLE_ENTRY_PTR pte;
+	WAIT_EVENT event;
+	VADDR window;
+	int i;
+	
+	assert( physical_copy_windows != NULL );
+	while( 1 )
+	{
+		SpinLock( &physical_copy_window_lock );
+		for(i=0; i<PHYSICAL_COPY_WINDOWS; i++)
+			if ( !(physical_copy_windows_used & (1<<i)) )
+				break;
+		if ( i < PHYSICAL_COPY_WINDOWS )
+		{
+			physical_copy_windows_used |= (1<<i);
+			SpinUnlock( &physical_copy_window_lock );
+			break;
+		}
+		/*the event is added under the lock, so a window released after the scan wakes us up*/
+		InitWaitEventOnStack( &event );
+		AddWaitEventToQueue( &physical_copy_window_wait_queue, &event );
+		SpinUnlock( &physical_copy_window_lock );
+		WaitForWaitEvent( &event, 0 );
+	}
+	
+	window = physical_copy_windows + i * PAGE_SIZE;
+	pte = PT_SELF_MAP_PAGE_TABLE1_PTE(window);
+	assert( !pte->present );
+	pte->all = PAGE_ALIGN(pa) | KERNEL_PTE_FLAG;
+	InvalidateTlb( (void *)window );
+	
+	return (void *)window;
+}
+
+/*! Unmaps and releases a copy window mapped by MapPhysicalPageCopyWindow()
+	\param window - address returned by MapPhysicalPageCopyWindow()
+*/
+void UnmapPhysicalPageCopyWindow(void * window)
+{
+	PAGE_TABLE_ENTRY_PTR pte;
+	int i = ((VADDR)window - physical_copy_windows) / PAGE_SIZE;
+	
+	assert( i >= 0 && i < PHYSICAL_COPY_WINDOWS );
+	pte = PT_SELF_MAP_PAGE_TABLE1_PTE((VADDR)window);
+	pte->all = 0;
+	InvalidateTlb( window );
+	
+	SpinLock( &physical_copy_window_lock );
+	physical_copy_windows_used &= ~(1<<i);
+	SpinUnlock( &physical_copy_window_lock );
+	WakeUpWaitQueue( &physical_copy_window_wait_queue, WAIT_EVENT_WAKE_UP_ALL );
+}
+
+/*! Returns page table entry pointer for a given va in any physical map
+	\param pmap - physical map
+	\param va - virtual address
+	\param window_used - set to TRUE if the page table is accessed through the physical page window
+	\return page table entry pointer or NULL if the page table is not present
+	\note if window_used is set, UnmapPhysicalPageWindow() should be called after accessing the pte
+*/
+static PAGE_TABLE_ENTRY_PTR MapPageTableEntry(PHYSICAL_MAP_PTR pmap, VADDR va, BOOLEAN * window_used)
+{
+	PAGE_DIRECTORY_ENTRY pde;
+	PAGE_TABLE_ENTRY_PTR page_table;
+	
+	*window_used = FALSE;
+	pde = pmap->page_directory[PAGE_DIRECTORY_ENTRY_INDEX(va)];
+	if ( !pde.present )
+		return NULL;
+	
+	/*kernel page tables are shared and current map page tables are available through self map*/
+	if ( IS_KERNEL_ADDRESS(va) || pmap == GetCurrentVirtualMap()->physical_map )
+		return PT_SELF_MAP_PAGE_TABLE1_PTE(va);
+	
+	page_table = (PAGE_TABLE_ENTRY_PTR)MapPhysicalPageWindow( PFN_TO_PA(pde.page_table_pfn) );
+	*window_used = TRUE;
+	return &page_table[PAGE_TABLE_ENTRY_INDEX(va)];
+}
+
+/*! Returns accessed/dirty status of a virtual address mapping and optionally clears the status
+	\param pmap - physical map which has the mapping
+	\param va - virtual address
+	\param clear_status - PAGE_STATUS_ACCESSED and/or PAGE_STATUS_DIRTY to clear after reading
+	\return PAGE_STATUS_ACCESSED and/or PAGE_STATUS_DIRTY; 0 if no mapping is present
+	\todo - Initiate IPI to other CPUs to flush TLB when a foreign map status is cleared
+*/
+UINT32 GetPhysicalMappingStatus(PHYSICAL_MAP_PTR pmap, VADDR va, UINT32 clear_status)
+{
+	PAGE_TABLE_ENTRY_PTR pte;
+	BOOLEAN window_used;
+	UINT32 status = 0, clear_mask = 0;
+	
+	pte = MapPageTableEntry( pmap, va, &window_used );
+	if ( pte != NULL && pte->present )
+	{
+		if ( pte->accessed )
+			status |= PAGE_STATUS_ACCESSED;
+		if ( pte->dirty )
+			status |= PAGE_STATUS_DIRTY;
+		
+		if ( clear_status & status & PAGE_STATUS_ACCESSED )
+			clear_mask |= PAGE_ACCESSED;
+		if ( clear_status & status & PAGE_STATUS_DIRTY )
+			clear_mask |= PAGE_DIRTY;
+		/*processor might set these bits in parallel so clear atomically*/
+		if ( clear_mask )
+			asm volatile("lock andl %1, %0" : "+m"(pte->all) : "r"(~clear_mask) );
+	}
+	if ( window_used )
+		UnmapPhysicalPageWindow();
+	if ( clear_mask )
+		InvalidateTlb( (void *)va );
+	
+	return status;
+}
+
+/*! Removes the virtual address mapping from any physical map and returns the final accessed/dirty status of the mapping
+	\param pmap - physical map which has the mapping
+	\param va - virtual address
+	\return PAGE_STATUS_ACCESSED and/or PAGE_STATUS_DIRTY before removing the mapping
+	\todo - Initiate IPI to other CPUs to flush TLB when a foreign map is modified
+*/
+UINT32 RevokePhysicalMapping(PHYSICAL_MAP_PTR pmap, VADDR va)
+{
+	PAGE_TABLE_ENTRY_PTR pte;
+	PAGE_TABLE_ENTRY old_pte;
+	BOOLEAN window_used;
+	UINT32 status = 0;
+	
+	old_pte.all = 0;
+	pte = MapPageTableEntry( pmap, va, &window_used );
+	if ( pte != NULL && pte->present )
+	{
+		/*exchange the entry so that a dirty bit set by the processor in parallel is not lost*/
+		asm volatile("xchgl %0, %1" : "=r"(old_pte.all), "+m"(pte->all) : "0"(0) );
+		if ( old_pte.accessed )
+			status |= PAGE_STATUS_ACCESSED;
+		if ( old_pte.dirty )
+			status |= PAGE_STATUS_DIRTY;
+	}
+	if ( window_used )
+		UnmapPhysicalPageWindow();
+	if ( old_pte.present )
+		InvalidateTlb( (void *)va );
+	
+	return status;
+}
+
 /*! Internal function used to initialize the physical map structure*/
 int PhysicalMapCacheConstructor( void *buffer)
 {
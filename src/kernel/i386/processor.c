@@ -6,6 +6,7 @@
 #include <kernel/arch.h>
 #include <kernel/parameter.h>
 #include <kernel/pm/thread.h>
+#include <kernel/system_call_handler.h>
 #include <kernel/i386/i386.h>
 
 extern UINT32 trampoline_data, trampoline_end;
@@ -135,6 +136,9 @@ void SecondaryCpuStart()
 
 	/* Load TSS so that we can switch to user mode*/
 	LoadTss();
+	
+	/* Enable sysenter - uses the TSS for the kernel stack*/
+	SetupFastSystemCall();
 
 	/* Start the architecture depended timer for secondary processor - to enable scheduler */
 	StartTimer(SCHEDULER_DEFAULT_QUANTUM, TRUE);
@@ -9,45 +9,102 @@
 #include <kernel/system_call_handler.h>
 #include <kernel/interrupt.h>
 #include <kernel/mm/kmem.h>
+#include <kernel/mm/vm.h>
+#include <kernel/i386/i386.h>
 
 #define SYSTEM_CALL_INTERRUPT_NUMBER (0x80-32)
 
-/*! Handles the system call interrupt
-	\param interrupt_info - passed by the generic ISR code - contains the register state at the time of system call raised
-	\param arg - not used
+/*! model specific registers used by the sysenter instruction*/
+#define IA32_SYSENTER_CS		0x174
+#define IA32_SYSENTER_ESP		0x175
+#define IA32_SYSENTER_EIP		0x176
+
+/*! Entry point of sysenter - kernel/i386/interrupt_stub.asm*/
+extern void SysenterEntry();
+
+/*! Writes a model specific register of the current processor*/
+#define WRITE_MSR(msr, value)	asm volatile("wrmsr" : : "c"(msr), "a"((UINT32)(value)), "d"(0))
+
+/*! Calls the system call requested by the given register state
+	\param regs - register state at the time of system call - the result is updated here
 	\note The following registers are used as input
 			eax = system call number
 			ebx, ecx, edx, esi, edi contains 5 arguments 0-4.
 		   The following registers are used as output
 			eax = return value
 			ebx = error code
- */
-ISR_RETURN_CODE SystemCallHandler(INTERRUPT_INFO_PTR interrupt_info, void * arg)
+*/
+static inline void DispatchSystemCall(REGS_PTR regs)
 {
 	int sys_call_no;
 	SYSTEM_CALL_ARGS sys_call_args;
 
-	sys_call_no = interrupt_info->regs->eax;
+	sys_call_no = regs->eax;
 	
 	if( !VALUE_WITH_IN_RANGE(0, max_system_calls, sys_call_no) )
 	{
 		KTRACE("sys_call_no out of limit %d\n", sys_call_no);
-		return ISR_END_PROCESSING;
+		return;
 	}		
 
-	sys_call_args.args[0] = interrupt_info->regs->ebx;
-	sys_call_args.args[1] = interrupt_info->regs->ecx;
-	sys_call_args.args[2] = interrupt_info->regs->edx;
-	sys_call_args.args[3] = interrupt_info->regs->esi;
-	sys_call_args.args[4] = interrupt_info->regs->edi;
+	sys_call_args.args[0] = regs->ebx;
+	sys_call_args.args[1] = regs->ecx;
+	sys_call_args.args[2] = regs->edx;
+	sys_call_args.args[3] = regs->esi;
+	sys_call_args.args[4] = regs->edi;
 
 	/*now call the required system call*/
-	interrupt_info->regs->ebx = (system_calls[sys_call_no])(&sys_call_args, &interrupt_info->regs->eax); /* ebx will tell if system call succeeded(0) or not */
+	regs->ebx = (system_calls[sys_call_no])(&sys_call_args, &regs->eax); /* ebx will tell if system call succeeded(0) or not */
+}
+
+/*! Handles the system call interrupt
+	\param interrupt_info - passed by the generic ISR code - contains the register state at the time of system call raised
+	\param arg - not used
+	\note see DispatchSystemCall() for the register usage
+ */
+ISR_RETURN_CODE SystemCallHandler(INTERRUPT_INFO_PTR interrupt_info, void * arg)
+{
+	DispatchSystemCall( interrupt_info->regs );
 
 	return ISR_END_PROCESSING;
 }
 
+/*! Handles a system call raised through sysenter - called from SysenterEntry
+	There is no interrupt to acknowledge, so the generic interrupt handler and the EOI are skipped.
+	\param regs - frame built by SysenterEntry - ebp holds the user stack pointer, which has the return address on top
+ */
+void FastSystemCallHandler(REGS_PTR regs)
+{
+	VADDR user_stack = regs->useresp;
+
+	/*a bad stack pointer gets an invalid return address, so the task faults in user mode instead of the kernel reading its memory*/
+	if ( user_stack >= KERNEL_MAP_START_VA - sizeof(UINT32) )
+	{
+		regs->eip = 0;
+		return;
+	}
+	regs->eip = *(UINT32 *)user_stack;
+	regs->useresp = user_stack + sizeof(UINT32);
+
+	DispatchSystemCall( regs );
+}
+
 void SetupSystemCallHandler(void)
 {
 	InstallInterruptHandler(SYSTEM_CALL_INTERRUPT_NUMBER, &SystemCallHandler, 0);
 }
+
+/*! Programs the sysenter MSRs of the current processor
+	Should be called after LoadTss() - sysenter loads its stack pointer from the TSS of the processor.
+*/
+void SetupFastSystemCall(void)
+{
+	int cpu = GetCurrentProcessorId();
+
+	if ( !CPU_FEATURE_SYSENTER(cpu) )
+		return;
+
+	WRITE_MSR( IA32_SYSENTER_CS, KERNEL_CODE_SELECTOR );
+	WRITE_MSR( IA32_SYSENTER_ESP, &processor_i386[cpu].tss.esp0 );
+	WRITE_MSR( IA32_SYSENTER_EIP, SysenterEntry );
+}
@@ -62,6 +62,7 @@ void InterruptHandler(REGS_PTR reg)
 	INTERRUPT_INFO interrupt_info;
 	INTERRUPT_HANDLER_PTR handler;
 	LIST_PTR tmp;
+	ISR_RETURN_CODE result;
 
 #if ARCH == i386
 	/*! In x86 the first 32 interrupts are exceptions and they are handled separately, so decrement by 32 to get correct interrupt number*/
@@ -80,17 +81,27 @@ void InterruptHandler(REGS_PTR reg)
 	}
 	else
 	{
-		if ( handler->isr(&interrupt_info, handler->isr_argument) == ISR_CONTINUE_PROCESSING )
+		result = handler->isr(&interrupt_info, handler->isr_argument);
+		if ( result == ISR_CONTINUE_PROCESSING )
 		{
 			LIST_FOR_EACH(tmp, &interrupt_handlers[reg->int_no].next_isr )
 			{
 				handler = STRUCT_ADDRESS_FROM_MEMBER(tmp, INTERRUPT_HANDLER, next_isr );
-				if ( handler->isr(&interrupt_info, handler->isr_argument) != ISR_CONTINUE_PROCESSING )
+				result = handler->isr(&interrupt_info, handler->isr_argument);
+				if ( result != ISR_CONTINUE_PROCESSING )
 					break;
 			}
 		}
+		if ( result == ISR_QUEUE_DPC )
+		{
+			assert( handler->dpc != NULL );
+			QueueDpc( handler->dpc );
+		}
 	}
 	SendEndOfInterrupt( reg->int_no );
+	
+	/*run the bottom halves before returning to the interrupted thread*/
+	DrainDpcQueue();
 }
 
 /*! Installs a custom IRQ handler for the given IRQ 
@@ -99,6 +110,17 @@ void InterruptHandler(REGS_PTR reg)
  * \param custom_argument - argument to be passed when the handler is called along with interrupt context
  */
 void InstallInterruptHandler(int interrupt_number, ISR_HANDLER isr_handler, void * custom_argument)
+{
+	InstallInterruptHandlerWithDpc( interrupt_number, isr_handler, custom_argument, NULL );
+}
+
+/*! Installs a custom IRQ handler with a bottom half
+ * \param interrupt_number - interrupt number
+ * \param isr_handler	- handler for the interrupt number
+ * \param custom_argument - argument to be passed when the handler is called along with interrupt context
+ * \param dpc - DPC queued when the handler returns ISR_QUEUE_DPC - owned by the caller, NULL if the handler does not return ISR_QUEUE_DPC
+ */
+void InstallInterruptHandlerWithDpc(int interrupt_number, ISR_HANDLER isr_handler, void * custom_argument, DPC_PTR dpc)
 {
 	INTERRUPT_HANDLER_PTR handler;
 	if ( interrupt_handlers[interrupt_number].isr == NULL )
@@ -114,6 +136,7 @@ void InstallInterruptHandler(int interrupt_number, ISR_HANDLER isr_handler, void
 	}
 	handler->isr = isr_handler;
 	handler->isr_argument = custom_argument;
+	handler->dpc = dpc;
 }
 
 /*!  This clears the handler for a given IRQ 
@@ -133,10 +156,12 @@ void UninstallInterruptHandler(int interrupt_number, ISR_HANDLER isr_handler)
 		{
 			interrupt_handlers[interrupt_number].isr = NULL;
 			interrupt_handlers[interrupt_number].isr_argument = NULL;
+			interrupt_handlers[interrupt_number].dpc = NULL;
 			return;
 		}
 		interrupt_handlers[interrupt_number].isr = new_handler->isr;
 		interrupt_handlers[interrupt_number].isr_argument = new_handler->isr;
+		interrupt_handlers[interrupt_number].dpc = new_handler->dpc;
 		RemoveFromList( &new_handler->next_isr);
 		kfree( new_handler );
 	}
@@ -162,6 +187,7 @@ static void InitInterruptHandler(INTERRUPT_HANDLER_PTR handler)
 {
 	handler->isr = NULL;
 	handler->isr_argument = NULL;
+	handler->dpc = NULL;
 	InitList( &handler->next_isr );
 }
 
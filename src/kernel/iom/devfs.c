@@ -16,6 +16,8 @@
 #include <kernel/pm/pm_types.h>
 #include <kernel/pm/thread.h>
 #include <kernel/pm/scheduler.h>
+#include <kernel/pit.h>
+#include <kernel/printf.h>
 #include <kernel/vfs/vfs.h>
 
 /*! User friendly name of the device fs*/
@@ -36,6 +38,14 @@ AVL_TREE_PTR	devfs_root=NULL;
 /*! total device files*/
 static int devfs_total_directory_entries=0;
 
+/*! bytes to write in the boot time device IO benchmark - 0 disables the benchmark*/
+UINT32 device_io_benchmark_bytes=0;
+
+/*! device written by the device IO benchmark*/
+#define DEVICE_IO_BENCHMARK_DEVICE			"Null"
+/*! size of a single write in the device IO benchmark*/
+#define DEVICE_IO_BENCHMARK_CHUNK_SIZE		(64*1024)
+
 /*! cache for devfs metadata*/
 CACHE	devfs_cache;
 
@@ -95,6 +105,8 @@ void InitDevFs()
 		KPRINTF("%s\n", ERROR_CODE_AS_STRING(ret) );
 		panic( "devfs mount failed" );
 	}
+	/*device read/write should reach the driver immediately*/
+	GetMount( DEV_FS_MOUNT_PATH )->flags |= MOUNT_FLAG_NO_CACHE;
 }
 
 /*! DevFs thread
@@ -194,10 +206,22 @@ static void ProcessVfsMessage( MESSAGE_TYPE message_type, VFS_IPC vfs_id, IPC_AR
 UINT32 ReadWriteDeviceCompletionRoutine(DEVICE_OBJECT_PTR device_object, IRP_PTR irp, void * context)
 {
 	assert(context != NULL );
-	WakeUpEvent( context, WAIT_EVENT_WAKE_UP_ALL);
+	WakeUpWaitQueue( context, WAIT_EVENT_WAKE_UP_ALL);
 	return 0;
 }
 
+/*! Returns the address space of the buffer passed in the current request
+	Requests from the VFS are served by the devfs thread, so the buffer belongs to the thread which sent the message.
+*/
+static VIRTUAL_MAP_PTR GetRequestorVirtualMap()
+{
+	THREAD_PTR thread = GetCurrentThread();
+	
+	if ( thread->ipc_reply_to_thread != NULL )
+		return thread->ipc_reply_to_thread->task->virtual_map;
+	return GetCurrentVirtualMap();
+}
+
 /*! Read/write devfs file
  * \param device_object - device object of the /dev/xxx file
  * \param user_buffer - buffer
@@ -212,7 +236,8 @@ ERROR_CODE ReadWriteDevice(DEVICE_OBJECT_PTR device_object, void * user_buffer,
 {
 	IRP_PTR irp;
 	IRP_MJ op;
-	WAIT_EVENT_PTR wait_event, wait_queue=NULL;
+	WAIT_EVENT wait_event;
+	WAIT_QUEUE wait_queue;
 	ERROR_CODE ret = ERROR_SUCCESS;
 	
 	assert( device_object != NULL );
@@ -228,6 +253,8 @@ ERROR_CODE ReadWriteDevice(DEVICE_OBJECT_PTR device_object, void * user_buffer,
 	FillIoStack( irp->current_stack_location, op, 0, device_object, NULL, NULL);
 	irp->current_stack_location->parameters.read_write.byte_offset = offset;
 	irp->current_stack_location->parameters.read_write.length = length;
+	irp->system_buffer = NULL;
+	irp->mdl_address = NULL;
 	/*setup the buffers based on buffering mode*/
 	if( device_object->flags & DO_BUFFERED_IO )
 	{
@@ -245,15 +272,30 @@ ERROR_CODE ReadWriteDevice(DEVICE_OBJECT_PTR device_object, void * user_buffer,
 				goto done;
 		}
 	}
+	else if( device_object->flags & DO_DIRECT_IO )
+	{
+		/*lock the caller's pages instead of copying - a device read writes into the buffer*/
+		irp->mdl_address = AllocateMdl( user_buffer, length );
+		if( irp->mdl_address == NULL )
+		{
+			ret = length ? ERROR_NOT_ENOUGH_MEMORY : ERROR_INVALID_PARAMETER;
+			goto done;
+		}
+		ret = ProbeAndLockPages( irp->mdl_address, GetRequestorVirtualMap(), !is_write );
+		if ( ret != ERROR_SUCCESS )
+			goto done;
+	}
 	else
-		panic("Only buffered IO is supported for now!");
+		panic("DO_NEITHER_IO is not supported for now!");
 	
 	/*if the caller didnt give a completion routine, perform a sync operation*/
 	if( completion_rountine == NULL )
 	{
 		/*create a completion event and wait for it, this event will be triggered by the completion_rountine */
-		wait_event = AddToEventQueue( &wait_queue );
-		SetIrpCompletionRoutine( irp, ReadWriteDeviceCompletionRoutine, wait_event, IRP_COMPLETION_INVOKE_ON_SUCCESS | IRP_COMPLETION_INVOKE_ON_ERROR | IRP_COMPLETION_INVOKE_ON_CANCEL );
+		InitWaitQueue( &wait_queue );
+		InitWaitEventOnStack( &wait_event );
+		AddWaitEventToQueue( &wait_queue, &wait_event );
+		SetIrpCompletionRoutine( irp, ReadWriteDeviceCompletionRoutine, &wait_queue, IRP_COMPLETION_INVOKE_ON_SUCCESS | IRP_COMPLETION_INVOKE_ON_ERROR | IRP_COMPLETION_INVOKE_ON_CANCEL );
 	}
 	else
 		SetIrpCompletionRoutine( irp, completion_rountine, completion_rountine_context, IRP_COMPLETION_INVOKE_ON_SUCCESS | IRP_COMPLETION_INVOKE_ON_ERROR | IRP_COMPLETION_INVOKE_ON_CANCEL );
@@ -263,6 +305,8 @@ ERROR_CODE ReadWriteDevice(DEVICE_OBJECT_PTR device_object, void * user_buffer,
 	/*\todo - what about pending?*/
 	if ( irp->io_status.status != ERROR_SUCCESS )
 	{
+		if( completion_rountine == NULL )
+			RemoveWaitEvent( &wait_event );
 		ret = irp->io_status.status;
 		goto done;
 	}
@@ -270,7 +314,7 @@ ERROR_CODE ReadWriteDevice(DEVICE_OBJECT_PTR device_object, void * user_buffer,
 	/*wait for the event*/
 	if( completion_rountine == NULL )
 	{
-		WaitForEvent(wait_event, 0);
+		WaitForWaitEvent( &wait_event, 0 );
 	}
 		
 	/*number of bytes read/written*/
@@ -283,6 +327,10 @@ ERROR_CODE ReadWriteDevice(DEVICE_OBJECT_PTR device_object, void * user_buffer,
 	}
 	
 done:
+	if ( irp->system_buffer )
+		kfree( irp->system_buffer );
+	if ( irp->mdl_address )
+		FreeMdl( irp->mdl_address );
 	FreeIrp( irp );
 	return ret;
 }
@@ -315,6 +363,79 @@ ERROR_CODE CreateDeviceNode(const char * filename, DEVICE_OBJECT_PTR device)
 	return ERROR_SUCCESS;
 }
 
+/*! Returns the device object of the given special file
+ * \param filename - file name under /device folder
+ * \return device object or NULL if there is no such file
+ * */
+DEVICE_OBJECT_PTR GetDeviceNode(const char * filename)
+{
+	DEVFS_METADATA search;
+	AVL_TREE_PTR node;
+	
+	if( filename == NULL || strlen(filename) > DEVFS_FILE_NAME_MAX-1 )
+		return NULL;
+	strcpy( search.name, filename );
+	node = SearchAvlTree( devfs_root, &search.tree, compare_dev_node_name );
+	if ( node == NULL )
+		return NULL;
+	return STRUCT_ADDRESS_FROM_MEMBER(node, DEVFS_METADATA, tree)->device;
+}
+
+/*! Writes the given buffer to the device repeatedly and returns the elapsed time in milliseconds*/
+static UINT32 BenchmarkDeviceWrite(DEVICE_OBJECT_PTR device_object, char * buffer, UINT32 total_bytes, UINT32 * failures)
+{
+	UINT32 written, start_ticks;
+	int result_count;
+	
+	*failures = 0;
+	start_ticks = timer_ticks;
+	for(written=0; written<total_bytes; written+=DEVICE_IO_BENCHMARK_CHUNK_SIZE)
+	{
+		if ( ReadWriteDevice( device_object, buffer, 0, DEVICE_IO_BENCHMARK_CHUNK_SIZE, TRUE, &result_count, NULL, NULL ) != ERROR_SUCCESS
+			|| result_count != DEVICE_IO_BENCHMARK_CHUNK_SIZE )
+			(*failures)++;
+	}
+	return TICKS_TO_MILLISECONDS( timer_ticks - start_ticks );
+}
+
+/*! Measures the large write throughput of buffered and direct IO and prints the result
+ *	\param total_bytes	Number of bytes to write in each mode
+ */
+void BenchmarkDeviceIo(UINT32 total_bytes)
+{
+	DEVICE_OBJECT_PTR device_object;
+	UINT32 saved_flags, buffered_ms, direct_ms, buffered_failures, direct_failures, kb;
+	char * buffer;
+	
+	device_object = GetDeviceNode( DEVICE_IO_BENCHMARK_DEVICE );
+	if ( device_object == NULL )
+	{
+		kprintf("Device IO benchmark: device %s not found\n", DEVICE_IO_BENCHMARK_DEVICE);
+		return;
+	}
+	buffer = kmalloc( DEVICE_IO_BENCHMARK_CHUNK_SIZE, 0 );
+	if ( buffer == NULL )
+	{
+		kprintf("Device IO benchmark: unable to allocate buffer\n");
+		return;
+	}
+	memset( buffer, 'A', DEVICE_IO_BENCHMARK_CHUNK_SIZE );
+	
+	/*run the same writes through both buffering modes*/
+	saved_flags = device_object->flags;
+	device_object->flags = ( saved_flags & ~DO_DIRECT_IO ) | DO_BUFFERED_IO;
+	buffered_ms = BenchmarkDeviceWrite( device_object, buffer, total_bytes, &buffered_failures );
+	device_object->flags = ( saved_flags & ~DO_BUFFERED_IO ) | DO_DIRECT_IO;
+	direct_ms = BenchmarkDeviceWrite( device_object, buffer, total_bytes, &direct_failures );
+	device_object->flags = saved_flags;
+	kfree( buffer );
+	
+	kb = total_bytes / 1024;
+	kprintf("Device IO benchmark: %d KB buffered %d ms (%d KB/sec, %d failed), direct %d ms (%d KB/sec, %d failed)\n", kb, 
+		buffered_ms, buffered_ms ? (kb / buffered_ms) * 1000 + ((kb % buffered_ms) * 1000) / buffered_ms : kb * 1000, buffered_failures,
+		direct_ms, direct_ms ? (kb / direct_ms) * 1000 + ((kb % direct_ms) * 1000) / direct_ms : kb * 1000, direct_failures );
+}
+
 /*! Returns the directory entries for a given directory
 	\param fs_data - fs provided data for the directory during open file if any
 	\param inode - inode of the file else -1
@@ -1,21 +1,101 @@
 /*!
 	\file	kernel/iom/driver.c
 	\brief	driver loand and unloading routines.
+
+	/boot/driver_id.txt maps device ids to driver files. It is parsed once into a hash table and parsed again only
+	when the vnode of the file changes(different vnode, inode, size or modification time). Loaded drivers are
+	hashed by their file name.
 */
 #include <ace.h>
 #include <string.h>
 #include <ctype.h>
+#include <ds/hash.h>
 #include <kernel/debug.h>
+#include <kernel/arch.h>
+#include <kernel/printf.h>
+#include <kernel/pit.h>
 #include <kernel/mm/kmem.h>
 #include <kernel/pm/elf.h>
 #include <kernel/pm/task.h>
 #include <kernel/iom/iom.h>
 #include <kernel/vfs/vfs.h>
 
+/*! number of buckets in the device id hash table - power of 2*/
+#define DRIVER_ID_HASH_SIZE			64
+/*! number of buckets in the loaded driver hash table - power of 2*/
+#define LOADED_DRIVER_HASH_SIZE		16
+
+/*! a line of the driver database*/
+typedef struct driver_id_entry
+{
+	LIST			hash_list;						/*! links the entries in a hash bucket*/
+	char *			driver_file_name;				/*! driver file - points inside this entry*/
+	char			device_id[0];					/*! device id followed by the driver file name*/
+}DRIVER_ID_ENTRY, * DRIVER_ID_ENTRY_PTR;
+
+/*! parsed driver database and the identity of the file it was parsed from - protected by driver_database_lock*/
+static struct
+{
+	LIST_PTR				table;					/*! hash buckets of DRIVER_ID_ENTRY or NULL if not parsed*/
+	VNODE_PTR				vnode;					/*! vnode of the file - compared only, no reference is held*/
+	MOUNTED_FILE_SYSTEM_PTR	mount;
+	UINT32					inode_number;
+	UINT32					file_size;
+	SYSTEM_TIME				modified_time;
+	UINT32					checked_ticks;			/*! when the file was last compared with the parsed database*/
+
+	UINT32					lookups;				/*! number of device id lookups*/
+	UINT32					checks;					/*! number of times the file is opened to check for a change*/
+	UINT32					parses;					/*! number of times the file is parsed*/
+	UINT32					lookup_time;			/*! total time spent in lookups in microseconds*/
+}driver_database;
+static SPIN_LOCK driver_database_lock;
+
+/*! loaded drivers hashed by driver file name - protected by driver_database_lock*/
+static LIST loaded_driver_table[LOADED_DRIVER_HASH_SIZE];
+
 extern LIST_PTR driver_list_head;
 
+extern inline UINT64 rdtsc();
+
 ERROR_CODE FindDriverFile(char * device_id, char * buffer, int buf_length);
 
+/*! Initializes the driver database and the loaded driver hash table*/
+void InitDriverDatabase()
+{
+	int i;
+
+	InitSpinLock( &driver_database_lock );
+	memset( &driver_database, 0, sizeof(driver_database) );
+	for(i=0; i<LOADED_DRIVER_HASH_SIZE; i++)
+		InitList( &loaded_driver_table[i] );
+}
+
+/*! Searches the loaded driver hash table for the given driver file
+	\param driver_file_name - driver file name
+	\return driver object or NULL if the driver is not loaded
+*/
+static DRIVER_OBJECT_PTR FindLoadedDriver(char * driver_file_name)
+{
+	DRIVER_OBJECT_PTR result = NULL;
+	LIST_PTR bucket, node;
+
+	bucket = &loaded_driver_table[ HashString(driver_file_name) & (LOADED_DRIVER_HASH_SIZE-1) ];
+	SpinLock( &driver_database_lock );
+	LIST_FOR_EACH(node, bucket)
+	{
+		DRIVER_OBJECT_PTR driver_object = STRUCT_ADDRESS_FROM_MEMBER( node, DRIVER_OBJECT, hash_list );
+		if ( strcmp( driver_file_name, driver_object->driver_file_name )==0 )
+		{
+			result = driver_object;
+			break;
+		}
+	}
+	SpinUnlock( &driver_database_lock );
+
+	return result;
+}
+
 /*! Loads a driver*/
 DRIVER_OBJECT_PTR LoadDriver(char * device_id)
 {
@@ -23,7 +103,6 @@ DRIVER_OBJECT_PTR LoadDriver(char * device_id)
 	DRIVER_OBJECT_PTR driver_object;
 	ERROR_CODE (*DriverEntry)(DRIVER_OBJECT_PTR pDriverObject);
 	ERROR_CODE err;
-	LIST_PTR node;
 	
 	err = FindDriverFile(device_id, driver_file_name, sizeof(driver_file_name));
 	ktrace("Driver for id %s : ", device_id);
@@ -36,15 +115,11 @@ DRIVER_OBJECT_PTR LoadDriver(char * device_id)
 	}		
 
 	/*check whether the driver is already loaded*/
-	LIST_FOR_EACH(node, driver_list_head)
+	driver_object = FindLoadedDriver( driver_file_name );
+	if ( driver_object != NULL )
 	{
-		driver_object = STRUCT_ADDRESS_FROM_MEMBER( node, DRIVER_OBJECT, driver_list );
-		if ( strcmp( driver_file_name, driver_object->driver_file_name )==0 )
-		{
-			ktrace("Driver already loaded %s\n", driver_object->driver_file_name);
-			return driver_object;
-		}
-			
+		ktrace("Driver already loaded %s\n", driver_object->driver_file_name);
+		return driver_object;
 	}
 	strcat( driver_file_path, driver_file_name );
 	kprintf("Loading %s: ", driver_file_path);
@@ -64,8 +139,11 @@ DRIVER_OBJECT_PTR LoadDriver(char * device_id)
 	if ( err != ERROR_SUCCESS )
 		goto error;
 
-	/*add the driver to the driver list*/
+	/*add the driver to the driver list and to the hash table*/
 	AddToList( driver_list_head, &driver_object->driver_list );
+	SpinLock( &driver_database_lock );
+	AddToList( &loaded_driver_table[ HashString(driver_file_name) & (LOADED_DRIVER_HASH_SIZE-1) ], &driver_object->hash_list );
+	SpinUnlock( &driver_database_lock );
 	kprintf("success\n");
 	return driver_object;
 
@@ -76,9 +154,123 @@ error:
 }
 
 #define SKIP_WHITE_SPACES	while( i<file_size && isspace(va[i]) ) i++;
-							
+
+/*! Frees a parsed driver database
+	\param table - hash buckets returned by ParseDriverDatabase()
+*/
+static void FreeDriverDatabase(LIST_PTR table)
+{
+	DRIVER_ID_ENTRY_PTR entry;
+	int i;
+
+	for(i=0; i<DRIVER_ID_HASH_SIZE; i++)
+	{
+		while( !IsListEmpty( &table[i] ) )
+		{
+			entry = STRUCT_ADDRESS_FROM_MEMBER( table[i].next, DRIVER_ID_ENTRY, hash_list );
+			RemoveFromList( &entry->hash_list );
+			kfree( entry );
+		}
+	}
+	kfree( table );
+}
+
+/*! Parses the driver database file into a hash table of device ids
+	\param va - file contents
+	\param file_size - size of the file
+	\return hash buckets or NULL if there is no memory
+*/
+static LIST_PTR ParseDriverDatabase(char * va, long file_size)
+{
+	LIST_PTR table;
+	int i;
+
+	table = kmalloc( sizeof(LIST) * DRIVER_ID_HASH_SIZE, 0 );
+	if ( table == NULL )
+		return NULL;
+	for(i=0; i<DRIVER_ID_HASH_SIZE; i++)
+		InitList( &table[i] );
+
+	i = 0;
+	while(i<file_size)
+	{
+		SKIP_WHITE_SPACES;
+
+		/*if the line not starting with comment character process it*/
+		if( i<file_size && va[i]!='#' )
+		{
+			int id_start, id_length, name_start, name_length;
+			DRIVER_ID_ENTRY_PTR entry;
+
+			/*driver id*/
+			id_start = i;
+			while( i<file_size && !isspace(va[i]) )
+				i++;
+			id_length = i - id_start;
+
+			/*driver file name should follow in the same line*/
+			while( i<file_size && (va[i] == ' ' || va[i] == '\t') )
+				i++;
+			name_start = i;
+			while( i<file_size && !isspace(va[i]) )
+				i++;
+			name_length = i - name_start;
+
+			if ( name_length > 0 )
+			{
+				entry = kmalloc( sizeof(DRIVER_ID_ENTRY) + id_length + name_length + 2, 0 );
+				if ( entry == NULL )
+				{
+					FreeDriverDatabase( table );
+					return NULL;
+				}
+				memcpy( entry->device_id, &va[id_start], id_length );
+				entry->device_id[id_length] = 0;
+				entry->driver_file_name = &entry->device_id[id_length+1];
+				memcpy( entry->driver_file_name, &va[name_start], name_length );
+				entry->driver_file_name[name_length] = 0;
+				/*add to the tail so that the first line of a device id is found first*/
+				AddToListTail( &table[ HashString(entry->device_id) & (DRIVER_ID_HASH_SIZE-1) ], &entry->hash_list );
+			}
+		}
+		/*skip till end of line*/
+		while( i<file_size && va[i]!='\n') i++;
+	}
+
+	return table;
+}
+
+/*! Returns TRUE if the parsed driver database was read from the given vnode - driver_database_lock should be held*/
+static BOOLEAN IsDriverDatabaseCurrent(VNODE_PTR vnode)
+{
+	return driver_database.table != NULL && vnode != NULL && driver_database.vnode == vnode
+		&& driver_database.mount == vnode->mounted_fs && driver_database.inode_number == vnode->inode_number
+		&& driver_database.file_size == vnode->file_size
+		&& memcmp( &driver_database.modified_time, &vnode->modified_time, sizeof(SYSTEM_TIME) ) == 0;
+}
+
+/*! Searches the parsed driver database for the given device id - driver_database_lock should be held*/
+static ERROR_CODE SearchDriverDatabase(char * device_id, char * buffer, int buf_length)
+{
+	LIST_PTR bucket, node;
+
+	bucket = &driver_database.table[ HashString(device_id) & (DRIVER_ID_HASH_SIZE-1) ];
+	LIST_FOR_EACH(node, bucket)
+	{
+		DRIVER_ID_ENTRY_PTR entry = STRUCT_ADDRESS_FROM_MEMBER( node, DRIVER_ID_ENTRY, hash_list );
+		if( strcmp(entry->device_id, device_id) == 0 )
+		{
+			strncpy( buffer, entry->driver_file_name, buf_length-1 );
+			buffer[buf_length-1] = 0;
+			return ERROR_SUCCESS;
+		}
+	}
+	return ERROR_NOT_FOUND;
+}
 
 /*! Finds suitable driver for the given id and returns its full path in the given buffer
+	The file is opened to check for a change only if the parsed database was not checked within the attribute cache
+	time - the VFS would return the same attributes anyway. So a change is noticed as late as any other VFS user would.
 	\param device_id - device identification string
 	\param buffer - buffer to place the driver path
 	\param buf_length - buffer size
@@ -86,71 +278,100 @@ error:
 ERROR_CODE FindDriverFile(char * device_id, char * buffer, int buf_length)
 {
 	ERROR_CODE err;
-	int file_id,i=0;
+	int file_id;
 	long file_size;
 	char driver_id_database[] = "/boot/driver_id.txt";
 	char * va;
-	
+	VNODE_PTR vnode;
+	LIST_PTR table, old_table = NULL;
+	UINT64 start_time;
+
 	assert(device_id != NULL );
 	assert(buffer != NULL );
 	assert(buf_length > 0);
-	
+
 	buffer[0]=0;
-	
+	start_time = rdtsc();
+
+	SpinLock( &driver_database_lock );
+	if ( driver_database.table != NULL
+		&& (INT32)(timer_ticks - driver_database.checked_ticks) < (INT32)MILLISECONDS_TO_TICKS( fs_param.vnode.attribute_cache_time ) )
+	{
+		err = SearchDriverDatabase( device_id, buffer, buf_length );
+		SpinUnlock( &driver_database_lock );
+		goto done;
+	}
+	driver_database.checks++;
+	SpinUnlock( &driver_database_lock );
+
 	err = OpenFile( &kernel_task, driver_id_database, VFS_ACCESS_TYPE_READ, OPEN_EXISTING, &file_id);
 	if ( err != ERROR_SUCCESS )
 		goto done;
-		
+
+	/*use the parsed database if the file is not changed*/
+	vnode = GetVnodeFromFile( file_id );
+	if ( vnode != NULL )
+		RevalidateVnodeAttributes( vnode );
+	SpinLock( &driver_database_lock );
+	if ( IsDriverDatabaseCurrent( vnode ) )
+	{
+		driver_database.checked_ticks = timer_ticks;
+		err = SearchDriverDatabase( device_id, buffer, buf_length );
+		SpinUnlock( &driver_database_lock );
+		goto close;
+	}
+	SpinUnlock( &driver_database_lock );
+
 	err = GetFileSize(&kernel_task, file_id, &file_size);
 	if ( err != ERROR_SUCCESS )
-		goto done;
+		goto close;
 
 	err = MapViewOfFile(file_id, (VADDR *) &va, PROT_READ, 0, file_size, 0, 0);
 	if ( err != ERROR_SUCCESS )
-		goto done;
-	
-	err=ERROR_NOT_FOUND;
-	/*read the file and try to find the driver file name*/
-	while(i<file_size)
+		goto close;
+
+	/*the entries keep their own copy of the strings, so the file is not needed after parsing*/
+	table = ParseDriverDatabase( va, file_size );
+	FreeVirtualMemory( GetCurrentVirtualMap(), (VADDR)va, file_size, 0 );
+	if ( table == NULL )
 	{
-		char driver_device_id[100];
-		SKIP_WHITE_SPACES;
+		err = ERROR_NOT_ENOUGH_MEMORY;
+		goto close;
+	}
 
-		/*if the line not starting with comment character process it*/
-		if( va[i]!='#' )
-		{
-			int j=0;
-			
-			/*copy the driver id*/
-			while( i<file_size && j<sizeof(driver_device_id)-1 && !isspace(va[i]) )
-				driver_device_id[j++] = va[i++];
-			driver_device_id[j]=0;
-			
-			/*if user didnt provide driver file name break*/
-			if ( va[i] != ' ' && va[i] != '\t' )
-				break;
-				
-			SKIP_WHITE_SPACES;
-			
-			if( strcmp(driver_device_id, device_id) == 0 )
-			{
-				/*copy driver file name*/
-				j=0;
-				while( i<file_size && j<buf_length-1 && !isspace(va[i]) )
-					buffer[j++] = va[i++];
-					
-				buffer[j]=0;
-				err = ERROR_SUCCESS;
-				break;
-			}
-		}
-		/*skip till end of line*/
-		while( i<file_size && va[i]!='\n') i++;
+	SpinLock( &driver_database_lock );
+	old_table = driver_database.table;
+	driver_database.table = table;
+	driver_database.vnode = vnode;
+	if ( vnode != NULL )
+	{
+		driver_database.mount = vnode->mounted_fs;
+		driver_database.inode_number = vnode->inode_number;
+		driver_database.file_size = vnode->file_size;
+		driver_database.modified_time = vnode->modified_time;
 	}
-	
-done:
-	/* \todo - release the mapping */
-	
+	driver_database.checked_ticks = timer_ticks;
+	driver_database.parses++;
+	err = SearchDriverDatabase( device_id, buffer, buf_length );
+	SpinUnlock( &driver_database_lock );
+
+	if ( old_table != NULL )
+		FreeDriverDatabase( old_table );
+
+close:
 	CloseFile(&kernel_task, file_id);
+done:
+	SpinLock( &driver_database_lock );
+	driver_database.lookups++;
+	if ( cpu_frequency >= 1000000 )
+		driver_database.lookup_time += (UINT32)(rdtsc() - start_time) / (cpu_frequency / 1000000);
+	SpinUnlock( &driver_database_lock );
 	return err;
 }
+
+/*! Prints the number of driver lookups and the time spent in them*/
+void PrintDriverDatabaseStatistics()
+{
+	kprintf("Driver lookup: %d lookups, %d file checks, %d database parses, %d us\n", driver_database.lookups, driver_database.checks, 
+		driver_database.parses, driver_database.lookup_time);
+}
@@ -21,18 +21,24 @@
 #define DRIVER_OBJECT_CACHE_MIN_BUFFERS				10
 #define DRIVER_OBJECT_CACHE_MAX_SLABS				100
 
-#define IRP_CACHE_FREE_SLABS_THRESHOLD				50
-#define IRP_CACHE_MIN_BUFFERS						50
+#define IRP_CACHE_FREE_SLABS_THRESHOLD				10
+#define IRP_CACHE_MIN_BUFFERS						10
 #define IRP_CACHE_MAX_SLABS							1000
 
+#define SMALL_IRP_CACHE_FREE_SLABS_THRESHOLD		50
+#define SMALL_IRP_CACHE_MIN_BUFFERS					50
+#define SMALL_IRP_CACHE_MAX_SLABS					1000
+
 /*! List of drivers loaded into the kernel address space */
 LIST_PTR driver_list_head = NULL;
 
 /*! cache for driver and device*/
 CACHE driver_object_cache;
 CACHE device_object_cache;
-/*! cache for irps*/
+/*! cache for irps with more than IRP_EMBEDDED_STACK_COUNT stack locations*/
 CACHE irp_cache;
+/*! cache for irps with embedded stack locations*/
+CACHE small_irp_cache;
 
 extern DRIVER_OBJECT_PTR LoadDriver(char * device_id);
 extern ERROR_CODE FindDriverFile(char * device_id, char * buffer, int buf_length);
@@ -43,8 +49,12 @@ int DeviceObjectCacheConstructor( void *buffer);
 int DeviceObjectCacheDestructor( void *buffer);
 int IrpCacheConstructor( void * buffer);
 int IrpCacheDestructor( void * buffer);
+int SmallIrpCacheConstructor( void * buffer);
+int SmallIrpCacheDestructor( void * buffer);
 
 extern void InitDevFs();
+extern void InitDriverDatabase();
+extern void PrintDriverDatabaseStatistics();
 
 
 /*! Initialize IO manager and start required boot drivers*/
@@ -61,10 +71,16 @@ void InitIoManager()
 	
 	if( InitCache(&irp_cache, sizeof(IRP), IRP_CACHE_FREE_SLABS_THRESHOLD, IRP_CACHE_MIN_BUFFERS, IRP_CACHE_MAX_SLABS, IrpCacheConstructor, IrpCacheDestructor) )
 		panic("InitIoManager - IRP cache init failed");
+	
+	if( InitCache(&small_irp_cache, sizeof(IRP) + IRP_EMBEDDED_STACK_COUNT * sizeof(IO_STACK_LOCATION), SMALL_IRP_CACHE_FREE_SLABS_THRESHOLD, SMALL_IRP_CACHE_MIN_BUFFERS, SMALL_IRP_CACHE_MAX_SLABS, SmallIrpCacheConstructor, SmallIrpCacheDestructor) )
+		panic("InitIoManager - small IRP cache init failed");
 		
 	/*initialize dev fs*/
 	InitDevFs();
 	
+	/*initialize driver id database*/
+	InitDriverDatabase();
+	
 	/*load root bus driver and call the DriverEntry*/
 	root_bus = LoadRootBusDriver() ;
 
@@ -77,6 +93,8 @@ void InitIoManager()
 
 	/*force the io manager to enumerate the buses on root bus*/
 	InvalidateDeviceRelations(root_bus_device_object, DEVICE_RELATIONS_TYPE_BUS_RELATION);
+	
+	PrintDriverDatabaseStatistics();
 }
 
 /*! Dummy Major function handler - used to initialize driver object function pointers
@@ -263,6 +281,7 @@ int DriverObjectCacheConstructor( void * buffer)
 	memset(dop, 0, sizeof(DRIVER_OBJECT) );
 
 	InitList( &dop->driver_list );
+	InitList( &dop->hash_list );
 	InitSpinLock( &dop->lock );
 	for(i=0;i<IRP_MJ_MAXIMUM_FUNCTION;i++)
 		dop->fn.MajorFunctions[i] = DummyMajorFunction;
@@ -313,3 +332,19 @@ int IrpCacheDestructor( void * buffer)
 	
 	return 0;
 }
+
+/*! Internal function used to initialize the IRP structure and its embedded stack locations*/
+int SmallIrpCacheConstructor( void * buffer)
+{
+	memset(buffer, 0, sizeof(IRP) + IRP_EMBEDDED_STACK_COUNT * sizeof(IO_STACK_LOCATION) );
+
+	return 0;
+}
+
+/*! Internal function used to initialize the IRP structure and its embedded stack locations*/
+int SmallIrpCacheDestructor( void * buffer)
+{
+	SmallIrpCacheConstructor(buffer);
+	
+	return 0;
+}
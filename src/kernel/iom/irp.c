@@ -10,26 +10,127 @@
 #include <kernel/pm/elf.h>
 #include <kernel/iom/iom.h>
 #include <kernel/vfs/vfs.h>
+#include <kernel/arch.h>
+#include <kernel/pit.h>
+#include <kernel/printf.h>
+#include <kernel/processor.h>
+#include <kernel/pm/thread.h>
 
-extern CACHE irp_cache;
+/*! Free small IRPs cached on a processor - accessed only by the owning processor with interrupts disabled*/
+typedef struct irp_lookaside
+{
+	IRP_PTR		head;						/*! first free IRP*/
+	UINT32		depth;						/*! number of IRPs in the list*/
+	
+	UINT32		allocate_hits;				/*! allocations served from the list*/
+	UINT32		allocate_misses;			/*! allocations which went to the small IRP cache*/
+	UINT32		free_misses;				/*! frees which went to the small IRP cache because the list was full*/
+}IRP_LOOKASIDE, * IRP_LOOKASIDE_PTR;
+
+static IRP_LOOKASIDE irp_lookaside[MAX_PROCESSORS];
+
+/*! lookaside lists are bypassed when this is FALSE - used by the benchmark*/
+static BOOLEAN irp_lookaside_enabled = TRUE;
+
+/*! number of IRPs to allocate in the boot time IRP benchmark - 0 disables the benchmark*/
+UINT32 irp_benchmark_count=0;
 
 int IrpCacheConstructor( void * buffer);
 int IrpCacheDestructor( void * buffer);
 
+/*! Returns the current processor's IRP lookaside list - interrupts should be disabled by the caller*/
+static IRP_LOOKASIDE_PTR GetCurrentIrpLookaside()
+{
+	PROCESSOR_PTR p = GET_CURRENT_PROCESSOR;
+	if ( p == NULL )
+		p = &processor[GetCurrentProcessorId()];
+	return &irp_lookaside[ p - processor ];
+}
+
+/*! Takes a small IRP from the current processor's lookaside list
+	\return irp or NULL if the list is empty
+*/
+static IRP_PTR AllocateIrpFromLookaside()
+{
+	IRP_LOOKASIDE_PTR lookaside;
+	IRP_PTR irp;
+	UINT32 flags;
+	
+	flags = DisableInterrupts();
+	lookaside = GetCurrentIrpLookaside();
+	irp = lookaside->head;
+	if ( irp != NULL )
+	{
+		lookaside->head = irp->lookaside_next;
+		lookaside->depth--;
+		lookaside->allocate_hits++;
+	}
+	else
+		lookaside->allocate_misses++;
+	RestoreInterrupts( flags );
+	
+	return irp;
+}
+
+/*! Puts a small IRP on the current processor's lookaside list
+	\param irp - irp to free
+	\return TRUE if the irp is cached, FALSE if the list is full
+*/
+static BOOLEAN FreeIrpToLookaside(IRP_PTR irp)
+{
+	IRP_LOOKASIDE_PTR lookaside;
+	BOOLEAN result = FALSE;
+	UINT32 flags;
+	
+	flags = DisableInterrupts();
+	lookaside = GetCurrentIrpLookaside();
+	if ( lookaside->depth < IRP_LOOKASIDE_DEPTH )
+	{
+		irp->lookaside_next = lookaside->head;
+		lookaside->head = irp;
+		lookaside->depth++;
+		result = TRUE;
+	}
+	else
+		lookaside->free_misses++;
+	RestoreInterrupts( flags );
+	
+	return result;
+}
+
 /*! Allocates a Irp for the use of driver
+	IRPs with up to IRP_EMBEDDED_STACK_COUNT stack locations are taken from the processor's lookaside list or
+	from the small IRP cache, with the stack locations in the same buffer. Bigger IRPs allocate the stack separately.
 	\param stack_size - number of stacks assoicated with this irp
 	\return irp
 */
 IRP_PTR AllocateIrp(BYTE stack_size)
 {
-	IRP_PTR irp;
+	IRP_PTR irp = NULL;
 	
 	assert( stack_size>0 );
-	/*! allocate irp and io stack*/
-	irp = AllocateBuffer( &irp_cache, CACHE_ALLOC_SLEEP );
-	if ( irp == NULL )
-		return NULL;
-	irp->current_stack_location = kmalloc( sizeof(IO_STACK_LOCATION)*stack_size, KMEM_NO_FAIL );
+	if ( stack_size <= IRP_EMBEDDED_STACK_COUNT )
+	{
+		if ( irp_lookaside_enabled )
+			irp = AllocateIrpFromLookaside();
+		if ( irp == NULL )
+			irp = AllocateBuffer( &small_irp_cache, CACHE_ALLOC_SLEEP );
+		if ( irp == NULL )
+			return NULL;
+		memset( irp, 0, sizeof(IRP) + sizeof(IO_STACK_LOCATION)*stack_size );
+		irp->flags = IRP_FLAG_EMBEDDED_STACK;
+		irp->current_stack_location = (IO_STACK_LOCATION_PTR)(irp + 1);
+	}
+	else
+	{
+		/*! allocate irp and io stack*/
+		irp = AllocateBuffer( &irp_cache, CACHE_ALLOC_SLEEP );
+		if ( irp == NULL )
+			return NULL;
+		memset( irp, 0, sizeof(IRP) );
+		irp->current_stack_location = kmalloc( sizeof(IO_STACK_LOCATION)*stack_size, KMEM_NO_FAIL );
+		memset( irp->current_stack_location, 0, sizeof(IO_STACK_LOCATION)*stack_size );
+	}
 	
 	irp->stack_count = stack_size;
 	irp->io_status.status = ERROR_NOT_SUPPORTED;
@@ -44,8 +145,16 @@ void FreeIrp(IRP_PTR irp)
 {
 	assert( irp != NULL );
 	
-	kfree( irp->current_stack_location );
-	FreeBuffer( irp, &irp_cache );
+	if ( irp->flags & IRP_FLAG_EMBEDDED_STACK )
+	{
+		if ( !irp_lookaside_enabled || !FreeIrpToLookaside( irp ) )
+			FreeBuffer( irp, &small_irp_cache );
+	}
+	else
+	{
+		kfree( irp->current_stack_location );
+		FreeBuffer( irp, &irp_cache );
+	}
 }
 
 /*! Reuses a already allocated Irp
@@ -55,15 +164,18 @@ void FreeIrp(IRP_PTR irp)
 void ReuseIrp(IRP_PTR irp, ERROR_CODE error_code)
 {
 	BYTE stack_size;
+	UINT32 flags;
 	IO_STACK_LOCATION_PTR io_stack;
 	
 	assert( irp != NULL );
 	
 	stack_size = irp->stack_count;
 	io_stack = irp->current_stack_location;
+	flags = irp->flags;
 
 	IrpCacheConstructor( irp );
 
+	irp->flags = flags;
 	irp->current_stack_location	= io_stack;
 	irp->stack_count = stack_size;
 	irp->io_status.status = error_code;
@@ -98,3 +210,62 @@ inline void FillIoStack(IO_STACK_LOCATION_PTR io_stack, BYTE major_function, BYT
 	io_stack->completion_routine = completion_routine;
 	io_stack->context = context;
 }
+
+/*! Completes a irp - sets the status and calls the completion routine registered by the initiator
+	\param irp - irp to complete
+	\param status - final status of the irp
+	\param information - request dependent value - number of bytes transferred for read/write
+*/
+void CompleteIrp(IRP_PTR irp, ERROR_CODE status, void * information)
+{
+	IO_STACK_LOCATION_PTR io_stack;
+	IRP_COMPLETION_INVOKE invoke;
+
+	assert( irp != NULL );
+	irp->io_status.status = status;
+	irp->io_status.information = information;
+
+	io_stack = irp->current_stack_location;
+	invoke = ( status == ERROR_SUCCESS ) ? IRP_COMPLETION_INVOKE_ON_SUCCESS : IRP_COMPLETION_INVOKE_ON_ERROR;
+	if ( io_stack->completion_routine && (io_stack->invoke_on & invoke) )
+		io_stack->completion_routine( io_stack->device_object, irp, io_stack->context );
+}
+
+/*! Allocates and frees the given number of IRPs and returns the elapsed time in milliseconds*/
+static UINT32 BenchmarkIrpAllocationCycle(UINT32 count, BYTE stack_size)
+{
+	UINT32 i, start_ticks;
+	IRP_PTR irp;
+	
+	start_ticks = timer_ticks;
+	for(i=0; i<count; i++)
+	{
+		irp = AllocateIrp( stack_size );
+		FillIoStack( irp->current_stack_location, IRP_MJ_READ, 0, NULL, NULL, NULL );
+		FreeIrp( irp );
+	}
+	return TICKS_TO_MILLISECONDS( timer_ticks - start_ticks );
+}
+
+/*! Measures the IRP allocate/free cost with and without the lookaside lists and prints the result
+ *	\param count	Number of IRPs to allocate in each mode
+ */
+void BenchmarkIrpAllocation(UINT32 count)
+{
+	UINT32 lookaside_ms, cache_ms, large_ms, flags;
+	IRP_LOOKASIDE lookaside;
+	
+	lookaside_ms = BenchmarkIrpAllocationCycle( count, 1 );
+	flags = DisableInterrupts();
+	lookaside = *GetCurrentIrpLookaside();
+	RestoreInterrupts( flags );
+	
+	irp_lookaside_enabled = FALSE;
+	cache_ms = BenchmarkIrpAllocationCycle( count, 1 );
+	irp_lookaside_enabled = TRUE;
+	
+	large_ms = BenchmarkIrpAllocationCycle( count, IRP_EMBEDDED_STACK_COUNT+1 );
+	
+	kprintf("IRP benchmark: %d alloc/free - lookaside %d ms (%d hits, %d misses), small cache %d ms, separate stack %d ms\n", 
+		count, lookaside_ms, lookaside.allocate_hits, lookaside.allocate_misses, cache_ms, large_ms );
+}
@@ -0,0 +1,210 @@
+/*!
+	\file	kernel/iom/mdl.c
+	\brief	Memory descriptor lists for direct IO
+
+	For DO_DIRECT_IO devices the io manager does not copy the caller's buffer. Instead the pages backing the
+	buffer are wired so that the page out daemon leaves them alone, and the driver gets a MDL listing them.
+	The driver can use the physical pages directly or get a kernel mapping through GetSystemAddressForMdl().
+*/
+#include <ace.h>
+#include <string.h>
+#include <kernel/debug.h>
+#include <kernel/mm/vm.h>
+#include <kernel/mm/pmem.h>
+#include <kernel/mm/kmem.h>
+#include <kernel/mm/virtual_page.h>
+#include <kernel/iom/mdl.h>
+
+/*! Allocates a MDL to describe the given buffer
+	\param va - start of the buffer
+	\param length - length of the buffer in bytes
+	\return MDL or NULL if the buffer is invalid or there is no memory
+*/
+MDL_PTR AllocateMdl(void * va, UINT32 length)
+{
+	MDL_PTR mdl;
+	UINT32 page_count;
+
+	if ( va == NULL || length == 0 || length > MDL_MAX_LENGTH || (VADDR)va + length < (VADDR)va )
+		return NULL;
+	page_count = ( PAGE_ALIGN_UP((VADDR)va + length) - PAGE_ALIGN(va) ) / PAGE_SIZE;
+	mdl = kmalloc( sizeof(MDL) + page_count * sizeof(VIRTUAL_PAGE_PTR), 0 );
+	if ( mdl == NULL )
+		return NULL;
+
+	mdl->flags = 0;
+	mdl->virtual_map = NULL;
+	mdl->start_va = PAGE_ALIGN(va);
+	mdl->byte_offset = (VADDR)va - mdl->start_va;
+	mdl->byte_count = length;
+	mdl->system_va = NULL;
+	mdl->page_count = page_count;
+	if ( mdl->start_va >= KERNEL_MAP_START_VA )
+		mdl->flags |= MDL_SOURCE_IS_KERNEL;
+
+	return mdl;
+}
+
+/*! Frees a MDL - the pages are unlocked if they are still locked
+	\param mdl - MDL to free
+*/
+void FreeMdl(MDL_PTR mdl)
+{
+	assert( mdl != NULL );
+	if ( mdl->flags & MDL_PAGES_LOCKED )
+		UnlockPages( mdl );
+	kfree( mdl );
+}
+
+/*! Wires the page backing the given user va
+	The page is looked up through the vm unit so that any address space can be probed, not only the current one.
+	\param vmap - virtual map of the va
+	\param va - page aligned user virtual address
+	\param write - if set the page should be writable without breaking copy-on-write
+	\return wired page or NULL if the page is not resident or can not be written in place
+*/
+static VIRTUAL_PAGE_PTR WireUserPage(VIRTUAL_MAP_PTR vmap, VADDR va, BOOLEAN write)
+{
+	VM_DESCRIPTOR_PTR vd;
+	VM_UNIT_PTR unit;
+	VM_VTOP_PTR vtop;
+	VIRTUAL_PAGE_PTR vp = NULL, page;
+	UINT32 vtop_index;
+
+	vd = GetVmDescriptor( vmap, va, PAGE_SIZE );
+	if ( vd == NULL )
+		return NULL;
+	if ( write && !(vd->protection & PROT_WRITE) )
+		return NULL;
+	unit = vd->unit;
+	vtop_index = ((va - vd->start) / PAGE_SIZE) + (vd->offset_in_unit/PAGE_SIZE);
+
+	SpinLock( &unit->vtop_lock );
+	vtop = &unit->vtop_array[vtop_index];
+	if ( VTOP_IN_MEMORY(vtop) )
+	{
+		page = VTOP_TO_VIRTUAL_PAGE(vtop);
+		/*page out daemon checks the wire count under the lru lock*/
+		SpinLock( &vm_data.lru_lock );
+		if ( !page->busy && !(write && page->copy_on_write) )
+		{
+			page->wire_count++;
+			vp = page;
+		}
+		SpinUnlock( &vm_data.lru_lock );
+	}
+	SpinUnlock( &unit->vtop_lock );
+
+	return vp;
+}
+
+/*! Drops the wire count taken by ProbeAndLockPages()
+	\param vp - page to unwire
+*/
+static void UnwirePage(VIRTUAL_PAGE_PTR vp)
+{
+	SpinLock( &vm_data.lru_lock );
+	assert( vp->wire_count > 0 );
+	vp->wire_count--;
+	SpinUnlock( &vm_data.lru_lock );
+}
+
+/*! Makes the pages of the MDL resident, wires them and fills the page list
+	Pages of the current address space are faulted in if required. Pages of other address spaces should
+	already be resident, because they can not be faulted in from here.
+	\param mdl - MDL created by AllocateMdl()
+	\param virtual_map - address space of the buffer - ignored for kernel buffers
+	\param write - TRUE if the device is going to write into the buffer(read operation)
+*/
+ERROR_CODE ProbeAndLockPages(MDL_PTR mdl, VIRTUAL_MAP_PTR virtual_map, BOOLEAN write)
+{
+	UINT32 i;
+	VADDR va, pa;
+	VA_STATUS status;
+	VIRTUAL_PAGE_PTR vp;
+
+	assert( mdl != NULL && !(mdl->flags & MDL_PAGES_LOCKED) );
+	if ( mdl->flags & MDL_SOURCE_IS_KERNEL )
+		virtual_map = &kernel_map;
+	assert( virtual_map != NULL );
+	mdl->virtual_map = virtual_map;
+
+	for(i=0; i<mdl->page_count; i++)
+	{
+		va = mdl->start_va + (i * PAGE_SIZE);
+		if ( mdl->flags & MDL_SOURCE_IS_KERNEL )
+		{
+			/*kernel memory is not paged out, so only the page is required*/
+			status = TranslatePaFromVa( va, &pa );
+			vp = ( status == VA_NOT_EXISTS ) ? NULL : PHYS_TO_VP( pa );
+		}
+		else
+		{
+			vp = WireUserPage( virtual_map, va, write );
+			/*fault the page in and try once more*/
+			if ( vp == NULL && virtual_map == GetCurrentVirtualMap()
+				&& MemoryFaultHandler( va, TRUE, write ) == ERROR_SUCCESS )
+				vp = WireUserPage( virtual_map, va, write );
+		}
+		if ( vp == NULL )
+		{
+			KTRACE("va %p can not be locked\n", va);
+			/*release the pages locked so far*/
+			if ( !(mdl->flags & MDL_SOURCE_IS_KERNEL) )
+			{
+				while( i-- > 0 )
+					UnwirePage( mdl->pages[i] );
+			}
+			return ERROR_INVALID_PARAMETER;
+		}
+		mdl->pages[i] = vp;
+	}
+
+	mdl->flags |= MDL_PAGES_LOCKED;
+	if ( write )
+		mdl->flags |= MDL_WRITE_OPERATION;
+	return ERROR_SUCCESS;
+}
+
+/*! Unmaps and unwires the pages locked by ProbeAndLockPages()
+	\param mdl - MDL with locked pages
+*/
+void UnlockPages(MDL_PTR mdl)
+{
+	UINT32 i;
+
+	assert( mdl != NULL && (mdl->flags & MDL_PAGES_LOCKED) );
+	if ( mdl->flags & MDL_MAPPED_TO_SYSTEM_VA )
+	{
+		FreeVirtualMemory( &kernel_map, mdl->system_va, mdl->page_count * PAGE_SIZE, 0 );
+		mdl->system_va = NULL;
+	}
+	if ( !(mdl->flags & MDL_SOURCE_IS_KERNEL) )
+	{
+		for(i=0; i<mdl->page_count; i++)
+			UnwirePage( mdl->pages[i] );
+	}
+	mdl->flags &= ~(MDL_PAGES_LOCKED | MDL_MAPPED_TO_SYSTEM_VA | MDL_WRITE_OPERATION);
+}
+
+/*! Returns a kernel address for the buffer described by a locked MDL
+	Kernel buffers are returned as it is, user pages are mapped into the kernel map once and the mapping is
+	released by UnlockPages().
+	\param mdl - MDL with locked pages
+	\return kernel address of the first byte of the buffer or NULL if there is no virtual address space
+*/
+void * GetSystemAddressForMdl(MDL_PTR mdl)
+{
+	assert( mdl != NULL && (mdl->flags & MDL_PAGES_LOCKED) );
+	if ( mdl->flags & MDL_SOURCE_IS_KERNEL )
+		return (void *)(mdl->start_va + mdl->byte_offset);
+
+	if ( !(mdl->flags & MDL_MAPPED_TO_SYSTEM_VA) )
+	{
+		mdl->system_va = MapVirtualPages( &kernel_map, mdl->pages, mdl->page_count, PROT_READ | PROT_WRITE );
+		if ( mdl->system_va == NULL )
+			return NULL;
+		mdl->flags |= MDL_MAPPED_TO_SYSTEM_VA;
+	}
+	return (void *)(mdl->system_va + mdl->byte_offset);
+}
@@ -0,0 +1,241 @@
+/*!
+ * \file	kernel/ipc/ipc_vector.c
+ * \brief	Scatter-gather(MESSAGE_TYPE_VECTOR) message payloads
+ *
+ * A vector message carries a list of address ranges instead of a single buffer. While the message is
+ * queued, every whole page of private user memory is held by a copy-on-write reference and only the
+ * partial pages at the range boundaries are copied into kernel memory. When the receiver's buffers are
+ * page aligned the shared pages are mapped into the receiver copy-on-write, so a multi page transfer
+ * does not copy the data at all.
+ */
+
+#include <ace.h>
+#include <string.h>
+#include <kernel/ipc.h>
+#include <kernel/debug.h>
+#include <kernel/mm/vm.h>
+#include <kernel/mm/pmem.h>
+#include <kernel/mm/kmem.h>
+#include <kernel/mm/virtual_page.h>
+
+/*! part of a vector payload - either a shared page or a copied chunk*/
+typedef struct ipc_vector_segment
+{
+	VIRTUAL_PAGE_PTR	vp;						/*! page shared copy-on-write from the sender - NULL if the data is copied*/
+	void *				data;					/*! kernel copy of the data - NULL if the page is shared*/
+	UINT32				length;					/*! length of the segment in bytes*/
+}IPC_VECTOR_SEGMENT, * IPC_VECTOR_SEGMENT_PTR;
+
+struct ipc_vector_buffer
+{
+	UINT32				length;					/*! total length of the payload*/
+	UINT32				segment_count;			/*! number of valid segments*/
+	IPC_VECTOR_SEGMENT	segments[0];			/*! segments in payload order*/
+};
+
+/*! Copies and validates an user supplied IPC_IOVEC array
+	\param iov - IPC_IOVEC array
+	\param count - number of entries
+	\param copy - local array to copy into(should hold IPC_MAX_IOVEC_COUNT entries)
+	\param length - total length of all the ranges
+*/
+static ERROR_CODE CopyIpcIoVector(IPC_IOVEC_PTR iov, UINT32 count, IPC_IOVEC_PTR copy, UINT32 * length)
+{
+	UINT32 i, total = 0;
+
+	if ( iov == NULL || count == 0 || count > IPC_MAX_IOVEC_COUNT )
+		return ERROR_INVALID_PARAMETER;
+	memcpy( copy, iov, count * sizeof(IPC_IOVEC) );
+	for(i=0; i<count; i++)
+	{
+		if ( copy[i].length == 0 )
+			continue;
+		if ( copy[i].base == NULL || copy[i].length > IPC_MAX_VECTOR_LENGTH )
+			return ERROR_INVALID_PARAMETER;
+		total += copy[i].length;
+		if ( total > IPC_MAX_VECTOR_LENGTH )
+			return ERROR_INVALID_PARAMETER;
+	}
+	*length = total;
+	return ERROR_SUCCESS;
+}
+
+/*! Gathers the given ranges into a kernel vector buffer
+	Whole pages of private user memory are shared copy-on-write, everything else is copied.
+	\param iov - sender's IPC_IOVEC array
+	\param count - number of entries in the array
+	\param vector - created vector buffer
+	\param length - total length of the payload
+*/
+ERROR_CODE CreateIpcVectorBuffer(IPC_IOVEC_PTR iov, UINT32 count, IPC_VECTOR_BUFFER_PTR * vector, UINT32 * length)
+{
+	IPC_IOVEC ranges[IPC_MAX_IOVEC_COUNT];
+	IPC_VECTOR_BUFFER_PTR vb;
+	IPC_VECTOR_SEGMENT_PTR seg;
+	VIRTUAL_MAP_PTR vmap;
+	UINT32 i, total, segments = 0;
+	ERROR_CODE ret;
+
+	assert( vector != NULL && length != NULL );
+	ret = CopyIpcIoVector( iov, count, ranges, &total );
+	if ( ret != ERROR_SUCCESS )
+		return ret;
+
+	/*each range needs at most one segment for every page it spans*/
+	for(i=0; i<count; i++)
+	{
+		if ( ranges[i].length )
+			segments += ( PAGE_ALIGN_UP((VADDR)ranges[i].base + ranges[i].length) - PAGE_ALIGN(ranges[i].base) ) / PAGE_SIZE;
+	}
+	vb = kmalloc( sizeof(IPC_VECTOR_BUFFER) + segments * sizeof(IPC_VECTOR_SEGMENT), 0 );
+	if ( vb == NULL )
+		return ERROR_NOT_ENOUGH_MEMORY;
+	vb->length = total;
+	vb->segment_count = 0;
+
+	vmap = GetCurrentVirtualMap();
+	for(i=0; i<count; i++)
+	{
+		VADDR va = (VADDR)ranges[i].base, end = va + ranges[i].length;
+		while( va < end )
+		{
+			UINT32 size = PAGE_ALIGN(va) + PAGE_SIZE - va;
+			if ( size > end - va )
+				size = end - va;
+			seg = &vb->segments[vb->segment_count];
+			seg->vp = NULL;
+			seg->data = NULL;
+			seg->length = size;
+			if ( size == PAGE_SIZE && va < KERNEL_MAP_START_VA )
+				seg->vp = ShareVirtualPageCopyOnWrite( vmap, va );
+			if ( seg->vp == NULL )
+			{
+				seg->data = kmalloc( size, 0 );
+				if ( seg->data == NULL )
+				{
+					FreeIpcVectorBuffer( vb );
+					return ERROR_NOT_ENOUGH_MEMORY;
+				}
+				memcpy( seg->data, (void *)va, size );
+			}
+			vb->segment_count++;
+			va += size;
+		}
+	}
+
+	*vector = vb;
+	*length = total;
+	return ERROR_SUCCESS;
+}
+
+/*! Copies part of a shared page to the given address
+	\param vp - source page
+	\param offset - offset within the page
+	\param dst - destination address
+	\param size - number of bytes to copy
+	\param bounce - page sized kernel buffer - required if dst is an user address
+*/
+static void CopyFromVirtualPage(VIRTUAL_PAGE_PTR vp, UINT32 offset, void * dst, UINT32 size, void * bounce)
+{
+	void * window;
+
+	/*user memory can not be touched while holding the window, since it might fault*/
+	window = MapPhysicalPageWindow( VP_TO_PHYS(vp) );
+	memcpy( bounce ? bounce : dst, ((char *)window) + offset, size );
+	UnmapPhysicalPageWindow();
+	if ( bounce )
+		memcpy( dst, bounce, size );
+}
+
+/*! Scatters a vector buffer into the receiver's buffers
+	Shared pages are mapped copy-on-write when the destination is page aligned private memory, otherwise
+	the data is copied. The payload is truncated if the receiver's buffers are smaller.
+	\param vector - vector buffer created by CreateIpcVectorBuffer()
+	\param iov - receiver's IPC_IOVEC array - on return each length holds the number of bytes received in that buffer
+	\param count - number of entries in the array
+*/
+ERROR_CODE CopyIpcVectorBuffer(IPC_VECTOR_BUFFER_PTR vector, IPC_IOVEC_PTR iov, UINT32 count)
+{
+	IPC_IOVEC ranges[IPC_MAX_IOVEC_COUNT];
+	VIRTUAL_MAP_PTR vmap;
+	void * bounce = NULL;
+	UINT32 i, total, seg_index = 0, seg_offset = 0, iov_index = 0, iov_offset = 0;
+	ERROR_CODE ret;
+
+	assert( vector != NULL );
+	ret = CopyIpcIoVector( iov, count, ranges, &total );
+	if ( ret != ERROR_SUCCESS )
+		return ret;
+
+	vmap = GetCurrentVirtualMap();
+	while( seg_index < vector->segment_count && iov_index < count )
+	{
+		IPC_VECTOR_SEGMENT_PTR seg = &vector->segments[seg_index];
+		VADDR dst = (VADDR)ranges[iov_index].base + iov_offset;
+		UINT32 size = seg->length - seg_offset;
+
+		if ( size > ranges[iov_index].length - iov_offset )
+			size = ranges[iov_index].length - iov_offset;
+
+		if ( seg->vp != NULL && seg_offset == 0 && size == PAGE_SIZE && IS_PAGE_ALIGNED(dst) && dst < KERNEL_MAP_START_VA
+			&& MapVirtualPageCopyOnWrite( vmap, dst, seg->vp ) == ERROR_SUCCESS )
+		{
+			/*page transferred without copying*/
+		}
+		else if ( seg->vp != NULL )
+		{
+			if ( bounce == NULL && dst < KERNEL_MAP_START_VA )
+			{
+				bounce = kmalloc( PAGE_SIZE, 0 );
+				if ( bounce == NULL )
+					return ERROR_NOT_ENOUGH_MEMORY;
+			}
+			CopyFromVirtualPage( seg->vp, seg_offset, (void *)dst, size, dst < KERNEL_MAP_START_VA ? bounce : NULL );
+		}
+		else
+			memcpy( (void *)dst, ((char *)seg->data) + seg_offset, size );
+
+		seg_offset += size;
+		if ( seg_offset == seg->length )
+		{
+			seg_index++;
+			seg_offset = 0;
+		}
+		iov_offset += size;
+		if ( iov_offset == ranges[iov_index].length )
+		{
+			iov_index++;
+			iov_offset = 0;
+		}
+	}
+	if ( bounce )
+		kfree( bounce );
+
+	/*report how much each buffer received - filled buffers keep their length*/
+	for(i=0; i<count; i++)
+	{
+		if ( i == iov_index )
+			iov[i].length = iov_offset;
+		else if ( i > iov_index )
+			iov[i].length = 0;
+	}
+	return ERROR_SUCCESS;
+}
+
+/*! Releases the pages and memory held by a vector buffer
+	\param vector - vector buffer created by CreateIpcVectorBuffer()
+*/
+void FreeIpcVectorBuffer(IPC_VECTOR_BUFFER_PTR vector)
+{
+	UINT32 i;
+
+	assert( vector != NULL );
+	for(i=0; i<vector->segment_count; i++)
+	{
+		if ( vector->segments[i].vp != NULL )
+			ReleaseVirtualPageCopyOnWrite( vector->segments[i].vp );
+		else
+			kfree( vector->segments[i].data );
+	}
+	kfree( vector );
+}
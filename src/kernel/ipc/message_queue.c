@@ -11,15 +11,51 @@
 #include <kernel/pm/pm_types.h>
 #include <kernel/pm/task.h>
 #include <kernel/pm/thread.h>
+#include <kernel/pm/scheduler.h>
+#include <kernel/mm/pmem.h>
+#include <kernel/pit.h>
 
 /*! System wide tunable to control the size of message queue in message_queue structure */
 UINT32 max_message_queue_length=100;	
 
-static void RemoveFromMessageQueue(MESSAGE_QUEUE_PTR message_queue);
+/*! System wide tunable to control the number of messages a task can have in the message queues - 0 disables the limit, kernel_task is never limited */
+UINT32 max_messages_per_sender=32;
+
+/*! Number of messages to send in the boot time IPC benchmark - 0 disables the benchmark*/
+UINT32 ipc_benchmark_messages=0;
+
+/*! Non zero to run the boot time IPC test(see VerifyMessageQueue())*/
+UINT32 ipc_test=0;
+
+/*! urgent and high priority messages in the list are received before the messages in the ring*/
+#define HIGH_PRIORITY_MESSAGE_PENDING(mq)	( (mq)->lane_count[MESSAGE_PRIORITY_URGENT] + (mq)->lane_count[MESSAGE_PRIORITY_HIGH] > 0 )
+
+/*! number of messages ReceiveMessageBatch() takes out of the ring or the lists under one lock acquisition*/
+#define MESSAGE_BATCH_CHUNK		8
+
+static void UnlinkFromMessageQueue(MESSAGE_QUEUE_PTR message_queue, MESSAGE_BUFFER_PTR buf);
 static void AddToMessageQueue(MESSAGE_QUEUE_PTR message_queue, MESSAGE_BUFFER_PTR buf);
+static ERROR_CODE SendMessageInternal(TASK_PTR target_task, MESSAGE_QUEUE_PTR message_queue, MESSAGE_TYPE type, IPC_ARG_TYPE arg1, IPC_ARG_TYPE arg2, IPC_ARG_TYPE arg3, IPC_ARG_TYPE arg4, IPC_ARG_TYPE arg5, IPC_ARG_TYPE arg6, UINT32 wait_time, THREAD_PTR * handoff);
+static ERROR_CODE SendToMessageRing(MESSAGE_QUEUE_PTR message_queue, MESSAGE_BUFFER_PTR msg_buf, THREAD_PTR * handoff);
+static MESSAGE_RING_PTR GetMessageRing(MESSAGE_QUEUE_PTR message_queue);
+static BOOLEAN CanReceiveMessage(MESSAGE_BUFFER_PTR msg_buf, IPC_ARG_TYPE arg1, IPC_ARG_TYPE arg5, IPC_ARG_TYPE arg6);
+static BOOLEAN CanReceiveIpcMessage(MESSAGE_BUFFER_PTR msg_buf, IPC_MESSAGE_PTR message);
+static void DiscardMessageBuffer(MESSAGE_BUFFER_PTR msg_buf, VIRTUAL_MAP_PTR target_map);
+static ERROR_CODE WaitForReplyCore(WAIT_EVENT_PTR wait_event, MESSAGE_TYPE type, IPC_ARG_TYPE arg1, IPC_ARG_TYPE arg2, IPC_ARG_TYPE arg3, IPC_ARG_TYPE arg4, IPC_ARG_TYPE arg5, IPC_ARG_TYPE arg6, int timeout);
+static ERROR_CODE ReceiveFromMessageRing(MESSAGE_QUEUE_PTR message_queue, IPC_ARG_TYPE arg1, IPC_ARG_TYPE arg2, IPC_ARG_TYPE arg3, IPC_ARG_TYPE arg4, IPC_ARG_TYPE arg5, IPC_ARG_TYPE arg6);
+static MESSAGE_BUFFER_PTR PeekMessageQueue(MESSAGE_QUEUE_PTR message_queue);
+static void WakeUpMessageQueueWaiters(MESSAGE_QUEUE_PTR message_queue, THREAD_PTR * handoff);
 static inline ERROR_CODE MessageBufferToArgs(MESSAGE_BUFFER_PTR msg_buf, IPC_ARG_TYPE arg1, IPC_ARG_TYPE arg2, IPC_ARG_TYPE arg3, IPC_ARG_TYPE arg4, IPC_ARG_TYPE arg5, IPC_ARG_TYPE arg6);
-static ERROR_CODE WaitOnMessageQueue(MESSAGE_QUEUE_PTR message_queue, int wait_time, MESSAGE_TYPE * type);
+static ERROR_CODE WaitOnMessageQueue(MESSAGE_QUEUE_PTR message_queue, int wait_time, BOOLEAN wait_for_space, MESSAGE_TYPE * type);
 static inline ERROR_CODE ArgsToMessageBuffer(TASK_PTR target_task, MESSAGE_BUFFER_PTR msg_buf, MESSAGE_TYPE type, IPC_ARG_TYPE arg1, IPC_ARG_TYPE arg2, IPC_ARG_TYPE arg3, IPC_ARG_TYPE arg4, IPC_ARG_TYPE arg5, IPC_ARG_TYPE arg6);
+static ERROR_CODE MessageBufferToIpcMessage(MESSAGE_BUFFER_PTR msg_buf, IPC_MESSAGE_PTR message);
+static UINT32 ReceiveBatchFromMessageRing(MESSAGE_QUEUE_PTR message_queue, IPC_MESSAGE_PTR messages, UINT32 max_count, BOOLEAN * blocked);
+static UINT32 PollMessageQueues(MESSAGE_QUEUE_PTR * queues, UINT32 queue_count);
+static UINT32 ReceiveBatchFromMessageList(MESSAGE_QUEUE_PTR message_queue, IPC_MESSAGE_PTR messages, UINT32 max_count, MESSAGE_PRIORITY lowest_priority, BOOLEAN * blocked);
+static MESSAGE_BUFFER_PTR FirstListMessage(MESSAGE_QUEUE_PTR message_queue);
+static MESSAGE_PRIORITY GetMessagePriority(THREAD_PTR thread);
+static ERROR_CODE TakeMessageCredit(TASK_PTR task, MESSAGE_PRIORITY priority, UINT32 wait_time, TASK_PTR * credit_task);
+static void ReturnMessageCredit(TASK_PTR task);
 
 /*! \brief					Initializes the given message queue
  *	\param	message_queue	Message queue to be initialized
@@ -28,7 +64,31 @@ void InitMessageQueue(MESSAGE_QUEUE_PTR message_queue)
 {
 	memset( message_queue, 0, sizeof(MESSAGE_QUEUE) );
 	InitSpinLock( &message_queue->lock );
-	InitSpinLock( &message_queue->wait_event_msg_queue_lock );
+	InitWaitQueue( &message_queue->wait_queue );
+}
+
+/*! \brief					Releases the message ring of the given message queue and drops the messages still queued
+ * 							The payload of the dropped messages is freed and their senders get the credits back.
+ *	\param message_queue	Message queue to be destroyed - nobody should be sending to or receiving from it
+ */
+void DestroyMessageQueue(MESSAGE_QUEUE_PTR message_queue)
+{
+	MESSAGE_RING_PTR ring = message_queue->ring;
+	MESSAGE_BUFFER_PTR msg_buf;
+	
+	if ( ring != NULL )
+	{
+		for( ; ring->head != ring->tail; ring->head++ )
+			DiscardMessageBuffer( &ring->slots[ring->head & MESSAGE_RING_MASK], NULL );
+		message_queue->ring = NULL;
+		kfree( ring );
+	}
+	while( (msg_buf = FirstListMessage( message_queue )) != NULL )
+	{
+		UnlinkFromMessageQueue( message_queue, msg_buf );
+		DiscardMessageBuffer( msg_buf, NULL );
+		kfree( msg_buf );
+	}
 }
 
 /*! \brief					Wrapper to SendMessageCore.
@@ -56,7 +116,11 @@ ERROR_CODE SendMessage(UINT32 pid_target_task, UINT8 queue_no, MESSAGE_TYPE type
 	return SendMessageCore(to_task, &to_task->message_queue[queue_no], type, arg1, arg2, arg3, arg4, arg5, arg6, wait_time);
 }
 
-/*! \brief					Sends a message from current task to the message queue specified. Holds target message queue's lock accross the life time of function.
+/*! \brief					Sends a message from current task to the message queue specified.
+ * 							The message is placed in the message ring if it is free, else it is queued in the message list of its priority under the queue lock.
+ * 							The priority is taken from the sender's scheduler class unless it is set by SetMessagePriority(). Each task can 
+ * 							have max_messages_per_sender messages in the queues, so a flooding task blocks itself instead of the other senders. 
+ * 							The kernel threads are not limited - they all belong to kernel_task and would share a single allowance.
  * 							If wait_time contains NO_WAIT, then this will return with error if queue is full. By default it will wait indefinitely until it places the message on the queue.
  *	\param message_queue	Pointer to target message queue, where the message has to be delivered.
  *	\param type 			Type of the message passed.
@@ -70,39 +134,121 @@ ERROR_CODE SendMessage(UINT32 pid_target_task, UINT8 queue_no, MESSAGE_TYPE type
  */
 ERROR_CODE SendMessageCore(TASK_PTR target_task, MESSAGE_QUEUE_PTR message_queue, MESSAGE_TYPE type, IPC_ARG_TYPE arg1, IPC_ARG_TYPE arg2, IPC_ARG_TYPE arg3, IPC_ARG_TYPE arg4, IPC_ARG_TYPE arg5, IPC_ARG_TYPE arg6, UINT32 wait_time)
 {
+	return SendMessageInternal( target_task, message_queue, type, arg1, arg2, arg3, arg4, arg5, arg6, wait_time, NULL );
+}
+
+/*! \brief					Sends a message and waits for the reply.
+ * 							If a receiver is blocked on the message queue, the processor is handed over to it directly instead of going through the ready queue.
+ * 							The receiver hands it back the same way when it replies and blocks for the next message.
+ *	\param target_task		Receiver task
+ *	\param message_queue	Pointer to target message queue, where the message has to be delivered.
+ *	\param type 			Type of the message passed.
+ *	\param arg1 - arg6		Arguments of the message(see SendMessageCore())
+ *	\param reply_type		Expected type of the reply
+ *	\param reply_arg1 - reply_arg6	Holders to put the arguments of the reply(see WaitForReply())
+ *  \param timeout			Max time to wait for the message to be queued and for the reply
+ */
+ERROR_CODE CallMessage(TASK_PTR target_task, MESSAGE_QUEUE_PTR message_queue, MESSAGE_TYPE type, IPC_ARG_TYPE arg1, IPC_ARG_TYPE arg2, IPC_ARG_TYPE arg3, IPC_ARG_TYPE arg4, IPC_ARG_TYPE arg5, IPC_ARG_TYPE arg6, 
+		MESSAGE_TYPE reply_type, IPC_ARG_TYPE reply_arg1, IPC_ARG_TYPE reply_arg2, IPC_ARG_TYPE reply_arg3, IPC_ARG_TYPE reply_arg4, IPC_ARG_TYPE reply_arg5, IPC_ARG_TYPE reply_arg6, int timeout)
+{
+	THREAD_PTR current_thread, receiver_thread = NULL;
+	WAIT_EVENT wait_event;
+	ERROR_CODE ret;
+	
+	current_thread = GetCurrentThread();
+	
+	/*register for the reply before sending, else a quick reply will be missed*/
+	InitWaitEventOnStack( &wait_event );
+	AddWaitEventToQueue( &current_thread->ipc_reply_event, &wait_event );
+	current_thread->ipc_call_pending = 1;
+	
+	ret = SendMessageInternal( target_task, message_queue, type, arg1, arg2, arg3, arg4, arg5, arg6, timeout, &receiver_thread );
+	if ( ret != ERROR_SUCCESS )
+	{
+		current_thread->ipc_call_pending = 0;
+		RemoveWaitEvent( &wait_event );
+		return ret;
+	}
+	
+	/*the receiver is woken up but not made ready - run it in place of this thread*/
+	if ( receiver_thread != NULL )
+		SetHandoffThread( receiver_thread );
+	
+	return WaitForReplyCore( &wait_event, reply_type, reply_arg1, reply_arg2, reply_arg3, reply_arg4, reply_arg5, reply_arg6, timeout );
+}
+
+/*! Sends a message to the given message queue
+ *	\param handoff - if not NULL, a receiver blocked on the queue is returned here instead of making it ready
+ *	\see SendMessageCore()
+ */
+static ERROR_CODE SendMessageInternal(TASK_PTR target_task, MESSAGE_QUEUE_PTR message_queue, MESSAGE_TYPE type, IPC_ARG_TYPE arg1, IPC_ARG_TYPE arg2, IPC_ARG_TYPE arg3, IPC_ARG_TYPE arg4, IPC_ARG_TYPE arg5, IPC_ARG_TYPE arg6, UINT32 wait_time, THREAD_PTR * handoff)
+{
+	MESSAGE_BUFFER message;
 	MESSAGE_BUFFER_PTR msg_buf;
+	MESSAGE_PRIORITY priority;
+	TASK_PTR credit_task;
 	ERROR_CODE	error_ret = ERROR_SUCCESS;;
 
 	if(message_queue == NULL)
 		return ERROR_INVALID_PARAMETER;
 
+	priority = GetMessagePriority( GetCurrentThread() );
+	error_ret = TakeMessageCredit( GetCurrentThread()->task, priority, wait_time, &credit_task );
+	if ( error_ret != ERROR_SUCCESS )
+		return error_ret;
+	
+	/*copy the payload before taking any lock - the ring and the lists are locked only to publish the message*/
+	error_ret = ArgsToMessageBuffer(target_task, &message, type, arg1, arg2, arg3, arg4, arg5, arg6 );
+	if ( error_ret != ERROR_SUCCESS )
+	{
+		ReturnMessageCredit( credit_task );
+		return error_ret;
+	}
+	message.priority = priority;
+	message.credit_task = credit_task;
+	
+	/*try the ring first - it does not need the queue lock or a message buffer allocation*/
+	if ( priority == MESSAGE_PRIORITY_NORMAL && SendToMessageRing( message_queue, &message, handoff ) == ERROR_SUCCESS )
+		return ERROR_SUCCESS;
+	
+	msg_buf = (MESSAGE_BUFFER_PTR)kmalloc(sizeof(MESSAGE_BUFFER), 0);
+	if ( msg_buf == NULL )
+	{
+		error_ret = ERROR_NOT_ENOUGH_MEMORY;
+		goto failed;
+	}
+	*msg_buf = message;
+	
 	SpinLock( &(message_queue->lock) );
 
-	/*Sending this message depends on queue length and wait time */
-	if(message_queue->buf_count >= max_message_queue_length)
+	/*Sending this message depends on queue length and wait time - urgent messages are never held back */
+	if( priority != MESSAGE_PRIORITY_URGENT && MESSAGE_QUEUE_LENGTH(message_queue) >= max_message_queue_length )
 	{
 		if( wait_time == MESSAGE_QUEUE_NO_WAIT )
 			error_ret = ERROR_NOT_ENOUGH_MEMORY;
 		else
-			error_ret = WaitOnMessageQueue( message_queue, wait_time, NULL );
+		{
+			SpinUnlock( &(message_queue->lock) );
+			error_ret = WaitOnMessageQueue( message_queue, wait_time, TRUE, NULL );
+			SpinLock( &(message_queue->lock) );
+		}
 		if ( error_ret != ERROR_SUCCESS )
 		{
+			SpinUnlock( &(message_queue->lock) );
+			kfree( msg_buf );
 			error_ret = ERROR_NOT_ENOUGH_MEMORY;
-			goto done;
+			goto failed;
 		}
 	}
-	msg_buf = (MESSAGE_BUFFER_PTR)kmalloc(sizeof(MESSAGE_BUFFER), 0);
-	if ( msg_buf == NULL )
-	{
-		error_ret = ERROR_NOT_ENOUGH_MEMORY;
-		goto done;
-	}
-
-	ArgsToMessageBuffer(target_task, msg_buf, type, arg1, arg2, arg3, arg4, arg5, arg6 );
 	AddToMessageQueue( message_queue, msg_buf );
-
-done:
 	SpinUnlock( &(message_queue->lock) );
+	
+	WakeUpMessageQueueWaiters( message_queue, handoff );
+	return ERROR_SUCCESS;
+
+failed:
+	/*the message is not queued - release the copied payload and the credit*/
+	DiscardMessageBuffer( &message, target_task->virtual_map );
 	return error_ret;
 }
 
@@ -140,13 +286,25 @@ ERROR_CODE ReceiveMessage(UINT8 queue_no, IPC_ARG_TYPE arg1, IPC_ARG_TYPE arg2,
   *	\param arg5				Holder to put argument 5 of the message(Address for MESSAGE_TYPE_REFERENCE, MESSAGE_TYPE_SHARE and MESSAGE_TYPE_SHARE_PA)
  *	\param arg6 			Holder to put argument 6 of the message(Length of the buffer for MESSAGE_TYPE_REFERENCE, MESSAGE_TYPE_SHARE and MESSAGE_TYPE_SHARE_PA)
  *  \param wait_time		Time in seconds that the user wants to wait for the message. If 0, then it's non blocking, if -1, it's blocking forever.
+ *	\return ERROR_INVALID_PARAMETER if the receive buffer does not suit the message, which stays queued. 
+ * 			If the payload can not be copied to a valid buffer(MESSAGE_TYPE_VECTOR) the message is consumed and the error is returned.
  */
 ERROR_CODE ReceiveMessageCore(MESSAGE_QUEUE_PTR message_queue, IPC_ARG_TYPE arg1, IPC_ARG_TYPE arg2, IPC_ARG_TYPE arg3, IPC_ARG_TYPE arg4, IPC_ARG_TYPE arg5, IPC_ARG_TYPE arg6, UINT32 wait_time)
 {
-	ERROR_CODE ret = ERROR_SUCCESS;
+	MESSAGE_BUFFER_PTR msg_buf;
+	ERROR_CODE ret;
 	
 	assert(message_queue != NULL);
 
+	/*messages in the ring are older than the normal priority messages in the list, but urgent and high priority messages go first*/
+	if ( !HIGH_PRIORITY_MESSAGE_PENDING(message_queue) )
+	{
+		ret = ReceiveFromMessageRing( message_queue, arg1, arg2, arg3, arg4, arg5, arg6 );
+		if ( ret != ERROR_NOT_FOUND )
+			return ret;
+	}
+	ret = ERROR_SUCCESS;
+	
 	SpinLock( &(message_queue->lock) );
 	if(message_queue->buf_count == 0)
 	{
@@ -155,7 +313,14 @@ ERROR_CODE ReceiveMessageCore(MESSAGE_QUEUE_PTR message_queue, IPC_ARG_TYPE arg1
 		else
 		{
 			SpinUnlock( &(message_queue->lock) );
-			ret = WaitOnMessageQueue( message_queue, wait_time, NULL );
+			ret = WaitOnMessageQueue( message_queue, wait_time, FALSE, NULL );
+			if ( ret == ERROR_SUCCESS && !HIGH_PRIORITY_MESSAGE_PENDING(message_queue) )
+			{
+				ret = ReceiveFromMessageRing( message_queue, arg1, arg2, arg3, arg4, arg5, arg6 );
+				if ( ret != ERROR_NOT_FOUND )
+					return ret;
+				ret = ERROR_SUCCESS;
+			}
 			SpinLock( &(message_queue->lock) );
 		}
 	}
@@ -165,18 +330,157 @@ ERROR_CODE ReceiveMessageCore(MESSAGE_QUEUE_PTR message_queue, IPC_ARG_TYPE arg1
 		goto done;
 	}
 
-	/*fill the args*/
-	ret = MessageBufferToArgs( message_queue->msg_queue, arg1, arg2, arg3, arg4, arg5, arg6 );
-	if( ret != ERROR_SUCCESS )
+	/*take the message out of the list and fill the args after releasing the lock*/
+	msg_buf = FirstListMessage( message_queue );
+	if ( !CanReceiveMessage( msg_buf, arg1, arg5, arg6 ) )
+	{
+		ret = ERROR_INVALID_PARAMETER;
 		goto done;
-	
-	RemoveFromMessageQueue(message_queue);
+	}
+	UnlinkFromMessageQueue( message_queue, msg_buf );
 		
 done:
 	SpinUnlock( &(message_queue->lock) );
+	if ( ret != ERROR_SUCCESS )
+		return ret;
+	
+	WakeUpMessageQueueWaiters( message_queue, NULL );
+	ret = MessageBufferToArgs( msg_buf, arg1, arg2, arg3, arg4, arg5, arg6 );
+	kfree( msg_buf );
 	return ret;
 }
 
+/*! \brief					Receives up to max_count messages from the given message queue.
+ * 							The messages are taken out of the ring and the message lists a chunk at a time under one lock acquisition and 
+ * 							copied to the array after releasing the lock; the waiting senders are woken up once for the whole batch.
+ * 							The status of each received entry holds the result of copying its payload.
+ *	\param message_queue	Message queue from where messages have to be fetched
+ *	\param messages			Array to put the messages - for MESSAGE_TYPE_VECTOR messages args[4] and args[5] of each entry should hold the receive 
+ * 							IPC_IOVEC array and its count, else the batch stops at that message. For MESSAGE_TYPE_REFERENCE messages args[4] and 
+ * 							args[5] can hold the receive buffer and its length; if args[4] is NULL the kernel copy of the payload is handed over in 
+ * 							args[4] and args[5] and the caller should kfree() it.
+ *	\param max_count		Number of entries in the array
+ *	\param count			Number of messages received
+ *  \param wait_time		Time to wait if the queue is empty. If MESSAGE_QUEUE_NO_WAIT, then it's non blocking, if 0, it's blocking forever.
+ *	\return ERROR_INVALID_PARAMETER if the first message can not be received into the given entry - it stays queued
+ */
+ERROR_CODE ReceiveMessageBatch(MESSAGE_QUEUE_PTR message_queue, IPC_MESSAGE_PTR messages, UINT32 max_count, UINT32 * count, UINT32 wait_time)
+{
+	BOOLEAN blocked = FALSE;
+	UINT32 received;
+	
+	assert( message_queue != NULL );
+	assert( count != NULL );
+	*count = 0;
+	if ( messages == NULL || max_count == 0 )
+		return ERROR_INVALID_PARAMETER;
+	
+	if ( MESSAGE_QUEUE_LENGTH(message_queue) == 0 )
+	{
+		if ( wait_time == MESSAGE_QUEUE_NO_WAIT )
+			return ERROR_NOT_FOUND;
+		if ( WaitOnMessageQueue( message_queue, wait_time, FALSE, NULL ) != ERROR_SUCCESS )
+			return ERROR_NOT_FOUND;
+	}
+	
+	/*same order as ReceiveMessageCore() - urgent and high priority lists, the ring and then the remaining lists; 
+	  a message which can not be received stops the batch, so that the later messages are not received before it*/
+	received = 0;
+	if ( HIGH_PRIORITY_MESSAGE_PENDING(message_queue) )
+		received = ReceiveBatchFromMessageList( message_queue, messages, max_count, MESSAGE_PRIORITY_HIGH, &blocked );
+	if ( received < max_count && !blocked )
+		received += ReceiveBatchFromMessageRing( message_queue, &messages[received], max_count - received, &blocked );
+	if ( received < max_count && !blocked && message_queue->buf_count > 0 )
+		received += ReceiveBatchFromMessageList( message_queue, &messages[received], max_count - received, MESSAGE_PRIORITY_LOW, &blocked );
+	
+	*count = received;
+	if ( received == 0 )
+		return blocked ? ERROR_INVALID_PARAMETER : ERROR_NOT_FOUND;
+	WakeUpMessageQueueWaiters( message_queue, NULL );
+	return ERROR_SUCCESS;
+}
+
+/*! \brief			Sends the given messages - each message can go to a different task and queue.
+ * 					Used to fan out a request to several servers without waiting for each send.
+ *	\param messages	Messages to send - task, queue, type and args of each entry should be filled; status of each entry is updated with the result
+ *	\param count	Number of messages
+ *  \param wait_time	Indicates how much time the sender can wait for each message to be queued.
+ *	\return			Number of messages sent successfully
+ */
+UINT32 SendMessageBatch(IPC_MESSAGE_PTR messages, UINT32 count, UINT32 wait_time)
+{
+	UINT32 i, sent = 0;
+	
+	assert( messages != NULL || count == 0 );
+	for(i=0; i<count; i++)
+	{
+		IPC_ARG_TYPE * args = messages[i].args;
+		messages[i].status = SendMessageInternal( messages[i].task, messages[i].queue, messages[i].type, args[0], args[1], args[2], args[3], args[4], args[5], wait_time, NULL );
+		if ( messages[i].status == ERROR_SUCCESS )
+			sent++;
+	}
+	return sent;
+}
+
+/*! \brief					Waits until any of the given message queues has a message or any of the given wait queues is woken up.
+ * 							This lets a server thread service all of its message queues and its pending IRPs(through the wait queue its 
+ * 							IRP completion routine wakes up, see ReadWriteDeviceCompletionRoutine()) without a thread per queue.
+ *	\param queues			Message queues to wait on
+ *	\param queue_count		Number of message queues
+ *	\param wait_queues		Additional wait queues to wait on - can be NULL
+ *	\param wait_queue_count	Number of additional wait queues
+ *	\param ready			Bit n is set if queues[n] has a message; bit queue_count+n is set if wait_queues[n] was woken up
+ *  \param wait_time		Time to wait. If MESSAGE_QUEUE_NO_WAIT, then it's non blocking(poll), if 0, it's blocking forever.
+ */
+ERROR_CODE WaitForMessageQueues(MESSAGE_QUEUE_PTR * queues, UINT32 queue_count, WAIT_QUEUE_PTR * wait_queues, UINT32 wait_queue_count, UINT32 * ready, int wait_time)
+{
+	WAIT_EVENT wait_events[IPC_MAX_WAIT_QUEUES];
+	UINT32 i, total;
+	ERROR_CODE ret;
+	
+	total = queue_count + wait_queue_count;
+	if ( ready == NULL || total == 0 || total > IPC_MAX_WAIT_QUEUES || (queue_count && queues == NULL) || (wait_queue_count && wait_queues == NULL) )
+		return ERROR_INVALID_PARAMETER;
+	
+	*ready = PollMessageQueues( queues, queue_count );
+	if ( *ready )
+		return ERROR_SUCCESS;
+	if ( wait_time == MESSAGE_QUEUE_NO_WAIT )
+		return ERROR_NOT_FOUND;
+	
+	/*link the events so that the first one fired wakes us up and dormants the others*/
+	for(i=0; i<total; i++)
+	{
+		InitWaitEventOnStack( &wait_events[i] );
+		if ( i > 0 )
+			ADD_MULTIPLE_WAIT_EVENTS( &wait_events[0], &wait_events[i] );
+	}
+	for(i=0; i<queue_count; i++)
+		AddWaitEventToQueue( &queues[i]->wait_queue, &wait_events[i] );
+	for(i=0; i<wait_queue_count; i++)
+		AddWaitEventToQueue( wait_queues[i], &wait_events[queue_count+i] );
+	
+	/*a message might have arrived before the events were queued*/
+	MemoryBarrier();
+	*ready = PollMessageQueues( queues, queue_count );
+	if ( *ready )
+	{
+		RemoveWaitEvent( &wait_events[0] );
+		return ERROR_SUCCESS;
+	}
+	
+	ret = WaitForWaitEvent( &wait_events[0], wait_time );
+	for(i=0; i<wait_queue_count; i++)
+	{
+		if ( wait_events[queue_count+i].fired )
+			*ready |= 1 << (queue_count+i);
+	}
+	*ready |= PollMessageQueues( queues, queue_count );
+	if ( *ready )
+		return ERROR_SUCCESS;
+	return ret == ERROR_SUCCESS ? ERROR_NOT_FOUND : ret;
+}
+
 /*! Replies to the last received message
  *	\param type 	Type of the message passed.
  *	\param arg1				Argument 1 of the message
@@ -188,11 +492,26 @@ done:
  */
 ERROR_CODE ReplyToLastMessage(MESSAGE_TYPE type, IPC_ARG_TYPE arg1, IPC_ARG_TYPE arg2, IPC_ARG_TYPE arg3, IPC_ARG_TYPE arg4, IPC_ARG_TYPE arg5, IPC_ARG_TYPE arg6)
 {
-	THREAD_PTR current_thread, to_thread;
+	THREAD_PTR current_thread;
 	ERROR_CODE ret;
 	
 	current_thread = GetCurrentThread();
-	to_thread = current_thread->ipc_reply_to_thread;
+	ret = ReplyToMessage( current_thread->ipc_reply_to_thread, type, arg1, arg2, arg3, arg4, arg5, arg6 );
+	if ( ret == ERROR_SUCCESS )
+		current_thread->ipc_reply_to_thread = NULL;
+	
+	return ret;
+}
+
+/*! Replies to a message received earlier - used to reply the messages received by ReceiveMessageBatch()
+ *	\param to_thread		Sender of the message(sender_thread of IPC_MESSAGE)
+ *	\param type 			Type of the message passed.
+ *	\param arg1 - arg6		Arguments of the message(see ReplyToLastMessage())
+ */
+ERROR_CODE ReplyToMessage(THREAD_PTR to_thread, MESSAGE_TYPE type, IPC_ARG_TYPE arg1, IPC_ARG_TYPE arg2, IPC_ARG_TYPE arg3, IPC_ARG_TYPE arg4, IPC_ARG_TYPE arg5, IPC_ARG_TYPE arg6)
+{
+	ERROR_CODE ret;
+	
 	if ( to_thread == NULL )
 	{
 		kprintf("Thread not found");
@@ -204,10 +523,15 @@ ERROR_CODE ReplyToLastMessage(MESSAGE_TYPE type, IPC_ARG_TYPE arg1, IPC_ARG_TYPE
 	if ( ret != ERROR_SUCCESS )
 		return ret;
 	
-	/*wakeup the thread*/
-	WakeUpEvent( &to_thread->ipc_reply_event, WAIT_EVENT_WAKE_UP_ALL );
-	
-	current_thread->ipc_reply_to_thread = NULL;
+	/*wakeup the thread - if it is blocked in CallMessage() switch to it directly when this thread blocks for the next message*/
+	if ( to_thread->ipc_call_pending )
+	{
+		to_thread = WakeUpWaitQueueForHandoff( &to_thread->ipc_reply_event, WAIT_EVENT_WAKE_UP_ALL );
+		if ( to_thread != NULL )
+			SetHandoffThread( to_thread );
+	}
+	else
+		WakeUpWaitQueue( &to_thread->ipc_reply_event, WAIT_EVENT_WAKE_UP_ALL );
 	
 	return ERROR_SUCCESS;
 }
@@ -222,16 +546,31 @@ ERROR_CODE ReplyToLastMessage(MESSAGE_TYPE type, IPC_ARG_TYPE arg1, IPC_ARG_TYPE
  *  \param timeout	Max time to wait for the reply
  */
 ERROR_CODE WaitForReply(MESSAGE_TYPE type, IPC_ARG_TYPE arg1, IPC_ARG_TYPE arg2, IPC_ARG_TYPE arg3, IPC_ARG_TYPE arg4, IPC_ARG_TYPE arg5, IPC_ARG_TYPE arg6, int timeout)
+{
+	WAIT_EVENT wait_event;
+	
+	/*wait for reply with timeout*/
+	InitWaitEventOnStack( &wait_event );
+	AddWaitEventToQueue( &GetCurrentThread()->ipc_reply_event, &wait_event );
+	return WaitForReplyCore( &wait_event, type, arg1, arg2, arg3, arg4, arg5, arg6, timeout );
+}
+
+/*! Waits on the given reply event and copies the reply
+ *	\param wait_event	Event queued in the current thread's reply event queue - it is removed from the queue here
+ *	\see WaitForReply()
+ */
+static ERROR_CODE WaitForReplyCore(WAIT_EVENT_PTR wait_event, MESSAGE_TYPE type, IPC_ARG_TYPE arg1, IPC_ARG_TYPE arg2, IPC_ARG_TYPE arg3, IPC_ARG_TYPE arg4, IPC_ARG_TYPE arg5, IPC_ARG_TYPE arg6, int timeout)
 {
 	THREAD_PTR current_thread;
-	WAIT_EVENT_PTR wait_event;
+	ERROR_CODE ret;
 	
 	current_thread = GetCurrentThread();
-	
-	/*wait for reply with timeout*/
-	wait_event = AddToEventQueue( &current_thread->ipc_reply_event );
-	if ( WaitForEvent(wait_event, timeout ) == 0 )
-		return ERROR_TIMEOUT;
+	ret = WaitForWaitEvent( wait_event, timeout );
+	/*if the reply came before this thread blocked, the receiver handed over is still waiting to run*/
+	FlushHandoffThread();
+	current_thread->ipc_call_pending = 0;
+	if ( ret != ERROR_SUCCESS )
+		return ret;
 
 	if ( current_thread->ipc_reply_message.type != type )
 		return ERROR_INVALID_FORMAT;
@@ -244,7 +583,7 @@ ERROR_CODE WaitForReply(MESSAGE_TYPE type, IPC_ARG_TYPE arg1, IPC_ARG_TYPE arg2,
 */
 void SkipMessage(MESSAGE_QUEUE_PTR msg_queue)
 {
-	ReceiveMessageCore(NULL, NULL, NULL, NULL, NULL, NULL, msg_queue, MESSAGE_QUEUE_NO_WAIT);
+	ReceiveMessageCore(msg_queue, NULL, NULL, NULL, NULL, NULL, NULL, MESSAGE_QUEUE_NO_WAIT);
 }
 
 /*! \brief					Returns information about next message present in the message queue.
@@ -261,28 +600,29 @@ ERROR_CODE GetNextMessageInfo(MESSAGE_QUEUE_PTR message_queue, MESSAGE_TYPE *typ
 	assert(message_queue != NULL);
 
 	SpinLock( &(message_queue->lock) );
-	if(message_queue->buf_count == 0)
+	if( MESSAGE_QUEUE_LENGTH(message_queue) == 0 )
 	{
 		if( wait_time == MESSAGE_QUEUE_NO_WAIT )
 			ret = ERROR_NOT_FOUND;
 		else
 		{
 			SpinUnlock( &(message_queue->lock) );
-			ret = WaitOnMessageQueue( message_queue, wait_time, NULL );
+			ret = WaitOnMessageQueue( message_queue, wait_time, FALSE, NULL );
 			SpinLock( &(message_queue->lock) );
 		}
 			
 	}
 	/*wait might timedout or somebody might have taken message before we took the spin lock*/
-	if( ret!=ERROR_SUCCESS || message_queue->buf_count == 0)
+	if( ret==ERROR_SUCCESS )
+		mb = PeekMessageQueue( message_queue );
+	if( mb == NULL )
 	{
 		ret = ERROR_NOT_FOUND;
 		goto done;
 	}
 
-	mb = message_queue->msg_queue;
 	*type = mb->type;
-	if ( mb->type == MESSAGE_TYPE_REFERENCE )
+	if ( mb->type == MESSAGE_TYPE_REFERENCE || mb->type == MESSAGE_TYPE_VECTOR )
 		*length = (int)mb->args[IPC_LENGTH_ARG_INDEX];
 
 done:
@@ -298,13 +638,14 @@ done:
  *	\param arg2 		Argument 2 of the message
  *	\param arg3			Argument 3 of the message
  *	\param arg4 		Argument 4 of the message
- *	\param arg5			Argument 5 of the message(Address to copy for MESSAGE_TYPE_REFERENCE, MESSAGE_TYPE_SHARE and MESSAGE_TYPE_SHARE_PA)
- *	\param arg6 		Argument 6 of the message(Length of the buffer for MESSAGE_TYPE_REFERENCE, MESSAGE_TYPE_SHARE and MESSAGE_TYPE_SHARE_PA)
+ *	\param arg5			Argument 5 of the message(Address to copy for MESSAGE_TYPE_REFERENCE, MESSAGE_TYPE_SHARE and MESSAGE_TYPE_SHARE_PA, IPC_IOVEC array for MESSAGE_TYPE_VECTOR)
+ *	\param arg6 		Argument 6 of the message(Length of the buffer for MESSAGE_TYPE_REFERENCE, MESSAGE_TYPE_SHARE and MESSAGE_TYPE_SHARE_PA, number of IPC_IOVEC entries for MESSAGE_TYPE_VECTOR)
  */
 static inline ERROR_CODE ArgsToMessageBuffer(TASK_PTR target_task, MESSAGE_BUFFER_PTR msg_buf, MESSAGE_TYPE type, IPC_ARG_TYPE arg1, IPC_ARG_TYPE arg2, IPC_ARG_TYPE arg3, IPC_ARG_TYPE arg4, IPC_ARG_TYPE arg5, IPC_ARG_TYPE arg6)
 {
 	ERROR_CODE ret;
 	VADDR copy_va;
+	UINT32 length;
 	
 	msg_buf->args[IPC_ARG_INDEX_1] = arg1;
 	msg_buf->args[IPC_ARG_INDEX_2] = arg2;
@@ -342,8 +683,6 @@ static inline ERROR_CODE ArgsToMessageBuffer(TASK_PTR target_task, MESSAGE_BUFFE
 			/*copy the result*/
 			msg_buf->args[IPC_ARG_INDEX_5] = (IPC_ARG_TYPE)copy_va;
 			msg_buf->args[IPC_ARG_INDEX_6] = (IPC_ARG_TYPE)IPC_ARGUMENT_LENGTH;
-			
-			type = MESSAGE_TYPE_REFERENCE;
 			break;
 		/*internal message to share the virtual page*/
 		case MESSAGE_TYPE_SHARE_PA:
@@ -356,35 +695,49 @@ static inline ERROR_CODE ArgsToMessageBuffer(TASK_PTR target_task, MESSAGE_BUFFE
 			
 			type = MESSAGE_TYPE_VALUE;
 			break;
+		/*gather the ranges described by arg5 - whole pages are shared copy-on-write and only the partial pages are copied*/
+		case MESSAGE_TYPE_VECTOR:
+			ret = CreateIpcVectorBuffer( (IPC_IOVEC_PTR)IPR_ARGUMENT_ADDRESS, (UINT32)IPC_ARGUMENT_LENGTH, (IPC_VECTOR_BUFFER_PTR *)&msg_buf->args[IPC_ADDRESS_ARG_INDEX], &length );
+			if ( ret != ERROR_SUCCESS )
+				return ret;
+			msg_buf->args[IPC_LENGTH_ARG_INDEX] = (IPC_ARG_TYPE)length;
+			break;
 		default:
 			return ERROR_INVALID_PARAMETER;
 	}
 	msg_buf->type = type;
+	msg_buf->priority = MESSAGE_PRIORITY_NORMAL;
 	msg_buf->sender_thread = GetCurrentThread();
+	msg_buf->credit_task = NULL;
 
 	return ERROR_SUCCESS;
 }
 
 /*! Copies values from message buffer structure to function arguments
- *	\param msg_buf 		Message buffer from which arguments to copy.
+ * 	The message is consumed even if the payload can not be copied - its payload is released and the sender credit is returned.
+ *	\param msg_buf 		Message buffer from which arguments to copy - it should be already removed from the message queue
  *	\param type 		Type of the message passed.
- *	\param arg1			Argument 1 of the message
+ *	\param arg1			Argument 1 of the message - NULL to discard the message
  *	\param arg2 		Argument 2 of the message
  *	\param arg3			Argument 3 of the message
  *	\param arg4 		Argument 4 of the message
- *	\param arg5			Argument 5 of the message(Address to copy for MESSAGE_TYPE_REFERENCE, MESSAGE_TYPE_SHARE and MESSAGE_TYPE_SHARE_PA)
- *	\param arg6 		Argument 6 of the message(Length of the buffer for MESSAGE_TYPE_REFERENCE, MESSAGE_TYPE_SHARE and MESSAGE_TYPE_SHARE_PA)
+ *	\param arg5			Argument 5 of the message(Address to copy for MESSAGE_TYPE_REFERENCE, MESSAGE_TYPE_SHARE and MESSAGE_TYPE_SHARE_PA, receive IPC_IOVEC array for MESSAGE_TYPE_VECTOR)
+ *	\param arg6 		Argument 6 of the message(Length of the buffer for MESSAGE_TYPE_REFERENCE, MESSAGE_TYPE_SHARE and MESSAGE_TYPE_SHARE_PA, number of IPC_IOVEC entries for MESSAGE_TYPE_VECTOR)
  */
 static inline ERROR_CODE MessageBufferToArgs(MESSAGE_BUFFER_PTR msg_buf, IPC_ARG_TYPE arg1, IPC_ARG_TYPE arg2, IPC_ARG_TYPE arg3, IPC_ARG_TYPE arg4, IPC_ARG_TYPE arg5, IPC_ARG_TYPE arg6)
 {
 	THREAD_PTR current_thread;
+	ERROR_CODE ret = ERROR_SUCCESS;
 	int copy_size;
 	
 	assert( msg_buf != NULL );
 	
 	/*! if the caller really wants to skip the message then do it*/
 	if ( arg1 == NULL )
+	{
+		DiscardMessageBuffer( msg_buf, NULL );
 		goto done;
+	}
 	
 	if ( arg1 )
 		*(long **)arg1 = msg_buf->args[IPC_ARG_INDEX_1];
@@ -406,111 +759,921 @@ static inline ERROR_CODE MessageBufferToArgs(MESSAGE_BUFFER_PTR msg_buf, IPC_ARG
 			break;
 		case MESSAGE_TYPE_REFERENCE:
 			/*sanity check*/
-			if( IPC_ARGUMENT_LENGTH <= 0 || IPC_ARGUMENT_LENGTH > PAGE_SIZE )
+			if( IPR_ARGUMENT_ADDRESS == NULL || IPC_ARGUMENT_LENGTH <= 0 || IPC_ARGUMENT_LENGTH > PAGE_SIZE )
 			{
 				KTRACE("IPC_ARGUMENT_LENGTH %d\n", IPC_ARGUMENT_LENGTH);
-				return ERROR_INVALID_PARAMETER;
+				ret = ERROR_INVALID_PARAMETER;
+			}
+			else
+			{
+				/*copy the entire sender buffer if reciver buffer is big enough else copy only the size of receiver buffer*/
+				copy_size = (int)msg_buf->args[IPC_LENGTH_ARG_INDEX];
+				if ( copy_size > IPC_ARGUMENT_LENGTH )
+					copy_size = IPC_ARGUMENT_LENGTH;
+				memcpy(IPR_ARGUMENT_ADDRESS, msg_buf->args[IPC_ADDRESS_ARG_INDEX], copy_size);
 			}
-			/*copy the entire sender buffer if reciver buffer is big enough else copy only the size of receiver buffer*/
-			copy_size = (int)msg_buf->args[IPC_LENGTH_ARG_INDEX];
-			if ( copy_size > IPC_ARGUMENT_LENGTH )
-				copy_size = IPC_ARGUMENT_LENGTH;
-				
-			memcpy(IPR_ARGUMENT_ADDRESS, msg_buf->args[IPC_ADDRESS_ARG_INDEX], copy_size);
 			kfree(msg_buf->args[IPC_ADDRESS_ARG_INDEX]);
 			break;
+		/*scatter the payload to the receiver buffers - each IPC_IOVEC length is updated with the bytes received*/
+		case MESSAGE_TYPE_VECTOR:
+			if ( IPR_ARGUMENT_ADDRESS == NULL || IPC_ARGUMENT_LENGTH <= 0 )
+				ret = ERROR_INVALID_PARAMETER;
+			else
+				ret = CopyIpcVectorBuffer( msg_buf->args[IPC_ADDRESS_ARG_INDEX], (IPC_IOVEC_PTR)IPR_ARGUMENT_ADDRESS, (UINT32)IPC_ARGUMENT_LENGTH );
+			FreeIpcVectorBuffer( msg_buf->args[IPC_ADDRESS_ARG_INDEX] );
+			break;
 	}
 	
 done:
 	current_thread = GetCurrentThread();
 	current_thread->ipc_reply_to_thread = msg_buf->sender_thread;
-	return ERROR_SUCCESS;
+	/*the message is consumed - let the sender queue another one*/
+	if ( msg_buf->credit_task != NULL )
+	{
+		ReturnMessageCredit( msg_buf->credit_task );
+		msg_buf->credit_task = NULL;
+	}
+	return ret;
+}
+
+/*! Checks whether the given receive buffer suits the message, so that a message which can not be received is left in the queue
+ *	\param msg_buf		Message to check
+ *	\param arg1			Argument 1 holder of the receiver - NULL if the message is skipped
+ *	\param arg5			Receive buffer for MESSAGE_TYPE_REFERENCE, receive IPC_IOVEC array for MESSAGE_TYPE_VECTOR
+ *	\param arg6			Length of the receive buffer, number of IPC_IOVEC entries for MESSAGE_TYPE_VECTOR
+ */
+static BOOLEAN CanReceiveMessage(MESSAGE_BUFFER_PTR msg_buf, IPC_ARG_TYPE arg1, IPC_ARG_TYPE arg5, IPC_ARG_TYPE arg6)
+{
+	if ( arg1 == NULL )
+		return TRUE;
+	if ( msg_buf->type == MESSAGE_TYPE_REFERENCE )
+		return IPR_ARGUMENT_ADDRESS != NULL && IPC_ARGUMENT_LENGTH > 0 && IPC_ARGUMENT_LENGTH <= PAGE_SIZE;
+	if ( msg_buf->type == MESSAGE_TYPE_VECTOR )
+		return IPR_ARGUMENT_ADDRESS != NULL && IPC_ARGUMENT_LENGTH > 0;
+	return TRUE;
+}
+
+/*! Releases the payload of a message which is not delivered and returns its sender credit
+ *	\param msg_buf		Message buffer to release
+ *	\param target_map	Virtual map of the receiver to unmap a MESSAGE_TYPE_SHARE message from - NULL to leave it mapped
+ */
+static void DiscardMessageBuffer(MESSAGE_BUFFER_PTR msg_buf, VIRTUAL_MAP_PTR target_map)
+{
+	switch( msg_buf->type )
+	{
+		case MESSAGE_TYPE_REFERENCE:
+			kfree( msg_buf->args[IPC_ADDRESS_ARG_INDEX] );
+			break;
+		case MESSAGE_TYPE_VECTOR:
+			FreeIpcVectorBuffer( msg_buf->args[IPC_ADDRESS_ARG_INDEX] );
+			break;
+		case MESSAGE_TYPE_SHARE:
+			if ( target_map != NULL )
+				FreeVirtualMemory( target_map, (VADDR)msg_buf->args[IPC_ADDRESS_ARG_INDEX], (size_t)msg_buf->args[IPC_LENGTH_ARG_INDEX], 0 );
+			break;
+		default:
+			break;
+	}
+	ReturnMessageCredit( msg_buf->credit_task );
+	msg_buf->credit_task = NULL;
 }
 
 /*! Waits for the given message queue for message buffer count to be incremented or decremented
  *	\param message_queue 	Message queue for which message buffer needs monitoring
  *	\param wait_time		How long monitoring can happen
+ *	\param wait_for_space	TRUE if the caller is a sender waiting for the queue to drain, FALSE if it is a receiver waiting for a message
  *	\param type				Type of the new buffer will be updated in this variabled
  */
-static ERROR_CODE WaitOnMessageQueue(MESSAGE_QUEUE_PTR message_queue, int wait_time, MESSAGE_TYPE * type)
+static ERROR_CODE WaitOnMessageQueue(MESSAGE_QUEUE_PTR message_queue, int wait_time, BOOLEAN wait_for_space, MESSAGE_TYPE * type)
 {
-	ERROR_CODE ret = ERROR_SUCCESS;
-	WAIT_EVENT_PTR	my_wait_event;
-	UINT32 ret_time;
+	ERROR_CODE ret;
+	WAIT_EVENT	my_wait_event;
+	UINT32 length;
 	
 	/* Wait for this message queue */
-	SpinLock( &message_queue->wait_event_msg_queue_lock );
-	my_wait_event = AddToEventQueue( &message_queue->wait_event_msg_queue );
-	SpinUnlock( &message_queue->wait_event_msg_queue_lock );
+	InitWaitEventOnStack( &my_wait_event );
+	AddWaitEventToQueue( &message_queue->wait_queue, &my_wait_event );
+	
+	/* the ring is updated without the queue lock, so recheck after queuing the event; 
+	 * if the queue has changed already fire the event ourself so that we dont sleep*/
+	length = MESSAGE_QUEUE_LENGTH(message_queue);
+	if ( wait_for_space ? length < max_message_queue_length : length > 0 )
+		WakeUpWaitQueue( &message_queue->wait_queue, WAIT_EVENT_WAKE_UP_ALL );
 
 	if(wait_time == MESSAGE_QUEUE_NO_WAIT)
 		wait_time = 0;
 
-	ret_time = WaitForEvent(my_wait_event, wait_time);
-	
-	if(ret_time == 0) /* no event fired and we timeout out */
-		ret = ERROR_TIMEOUT;
-	else
+	ret = WaitForWaitEvent( &my_wait_event, wait_time );
+	/*if the caller supplied type variable, fill it*/
+	if ( ret == ERROR_SUCCESS && type )
 	{
-		assert( my_wait_event->fired == 1);
-			/*if the caller supplied type variable, fill it*/
-		if ( type )
-		{
-			MESSAGE_BUFFER_PTR buf;
-			/* take the lock again because we have returned from blocked state */
-			SpinLock( &message_queue->wait_event_msg_queue_lock  ); 
-			buf = message_queue->msg_queue;
-			if( buf )
-				*type = buf->type;
-			else
-				ret = ERROR_NOT_FOUND;
-			
-			SpinUnlock( &message_queue->wait_event_msg_queue_lock );
-		}
+		MESSAGE_BUFFER_PTR buf;
+		/* take the lock again because we have returned from blocked state */
+		SpinLock( &message_queue->wait_queue.lock ); 
+		buf = PeekMessageQueue( message_queue );
+		if( buf )
+			*type = buf->type;
+		else
+			ret = ERROR_NOT_FOUND;
+		
+		SpinUnlock( &message_queue->wait_queue.lock );
 	}
-
-	kfree(my_wait_event);
 	
 	return ret;
 }
 
-/*! Adds the given message buffer to the message queue
+/*! Adds the given message buffer to the message list of its priority
  *	\param message_queue	Message queue to which the new message buffer has to inserted
  *	\param buf				Message buffer to be added to the queue
  */
 static void AddToMessageQueue(MESSAGE_QUEUE_PTR message_queue, MESSAGE_BUFFER_PTR buf)
 {
+	MESSAGE_BUFFER_PTR * head;
+	
 	assert(message_queue != NULL);
 	assert(buf != NULL);
+	assert(buf->priority >= 0 && buf->priority < MESSAGE_PRIORITY_LANES);
 	
+	head = &message_queue->msg_queue[buf->priority];
 	InitList( &buf->message_buffer_queue );
-	if(message_queue->msg_queue == NULL)
-		message_queue->msg_queue = buf;
+	if(*head == NULL)
+		*head = buf;
 	else
-		AddToListTail( &message_queue->msg_queue->message_buffer_queue, &buf->message_buffer_queue );
+		AddToListTail( &(*head)->message_buffer_queue, &buf->message_buffer_queue );
 	
+	message_queue->lane_count[buf->priority]++;
 	message_queue->buf_count++;
-	WakeUpEvent( &message_queue->wait_event_msg_queue, 0);
+	message_queue->overflow_count++;
 }
 
-/*! Removes the first message from the given message queue
+/*! Removes the first message of the highest priority list from the given message queue - the caller should free the message buffer
  *	\param message_queue - message queue to be processed
+ *	\param buf - first message of the highest priority list(see FirstListMessage())
  */
-static void RemoveFromMessageQueue(MESSAGE_QUEUE_PTR message_queue)
+static void UnlinkFromMessageQueue(MESSAGE_QUEUE_PTR message_queue, MESSAGE_BUFFER_PTR buf)
 {
-	MESSAGE_BUFFER_PTR buf;
+	MESSAGE_PRIORITY lane;
 	
 	assert(message_queue != NULL);
-	
-	buf = message_queue->msg_queue;
+	assert(buf != NULL && buf == FirstListMessage( message_queue ));
+	lane = buf->priority;
 	message_queue->buf_count--;
-	assert(message_queue->buf_count >= 0);
+	message_queue->lane_count[lane]--;
 
-	if(message_queue->buf_count == 0)
-		message_queue->msg_queue = NULL;
+	if(message_queue->lane_count[lane] == 0)
+		message_queue->msg_queue[lane] = NULL;
 	else
-		message_queue->msg_queue = STRUCT_ADDRESS_FROM_MEMBER( buf->message_buffer_queue.next, MESSAGE_BUFFER, message_buffer_queue);
+		message_queue->msg_queue[lane] = STRUCT_ADDRESS_FROM_MEMBER( buf->message_buffer_queue.next, MESSAGE_BUFFER, message_buffer_queue);
 	
 	RemoveFromList( &buf->message_buffer_queue );
-	kfree( buf );
+}
+
+/*! Returns the message ring of the given message queue, allocating it on the first use
+ *	Most of the message queues of a task are never used, so the ring is not embedded in the message queue.
+ *	\param message_queue	Message queue
+ *	\return NULL if the ring can not be allocated - the message should be queued in the list
+ */
+static MESSAGE_RING_PTR GetMessageRing(MESSAGE_QUEUE_PTR message_queue)
+{
+	MESSAGE_RING_PTR ring;
+	
+	if ( message_queue->ring != NULL )
+		return message_queue->ring;
+	
+	ring = (MESSAGE_RING_PTR)kmalloc( sizeof(MESSAGE_RING), 0 );
+	if ( ring == NULL )
+		return NULL;
+	memset( ring, 0, sizeof(MESSAGE_RING) );
+	InitSpinLock( &ring->consumer_lock );
+	InitSpinLock( &ring->producer_lock );
+	
+	/*another sender might have installed its ring meanwhile*/
+	SpinLock( &message_queue->lock );
+	if ( message_queue->ring == NULL )
+	{
+		/*the ring should be initialized before the receivers can see it*/
+		COMPILER_BARRIER();
+		message_queue->ring = ring;
+		ring = NULL;
+	}
+	SpinUnlock( &message_queue->lock );
+	if ( ring != NULL )
+		kfree( ring );
+	
+	return message_queue->ring;
+}
+
+/*! Places a message in the message ring of the given message queue
+ *	\param message_queue	Message queue to which the message has to be delivered
+ *	\param msg_buf			Message to copy to the ring - its payload is already copied by ArgsToMessageBuffer()
+ *	\param handoff			If not NULL, a receiver blocked on the queue is returned here instead of making it ready
+ *	\return ERROR_BUSY if the ring can not be used and the message should be queued in the list
+ */
+static ERROR_CODE SendToMessageRing(MESSAGE_QUEUE_PTR message_queue, MESSAGE_BUFFER_PTR msg_buf, THREAD_PTR * handoff)
+{
+	MESSAGE_RING_PTR ring;
+	UINT32 tail;
+	
+	ring = GetMessageRing( message_queue );
+	if ( ring == NULL )
+		return ERROR_BUSY;
+	
+	/*another sender owns the ring*/
+	if ( TrySpinLock( &ring->producer_lock ) != 0 )
+		return ERROR_BUSY;
+	
+	/*ring is full or older normal priority messages are waiting in the list*/
+	tail = ring->tail;
+	if ( tail - ring->head >= MESSAGE_RING_SIZE || message_queue->lane_count[MESSAGE_PRIORITY_NORMAL] > 0 || tail - ring->head >= max_message_queue_length )
+	{
+		SpinUnlock( &ring->producer_lock );
+		return ERROR_BUSY;
+	}
+	
+	/*the slot is not visible to the receiver until tail is advanced*/
+	ring->slots[tail & MESSAGE_RING_MASK] = *msg_buf;
+	COMPILER_BARRIER();
+	ring->tail = tail + 1;
+	SpinUnlock( &ring->producer_lock );
+	
+	WakeUpMessageQueueWaiters( message_queue, handoff );
+	return ERROR_SUCCESS;
+}
+
+/*! Receives the oldest message from the message ring of the given message queue
+ *	\param message_queue	Message queue from where message has to be fetched
+ *	\param arg1 - arg6		Holders to put the arguments of the message
+ *	\return ERROR_NOT_FOUND if the ring is empty
+ */
+static ERROR_CODE ReceiveFromMessageRing(MESSAGE_QUEUE_PTR message_queue, IPC_ARG_TYPE arg1, IPC_ARG_TYPE arg2, IPC_ARG_TYPE arg3, IPC_ARG_TYPE arg4, IPC_ARG_TYPE arg5, IPC_ARG_TYPE arg6)
+{
+	MESSAGE_RING_PTR ring = message_queue->ring;
+	MESSAGE_BUFFER message;
+	ERROR_CODE ret = ERROR_NOT_FOUND;
+	UINT32 head;
+	
+	if ( ring == NULL || ring->head == ring->tail )
+		return ERROR_NOT_FOUND;
+	
+	/*uncontended for a single receiver - multiple receivers take turns*/
+	SpinLock( &ring->consumer_lock );
+	head = ring->head;
+	if ( head != ring->tail )
+	{
+		if ( CanReceiveMessage( &ring->slots[head & MESSAGE_RING_MASK], arg1, arg5, arg6 ) )
+		{
+			/*copy the slot and give it back to the sender - the args are filled after releasing the lock*/
+			message = ring->slots[head & MESSAGE_RING_MASK];
+			COMPILER_BARRIER();
+			ring->head = head + 1;
+			ret = ERROR_SUCCESS;
+		}
+		else
+			ret = ERROR_INVALID_PARAMETER;
+	}
+	SpinUnlock( &ring->consumer_lock );
+	if ( ret != ERROR_SUCCESS )
+		return ret;
+	
+	WakeUpMessageQueueWaiters( message_queue, NULL );
+	return MessageBufferToArgs( &message, arg1, arg2, arg3, arg4, arg5, arg6 );
+}
+
+/*! Receives up to max_count messages from the message ring - the slots are copied out a chunk at a time under the consumer lock
+ *	\param message_queue	Message queue from where messages have to be fetched
+ *	\param messages			Array to put the messages
+ *	\param max_count		Number of entries in the array
+ *	\param blocked			Set to TRUE if the receive stopped at a message which can not be received into its entry
+ *	\return number of messages received - the caller should wake up the waiters
+ */
+static UINT32 ReceiveBatchFromMessageRing(MESSAGE_QUEUE_PTR message_queue, IPC_MESSAGE_PTR messages, UINT32 max_count, BOOLEAN * blocked)
+{
+	MESSAGE_RING_PTR ring = message_queue->ring;
+	MESSAGE_BUFFER claimed[MESSAGE_BATCH_CHUNK];
+	UINT32 head, i, claim, count = 0;
+	
+	if ( ring == NULL )
+		return 0;
+	
+	while( count < max_count && ring->head != ring->tail )
+	{
+		claim = 0;
+		SpinLock( &ring->consumer_lock );
+		head = ring->head;
+		while( claim < MESSAGE_BATCH_CHUNK && count + claim < max_count && head != ring->tail )
+		{
+			if ( !CanReceiveIpcMessage( &ring->slots[head & MESSAGE_RING_MASK], &messages[count + claim] ) )
+			{
+				*blocked = TRUE;
+				break;
+			}
+			claimed[claim++] = ring->slots[head & MESSAGE_RING_MASK];
+			head++;
+		}
+		/*give the slots back to the sender - the messages are filled after releasing the lock*/
+		COMPILER_BARRIER();
+		ring->head = head;
+		SpinUnlock( &ring->consumer_lock );
+		
+		for(i=0; i<claim; i++)
+			MessageBufferToIpcMessage( &claimed[i], &messages[count + i] );
+		count += claim;
+		if ( claim < MESSAGE_BATCH_CHUNK || *blocked )
+			break;
+	}
+	
+	return count;
+}
+
+/*! Copies a message buffer to an IPC_MESSAGE - the message is consumed and the result of the copy is stored in the status of the IPC_MESSAGE
+ *	\param msg_buf		Message buffer from which arguments to copy - it should be already removed from the message queue
+ *	\param message		Message to fill - args[4] and args[5] are used as receive buffer for MESSAGE_TYPE_REFERENCE and MESSAGE_TYPE_VECTOR
+ */
+static ERROR_CODE MessageBufferToIpcMessage(MESSAGE_BUFFER_PTR msg_buf, IPC_MESSAGE_PTR message)
+{
+	IPC_ARG_TYPE * args = message->args;
+	
+	message->type = msg_buf->type;
+	message->sender_thread = msg_buf->sender_thread;
+	/*no receive buffer - hand over the kernel copy of the payload as it is, the receiver should kfree() it*/
+	if ( msg_buf->type == MESSAGE_TYPE_REFERENCE && args[IPC_ADDRESS_ARG_INDEX] == NULL )
+	{
+		msg_buf->type = MESSAGE_TYPE_VALUE;
+		message->status = MessageBufferToArgs( msg_buf, &args[0], &args[1], &args[2], &args[3], &args[4], &args[5] );
+	}
+	else if ( msg_buf->type == MESSAGE_TYPE_REFERENCE || msg_buf->type == MESSAGE_TYPE_VECTOR )
+		message->status = MessageBufferToArgs( msg_buf, &args[0], &args[1], &args[2], &args[3], args[4], args[5] );
+	else
+		message->status = MessageBufferToArgs( msg_buf, &args[0], &args[1], &args[2], &args[3], &args[4], &args[5] );
+	return message->status;
+}
+
+/*! Checks whether the receive buffer of the given IPC_MESSAGE suits the message(see CanReceiveMessage())
+ *	\param msg_buf		Message to check
+ *	\param message		Entry of the receiver - args[4] and args[5] hold the receive buffer for MESSAGE_TYPE_REFERENCE and MESSAGE_TYPE_VECTOR
+ */
+static BOOLEAN CanReceiveIpcMessage(MESSAGE_BUFFER_PTR msg_buf, IPC_MESSAGE_PTR message)
+{
+	/*the payload of a MESSAGE_TYPE_REFERENCE message is handed over if there is no receive buffer*/
+	if ( msg_buf->type == MESSAGE_TYPE_REFERENCE && message->args[IPC_ADDRESS_ARG_INDEX] == NULL )
+		return TRUE;
+	return CanReceiveMessage( msg_buf, &message->args[0], message->args[4], message->args[5] );
+}
+
+/*! Returns a bitmap of the message queues which have messages
+ *	\param queues		Message queues to check
+ *	\param queue_count	Number of message queues
+ */
+static UINT32 PollMessageQueues(MESSAGE_QUEUE_PTR * queues, UINT32 queue_count)
+{
+	UINT32 i, ready = 0;
+	
+	for(i=0; i<queue_count; i++)
+	{
+		if ( MESSAGE_QUEUE_LENGTH(queues[i]) > 0 )
+			ready |= 1 << i;
+	}
+	return ready;
+}
+
+/*! Returns the oldest message in the given message queue without removing it
+ *	\param message_queue	Message queue to look into
+ */
+static MESSAGE_BUFFER_PTR PeekMessageQueue(MESSAGE_QUEUE_PTR message_queue)
+{
+	MESSAGE_RING_PTR ring = message_queue->ring;
+	
+	if ( !HIGH_PRIORITY_MESSAGE_PENDING(message_queue) && ring != NULL && ring->head != ring->tail )
+		return &ring->slots[ring->head & MESSAGE_RING_MASK];
+	return FirstListMessage( message_queue );
+}
+
+/*! Returns the oldest message of the highest priority list of the given message queue
+ *	\param message_queue	Message queue to look into
+ */
+static MESSAGE_BUFFER_PTR FirstListMessage(MESSAGE_QUEUE_PTR message_queue)
+{
+	int i;
+	
+	for(i=0; i<MESSAGE_PRIORITY_LANES; i++)
+	{
+		if ( message_queue->msg_queue[i] != NULL )
+			return message_queue->msg_queue[i];
+	}
+	return NULL;
+}
+
+/*! Receives up to max_count messages from the message lists - the messages are unlinked a chunk at a time under the queue lock
+ *	\param message_queue	Message queue from where messages have to be fetched
+ *	\param messages			Array to put the messages
+ *	\param max_count		Number of entries in the array
+ *	\param lowest_priority	Messages below this priority are not received
+ *	\param blocked			Set to TRUE if the receive stopped at a message which can not be received into its entry
+ *	\return number of messages received - the caller should wake up the waiters
+ */
+static UINT32 ReceiveBatchFromMessageList(MESSAGE_QUEUE_PTR message_queue, IPC_MESSAGE_PTR messages, UINT32 max_count, MESSAGE_PRIORITY lowest_priority, BOOLEAN * blocked)
+{
+	MESSAGE_BUFFER_PTR buf, claimed[MESSAGE_BATCH_CHUNK];
+	UINT32 i, claim, count = 0;
+	
+	while( count < max_count )
+	{
+		claim = 0;
+		SpinLock( &(message_queue->lock) );
+		while( claim < MESSAGE_BATCH_CHUNK && count + claim < max_count )
+		{
+			buf = FirstListMessage( message_queue );
+			if ( buf == NULL || buf->priority > lowest_priority )
+				break;
+			if ( !CanReceiveIpcMessage( buf, &messages[count + claim] ) )
+			{
+				*blocked = TRUE;
+				break;
+			}
+			UnlinkFromMessageQueue( message_queue, buf );
+			claimed[claim++] = buf;
+		}
+		SpinUnlock( &(message_queue->lock) );
+		
+		/*fill the messages after releasing the lock*/
+		for(i=0; i<claim; i++)
+		{
+			MessageBufferToIpcMessage( claimed[i], &messages[count + i] );
+			kfree( claimed[i] );
+		}
+		count += claim;
+		if ( claim < MESSAGE_BATCH_CHUNK || *blocked )
+			break;
+	}
+	
+	return count;
+}
+
+/*! Sets the priority of the messages sent by the current thread
+ *	\param priority		New priority - MESSAGE_PRIORITY_INHERIT to derive it from the scheduler class of the thread
+ *	\return previous priority, so that the caller can restore it
+ */
+MESSAGE_PRIORITY SetMessagePriority(MESSAGE_PRIORITY priority)
+{
+	THREAD_PTR current_thread = GetCurrentThread();
+	MESSAGE_PRIORITY previous;
+	
+	assert( priority >= MESSAGE_PRIORITY_INHERIT && priority < MESSAGE_PRIORITY_LANES );
+	previous = current_thread->ipc_priority;
+	current_thread->ipc_priority = priority;
+	return previous;
+}
+
+/*! Returns the priority of the messages sent by the given thread
+ *	\param thread	Sender thread
+ */
+static MESSAGE_PRIORITY GetMessagePriority(THREAD_PTR thread)
+{
+	if ( thread->ipc_priority != MESSAGE_PRIORITY_INHERIT )
+		return thread->ipc_priority;
+	
+	switch( thread->priority )
+	{
+		case SCHED_CLASS_VERY_HIGH:
+		case SCHED_CLASS_HIGH:
+			return MESSAGE_PRIORITY_HIGH;
+		case SCHED_CLASS_MID:
+			return MESSAGE_PRIORITY_NORMAL;
+		default:
+			return MESSAGE_PRIORITY_LOW;
+	}
+}
+
+/*! Charges a message to the sender task, waits if the task already has max_messages_per_sender messages queued
+ *	\param task			Sender task - kernel_task is not charged, since all the kernel servers would share its credits
+ *	\param priority		Priority of the message - urgent messages are not charged
+ *	\param wait_time	Time to wait for a credit. If MESSAGE_QUEUE_NO_WAIT, then it's non blocking, if 0, it's blocking forever.
+ *	\param credit_task	Updated with the task charged or NULL if the message is not charged
+ */
+static ERROR_CODE TakeMessageCredit(TASK_PTR task, MESSAGE_PRIORITY priority, UINT32 wait_time, TASK_PTR * credit_task)
+{
+	WAIT_EVENT wait_event;
+	
+	*credit_task = NULL;
+	if ( priority == MESSAGE_PRIORITY_URGENT || max_messages_per_sender == 0 || task == &kernel_task )
+		return ERROR_SUCCESS;
+	
+	while( 1 )
+	{
+		SpinLock( &task->lock );
+		if ( task->ipc_messages_queued < max_messages_per_sender )
+		{
+			task->ipc_messages_queued++;
+			SpinUnlock( &task->lock );
+			*credit_task = task;
+			return ERROR_SUCCESS;
+		}
+		SpinUnlock( &task->lock );
+		
+		if ( wait_time == MESSAGE_QUEUE_NO_WAIT )
+			return ERROR_NOT_ENOUGH_MEMORY;
+		InitWaitEventOnStack( &wait_event );
+		AddWaitEventToQueue( &task->ipc_credit_wait_queue, &wait_event );
+		/*a message might have been received before the event was queued*/
+		MemoryBarrier();
+		if ( task->ipc_messages_queued < max_messages_per_sender )
+			RemoveWaitEvent( &wait_event );
+		else if ( WaitForWaitEvent( &wait_event, wait_time ) != ERROR_SUCCESS )
+			return ERROR_NOT_ENOUGH_MEMORY;
+	}
+}
+
+/*! Returns a credit taken by TakeMessageCredit() and wakes up the senders waiting for it
+ *	\param task			Task charged for the message - can be NULL
+ */
+static void ReturnMessageCredit(TASK_PTR task)
+{
+	if ( task == NULL )
+		return;
+	
+	SpinLock( &task->lock );
+	assert( task->ipc_messages_queued > 0 );
+	task->ipc_messages_queued--;
+	SpinUnlock( &task->lock );
+	
+	MemoryBarrier();
+	if ( !IS_WAIT_QUEUE_EMPTY( &task->ipc_credit_wait_queue ) )
+		WakeUpWaitQueue( &task->ipc_credit_wait_queue, WAIT_EVENT_WAKE_UP_ALL );
+}
+
+/*! Wakes up the senders and receivers waiting on the given message queue
+ *	\param message_queue	Message queue which is changed
+ *	\param handoff			If not NULL, one blocked waiter is returned here instead of making it ready
+ */
+static void WakeUpMessageQueueWaiters(MESSAGE_QUEUE_PTR message_queue, THREAD_PTR * handoff)
+{
+	/*the queue update should be visible before checking for waiters, else a waiter which queued its event after the check could miss it*/
+	MemoryBarrier();
+	if ( IS_WAIT_QUEUE_EMPTY( &message_queue->wait_queue ) )
+		return;
+	
+	if ( handoff != NULL )
+		*handoff = WakeUpWaitQueueForHandoff( &message_queue->wait_queue, WAIT_EVENT_WAKE_UP_ALL );
+	else
+		WakeUpWaitQueue( &message_queue->wait_queue, WAIT_EVENT_WAKE_UP_ALL );
+}
+
+static MESSAGE_QUEUE benchmark_queue, benchmark_done_queue;
+
+/*! value sent to stop the round trip benchmark server*/
+#define BENCHMARK_SERVER_EXIT		((UINT32)-1)
+
+/*! Echo server thread of the IPC round trip benchmark - replies every message with the same value*/
+static void MessageQueueBenchmarkServer()
+{
+	UINT32 value;
+	
+	do
+	{
+		if ( ReceiveMessageCore( &benchmark_queue, &value, NULL, NULL, NULL, NULL, NULL, 0 ) != ERROR_SUCCESS )
+			continue;
+		ReplyToLastMessage( MESSAGE_TYPE_VALUE, (IPC_ARG_TYPE)value, 0, 0, 0, 0, 0 );
+	}while( value != BENCHMARK_SERVER_EXIT );
+	
+	ExitThread();
+}
+
+/*! Measures the round trip time of send + wait for reply and of CallMessage() and prints the result
+ *	\param count	Number of calls to make in each mode
+ */
+static void BenchmarkMessageQueueRoundTrip(UINT32 count)
+{
+	UINT32 i, value, start_ticks, send_ms, call_ms, send_failures=0, call_failures=0;
+	WAIT_EVENT wait_event;
+	
+	if ( CreateThread( &kernel_task, MessageQueueBenchmarkServer, SCHED_CLASS_HIGH, TRUE, NULL ) == NULL )
+	{
+		kprintf("IPC benchmark: unable to create server thread\n");
+		return;
+	}
+	
+	/*separate send and wait without handoff - the reply event is registered before sending, so a quick reply is not missed*/
+	start_ticks = timer_ticks;
+	for(i=0; i<count; i++)
+	{
+		InitWaitEventOnStack( &wait_event );
+		AddWaitEventToQueue( &GetCurrentThread()->ipc_reply_event, &wait_event );
+		if ( SendMessageCore( &kernel_task, &benchmark_queue, MESSAGE_TYPE_VALUE, (IPC_ARG_TYPE)i, 0, 0, 0, 0, 0, 0 ) != ERROR_SUCCESS )
+		{
+			RemoveWaitEvent( &wait_event );
+			send_failures++;
+			continue;
+		}
+		if ( WaitForReplyCore( &wait_event, MESSAGE_TYPE_VALUE, &value, NULL, NULL, NULL, NULL, NULL, 0 ) != ERROR_SUCCESS || value != i )
+			send_failures++;
+	}
+	send_ms = TICKS_TO_MILLISECONDS( timer_ticks - start_ticks );
+	
+	start_ticks = timer_ticks;
+	for(i=0; i<count; i++)
+	{
+		if ( CallMessage( &kernel_task, &benchmark_queue, MESSAGE_TYPE_VALUE, (IPC_ARG_TYPE)i, 0, 0, 0, 0, 0,
+			MESSAGE_TYPE_VALUE, &value, NULL, NULL, NULL, NULL, NULL, 0 ) != ERROR_SUCCESS || value != i )
+			call_failures++;
+	}
+	call_ms = TICKS_TO_MILLISECONDS( timer_ticks - start_ticks );
+	
+	CallMessage( &kernel_task, &benchmark_queue, MESSAGE_TYPE_VALUE, (IPC_ARG_TYPE)BENCHMARK_SERVER_EXIT, 0, 0, 0, 0, 0,
+			MESSAGE_TYPE_VALUE, &value, NULL, NULL, NULL, NULL, NULL, 0 );
+	
+	/*microseconds per round trip, computed without 64 bit division*/
+	kprintf("IPC benchmark: send+wait %d us/call (%d failed), CallMessage %d us/call (%d failed)\n", 
+		(send_ms / count) * 1000 + ((send_ms % count) * 1000) / count, send_failures, 
+		(call_ms / count) * 1000 + ((call_ms % count) * 1000) / count, call_failures );
+}
+
+/*! Receiver thread of the IPC benchmark*/
+static void MessageQueueBenchmarkReceiver()
+{
+	UINT32 i, value;
+	
+	for(i=0; i<ipc_benchmark_messages; i++)
+		ReceiveMessageCore( &benchmark_queue, &value, NULL, NULL, NULL, NULL, NULL, 0 );
+	
+	SendMessageCore( &kernel_task, &benchmark_done_queue, MESSAGE_TYPE_VALUE, (IPC_ARG_TYPE)i, 0, 0, 0, 0, 0, 0 );
+	ExitThread();
+}
+
+/*! Measures the message throughput between two kernel threads and prints the result
+ *	\param count	Number of messages to send
+ */
+void BenchmarkMessageQueue(UINT32 count)
+{
+	UINT32 i, start_ticks, elapsed_ms, value;
+	
+	InitMessageQueue( &benchmark_queue );
+	InitMessageQueue( &benchmark_done_queue );
+	ipc_benchmark_messages = count;
+	if ( CreateThread( &kernel_task, MessageQueueBenchmarkReceiver, SCHED_CLASS_HIGH, TRUE, NULL ) == NULL )
+	{
+		kprintf("IPC benchmark: unable to create receiver thread\n");
+		return;
+	}
+	
+	start_ticks = timer_ticks;
+	for(i=0; i<count; i++)
+		SendMessageCore( &kernel_task, &benchmark_queue, MESSAGE_TYPE_VALUE, (IPC_ARG_TYPE)i, 0, 0, 0, 0, 0, 0 );
+	ReceiveMessageCore( &benchmark_done_queue, &value, NULL, NULL, NULL, NULL, NULL, 0 );
+	elapsed_ms = TICKS_TO_MILLISECONDS( timer_ticks - start_ticks );
+	
+	kprintf("IPC benchmark: %d messages in %d ms (%d messages/sec, %d queued in list)\n", count, elapsed_ms, 
+		elapsed_ms ? (count / elapsed_ms) * 1000 + ((count % elapsed_ms) * 1000) / elapsed_ms : count * 1000, benchmark_queue.overflow_count );
+	
+	BenchmarkMessageQueueRoundTrip( count );
+}
+
+static MESSAGE_QUEUE test_queue, test_idle_queue;
+
+/*! value sent by the IPC test sender thread*/
+#define IPC_TEST_WAKE_UP_VALUE		0x1234
+/*! max time the IPC test waits for the sender thread in milliseconds*/
+#define IPC_TEST_WAIT_TIME			5000
+
+/*! offset of a MESSAGE_TYPE_VECTOR test payload in its first page - the payload is a partial page, a whole page and a partial page*/
+#define IPC_TEST_VECTOR_OFFSET		100
+/*! length of the MESSAGE_TYPE_VECTOR test payload*/
+#define IPC_TEST_VECTOR_LENGTH		(2 * PAGE_SIZE + 100)
+
+/*! result of the MESSAGE_TYPE_VECTOR test - updated by MessageQueueVectorTestThread()*/
+static char * vector_test_failure;
+
+/*! Fills the given buffer with the MESSAGE_TYPE_VECTOR test pattern*/
+static void FillVectorTestPattern(BYTE * buffer, UINT32 length)
+{
+	UINT32 i;
+	
+	for(i=0; i<length; i++)
+		buffer[i] = (BYTE)(i * 7 + 3);
+}
+
+/*! Checks the given buffer has the MESSAGE_TYPE_VECTOR test pattern*/
+static BOOLEAN CheckVectorTestPattern(BYTE * buffer, UINT32 length)
+{
+	UINT32 i;
+	
+	for(i=0; i<length; i++)
+	{
+		if ( buffer[i] != (BYTE)(i * 7 + 3) )
+			return FALSE;
+	}
+	return TRUE;
+}
+
+/*! Sends the MESSAGE_TYPE_VECTOR test payload to test_queue and receives it into the given buffer
+ *	\param payload		Sender buffer
+ *	\param buffer		Receive buffer - should hold IPC_TEST_VECTOR_LENGTH bytes
+ *	\return failure description or NULL if the payload is received intact
+ */
+static char * TransferVectorTestPayload(VADDR payload, VADDR buffer)
+{
+	IPC_IOVEC iov;
+	UINT32 arg1;
+	
+	iov.base = (void *)payload;
+	iov.length = IPC_TEST_VECTOR_LENGTH;
+	if ( SendMessageCore( &kernel_task, &test_queue, MESSAGE_TYPE_VECTOR, (IPC_ARG_TYPE)1, 0, 0, 0, &iov, (IPC_ARG_TYPE)1, MESSAGE_QUEUE_NO_WAIT ) != ERROR_SUCCESS )
+		return "unable to send vector message";
+	iov.base = (void *)buffer;
+	iov.length = IPC_TEST_VECTOR_LENGTH;
+	if ( ReceiveMessageCore( &test_queue, &arg1, NULL, NULL, NULL, &iov, (IPC_ARG_TYPE)1, MESSAGE_QUEUE_NO_WAIT ) != ERROR_SUCCESS || arg1 != 1 )
+		return "unable to receive vector message";
+	if ( iov.length != IPC_TEST_VECTOR_LENGTH || !CheckVectorTestPattern( (BYTE *)buffer, IPC_TEST_VECTOR_LENGTH ) )
+		return "vector payload is corrupted";
+	return NULL;
+}
+
+/*! Kernel thread of the MESSAGE_TYPE_VECTOR test - it runs in a scratch task, since only user memory is shared copy-on-write.
+ * 	The payload is received into page aligned user memory(the whole page is mapped copy-on-write),
+ * 	into unaligned user memory(the page is copied through the bounce buffer) and into kernel memory.
+ */
+static void MessageQueueVectorTestThread()
+{
+	VIRTUAL_MAP_PTR vmap = GetCurrentVirtualMap();
+	VADDR send_va = NULL, receive_va = NULL, send_pa, receive_pa;
+	BYTE * kernel_buffer = NULL;
+	
+	vector_test_failure = "unable to allocate memory";
+	if ( AllocateVirtualMemory( vmap, &send_va, 0, 3 * PAGE_SIZE, PROT_READ|PROT_WRITE, VM_UNIT_FLAG_PRIVATE, NULL ) != ERROR_SUCCESS
+		|| AllocateVirtualMemory( vmap, &receive_va, 0, 4 * PAGE_SIZE, PROT_READ|PROT_WRITE, VM_UNIT_FLAG_PRIVATE, NULL ) != ERROR_SUCCESS
+		|| (kernel_buffer = kmalloc( IPC_TEST_VECTOR_LENGTH, 0 )) == NULL )
+		goto done;
+	FillVectorTestPattern( (BYTE *)send_va + IPC_TEST_VECTOR_OFFSET, IPC_TEST_VECTOR_LENGTH );
+	/*fault in the receive pages, so that the copy-on-write mapping replaces a present page*/
+	memset( (void *)receive_va, 0, 4 * PAGE_SIZE );
+	
+	/*the same offset in the receive buffer lands the whole page on a page boundary*/
+	vector_test_failure = TransferVectorTestPayload( send_va + IPC_TEST_VECTOR_OFFSET, receive_va + IPC_TEST_VECTOR_OFFSET );
+	if ( vector_test_failure != NULL )
+		goto done;
+	/*sharing unmapped the sender page - this read maps it again read only*/
+	if ( ((volatile BYTE *)send_va)[PAGE_SIZE] != ((BYTE *)receive_va)[PAGE_SIZE]
+		|| TranslatePaFromVa( send_va + PAGE_SIZE, &send_pa ) == VA_NOT_EXISTS || TranslatePaFromVa( receive_va + PAGE_SIZE, &receive_pa ) == VA_NOT_EXISTS
+		|| send_pa != receive_pa )
+	{
+		vector_test_failure = "whole page is not mapped copy-on-write";
+		goto done;
+	}
+	/*a write from the sender should get its own copy and leave the receiver's page unchanged*/
+	((BYTE *)send_va)[PAGE_SIZE] ^= 0xFF;
+	if ( !CheckVectorTestPattern( (BYTE *)receive_va + IPC_TEST_VECTOR_OFFSET, IPC_TEST_VECTOR_LENGTH ) )
+	{
+		vector_test_failure = "sender write is seen by the receiver";
+		goto done;
+	}
+	((BYTE *)send_va)[PAGE_SIZE] ^= 0xFF;
+	
+	/*unaligned user buffer - the shared page goes through the bounce buffer*/
+	vector_test_failure = TransferVectorTestPayload( send_va + IPC_TEST_VECTOR_OFFSET, receive_va + PAGE_SIZE + 1 );
+	if ( vector_test_failure != NULL )
+		goto done;
+	
+	/*kernel buffer - the shared page is copied directly*/
+	vector_test_failure = TransferVectorTestPayload( send_va + IPC_TEST_VECTOR_OFFSET, (VADDR)kernel_buffer );
+	
+done:
+	if ( kernel_buffer != NULL )
+		kfree( kernel_buffer );
+	if ( receive_va != NULL )
+		FreeVirtualMemory( vmap, receive_va, 4 * PAGE_SIZE, 0 );
+	if ( send_va != NULL )
+		FreeVirtualMemory( vmap, send_va, 3 * PAGE_SIZE, 0 );
+	ExitThread();
+}
+
+/*! Sender thread of the IPC test - wakes up the main thread blocked on the test queues*/
+static void MessageQueueTestSender()
+{
+	SendMessageCore( &kernel_task, &test_idle_queue, MESSAGE_TYPE_VALUE, (IPC_ARG_TYPE)IPC_TEST_WAKE_UP_VALUE, 0, 0, 0, 0, 0, 0 );
+	ExitThread();
+}
+
+/*! Checks SendMessageBatch(), WaitForMessageQueues(), ReceiveMessageBatch() and MESSAGE_TYPE_VECTOR messages and prints the result*/
+void VerifyMessageQueue()
+{
+	THREAD_CONTAINER_PTR thread_container;
+	TASK_PTR task;
+	VADDR va = NULL;
+	char reference[] = "batch";
+	char vector_data[16];
+	IPC_IOVEC iov;
+	IPC_MESSAGE messages[4];
+	MESSAGE_QUEUE_PTR queues[2] = { &test_idle_queue, &test_queue };
+	UINT32 i, count, ready, value;
+	ERROR_CODE ret;
+	
+	InitMessageQueue( &test_queue );
+	InitMessageQueue( &test_idle_queue );
+	
+	/*fan out three messages - the reference message payload is copied while queued*/
+	memset( messages, 0, sizeof(messages) );
+	for(i=0; i<3; i++)
+	{
+		messages[i].task = &kernel_task;
+		messages[i].queue = &test_queue;
+		messages[i].type = MESSAGE_TYPE_VALUE;
+		messages[i].args[0] = (IPC_ARG_TYPE)(i+1);
+	}
+	messages[1].type = MESSAGE_TYPE_REFERENCE;
+	messages[1].args[4] = reference;
+	messages[1].args[5] = (IPC_ARG_TYPE)sizeof(reference);
+	if ( SendMessageBatch( messages, 3, MESSAGE_QUEUE_NO_WAIT ) != 3 )
+	{
+		kprintf("IPC test: SendMessageBatch failed (%d %d %d)\n", messages[0].status, messages[1].status, messages[2].status);
+		goto done;
+	}
+	
+	ret = WaitForMessageQueues( queues, 2, NULL, 0, &ready, MESSAGE_QUEUE_NO_WAIT );
+	if ( ret != ERROR_SUCCESS || ready != 2 )
+	{
+		kprintf("IPC test: WaitForMessageQueues returned %d ready %x\n", ret, ready);
+		goto done;
+	}
+	
+	/*no receive buffer is given, so the reference payload should be handed over*/
+	memset( messages, 0, sizeof(messages) );
+	ret = ReceiveMessageBatch( &test_queue, messages, 4, &count, MESSAGE_QUEUE_NO_WAIT );
+	if ( ret != ERROR_SUCCESS || count != 3 )
+	{
+		kprintf("IPC test: ReceiveMessageBatch returned %d count %d\n", ret, count);
+		goto done;
+	}
+	for(i=0; i<3; i++)
+	{
+		if ( messages[i].status != ERROR_SUCCESS || messages[i].args[0] != (IPC_ARG_TYPE)(i+1) )
+		{
+			kprintf("IPC test: message %d is received as %d (status %d)\n", i+1, messages[i].args[0], messages[i].status);
+			goto done;
+		}
+	}
+	if ( messages[1].type != MESSAGE_TYPE_REFERENCE || messages[1].args[4] == NULL || (UINT32)messages[1].args[5] != sizeof(reference) 
+		|| strcmp( messages[1].args[4], reference ) != 0 )
+	{
+		kprintf("IPC test: reference payload is not handed over\n");
+		goto done;
+	}
+	kfree( messages[1].args[4] );
+	
+	/*a vector message needs a receive IPC_IOVEC array - the batch should fail and leave it queued*/
+	iov.base = vector_data;
+	iov.length = sizeof(vector_data);
+	if ( SendMessageCore( &kernel_task, &test_queue, MESSAGE_TYPE_VECTOR, 0, 0, 0, 0, &iov, (IPC_ARG_TYPE)1, MESSAGE_QUEUE_NO_WAIT ) != ERROR_SUCCESS )
+	{
+		kprintf("IPC test: unable to send vector message\n");
+		goto done;
+	}
+	memset( messages, 0, sizeof(messages) );
+	ret = ReceiveMessageBatch( &test_queue, messages, 4, &count, MESSAGE_QUEUE_NO_WAIT );
+	if ( ret != ERROR_INVALID_PARAMETER || count != 0 || MESSAGE_QUEUE_LENGTH(&test_queue) != 1 )
+	{
+		kprintf("IPC test: vector message without receive buffer returned %d count %d\n", ret, count);
+		goto done;
+	}
+	SkipMessage( &test_queue );
+	
+	/*block on both queues until the sender thread posts to the idle queue*/
+	if ( CreateThread( &kernel_task, MessageQueueTestSender, SCHED_CLASS_HIGH, TRUE, NULL ) == NULL )
+	{
+		kprintf("IPC test: unable to create sender thread\n");
+		goto done;
+	}
+	ret = WaitForMessageQueues( queues, 2, NULL, 0, &ready, IPC_TEST_WAIT_TIME );
+	if ( ret != ERROR_SUCCESS || ready != 1 )
+	{
+		kprintf("IPC test: blocking WaitForMessageQueues returned %d ready %x\n", ret, ready);
+		goto done;
+	}
+	if ( ReceiveMessageCore( &test_idle_queue, &value, NULL, NULL, NULL, NULL, NULL, MESSAGE_QUEUE_NO_WAIT ) != ERROR_SUCCESS || value != IPC_TEST_WAKE_UP_VALUE )
+	{
+		kprintf("IPC test: wake up message is not received\n");
+		goto done;
+	}
+	
+	/*vector messages share only user memory - run the vector test in a scratch task(same way as CallBiosIsr())*/
+	if ( AllocateVirtualMemory( GetCurrentVirtualMap(), &va, 0, PAGE_SIZE, PROT_READ|PROT_WRITE, VM_UNIT_FLAG_PRIVATE, NULL ) != ERROR_SUCCESS
+		|| (task = CreateTask( (char *)va, IMAGE_TYPE_BIN_PROGRAM, TASK_CREATION_FLAG_NO_THREAD, NULL, NULL, NULL )) == NULL
+		|| (thread_container = CreateThread( task, MessageQueueVectorTestThread, SCHED_CLASS_HIGH, TRUE, NULL )) == NULL )
+	{
+		kprintf("IPC test: unable to create vector test thread\n");
+		goto done;
+	}
+	WaitForThread( &thread_container->thread, 0 );
+	FreeThread( &thread_container->thread );
+	if ( vector_test_failure != NULL )
+	{
+		kprintf("IPC test: %s\n", vector_test_failure);
+		goto done;
+	}
+	
+	kprintf("IPC test: passed\n");
+	
+done:
+	if ( va != NULL )
+		FreeVirtualMemory( GetCurrentVirtualMap(), va, PAGE_SIZE, 0 );
+	DestroyMessageQueue( &test_queue );
+	DestroyMessageQueue( &test_idle_queue );
 }
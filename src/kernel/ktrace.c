@@ -2,25 +2,280 @@
 	\file		src/kernel/ktrace.c	
 	\brief	ktrace and assert are defined here.
 	Note - calls to these functions should made only after calling InitKtrace()
+
+	By default ktrace() formats the message and writes it to the debug port one character at a time, the caller
+	waits for the UART. If the ktrace_buffer_records kernel parameter is set, InitKtraceLog() switches ktrace()
+	to binary records: the caller stores the time stamp, the format string address and the raw argument words
+	in its processor's ring and returns. Only the argument words the format uses are copied and %s strings which
+	are not in the kernel's read only sections are copied with them(truncated to KTRACE_RECORD_STRING_SIZE). A very low priority kernel thread writes the records to the debug port,
+	scripts/ktrace_decode.py formats them on the host using the kernel image. When a ring is full the record is
+	dropped and counted - the caller never waits.
 */
 #include <stdlib.h>
+#include <string.h>
+#include <ds/bits.h>
 #include <kernel/debug.h>
 #include <kernel/arch.h>
 #include <kernel/printf.h>
+#include <kernel/processor.h>
+#include <kernel/mm/kmem.h>
+#include <kernel/mm/vm.h>
+#include <kernel/pm/task.h>
+#include <kernel/pm/thread.h>
+#include <kernel/pm/scheduler.h>
+#include <kernel/pm/timeout_queue.h>
 
 #define MAX_STACK_FRAMES	50
 
+/*! how often the drain thread writes the logged records(in milliseconds)*/
+#define KTRACE_DRAIN_INTERVAL	20
+
+extern inline UINT64 rdtsc();
+
+/*! Per processor ring of binary ktrace records
+	Records are added only by the owning processor with interrupts disabled and removed only by the drain
+	thread, so head and tail each have a single writer and no lock is required.*/
+typedef struct ktrace_log
+{
+	KTRACE_RECORD_PTR	records;			/*! ring - size is a power of 2*/
+	UINT32				size;				/*! number of records in the ring*/
+	volatile UINT32		head;				/*! next record to fill - written by the owning processor*/
+	volatile UINT32		tail;				/*! next record to write out - written by the drain thread*/
+	volatile UINT32		dropped;			/*! records dropped because the ring was full*/
+	UINT32				reported_dropped;	/*! dropped count already reported to the decoder*/
+}KTRACE_LOG, * KTRACE_LOG_PTR;
+
 /*! function pointer is used by the ktrace() to write characters 
 */
 void (*ktrace_putc)(void * arg, char ch) = NULL;
 
+/*! kernel parameter - binary ktrace records per processor(rounded up to power of 2), 0 keeps the synchronous text output*/
+UINT32 ktrace_buffer_records = 0;
+
+/*! set when ktrace() should log binary records*/
+static volatile BOOLEAN ktrace_log_enabled = FALSE;
+static KTRACE_LOG ktrace_logs[MAX_PROCESSORS];
+
+/*! Copies the arguments used by the format string into the record
+	The words are read from the caller's stack, so the copy stops at the top of the current kernel stack - interrupt
+	handlers run on the same stack. A %s string is copied unless it is in the kernel's read only sections, which the
+	decoder reads from the kernel image; a string which does not fit in the remaining room is truncated and once the
+	room is used up the decoder can only show the address of the later strings.
+	The format is parsed the same way as scripts/ktrace_decode.py does.
+	\param record - record to fill
+	\param fmt - format string
+	\param args - first argument word of the ktrace() call
+*/
+static void KtraceCopyArguments(KTRACE_RECORD_PTR record, const char * fmt, UINT32 * args)
+{
+	UINT32 available, count = 0, words, length = 0, room;
+	char * string;
+
+	available = (UINT32 *)( GetKernelStackPointer() + KERNEL_STACK_SIZE ) - args;
+	if ( available > KTRACE_RECORD_ARGS )
+		available = KTRACE_RECORD_ARGS;
+
+	record->string_args = 0;
+	while( *fmt && count < available )
+	{
+		if ( *fmt++ != '%' )
+			continue;
+		/*flags, width and precision*/
+		words = 1;
+		while( *fmt && strchr( " #+-0123456789.*hlL", *fmt ) )
+		{
+			if ( *fmt == '*' )
+				count++;
+			else if ( *fmt == 'l' && fmt[1] == 'l' )
+			{
+				words = 2;
+				fmt++;
+			}
+			fmt++;
+		}
+		if ( *fmt == 0 )
+			break;
+		switch( *fmt++ )
+		{
+			case 'd': case 'i': case 'u': case 'o': case 'x': case 'X':
+			case 'D': case 'O': case 'U': case 'p':
+				count += words;
+				break;
+			case 'c':
+				count++;
+				break;
+			case 's':
+				if ( count >= available )
+					break;
+				string = (char *)args[count];
+				room = KTRACE_RECORD_STRING_SIZE - length;
+				/*need room for at least one character and the terminator*/
+				if ( string != NULL && room > 1
+					&& !VALUE_WITH_IN_RANGE( kernel_reserve_range.code_va_start, kernel_reserve_range.code_va_end, (VADDR)string ) )
+				{
+					while( *string && room > 1 )
+					{
+						record->strings[length++] = *string++;
+						room--;
+					}
+					record->strings[length++] = 0;
+					record->string_args |= 1 << count;
+				}
+				count++;
+				break;
+		}
+	}
+	if ( count > available )
+		count = available;
+	memcpy( record->args, args, count * sizeof(UINT32) );
+	record->arg_count = count;
+	record->string_length = length;
+}
+
+/*! Adds a record to the current processor's ring
+	\param fmt - format string
+	\param args - arguments of the ktrace() call
+*/
+static void KtraceLogRecord(const char * fmt, UINT32 * args)
+{
+	PROCESSOR_PTR p;
+	KTRACE_LOG_PTR log;
+	KTRACE_RECORD_PTR record;
+	UINT32 flags, head;
+
+	flags = DisableInterrupts();
+	p = GET_CURRENT_PROCESSOR;
+	if ( p == NULL )
+		p = &processor[GetCurrentProcessorId()];
+	log = &ktrace_logs[p - processor];
+	head = log->head;
+	if ( log->records == NULL || head - log->tail >= log->size )
+	{
+		log->dropped++;
+		RestoreInterrupts( flags );
+		return;
+	}
+
+	record = &log->records[ head & (log->size-1) ];
+	record->magic[0] = KTRACE_RECORD_MAGIC0;
+	record->magic[1] = KTRACE_RECORD_MAGIC1;
+	record->processor_id = p - processor;
+	record->format = (UINT32)fmt;
+	record->timestamp = rdtsc();
+	KtraceCopyArguments( record, fmt, args );
+	/*publish the record only after it is filled*/
+	COMPILER_BARRIER();
+	log->head = head + 1;
+	RestoreInterrupts( flags );
+}
+
 /*! prints the given message in configured debug ports see ktrace.c in arch dir
 */
 int ktrace(const char *fmt, ...)
 {
+	if ( ktrace_log_enabled )
+	{
+		KtraceLogRecord( fmt, (UINT32 *)((&fmt)+1) );
+		return 0;
+	}
 	return _doprint( fmt, ktrace_putc, NULL, (va_list) ((&fmt)+1));
 }
 
+/*! Writes the records logged by a processor to the debug port
+	\param log - ring to drain
+	\param processor_id - owner of the ring
+*/
+static void DrainKtraceLog(KTRACE_LOG_PTR log, int processor_id)
+{
+	KTRACE_RECORD record;
+	UINT32 dropped;
+
+	while( log->tail != log->head )
+	{
+		record = log->records[ log->tail & (log->size-1) ];
+		/*the slot can be reused only after it is copied*/
+		COMPILER_BARRIER();
+		log->tail++;
+		KtraceWrite( &record, OFFSET_OF_MEMBER(KTRACE_RECORD, strings) + record.string_length );
+	}
+
+	/*report the drops so that the decoder can show the gap*/
+	dropped = log->dropped;
+	if ( dropped != log->reported_dropped )
+	{
+		memset( &record, 0, sizeof(record) );
+		record.magic[0] = KTRACE_RECORD_MAGIC0;
+		record.magic[1] = KTRACE_RECORD_MAGIC1;
+		record.processor_id = processor_id;
+		record.arg_count = 1;
+		record.timestamp = rdtsc();
+		record.args[0] = dropped - log->reported_dropped;
+		log->reported_dropped = dropped;
+		KtraceWrite( &record, OFFSET_OF_MEMBER(KTRACE_RECORD, strings) );
+	}
+}
+
+/*! Writes the logged records of all processors to the debug port
+	Called by the drain thread and by panic() so that the last records are not lost.
+*/
+void FlushKtraceLog()
+{
+	int i;
+
+	for(i=0; i<count_running_processors; i++)
+	{
+		if ( ktrace_logs[i].records != NULL )
+			DrainKtraceLog( &ktrace_logs[i], i );
+	}
+}
+
+/*! Drain thread - writes the logged records to the debug port periodically
+*/
+static void KtraceDrainThread()
+{
+	while( 1 )
+	{
+		FlushKtraceLog();
+		Sleep( KTRACE_DRAIN_INTERVAL );
+	}
+}
+
+/*! Switches ktrace() to binary records if the ktrace_buffer_records kernel parameter is set
+	\note should be called from boot thread after the scheduler is initialized
+*/
+void InitKtraceLog()
+{
+	UINT32 size;
+	int i;
+
+	if ( ktrace_buffer_records == 0 )
+		return;
+	for(size=1; size < ktrace_buffer_records; size <<= 1);
+	for(i=0; i<count_running_processors; i++)
+	{
+		ktrace_logs[i].records = kmalloc( sizeof(KTRACE_RECORD) * size, 0 );
+		if ( ktrace_logs[i].records == NULL )
+		{
+			kprintf("Unable to allocate %d ktrace records - ktrace stays synchronous\n", size);
+			while( i-- > 0 )
+			{
+				kfree( ktrace_logs[i].records );
+				ktrace_logs[i].records = NULL;
+			}
+			return;
+		}
+		ktrace_logs[i].size = size;
+	}
+	if ( CreateThread( &kernel_task, KtraceDrainThread, SCHED_CLASS_VERY_LOW, TRUE, NULL ) == NULL )
+	{
+		kprintf("Unable to create ktrace drain thread - ktrace stays synchronous\n");
+		return;
+	}
+
+	ktrace("ktrace: switching to binary records(%d per processor), decode with scripts/ktrace_decode.py\n", size);
+	ktrace_log_enabled = TRUE;
+}
+
 /*! assert function
 Halts the system after printing the message. Used by assert macro
 */
@@ -36,6 +291,9 @@ void panic(char * message)
 {
 	static int panic=0;
 	panic++;
+	/*write out the trace records leading to the panic*/
+	if ( ktrace_log_enabled && panic <= 1 )
+		FlushKtraceLog();
 	if( message ) 
 	{
 		kprintf("panic() : %s\n", message);
@@ -12,14 +12,18 @@
 #include <kernel/multiboot.h>
 #include <kernel/time.h>
 #include <kernel/interrupt.h>
+#include <kernel/ipc.h>
+#include <kernel/profiler.h>
 #include <kernel/mm/pmem.h>
 #include <kernel/mm/kmem.h>
 #include <kernel/mm/vm.h>
+#include <kernel/mm/page_out.h>
 #include <kernel/pm/task.h>
 #include <kernel/pm/thread.h>
 #include <kernel/pm/elf.h>
 #include <kernel/pm/scheduler.h>
 #include <kernel/iom/iom.h>
+#include <kernel/iom/devfs.h>
 #include <kernel/system_call_handler.h>
 #include <kernel/module.h>
 #include <kernel/i386/i386.h>
@@ -54,6 +58,9 @@ void cmain(unsigned long magic, MULTIBOOT_INFO_PTR mbi)
 	/* Initialize virtual memory manager*/
 	InitVm();
 	
+	/* Sort the kernel symbols for fast address and name lookups - needs kernel heap*/
+	InitKernelSymbolIndex();
+	
 	/* Read ACPI tables and enable ACPI mode*/
 	if ( InitACPI() != 0 )
 		panic("ACPI Initialization failed.\n");
@@ -82,15 +89,49 @@ void cmain(unsigned long magic, MULTIBOOT_INFO_PTR mbi)
 	/* Start the architecture depended timer for master processor - to enable scheduler */
 	StartTimer(SCHEDULER_DEFAULT_QUANTUM, FALSE);
 	
+	/* Buffer ktrace output and write it from a thread if requested through kernel parameter */
+	InitKtraceLog();
+	
 	/* Initialize virtual file system */
 	InitVfs();
 	
+	/* Start the page out daemon - needs scheduler and vfs */
+	InitPageOutDaemon();
+	
 	/* Initialize IO manager and start drivers*/
 	InitIoManager();
 	
 	/* Installl system call handler */
 	SetupSystemCallHandler();	
 	
+	/* Measure IPC throughput if requested through kernel parameter */
+	if ( ipc_benchmark_messages )
+		BenchmarkMessageQueue( ipc_benchmark_messages );
+	
+	/* Compare buffered and direct device IO if requested through kernel parameter */
+	if ( device_io_benchmark_bytes )
+		BenchmarkDeviceIo( device_io_benchmark_bytes );
+	
+	/* Measure IRP allocation cost if requested through kernel parameter */
+	if ( irp_benchmark_count )
+		BenchmarkIrpAllocation( irp_benchmark_count );
+	
+	/* Check the kernel symbol indexes against the symbol table if requested through kernel parameter */
+	if ( kernel_symbol_test )
+		VerifyKernelSymbolIndex();
+	
+	/* Check batched and multi queue IPC if requested through kernel parameter */
+	if ( ipc_test )
+		VerifyMessageQueue();
+	
+	/* Evict a mapped page and fault it in again if requested through kernel parameter */
+	if ( page_out_test )
+		VerifyPageOut();
+	
+	/* Profile the system in the background if requested through kernel parameter */
+	if ( profiler_boot_seconds )
+		ProfileSystem( profiler_boot_seconds );
+	
 	//InitGraphicsConsole();
 	
 	kprintf("Kernel initialization complete - Loading shell\n");
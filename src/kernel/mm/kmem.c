@@ -60,7 +60,7 @@ void InitKmem()
 	if ( InitCache(&dir_entry_cache, sizeof(DIRECTORY_ENTRY), fs_param.dir_entry.free_slabs_threshold, fs_param.dir_entry.min_buffers, fs_param.dir_entry.max_buffers, DirEntryCacheConstructor, DirEntryCacheDestructor) == -1 )
 		panic("InitCache(dir_entry_cache) failed");
 		
-	if ( InitCache(&vnode_cache, sizeof(VNODE), fs_param.dir_entry.free_slabs_threshold, fs_param.dir_entry.min_buffers, fs_param.dir_entry.max_buffers, VnodeCacheConstructor, VnodeCacheDestructor) == -1 )
+	if ( InitCache(&vnode_cache, sizeof(VNODE), fs_param.vnode.free_slabs_threshold, fs_param.vnode.min_buffers, fs_param.vnode.max_buffers, VnodeCacheConstructor, VnodeCacheDestructor) == -1 )
 		panic("InitCache(vnode_cache) failed");
 	
 }
@@ -0,0 +1,774 @@
+/*!
+	\file	kernel/mm/page_out.c
+	\brief	page out daemon - ages and evicts pages using two list clock algorithm
+
+	AllocateVirtualPages() adds every allocated page to the tail of the active list. The page out daemon
+	wakes up periodically or when somebody runs out of free pages and does the following
+		1) Scans the head of the active list, pages which are referenced(PTE accessed bit) after the last scan
+		   get a second chance and go to the tail of the active list; other pages are moved to the inactive list.
+		2) Scans the head of the inactive list and evicts the pages which are not referenced after deactivation.
+			a) UBC pages are written back to the file if they are modified and then freed.
+			b) Anonymous pages are written to the swap vnode and the vm unit vtop entry is changed to point the swap vnode.
+
+	Only UBC pages and anonymous pages with user mappings are pageable, other pages(kmem, page tables etc) are just rotated.
+	A page's mappings are found through VA_MAP records added by MemoryFaultHandler().
+*/
+#include <string.h>
+#include <kernel/debug.h>
+#include <kernel/arch.h>
+#include <kernel/wait_event.h>
+#include <kernel/mm/vm.h>
+#include <kernel/mm/pmem.h>
+#include <kernel/mm/kmem.h>
+#include <kernel/mm/virtual_page.h>
+#include <kernel/mm/page_out.h>
+#include <kernel/pm/task.h>
+#include <kernel/pm/thread.h>
+#include <kernel/vfs/vfs.h>
+
+/*! kernel parameter - page out daemon tries to keep atleast this many pages free*/
+UINT32 page_out_free_target = 256;
+/*! kernel parameter - how often the page out daemon ages the pages(in milliseconds)*/
+UINT32 page_out_interval = 1000;
+/*! kernel parameter - maximum pages examined in a list during a single scan*/
+UINT32 page_out_scan_batch = 64;
+/*! kernel parameter - size of memory backed swap in KB(0 means no memory swap)
+	Memory backed swap is a stand-in for a swap device and it is useful to test the paging code*/
+UINT32 swap_memory_size = 0;
+/*! kernel parameter - evicts a mapped file page during boot and checks that it is faulted in again*/
+UINT32 page_out_test = 0;
+
+PAGE_OUT_STATISTICS page_out_statistics;
+
+/*! swap vnode and its slot usage*/
+typedef struct swap_info
+{
+	SPIN_LOCK	lock;					/*! lock to protect the structure*/
+	VNODE_PTR	vnode;					/*! vnode used as swap*/
+	UINT32		total_slots;			/*! total page slots in the swap vnode*/
+	UINT32		free_slots;				/*! free page slots in the swap vnode*/
+	UINT32		next_slot;				/*! hint to start search for a free slot*/
+	UINT16 *	slot_map;				/*! reference count of each slot, 0 means the slot is free*/
+}SWAP_INFO;
+
+static SWAP_INFO swap_info;
+
+/*! page out daemon waits on this queue*/
+static WAIT_QUEUE page_out_wait_queue;
+/*! threads waiting for free pages wait on this queue*/
+static WAIT_QUEUE free_pages_wait_queue;
+/*! page out daemon thread*/
+static THREAD_PTR page_out_thread = NULL;
+
+static void PageOutDaemon();
+static void AgeActiveVirtualPages(UINT32 count);
+static UINT32 ScanInactiveVirtualPages(UINT32 count, UINT32 target);
+static BOOLEAN IsVirtualPagePageable(VIRTUAL_PAGE_PTR vp);
+static BOOLEAN TestAndClearVirtualPageReference(VIRTUAL_PAGE_PTR vp);
+static ERROR_CODE EvictVirtualPage(VIRTUAL_PAGE_PTR vp);
+static ERROR_CODE AllocateSwapSlot(UINT32 * offset);
+static ERROR_CODE SwapPageIo(VNODE_PTR vnode, UINT32 offset, VIRTUAL_PAGE_PTR vp, BOOLEAN write);
+static ERROR_CODE RedirectVirtualPageVtops(VIRTUAL_PAGE_PTR vp, VA_MAP_PTR * va_map_list, VNODE_PTR swap_vnode, UINT32 swap_offset, UINT32 * swap_references);
+static BOOLEAN IsVaMapListOfSingleUnit(VA_MAP_PTR va_map_list);
+static void ReattachVaMapList(VIRTUAL_PAGE_PTR vp, VA_MAP_PTR va_map_list);
+static ERROR_CODE EvictPageOutTestPage(VIRTUAL_PAGE_PTR vp, VNODE_PTR pin_vnode);
+
+/*! Initializes swap and starts the page out daemon
+	\note should be called from boot thread after the scheduler and vfs are initialized
+*/
+void InitPageOutDaemon()
+{
+	THREAD_CONTAINER_PTR tc;
+
+	InitWaitQueue( &page_out_wait_queue );
+	InitWaitQueue( &free_pages_wait_queue );
+	InitSpinLock( &swap_info.lock );
+	memset( &page_out_statistics, 0, sizeof(page_out_statistics) );
+
+	/*page tables of other address spaces are accessed through the window*/
+	InitPhysicalPageWindow();
+
+	if ( swap_memory_size )
+	{
+		VNODE_PTR vnode = CreateMemorySwapVnode( swap_memory_size * 1024 );
+		if ( vnode == NULL || AddSwapVnode( vnode, vnode->file_size ) != ERROR_SUCCESS )
+			kprintf("Unable to create memory swap of %d KB\n", swap_memory_size);
+	}
+
+	tc = CreateThread( &kernel_task, PageOutDaemon, SCHED_CLASS_HIGH, TRUE, NULL );
+	if ( tc == NULL )
+		panic("Unable to create page out daemon");
+	page_out_thread = &tc->thread;
+}
+
+/*! Page out daemon thread
+	Sleeps for page_out_interval or until somebody wakes it and then ages/evicts pages.
+*/
+static void PageOutDaemon()
+{
+	WAIT_EVENT event;
+
+	/*memory is freed by the file system writes, they should not wait behind the other requests*/
+	SetMessagePriority( MESSAGE_PRIORITY_URGENT );
+	while( 1 )
+	{
+		InitWaitEventOnStack( &event );
+		AddWaitEventToQueue( &page_out_wait_queue, &event );
+		WaitForWaitEvent( &event, page_out_interval );
+
+		if ( vm_data.total_free_pages < page_out_free_target )
+			PageOutVirtualPages( page_out_free_target - vm_data.total_free_pages );
+		else
+			AgeActiveVirtualPages( page_out_scan_batch );
+
+		/*let the waiters retry their allocation*/
+		WakeUpWaitQueue( &free_pages_wait_queue, WAIT_EVENT_WAKE_UP_ALL );
+	}
+}
+
+/*! Wakes up the page out daemon
+*/
+void WakeUpPageOutDaemon()
+{
+	WakeUpWaitQueue( &page_out_wait_queue, WAIT_EVENT_WAKE_UP_ALL );
+}
+
+/*! Wakes up the page out daemon and waits until it completes a scan
+	\param timeout - maximum time to wait in milliseconds
+	\return ERROR_SUCCESS - the daemon completed a scan, the caller can retry allocation
+			ERROR_TIMEOUT - the daemon did not complete within timeout
+			ERROR_BUSY - the daemon is not running or the caller is the daemon itself
+*/
+ERROR_CODE WaitForFreeVirtualPages(UINT32 timeout)
+{
+	WAIT_EVENT event;
+
+	if ( page_out_thread == NULL || GetCurrentThread() == page_out_thread )
+		return ERROR_BUSY;
+
+	/*no memory allocation here - the caller is already short of memory*/
+	InitWaitEventOnStack( &event );
+	AddWaitEventToQueue( &free_pages_wait_queue, &event );
+	WakeUpWaitQueue( &page_out_wait_queue, WAIT_EVENT_WAKE_UP_ALL );
+
+	return WaitForWaitEvent( &event, timeout );
+}
+
+/*! Runs the clock on both the lists until target pages are freed or the lists are scanned twice
+	\param target - number of pages to free
+	\return number of pages freed
+*/
+UINT32 PageOutVirtualPages(UINT32 target)
+{
+	UINT32 freed = 0, pass;
+
+	page_out_statistics.scans++;
+	/*pages deactivated during the first pass are evicted only if they are not referenced till the second pass*/
+	for(pass=0; pass<2 && freed<target; pass++)
+	{
+		AgeActiveVirtualPages( page_out_scan_batch );
+		freed += ScanInactiveVirtualPages( page_out_scan_batch, target-freed );
+	}
+	return freed;
+}
+
+/*! Moves the unreferenced pages from the head of the active list to the inactive list
+	\param count - maximum pages to examine
+
+	The inactive list is refilled until it is half the size of active list.
+*/
+static void AgeActiveVirtualPages(UINT32 count)
+{
+	VIRTUAL_PAGE_PTR vp;
+
+	while ( count-- )
+	{
+		SpinLock( &vm_data.lru_lock );
+		if ( vm_data.active_list == NULL || vm_data.inactive_count*2 >= vm_data.active_count )
+		{
+			SpinUnlock( &vm_data.lru_lock );
+			break;
+		}
+		vp = vm_data.active_list;
+		page_out_statistics.pages_scanned++;
+		/*rotate the page to the tail and examine it without holding the lru lock*/
+		ActivateVirtualPage( vp );
+		if ( !IsVirtualPagePageable( vp ) )
+		{
+			SpinUnlock( &vm_data.lru_lock );
+			continue;
+		}
+		vp->busy = 1;
+		SpinUnlock( &vm_data.lru_lock );
+
+		if ( TestAndClearVirtualPageReference( vp ) )
+		{
+			page_out_statistics.pages_activated++;
+			vp->busy = 0;
+			continue;
+		}
+
+		SpinLock( &vm_data.lru_lock );
+		/*page might have been freed while we were examining it*/
+		if ( vp->active )
+		{
+			DeactivateVirtualPage( vp );
+			page_out_statistics.pages_deactivated++;
+		}
+		vp->busy = 0;
+		SpinUnlock( &vm_data.lru_lock );
+	}
+}
+
+/*! Evicts the unreferenced pages from the head of the inactive list
+	\param count - maximum pages to examine
+	\param target - number of pages to free
+	\return number of pages freed
+*/
+static UINT32 ScanInactiveVirtualPages(UINT32 count, UINT32 target)
+{
+	VIRTUAL_PAGE_PTR vp;
+	UINT32 freed = 0;
+
+	while ( count-- && freed < target )
+	{
+		SpinLock( &vm_data.lru_lock );
+		vp = vm_data.inactive_list;
+		if ( vp == NULL )
+		{
+			SpinUnlock( &vm_data.lru_lock );
+			break;
+		}
+		page_out_statistics.pages_scanned++;
+		if ( !IsVirtualPagePageable( vp ) )
+		{
+			ActivateVirtualPage( vp );
+			SpinUnlock( &vm_data.lru_lock );
+			continue;
+		}
+		/*rotate so that the next iteration picks a different page even if this eviction fails*/
+		DeactivateVirtualPage( vp );
+		vp->busy = 1;
+		SpinUnlock( &vm_data.lru_lock );
+
+		/*referenced after deactivation - give it another chance*/
+		if ( TestAndClearVirtualPageReference( vp ) )
+		{
+			SpinLock( &vm_data.lru_lock );
+			if ( vp->inactive )
+				ActivateVirtualPage( vp );
+			vp->busy = 0;
+			SpinUnlock( &vm_data.lru_lock );
+			page_out_statistics.pages_activated++;
+			continue;
+		}
+
+		if ( EvictVirtualPage( vp ) == ERROR_SUCCESS )
+			freed++;
+		else
+		{
+			page_out_statistics.page_out_failures++;
+			vp->busy = 0;
+		}
+	}
+	return freed;
+}
+
+/*! Checks whether the page out daemon can evict the given page
+	\param vp - virtual page
+	\note vm_data.lru_lock should be taken by the caller
+*/
+static BOOLEAN IsVirtualPagePageable(VIRTUAL_PAGE_PTR vp)
+{
+	if ( vp->busy || vp->wire_count || vp->copy_on_write )
+		return FALSE;
+	if ( vp->ubc )
+		return vp->ubc_info.loaded;
+	/*anonymous page - only user mappings are recorded and a swap vnode is required to page it out*/
+	return vp->va_map_list != NULL && swap_info.vnode != NULL;
+}
+
+/*! Tests and clears the accessed bit on all the mappings of the given virtual page
+	\param vp - virtual page
+	\return TRUE if any of the mapping was accessed since the last call
+
+	Dirty bit is not cleared here, but a ubc page is marked dirty so that it will be written back before eviction.
+	The dirty bit is cleared by the ubc when the page is written back.
+*/
+static BOOLEAN TestAndClearVirtualPageReference(VIRTUAL_PAGE_PTR vp)
+{
+	UINT32 status;
+
+	status = GetVirtualPageMappingStatus( vp, PAGE_STATUS_ACCESSED );
+	if ( (status & PAGE_STATUS_DIRTY) && vp->ubc )
+		MarkVnodePageDirty( vp->ubc_info.vnode, vp );
+
+	return (status & PAGE_STATUS_ACCESSED) ? TRUE : FALSE;
+}
+
+/*! Writes the page to its backing store(file or swap), removes all its mappings and frees it
+	\param vp - virtual page to evict(busy bit should be set by the caller)
+	\return ERROR_SUCCESS if the page is freed
+*/
+static ERROR_CODE EvictVirtualPage(VIRTUAL_PAGE_PTR vp)
+{
+	VA_MAP_PTR va_map_list, va_map;
+	VNODE_PTR swap_vnode = NULL;
+	UINT32 status = 0, swap_offset = 0, swap_references = 0;
+	ERROR_CODE ret;
+
+	/*anonymous page needs a swap slot before touching the mappings*/
+	if ( !vp->ubc )
+	{
+		ret = AllocateSwapSlot( &swap_offset );
+		if ( ret != ERROR_SUCCESS )
+			return ret;
+		swap_vnode = swap_info.vnode;
+	}
+
+	/*detach and revoke all the mappings - any further access will fault and find the page again through the vm unit*/
+	SpinLock( &vp->lock );
+	va_map_list = vp->va_map_list;
+	/*the vtop entries of an anonymous page are changed together, so all of them should be in one vm unit*/
+	if ( swap_vnode && !IsVaMapListOfSingleUnit( va_map_list ) )
+	{
+		SpinUnlock( &vp->lock );
+		ReleaseSwapSlot( swap_vnode, swap_offset );
+		return ERROR_BUSY;
+	}
+	vp->va_map_list = NULL;
+	SpinUnlock( &vp->lock );
+	va_map = va_map_list;
+	if ( va_map != NULL )
+	{
+		do
+		{
+			status |= RevokePhysicalMapping( va_map->physical_map, va_map->va );
+			va_map = STRUCT_ADDRESS_FROM_MEMBER( va_map->list.next, VA_MAP, list );
+		}while( va_map != va_map_list );
+	}
+
+	/*write the content to the backing store*/
+	if ( vp->ubc )
+	{
+		if ( status & PAGE_STATUS_DIRTY )
+			MarkVnodePageDirty( vp->ubc_info.vnode, vp );
+		ret = ERROR_SUCCESS;
+		if ( vp->ubc_info.modified )
+		{
+			ret = WriteUbcPage( vp->ubc_info.vnode, vp->ubc_info.offset, vp );
+			if ( ret == ERROR_SUCCESS )
+				page_out_statistics.ubc_pages_written++;
+		}
+	}
+	else
+		ret = SwapPageIo( swap_vnode, swap_offset, vp, TRUE );
+
+	/*point the vm unit entries to the backing store, this fails if the page is faulted in again during the IO*/
+	if ( ret == ERROR_SUCCESS )
+		ret = RedirectVirtualPageVtops( vp, &va_map_list, swap_vnode, swap_offset, &swap_references );
+	/*a ubc page which is pinned, mapped again through the vnode or dirtied again by a file write stays in the vnode*/
+	if ( ret == ERROR_SUCCESS && vp->ubc )
+		ret = RemoveVnodePage( vp->ubc_info.vnode, vp );
+	if ( ret != ERROR_SUCCESS )
+	{
+		/*the remaining vtop entries still point to the page, so it will be mapped again on next access*/
+		if ( swap_vnode && swap_references == 0 )
+			ReleaseSwapSlot( swap_vnode, swap_offset );
+		ReattachVaMapList( vp, va_map_list );
+		return ret;
+	}
+
+	if ( swap_vnode )
+	{
+		if ( swap_references == 0 )
+			ReleaseSwapSlot( swap_vnode, swap_offset );
+		page_out_statistics.pages_swapped_out++;
+	}
+	else
+		page_out_statistics.ubc_pages_freed++;
+
+	vp->busy = 0;
+	FreeVirtualPages( vp, 1 );
+
+	return ERROR_SUCCESS;
+}
+
+/*! Points the vtop entries of an evicted page to its backing store
+	\param vp - virtual page being evicted
+	\param va_map_list - detached mapping records of the page, records of the changed entries are freed
+	\param swap_vnode - swap vnode for an anonymous page, NULL for a ubc page
+	\param swap_offset - swap slot of an anonymous page
+	\param swap_references - updated with the number of vtop entries pointing to the swap slot
+	\return ERROR_BUSY if the page is mapped again after its mappings were detached
+
+	MemoryFaultHandler() maps a page and records the mapping under the vtop lock, so the check made here under the
+	same lock sees every fault through this vm unit. A fault through the vnode of a changed ubc entry is seen by
+	RemoveVnodePage().
+*/
+static ERROR_CODE RedirectVirtualPageVtops(VIRTUAL_PAGE_PTR vp, VA_MAP_PTR * va_map_list, VNODE_PTR swap_vnode, UINT32 swap_offset, UINT32 * swap_references)
+{
+	VM_UNIT_PTR locked_unit = NULL;
+	ERROR_CODE ret = ERROR_SUCCESS;
+	BOOLEAN mapped;
+
+	while ( *va_map_list != NULL )
+	{
+		VA_MAP_PTR va_map = *va_map_list;
+		VM_UNIT_PTR unit = va_map->unit;
+		VM_VTOP_PTR vtop = &unit->vtop_array[va_map->vtop_index];
+
+		if ( unit != locked_unit )
+		{
+			if ( locked_unit != NULL )
+				SpinUnlock( &locked_unit->vtop_lock );
+			SpinLock( &unit->vtop_lock );
+			locked_unit = unit;
+			SpinLock( &vp->lock );
+			mapped = vp->va_map_list != NULL;
+			SpinUnlock( &vp->lock );
+			if ( mapped )
+			{
+				ret = ERROR_BUSY;
+				break;
+			}
+		}
+		if ( VTOP_IN_MEMORY(vtop) && VTOP_TO_VIRTUAL_PAGE(vtop) == vp )
+		{
+			if ( swap_vnode )
+			{
+				/*the first reference is taken during slot allocation*/
+				if ( (*swap_references)++ )
+					ReferenceSwapSlot( swap_vnode, swap_offset );
+				vtop->vnode = swap_vnode;
+				vtop->swap_offset = swap_offset;
+			}
+			else
+				vtop->vpage = NULL;
+			unit->page_count--;
+		}
+
+		/*the entry no longer points to the page*/
+		if ( IsListEmpty( &va_map->list ) )
+			*va_map_list = NULL;
+		else
+			*va_map_list = STRUCT_ADDRESS_FROM_MEMBER( va_map->list.next, VA_MAP, list );
+		RemoveFromList( &va_map->list );
+		kfree( va_map );
+	}
+	if ( locked_unit != NULL )
+		SpinUnlock( &locked_unit->vtop_lock );
+
+	return ret;
+}
+
+/*! Returns TRUE if all the records in the list are of the same vm unit
+	\note vp->lock should be taken by the caller
+*/
+static BOOLEAN IsVaMapListOfSingleUnit(VA_MAP_PTR va_map_list)
+{
+	LIST_PTR list;
+
+	if ( va_map_list == NULL )
+		return TRUE;
+	LIST_FOR_EACH(list, &va_map_list->list)
+	{
+		if ( STRUCT_ADDRESS_FROM_MEMBER(list, VA_MAP, list)->unit != va_map_list->unit )
+			return FALSE;
+	}
+	return TRUE;
+}
+
+/*! Links a detached list of VA_MAP records back to the page after a failed eviction
+	\param vp - virtual page
+	\param va_map_list - detached records
+*/
+static void ReattachVaMapList(VIRTUAL_PAGE_PTR vp, VA_MAP_PTR va_map_list)
+{
+	while ( va_map_list != NULL )
+	{
+		VA_MAP_PTR va_map = va_map_list;
+		if ( IsListEmpty( &va_map->list ) )
+			va_map_list = NULL;
+		else
+			va_map_list = STRUCT_ADDRESS_FROM_MEMBER( va_map->list.next, VA_MAP, list );
+		RemoveFromList( &va_map->list );
+		/*a mapping recorded again by a fault frees the record*/
+		LinkVaMapToVirtualPage( vp, va_map, va_map->physical_map, va_map->va, va_map->unit, va_map->vtop_index );
+	}
+}
+
+/*! Reads a swapped out page into the given virtual page
+	\param vnode - swap vnode from the vtop entry
+	\param offset - swap offset from the vtop entry
+	\param vp - virtual page to fill
+	\note caller should release the swap slot after changing the vtop entry to point the virtual page
+*/
+ERROR_CODE SwapInVirtualPage(VNODE_PTR vnode, UINT32 offset, VIRTUAL_PAGE_PTR vp)
+{
+	ERROR_CODE ret;
+
+	assert( vnode != NULL );
+	ret = SwapPageIo( vnode, offset, vp, FALSE );
+	if ( ret != ERROR_SUCCESS )
+		return ret;
+
+	page_out_statistics.pages_swapped_in++;
+
+	return ERROR_SUCCESS;
+}
+
+/*! Reads/writes a page from/to the swap vnode
+	\param vnode - swap vnode
+	\param offset - offset in the swap vnode
+	\param vp - virtual page
+	\param write - TRUE to write the page to swap, FALSE to read from swap
+
+	A vnode without mounted file system is a memory backed swap and fs_data points to its backing memory.
+*/
+static ERROR_CODE SwapPageIo(VNODE_PTR vnode, UINT32 offset, VIRTUAL_PAGE_PTR vp, BOOLEAN write)
+{
+	BYTE * store;
+	void * va;
+
+	if ( vnode->mounted_fs != NULL )
+		return TransferVnodePage( vnode, offset, vp->physical_address, write );
+
+	assert( offset + PAGE_SIZE <= vnode->file_size );
+	store = (BYTE *)vnode->fs_data + offset;
+	va = MapPhysicalPageWindow( vp->physical_address );
+	if ( write )
+		memcpy( store, va, PAGE_SIZE );
+	else
+		memcpy( va, store, PAGE_SIZE );
+	UnmapPhysicalPageWindow();
+
+	return ERROR_SUCCESS;
+}
+
+/*! Uses the given vnode as swap
+	\param vnode - vnode to use as swap
+	\param size - size of the swap in bytes
+*/
+ERROR_CODE AddSwapVnode(VNODE_PTR vnode, UINT32 size)
+{
+	UINT32 total_slots = size / PAGE_SIZE;
+	UINT16 * slot_map;
+
+	assert( vnode != NULL );
+	if ( total_slots == 0 )
+		return ERROR_INVALID_PARAMETER;
+
+	slot_map = (UINT16 *)kmalloc( total_slots * sizeof(UINT16), 0 );
+	if ( slot_map == NULL )
+		return ERROR_NOT_ENOUGH_MEMORY;
+	memset( slot_map, 0, total_slots * sizeof(UINT16) );
+
+	SpinLock( &swap_info.lock );
+	/*\todo - support more than one swap vnode*/
+	if ( swap_info.vnode != NULL )
+	{
+		SpinUnlock( &swap_info.lock );
+		kfree( slot_map );
+		return ERROR_BUSY;
+	}
+	ReferenceVnode( vnode, NULL );
+	swap_info.slot_map = slot_map;
+	swap_info.total_slots = swap_info.free_slots = total_slots;
+	swap_info.next_slot = 0;
+	swap_info.vnode = vnode;
+	SpinUnlock( &swap_info.lock );
+
+	kprintf("Swap: %d KB\n", (total_slots * PAGE_SIZE) / 1024 );
+	return ERROR_SUCCESS;
+}
+
+/*! Creates a memory backed vnode which can be used as swap
+	\param size - size of the swap in bytes
+	\return vnode on success, NULL on failure
+*/
+VNODE_PTR CreateMemorySwapVnode(UINT32 size)
+{
+	VNODE_PTR vnode;
+
+	size = PAGE_ALIGN(size);
+	if ( size == 0 )
+		return NULL;
+	vnode = AllocateBuffer( &vnode_cache, 0 );
+	if ( vnode == NULL )
+		return NULL;
+	vnode->fs_data = kmalloc( size, 0 );
+	if ( vnode->fs_data == NULL )
+	{
+		FreeBuffer( vnode, &vnode_cache );
+		return NULL;
+	}
+	vnode->file_size = size;
+	vnode->mounted_fs = NULL;
+
+	return vnode;
+}
+
+/*! Allocates a free slot in the swap vnode
+	\param offset - output - offset of the slot in the swap vnode
+*/
+static ERROR_CODE AllocateSwapSlot(UINT32 * offset)
+{
+	UINT32 i, slot;
+
+	SpinLock( &swap_info.lock );
+	if ( swap_info.vnode == NULL || swap_info.free_slots == 0 )
+	{
+		SpinUnlock( &swap_info.lock );
+		return ERROR_NOT_ENOUGH_MEMORY;
+	}
+	for(i=0; i<swap_info.total_slots; i++)
+	{
+		slot = (swap_info.next_slot + i) % swap_info.total_slots;
+		if ( swap_info.slot_map[slot] == 0 )
+		{
+			swap_info.slot_map[slot] = 1;
+			swap_info.free_slots--;
+			swap_info.next_slot = slot + 1;
+			SpinUnlock( &swap_info.lock );
+
+			*offset = slot * PAGE_SIZE;
+			return ERROR_SUCCESS;
+		}
+	}
+	SpinUnlock( &swap_info.lock );
+
+	return ERROR_NOT_ENOUGH_MEMORY;
+}
+
+/*! Adds a reference to a swap slot - used when a vm unit with swapped out pages is copied
+	\param vnode - swap vnode
+	\param offset - offset of the slot in the swap vnode
+*/
+void ReferenceSwapSlot(VNODE_PTR vnode, UINT32 offset)
+{
+	UINT32 slot = offset / PAGE_SIZE;
+
+	SpinLock( &swap_info.lock );
+	assert( vnode == swap_info.vnode );
+	assert( slot < swap_info.total_slots && swap_info.slot_map[slot] > 0 );
+	swap_info.slot_map[slot]++;
+	SpinUnlock( &swap_info.lock );
+}
+
+/*! Releases a reference to a swap slot and frees the slot when the last reference is gone
+	\param vnode - swap vnode
+	\param offset - offset of the slot in the swap vnode
+*/
+void ReleaseSwapSlot(VNODE_PTR vnode, UINT32 offset)
+{
+	UINT32 slot = offset / PAGE_SIZE;
+
+	SpinLock( &swap_info.lock );
+	assert( vnode == swap_info.vnode );
+	assert( slot < swap_info.total_slots && swap_info.slot_map[slot] > 0 );
+	swap_info.slot_map[slot]--;
+	if ( swap_info.slot_map[slot] == 0 )
+		swap_info.free_slots++;
+	SpinUnlock( &swap_info.lock );
+}
+
+/*! Maps the driver database, evicts its first page and checks that the page is faulted in again with the same content
+	The page is evicted first with a pin taken during the eviction, which should fail and leave the page usable, and then
+	without the pin.
+*/
+void VerifyPageOut()
+{
+	char file_path[] = "/boot/driver_id.txt";
+	VADDR va = NULL, pa, first_pa;
+	VIRTUAL_PAGE_PTR vp;
+	VNODE_PTR vnode;
+	BYTE copy[64];
+	long file_size;
+	int file_id;
+	ERROR_CODE pinned_ret, ret;
+
+	if ( OpenFile( &kernel_task, file_path, VFS_ACCESS_TYPE_READ, OPEN_EXISTING, &file_id ) != ERROR_SUCCESS )
+	{
+		kprintf("Page out test: unable to open %s\n", file_path);
+		return;
+	}
+	vnode = GetVnodeFromFile( file_id );
+	if ( vnode == NULL || GetFileSize( &kernel_task, file_id, &file_size ) != ERROR_SUCCESS || (UINT32)file_size < sizeof(copy)
+		|| MapViewOfFile( file_id, &va, PROT_READ, 0, file_size, 0, 0 ) != ERROR_SUCCESS )
+	{
+		kprintf("Page out test: unable to map %s\n", file_path);
+		goto close;
+	}
+
+	/*fault the page in*/
+	memcpy( copy, (void *)va, sizeof(copy) );
+	if ( TranslatePaFromVa( va, &first_pa ) == VA_NOT_EXISTS || (vp = PhysicalToVirtualPage( first_pa )) == NULL )
+	{
+		kprintf("Page out test: page is not mapped after the fault\n");
+		goto unmap;
+	}
+
+	/*a pinned page stays in the vnode and the next fault should map the same page*/
+	pinned_ret = EvictPageOutTestPage( vp, vnode );
+	if ( pinned_ret == ERROR_SUCCESS )
+	{
+		kprintf("Page out test: pinned page is evicted\n");
+		goto unmap;
+	}
+	if ( memcmp( copy, (void *)va, sizeof(copy) ) != 0 || TranslatePaFromVa( va, &pa ) == VA_NOT_EXISTS || pa != first_pa )
+	{
+		kprintf("Page out test: pinned page is not mapped again\n");
+		goto unmap;
+	}
+
+	ret = EvictPageOutTestPage( vp, NULL );
+	if ( ret != ERROR_SUCCESS )
+	{
+		kprintf("Page out test: eviction failed (%d)\n", ret);
+		goto unmap;
+	}
+	if ( TranslatePaFromVa( va, &pa ) != VA_NOT_EXISTS )
+	{
+		kprintf("Page out test: evicted page is still mapped\n");
+		goto unmap;
+	}
+	/*this access reads the page again from the file*/
+	if ( memcmp( copy, (void *)va, sizeof(copy) ) != 0 )
+		kprintf("Page out test: content changed after page in\n");
+	else
+		kprintf("Page out test: passed (pinned eviction returned %d, %d ubc pages freed)\n", pinned_ret, page_out_statistics.ubc_pages_freed);
+
+unmap:
+	FreeVirtualMemory( GetCurrentVirtualMap(), va, file_size, 0 );
+close:
+	CloseFile( &kernel_task, file_id );
+}
+
+/*! Marks the page busy like the page out daemon does and evicts it
+	\param vp - page to evict
+	\param pin_vnode - if not NULL the page is pinned after it is marked busy, so the eviction should fail
+*/
+static ERROR_CODE EvictPageOutTestPage(VIRTUAL_PAGE_PTR vp, VNODE_PTR pin_vnode)
+{
+	VIRTUAL_PAGE_PTR pinned = NULL;
+	ERROR_CODE ret;
+
+	SpinLock( &vm_data.lru_lock );
+	if ( !IsVirtualPagePageable( vp ) )
+	{
+		SpinUnlock( &vm_data.lru_lock );
+		return ERROR_BUSY;
+	}
+	vp->busy = 1;
+	SpinUnlock( &vm_data.lru_lock );
+
+	if ( pin_vnode != NULL )
+		pinned = PinVnodePage( pin_vnode, vp->ubc_info.offset );
+	ret = EvictVirtualPage( vp );
+	if ( ret != ERROR_SUCCESS )
+		vp->busy = 0;
+	if ( pinned != NULL )
+		PutVnodePages( &pinned, 1 );
+	return ret;
+}
@@ -5,6 +5,7 @@
 #include <kernel/mm/vm.h>
 #include <kernel/mm/virtual_page.h>
 #include <kernel/mm/pmem.h>
+#include <kernel/mm/kmem.h>
 #include <kernel/debug.h>
 #include <string.h>
 
@@ -32,6 +33,7 @@ static void inline RemoveVirtualPageFromVmFreeTree(VIRTUAL_PAGE_PTR vp);
 static void AddVirtualPageToActiveLRUList(VIRTUAL_PAGE_PTR vp);
 static void RemoveVirtualPageFromLRUList(VIRTUAL_PAGE_PTR vp);
 static COMPARISION_RESULT free_range_compare_fn(BINARY_TREE_PTR node1, BINARY_TREE_PTR node2);
+static VA_MAP_PTR FindVaMap(VIRTUAL_PAGE_PTR vp, PHYSICAL_MAP_PTR pmap, VADDR va);
 
 /*! Initializes a virtual page array
 	\param vpa	- starting address of the virtual page array
@@ -331,6 +333,8 @@ try_different_vp_range:
 		free_vp--;
 	}
 	
+	vm_data.total_free_pages -= pages;
+	
 	/*remove the free range from the tree*/
 	RemoveNodeFromAvlTree( free_tree, VP_AVL_TREE(first_vp), 1, free_range_compare_fn );
 	/*if the free range is not fully used add it again to the free tree*/
@@ -341,20 +345,266 @@ try_different_vp_range:
 	
 	return result;
 }
+/*! Links the given virtual page at the tail of a LRU list
+	\param head - LRU list head(vm_data.active_list or vm_data.inactive_list)
+	\param vp - virtual page to link
+	\note vm_data.lru_lock should be taken by the caller
+*/
+static void inline LinkVirtualPageToLRUList(VIRTUAL_PAGE_PTR * head, VIRTUAL_PAGE_PTR vp)
+{
+	InitList( &vp->lru_list );
+	if ( *head == NULL )
+		*head = vp;
+	else
+		AddToListTail( &(*head)->lru_list, &vp->lru_list );
+}
+/*! Unlinks the given virtual page from a LRU list
+	\param head - LRU list head(vm_data.active_list or vm_data.inactive_list)
+	\param vp - virtual page to unlink
+	\note vm_data.lru_lock should be taken by the caller
+*/
+static void inline UnlinkVirtualPageFromLRUList(VIRTUAL_PAGE_PTR * head, VIRTUAL_PAGE_PTR vp)
+{
+	if ( *head == vp )
+	{
+		if ( IsListEmpty( &vp->lru_list ) )
+			*head = NULL;
+		else
+			*head = STRUCT_ADDRESS_FROM_MEMBER( vp->lru_list.next, VIRTUAL_PAGE, lru_list );
+	}
+	RemoveFromList( &vp->lru_list );
+}
 /*! Adds the given virtual page to active lru list
 	\param vp - virtual page to add
-	\todo add implementation
 */
 static void AddVirtualPageToActiveLRUList(VIRTUAL_PAGE_PTR vp)
 {
 	assert(!vp->free);
+	
+	SpinLock( &vm_data.lru_lock );
+	assert( !vp->active && !vp->inactive );
+	LinkVirtualPageToLRUList( &vm_data.active_list, vp );
+	vp->active = 1;
+	vm_data.active_count++;
+	SpinUnlock( &vm_data.lru_lock );
 }
 /*! Removes the given virtual page from lru list
 	\param vp - virtual page to remove
-	\todo add implementation
+	
+	Pages which are not in any of the LRU lists(locked/reserved pages) are ignored.
 */
 static void RemoveVirtualPageFromLRUList(VIRTUAL_PAGE_PTR vp)
 {
+	SpinLock( &vm_data.lru_lock );
+	if ( vp->active )
+	{
+		UnlinkVirtualPageFromLRUList( &vm_data.active_list, vp );
+		vp->active = 0;
+		vm_data.active_count--;
+	}
+	else if ( vp->inactive )
+	{
+		UnlinkVirtualPageFromLRUList( &vm_data.inactive_list, vp );
+		vp->inactive = 0;
+		vm_data.inactive_count--;
+	}
+	SpinUnlock( &vm_data.lru_lock );
+}
+/*! Moves the given virtual page to the tail of the active lru list
+	\param vp - virtual page which was referenced recently
+	\note vm_data.lru_lock should be taken by the caller
+*/
+void ActivateVirtualPage(VIRTUAL_PAGE_PTR vp)
+{
+	if ( vp->inactive )
+	{
+		UnlinkVirtualPageFromLRUList( &vm_data.inactive_list, vp );
+		vp->inactive = 0;
+		vm_data.inactive_count--;
+	}
+	else if ( vp->active )
+	{
+		UnlinkVirtualPageFromLRUList( &vm_data.active_list, vp );
+		vm_data.active_count--;
+	}
+	LinkVirtualPageToLRUList( &vm_data.active_list, vp );
+	vp->active = 1;
+	vm_data.active_count++;
+}
+/*! Moves the given virtual page to the tail of the inactive lru list
+	\param vp - virtual page which was not referenced recently
+	\note vm_data.lru_lock should be taken by the caller
+*/
+void DeactivateVirtualPage(VIRTUAL_PAGE_PTR vp)
+{
+	if ( vp->active )
+	{
+		UnlinkVirtualPageFromLRUList( &vm_data.active_list, vp );
+		vp->active = 0;
+		vm_data.active_count--;
+	}
+	else if ( vp->inactive )
+	{
+		UnlinkVirtualPageFromLRUList( &vm_data.inactive_list, vp );
+		vm_data.inactive_count--;
+	}
+	LinkVirtualPageToLRUList( &vm_data.inactive_list, vp );
+	vp->inactive = 1;
+	vm_data.inactive_count++;
+}
+
+/*! Records a virtual address mapping of the given virtual page so that page out daemon can find and remove the mapping
+	\param vp - virtual page
+	\param pmap - physical map in which the page is mapped
+	\param va - virtual address of the mapping
+	\param unit - vm unit which references the page
+	\param vtop_index - index of the page in the vm unit
+*/
+ERROR_CODE AddVaMapToVirtualPage(VIRTUAL_PAGE_PTR vp, PHYSICAL_MAP_PTR pmap, VADDR va, VM_UNIT_PTR unit, UINT32 vtop_index)
+{
+	VA_MAP_PTR va_map;
+	BOOLEAN found;
+	
+	assert( vp != NULL && pmap != NULL );
+	
+	va = PAGE_ALIGN(va);
+	/*if the mapping is already recorded nothing to do*/
+	SpinLock( &vp->lock );
+	found = FindVaMap( vp, pmap, va ) != NULL;
+	SpinUnlock( &vp->lock );
+	if ( found )
+		return ERROR_SUCCESS;
+	
+	va_map = (VA_MAP_PTR)kmalloc( sizeof(VA_MAP), 0 );
+	if ( va_map == NULL )
+		return ERROR_NOT_ENOUGH_MEMORY;
+	LinkVaMapToVirtualPage( vp, va_map, pmap, va, unit, vtop_index );
+	
+	return ERROR_SUCCESS;
+}
+
+/*! Records a virtual address mapping of the given virtual page in a record allocated by the caller
+	This cant fail, so the caller can allocate the record before mapping the page and record the mapping under its locks.
+	\param vp - virtual page
+	\param va_map - record allocated using kmalloc(), it is freed if the mapping is already recorded
+	\param pmap - physical map in which the page is mapped
+	\param va - virtual address of the mapping
+	\param unit - vm unit which references the page
+	\param vtop_index - index of the page in the vm unit
+*/
+void LinkVaMapToVirtualPage(VIRTUAL_PAGE_PTR vp, VA_MAP_PTR va_map, PHYSICAL_MAP_PTR pmap, VADDR va, VM_UNIT_PTR unit, UINT32 vtop_index)
+{
+	assert( vp != NULL && va_map != NULL && pmap != NULL );
+	
+	va_map->va = PAGE_ALIGN(va);
+	va_map->physical_map = pmap;
+	va_map->unit = unit;
+	va_map->vtop_index = vtop_index;
+	InitList( &va_map->list );
+	
+	SpinLock( &vp->lock );
+	if ( FindVaMap( vp, pmap, va_map->va ) != NULL )
+	{
+		SpinUnlock( &vp->lock );
+		kfree( va_map );
+		return;
+	}
+	if ( vp->va_map_list == NULL )
+		vp->va_map_list = va_map;
+	else
+		AddToListTail( &vp->va_map_list->list, &va_map->list );
+	SpinUnlock( &vp->lock );
+}
+
+/*! Returns the record of the given mapping of a virtual page or NULL
+	\note vp->lock should be taken by the caller
+*/
+static VA_MAP_PTR FindVaMap(VIRTUAL_PAGE_PTR vp, PHYSICAL_MAP_PTR pmap, VADDR va)
+{
+	VA_MAP_PTR va_map;
+	LIST_PTR list;
+	
+	if ( vp->va_map_list == NULL )
+		return NULL;
+	if ( vp->va_map_list->physical_map == pmap && vp->va_map_list->va == va )
+		return vp->va_map_list;
+	LIST_FOR_EACH(list, &vp->va_map_list->list)
+	{
+		va_map = STRUCT_ADDRESS_FROM_MEMBER(list, VA_MAP, list);
+		if ( va_map->physical_map == pmap && va_map->va == va )
+			return va_map;
+	}
+	return NULL;
+}
+
+/*! Removes and frees a virtual address mapping record of the given virtual page
+	\param vp - virtual page
+	\param va_map - mapping record to remove
+	\note virtual page lock should be taken by the caller
+*/
+void RemoveVaMapFromVirtualPage(VIRTUAL_PAGE_PTR vp, VA_MAP_PTR va_map)
+{
+	assert( vp->va_map_list != NULL );
+	if ( vp->va_map_list == va_map )
+	{
+		if ( IsListEmpty( &va_map->list ) )
+			vp->va_map_list = NULL;
+		else
+			vp->va_map_list = STRUCT_ADDRESS_FROM_MEMBER( va_map->list.next, VA_MAP, list );
+	}
+	RemoveFromList( &va_map->list );
+	kfree( va_map );
+}
+
+/*! Finds and removes the mapping record of a virtual page for the given va
+	\param vp - virtual page
+	\param pmap - physical map of the mapping
+	\param va - virtual address of the mapping
+*/
+void RemoveVirtualPageMapping(VIRTUAL_PAGE_PTR vp, PHYSICAL_MAP_PTR pmap, VADDR va)
+{
+	VA_MAP_PTR va_map;
+	
+	SpinLock( &vp->lock );
+	va_map = vp->va_map_list;
+	if ( va_map != NULL )
+	{
+		do
+		{
+			if ( va_map->physical_map == pmap && va_map->va == va )
+			{
+				RemoveVaMapFromVirtualPage( vp, va_map );
+				break;
+			}
+			va_map = STRUCT_ADDRESS_FROM_MEMBER( va_map->list.next, VA_MAP, list );
+		}while( va_map != vp->va_map_list );
+	}
+	SpinUnlock( &vp->lock );
+}
+
+/*! Returns the combined accessed/dirty status of all the mappings of a virtual page
+	\param vp - virtual page
+	\param clear_status - PAGE_STATUS_* bits to clear on all the mappings
+	\return PAGE_STATUS_* bits set on any of the mapping
+*/
+UINT32 GetVirtualPageMappingStatus(VIRTUAL_PAGE_PTR vp, UINT32 clear_status)
+{
+	VA_MAP_PTR va_map;
+	UINT32 status = 0;
+
+	SpinLock( &vp->lock );
+	va_map = vp->va_map_list;
+	if ( va_map != NULL )
+	{
+		do
+		{
+			status |= GetPhysicalMappingStatus( va_map->physical_map, va_map->va, clear_status );
+			va_map = STRUCT_ADDRESS_FROM_MEMBER( va_map->list.next, VA_MAP, list );
+		}while( va_map != vp->va_map_list );
+	}
+	SpinUnlock( &vp->lock );
+
+	return status;
 }
 
 /*! Frees one or more virtual page to the VM subsystem
@@ -375,11 +625,14 @@ UINT32 FreeVirtualPages(VIRTUAL_PAGE_PTR first_vp, int pages)
 		
 		SpinLock( &vp->lock );
 		
-		/*Remove from lru only if the page exists there*/
-		if( vp->ubc )
-			vp->ubc = 0;
-		else
-			RemoveVirtualPageFromLRUList( vp );
+		/*Remove from lru - locked pages are not in lru and they are ignored*/
+		vp->ubc = 0;
+		vp->copy_on_write = 0;
+		RemoveVirtualPageFromLRUList( vp );
+		
+		/*free the stale mapping records if any*/
+		while ( vp->va_map_list != NULL )
+			RemoveVaMapFromVirtualPage( vp, vp->va_map_list );
 		
 		/*Add the page to free tree and set the free bit*/
 		AddVirtualPageToVmFreeTree( vp, TRUE );
@@ -390,6 +643,10 @@ UINT32 FreeVirtualPages(VIRTUAL_PAGE_PTR first_vp, int pages)
 		vp = PHYS_TO_VP( vp->physical_address + PAGE_SIZE );
 	}
 	
+	SpinLock( &vm_data.lock );
+	vm_data.total_free_pages += pages;
+	SpinUnlock( &vm_data.lock );
+	
 	return 0;
 }
 
@@ -427,7 +684,10 @@ UINT32 ReserveVirtualPages(VIRTUAL_PAGE_PTR first_vp, int pages)
 	{
 		SpinLock( &first_vp[i].lock );
 		if ( first_vp[i].free ) 
+		{
 			RemoveVirtualPageFromVmFreeTree( &first_vp[i]  );
+			vm_data.total_free_pages--;
+		}
 		else
 			RemoveVirtualPageFromLRUList( &first_vp[i] );
 		SpinUnlock( &first_vp[i].lock );
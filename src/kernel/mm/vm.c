@@ -10,6 +10,7 @@
 #include <kernel/mm/pmem.h>
 #include <kernel/mm/kmem.h>
 #include <kernel/mm/virtual_page.h>
+#include <kernel/mm/page_out.h>
 #include <kernel/pm/thread.h>
 #include <kernel/vfs/vfs.h>
 
@@ -31,6 +32,12 @@ extern VADDR kernel_virtual_address, kernel_code_end, kernel_data_start, ebss;
 
 static ERROR_CODE MapKernel();
 static void InitKernelDescriptorVtoP(VM_DESCRIPTOR_PTR vd, VADDR va_start, VADDR va_end, VADDR pa_start);
+static VIRTUAL_PAGE_PTR BreakCopyOnWrite(VIRTUAL_MAP_PTR virtual_map, VM_UNIT_PTR unit, UINT32 vtop_index, VIRTUAL_PAGE_PTR vp, VADDR va);
+
+/*! returns TRUE if a write through the given unit should not modify the page in place
+	A ubc page mapped into a private unit is always treated as shared with the file.
+*/
+#define IS_COPY_ON_WRITE_PAGE(unit, vp)		( (unit)->type != VM_UNIT_TYPE_FILE_MAPPED && ( (vp)->copy_on_write || (vp)->ubc ) )
 
 /*! initializes the Virtual memory subsystem
 */
@@ -44,8 +51,11 @@ void InitVm()
 	vm_data.free_tree = NULL;
 	vm_data.free_tree_1M = NULL;
 	vm_data.free_tree_16M = NULL;
+	InitSpinLock(&vm_data.lru_lock);
 	vm_data.active_list = NULL;
 	vm_data.inactive_list = NULL;
+	vm_data.active_count = 0;
+	vm_data.inactive_count = 0;
 	vm_data.total_memory_pages = 0;
 	vm_data.total_free_pages = 0;
 
@@ -175,7 +185,7 @@ VADDR MapPhysicalMemory(VIRTUAL_MAP_PTR vmap, UINT32 pa, UINT32 size, VADDR pref
 	assert(pa != 0);
 	size = PAGE_ALIGN_UP(size);
 	pa = PAGE_ALIGN(pa);
-	if ( AllocateVirtualMemory( vmap, &va, preferred_va, size, protection, 0, NULL) != ERROR_SUCCESS )
+	if ( AllocateVirtualMemory( vmap, &va, preferred_va, size, protection, VM_UNIT_FLAG_FOREIGN_PAGES, NULL) != ERROR_SUCCESS )
 	{
 		return NULL;
 	}
@@ -216,6 +226,410 @@ VADDR MapPhysicalMemory(VIRTUAL_MAP_PTR vmap, UINT32 pa, UINT32 size, VADDR pref
 	return va;
 }
 
+/*! Maps an array of virtual pages into a contiguous virtual address range
+	The pages need not be physically contiguous. This is used to hand over a run of ubc pages to a file system in single request.
+	\param vmap - virtual map
+	\param vps - array of virtual pages
+	\param count - number of pages in the array
+	\param protection - protection for the mapping
+	\return - 	Newly allocated VA on success
+				NULL on failure
+*/
+VADDR MapVirtualPages(VIRTUAL_MAP_PTR vmap, VIRTUAL_PAGE_PTR * vps, UINT32 count, UINT32 protection)
+{
+	VADDR va;
+	UINT32 i, vtop_index, size = count * PAGE_SIZE;
+	VM_DESCRIPTOR_PTR vd;
+
+	assert( vps != NULL && count > 0 );
+	if ( AllocateVirtualMemory( vmap, &va, 0, size, protection, VM_UNIT_FLAG_FOREIGN_PAGES, NULL) != ERROR_SUCCESS )
+		return NULL;
+	vd = GetVmDescriptor(vmap, va, 1);
+	assert ( vd != NULL  );
+	vtop_index = ((va - vd->start) / PAGE_SIZE) + (vd->offset_in_unit/PAGE_SIZE);
+
+	for(i=0; i<count; i++)
+	{
+		/*create the mapping now if it is the current map, else it will be created on first access*/
+		if ( GetCurrentVirtualMap() == vmap && CreatePhysicalMapping(vmap->physical_map, va+(i*PAGE_SIZE), vps[i]->physical_address, protection) != ERROR_SUCCESS )
+		{
+			FreeVirtualMemory(vmap, va, size, 0);
+			return NULL;
+		}
+		vd->unit->page_count++;
+		vd->unit->vtop_array[vtop_index+i].vpage = (VIRTUAL_PAGE_PTR) ( ((VADDR)vps[i]) | 1 );
+	}
+	return va;
+}
+
+/*! Returns TRUE if the page is mapped by a file mapping - such a mapping can modify the page at any time
+	\param vp - virtual page
+*/
+static BOOLEAN IsVirtualPageFileMapped(VIRTUAL_PAGE_PTR vp)
+{
+	VA_MAP_PTR va_map;
+	BOOLEAN file_mapped = FALSE;
+	
+	SpinLock( &vp->lock );
+	va_map = vp->va_map_list;
+	if ( va_map != NULL )
+	{
+		do
+		{
+			if ( va_map->unit->type == VM_UNIT_TYPE_FILE_MAPPED )
+			{
+				file_mapped = TRUE;
+				break;
+			}
+			va_map = STRUCT_ADDRESS_FROM_MEMBER( va_map->list.next, VA_MAP, list );
+		}while( va_map != vp->va_map_list );
+	}
+	SpinUnlock( &vp->lock );
+	
+	return file_mapped;
+}
+
+/*! Replaces the page backing the given va with a copy-on-write mapping of the given page
+	This is used to satisfy page aligned file reads from ubc pages without copying the data.
+	If the va is already backed by a shared page, the sharer reference of the old page is dropped.
+	\param vmap - virtual map
+	\param va - page aligned virtual address - it should be private anonymous writable memory
+	\param vp - page to map
+	\return ERROR_NOT_SUPPORTED if the va can not be remapped, caller should copy the data
+*/
+ERROR_CODE MapVirtualPageCopyOnWrite(VIRTUAL_MAP_PTR vmap, VADDR va, VIRTUAL_PAGE_PTR vp)
+{
+	VM_DESCRIPTOR_PTR vd;
+	VM_UNIT_PTR unit;
+	VM_VTOP_PTR vtop;
+	VIRTUAL_PAGE_PTR old_vp = NULL;
+	VNODE_PTR swap_vnode = NULL;
+	UINT32 vtop_index, swap_offset = 0;
+	BOOLEAN refused = FALSE, old_shared = FALSE;
+	
+	assert( IS_PAGE_ALIGNED(va) );
+	vd = GetVmDescriptor(vmap, va, PAGE_SIZE);
+	if ( vd == NULL || !(vd->protection & PROT_WRITE) )
+		return ERROR_INVALID_PARAMETER;
+	unit = vd->unit;
+	/*other type of memory would expose the page to a file or to other tasks*/
+	if ( unit->type != VM_UNIT_TYPE_ANONYMOUS || !(unit->flag & VM_UNIT_FLAG_PRIVATE) )
+		return ERROR_NOT_SUPPORTED;
+	/*writes through a file mapping would be seen by the sharer*/
+	if ( IsVirtualPageFileMapped( vp ) )
+		return ERROR_NOT_SUPPORTED;
+	vtop_index = ((va - vd->start) / PAGE_SIZE) + (vd->offset_in_unit/PAGE_SIZE);
+	
+	/*record the sharer first, UnshareVirtualPage() can move only the sharers it can find*/
+	if ( AddVaMapToVirtualPage( vp, vmap->physical_map, va, unit, vtop_index ) != ERROR_SUCCESS )
+		return ERROR_NOT_SUPPORTED;
+	SpinLock( &vp->lock );
+	vp->copy_on_write++;
+	SpinUnlock( &vp->lock );
+	
+	SpinLock( &unit->vtop_lock );
+	vtop = &unit->vtop_array[vtop_index];
+	if ( VTOP_IN_MEMORY(vtop) )
+	{
+		old_vp = VTOP_TO_VIRTUAL_PAGE(vtop);
+		SpinLock( &vm_data.lru_lock );
+		if ( old_vp == vp || old_vp->busy || old_vp->wire_count )
+			refused = TRUE;
+		else if ( old_vp->copy_on_write || old_vp->ubc )
+			old_shared = TRUE;
+		else
+			old_vp->busy = 1;	/*claim the private page so that the page out daemon leaves it alone*/
+		SpinUnlock( &vm_data.lru_lock );
+		if ( refused )
+		{
+			SpinUnlock( &unit->vtop_lock );
+			SpinLock( &vp->lock );
+			vp->copy_on_write--;
+			SpinUnlock( &vp->lock );
+			/*the page is already mapped here - the mapping record belongs to the earlier remap*/
+			if ( old_vp == vp )
+				return ERROR_SUCCESS;
+			RemoveVirtualPageMapping( vp, vmap->physical_map, va );
+			return ERROR_NOT_SUPPORTED;
+		}
+	}
+	else
+	{
+		if ( vtop->vnode != NULL )
+		{
+			swap_vnode = vtop->vnode;
+			swap_offset = vtop->swap_offset;
+		}
+		unit->page_count++;
+	}
+	vtop->vpage = (VIRTUAL_PAGE_PTR) ( ((VADDR)vp) | 1 );
+	SpinUnlock( &unit->vtop_lock );
+	
+	/*map it read only, the first write will break the sharing*/
+	if ( old_vp != NULL )
+		RevokePhysicalMapping( vmap->physical_map, va );
+	if ( GetCurrentVirtualMap() == vmap )
+		CreatePhysicalMapping( vmap->physical_map, va, vp->physical_address, vd->protection & ~PROT_WRITE );
+	
+	if ( old_shared )
+	{
+		/*drop only this unit's reference, the other sharers or the ubc keep the page*/
+		RemoveVirtualPageMapping( old_vp, vmap->physical_map, va );
+		if ( old_vp->ubc )
+		{
+			SpinLock( &old_vp->lock );
+			if ( old_vp->copy_on_write )
+				old_vp->copy_on_write--;
+			SpinUnlock( &old_vp->lock );
+		}
+		else
+			ReleaseVirtualPageCopyOnWrite( old_vp );
+	}
+	else if ( old_vp != NULL )
+	{
+		old_vp->busy = 0;
+		FreeVirtualPages( old_vp, 1 );
+	}
+	else if ( swap_vnode != NULL )
+		ReleaseSwapSlot( swap_vnode, swap_offset );
+	
+	return ERROR_SUCCESS;
+}
+
+/*! Allocates a new page and copies the contents of the given page into it
+	\param vp - page to copy
+	\return new page or NULL on memory shortage
+*/
+VIRTUAL_PAGE_PTR DuplicateVirtualPage(VIRTUAL_PAGE_PTR vp)
+{
+	VIRTUAL_PAGE_PTR copy;
+	BYTE * buffer;
+	void * window;
+	
+	copy = AllocateVirtualPages(1, VIRTUAL_PAGE_RANGE_TYPE_NORMAL);
+	if ( copy == NULL && WaitForFreeVirtualPages(PAGE_OUT_WAIT_TIME) == ERROR_SUCCESS )
+		copy = AllocateVirtualPages(1, VIRTUAL_PAGE_RANGE_TYPE_NORMAL);
+	if ( copy == NULL )
+		return NULL;
+	/*only one physical page window can be held at a time*/
+	buffer = kmalloc( PAGE_SIZE, 0 );
+	if ( buffer == NULL )
+	{
+		FreeVirtualPages( copy, 1 );
+		return NULL;
+	}
+	window = MapPhysicalPageWindow( vp->physical_address );
+	memcpy( buffer, window, PAGE_SIZE );
+	UnmapPhysicalPageWindow();
+	window = MapPhysicalPageWindow( copy->physical_address );
+	memcpy( window, buffer, PAGE_SIZE );
+	UnmapPhysicalPageWindow();
+	kfree( buffer );
+	
+	return copy;
+}
+
+/*! Moves the copy-on-write sharers of a page to a private copy so that the page can be modified in place
+	\param vp - page which is going to be modified
+	\return ERROR_SUCCESS if the page is no longer shared
+	
+	Every sharer is found through its mapping record - MapVirtualPageCopyOnWrite() records the mapping before
+	it shares the page and CopyVmUnit() gives a copied unit its own copy of a ubc page.
+*/
+ERROR_CODE UnshareVirtualPage(VIRTUAL_PAGE_PTR vp)
+{
+	VIRTUAL_PAGE_PTR copy;
+	VA_MAP_PTR va_map, moved_list = NULL;
+	UINT32 moved = 0;
+	
+	if ( vp->copy_on_write == 0 )
+		return ERROR_SUCCESS;
+	
+	copy = DuplicateVirtualPage( vp );
+	if ( copy == NULL )
+		return ERROR_NOT_ENOUGH_MEMORY;
+	/*keep the page out daemon away until the sharers are moved*/
+	copy->copy_on_write = 1;
+	
+	/*detach the mappings of private units*/
+	SpinLock( &vp->lock );
+	do
+	{
+		va_map = vp->va_map_list;
+		if ( va_map == NULL )
+			break;
+		while ( va_map->unit->type == VM_UNIT_TYPE_FILE_MAPPED )
+		{
+			va_map = STRUCT_ADDRESS_FROM_MEMBER( va_map->list.next, VA_MAP, list );
+			if ( va_map == vp->va_map_list )
+			{
+				va_map = NULL;
+				break;
+			}
+		}
+		if ( va_map == NULL )
+			break;
+		if ( vp->va_map_list == va_map )
+			vp->va_map_list = IsListEmpty( &va_map->list ) ? NULL : STRUCT_ADDRESS_FROM_MEMBER( va_map->list.next, VA_MAP, list );
+		RemoveFromList( &va_map->list );
+		if ( moved_list == NULL )
+			moved_list = va_map;
+		else
+			AddToListTail( &moved_list->list, &va_map->list );
+	}while( 1 );
+	vp->copy_on_write = 0;
+	SpinUnlock( &vp->lock );
+	
+	/*point the sharers to the copy, they will fault and map it again*/
+	va_map = moved_list;
+	if ( va_map != NULL )
+	{
+		do
+		{
+			VM_UNIT_PTR unit = va_map->unit;
+			VM_VTOP_PTR vtop = &unit->vtop_array[va_map->vtop_index];
+			
+			SpinLock( &unit->vtop_lock );
+			if ( VTOP_IN_MEMORY(vtop) && VTOP_TO_VIRTUAL_PAGE(vtop) == vp )
+			{
+				vtop->vpage = (VIRTUAL_PAGE_PTR) ( ((VADDR)copy) | 1 );
+				moved++;
+			}
+			SpinUnlock( &unit->vtop_lock );
+			RevokePhysicalMapping( va_map->physical_map, va_map->va );
+			
+			va_map = STRUCT_ADDRESS_FROM_MEMBER( va_map->list.next, VA_MAP, list );
+		}while( va_map != moved_list );
+	}
+	
+	/*sharers own the copy now*/
+	SpinLock( &copy->lock );
+	copy->va_map_list = moved_list;
+	copy->copy_on_write = moved > 1 ? moved - 1 : 0;
+	SpinUnlock( &copy->lock );
+	if ( moved == 0 )
+		FreeVirtualPages( copy, 1 );
+	
+	return ERROR_SUCCESS;
+}
+
+/*! Takes a copy-on-write reference to the page backing the given va
+	The va is made read only, so a later write from the owner gets its own copy and the referenced page stays unchanged.
+	This is used to pass whole pages in IPC messages without copying the data.
+	\param vmap - virtual map
+	\param va - page aligned virtual address - it should be private anonymous memory
+	\return page with an extra copy-on-write reference or NULL if the va can not be shared, caller should copy the data
+*/
+VIRTUAL_PAGE_PTR ShareVirtualPageCopyOnWrite(VIRTUAL_MAP_PTR vmap, VADDR va)
+{
+	VM_DESCRIPTOR_PTR vd;
+	VM_UNIT_PTR unit;
+	VM_VTOP_PTR vtop;
+	VIRTUAL_PAGE_PTR vp = NULL, page;
+	UINT32 vtop_index;
+	
+	assert( IS_PAGE_ALIGNED(va) );
+	vd = GetVmDescriptor(vmap, va, PAGE_SIZE);
+	if ( vd == NULL )
+		return NULL;
+	unit = vd->unit;
+	if ( unit->type != VM_UNIT_TYPE_ANONYMOUS || !(unit->flag & VM_UNIT_FLAG_PRIVATE) )
+		return NULL;
+	vtop_index = ((va - vd->start) / PAGE_SIZE) + (vd->offset_in_unit/PAGE_SIZE);
+	
+	SpinLock( &unit->vtop_lock );
+	vtop = &unit->vtop_array[vtop_index];
+	if ( VTOP_IN_MEMORY(vtop) )
+	{
+		/*take the reference first so that the page out daemon leaves the page alone*/
+		page = VTOP_TO_VIRTUAL_PAGE(vtop);
+		SpinLock( &page->lock );
+		page->copy_on_write++;
+		SpinUnlock( &page->lock );
+		SpinLock( &vm_data.lru_lock );
+		if ( !page->busy && !page->ubc && !page->wire_count )
+			vp = page;
+		SpinUnlock( &vm_data.lru_lock );
+		if ( vp == NULL )
+		{
+			SpinLock( &page->lock );
+			page->copy_on_write--;
+			SpinUnlock( &page->lock );
+		}
+	}
+	SpinUnlock( &unit->vtop_lock );
+	
+	/*the next access will fault and map the page read only*/
+	if ( vp != NULL )
+		RevokePhysicalMapping( vmap->physical_map, va );
+	
+	return vp;
+}
+
+/*! Drops a reference taken by ShareVirtualPageCopyOnWrite()
+	The page is freed if all the other sharers have moved to their own copies.
+	\param vp - page to release
+*/
+void ReleaseVirtualPageCopyOnWrite(VIRTUAL_PAGE_PTR vp)
+{
+	BOOLEAN last;
+	
+	SpinLock( &vp->lock );
+	last = ( vp->copy_on_write == 0 );
+	if ( !last )
+		vp->copy_on_write--;
+	SpinUnlock( &vp->lock );
+	if ( last )
+		FreeVirtualPages( vp, 1 );
+}
+
+/*! Gives a private copy of a shared page to the faulting unit
+	\param virtual_map - virtual map of the faulting va
+	\param unit - vm unit of the faulting va
+	\param vtop_index - index of the page in the unit
+	\param vp - shared page
+	\param va - page aligned faulting va
+	\return new page or NULL on memory shortage, the shared page is returned if the vtop entry no longer points it
+*/
+static VIRTUAL_PAGE_PTR BreakCopyOnWrite(VIRTUAL_MAP_PTR virtual_map, VM_UNIT_PTR unit, UINT32 vtop_index, VIRTUAL_PAGE_PTR vp, VADDR va)
+{
+	VM_VTOP_PTR vtop = &unit->vtop_array[vtop_index];
+	VIRTUAL_PAGE_PTR new_vp;
+	void * window;
+	
+	new_vp = AllocateVirtualPages(1, VIRTUAL_PAGE_RANGE_TYPE_NORMAL);
+	if ( new_vp == NULL && WaitForFreeVirtualPages(PAGE_OUT_WAIT_TIME) == ERROR_SUCCESS )
+		new_vp = AllocateVirtualPages(1, VIRTUAL_PAGE_RANGE_TYPE_NORMAL);
+	if ( new_vp == NULL )
+		return NULL;
+	
+	/*copy through a read only mapping of the shared page*/
+	CreatePhysicalMapping( virtual_map->physical_map, va, vp->physical_address, PROT_READ );
+	window = MapPhysicalPageWindow( new_vp->physical_address );
+	memcpy( window, (void *)va, PAGE_SIZE );
+	UnmapPhysicalPageWindow();
+	
+	SpinLock( &unit->vtop_lock );
+	/*a ubc page can be evicted while it is copied, the caller looks up the page again*/
+	if ( !VTOP_IN_MEMORY(vtop) || VTOP_TO_VIRTUAL_PAGE(vtop) != vp )
+	{
+		SpinUnlock( &unit->vtop_lock );
+		RevokePhysicalMapping( virtual_map->physical_map, va );
+		FreeVirtualPages( new_vp, 1 );
+		return vp;
+	}
+	vtop->vpage = (VIRTUAL_PAGE_PTR) ( ((VADDR)new_vp) | 1 );
+	SpinUnlock( &unit->vtop_lock );
+	
+	RemoveVirtualPageMapping( vp, virtual_map->physical_map, va );
+	SpinLock( &vp->lock );
+	if ( vp->copy_on_write )
+		vp->copy_on_write--;
+	SpinUnlock( &vp->lock );
+	
+	return new_vp;
+}
+
 /*! Allocates virtual memory of given size 
 	\param vmap   - Virtual Map from on which allocation is done
 	\param va_ptr - Out parameter - returned va address is stored here
@@ -294,21 +708,34 @@ ERROR_CODE AllocateVirtualMemory(VIRTUAL_MAP_PTR vmap, VADDR * va_ptr, VADDR pre
 }
 
 /*! Free the already allocated virtual memory range
+	If the range is a whole vm descriptor, the descriptor is released with its unit reference so that the
+	range can be reused.
+	\todo - release part of a descriptor
 */
 ERROR_CODE FreeVirtualMemory(VIRTUAL_MAP_PTR vmap, VADDR va, size_t size, UINT32 flags)
 {
 	ERROR_CODE ret;
 	UINT32 rem_va;
+	VM_DESCRIPTOR_PTR vd;
 	
-	/*remove the page table entries*/
+	va = PAGE_ALIGN(va);
+	size = PAGE_ALIGN_UP(size);
+	/*remove the page table entries - the self map is valid only for the current map and the kernel range*/
 	for(rem_va = va; rem_va < (va+size); rem_va+=PAGE_SIZE)
 	{
+		if ( vmap != &kernel_map && vmap != GetCurrentVirtualMap() )
+		{
+			RevokePhysicalMapping(vmap->physical_map, rem_va);
+			continue;
+		}
 		ret = RemovePhysicalMapping(vmap->physical_map, rem_va);
 		if ( ret != ERROR_SUCCESS )
 			return ret;
 	}
 	
-	/*TODO - remove the vm descriptor entry*/
+	vd = GetVmDescriptor(vmap, va, 1);
+	if ( vd != NULL && vd->start == va && PAGE_ALIGN_UP(vd->end+1) == va+size )
+		FreeVmDescriptor( vd );
 	return ERROR_SUCCESS;
 }
 
@@ -515,13 +942,21 @@ ERROR_CODE CopyToUserSpace(void * user_va, void * kernel_va, size_t length)
 }
 
 /*! Generic memory management fault handler
+	The page is looked up without the vtop lock and installed, mapped and its mapping recorded under the vtop lock after
+	checking the vtop entry did not change. The page out daemon changes the vtop entry under the same lock only if no
+	mapping is recorded, so a page is never mapped after it is evicted.
 */
 ERROR_CODE MemoryFaultHandler(UINT32 va, int is_user_mode, int access_type)
 {
 	VIRTUAL_MAP_PTR virtual_map;
 	VM_DESCRIPTOR_PTR vd;
-	UINT32 vtop_index;
+	VM_UNIT_PTR unit;
+	VM_VTOP_PTR vtop;
+	UINT32 vtop_index, swap_offset;
 	VIRTUAL_PAGE_PTR vp = NULL;
+	VNODE_PTR swap_vnode;
+	VA_MAP_PTR va_map = NULL;
+	BOOLEAN new_page, pinned, installed;
 	int zero_fill = FALSE;
 	VADDR aligned_va;
 	THREAD_PTR thread = GetCurrentThread();
@@ -560,34 +995,91 @@ retry:
 		return ERROR_NOT_FOUND;	
 	}
 
+	unit = vd->unit;
 	vtop_index = ((va - vd->start) / PAGE_SIZE) + (vd->offset_in_unit/PAGE_SIZE);
-	assert( vtop_index <= (vd->unit->size/PAGE_SIZE) );
+	assert( vtop_index <= (unit->size/PAGE_SIZE) );
+	vtop = &unit->vtop_array[vtop_index];
+	
+	/*user and file mappings are recorded so that the page out daemon can find and revoke them,
+	  the record is allocated before the page is mapped because recording cant fail after that*/
+	if ( aligned_va < KERNEL_MAP_START_VA || unit->type == VM_UNIT_TYPE_FILE_MAPPED )
+	{
+		va_map = (VA_MAP_PTR)kmalloc( sizeof(VA_MAP), 0 );
+		if ( va_map == NULL && WaitForFreeVirtualPages(PAGE_OUT_WAIT_TIME) == ERROR_SUCCESS )
+			va_map = (VA_MAP_PTR)kmalloc( sizeof(VA_MAP), 0 );
+		if ( va_map == NULL )
+		{
+			kprintf("Unable to record the mapping during page fault\n");
+			if ( is_user_mode )
+				return ERROR_RETRY;
+			else
+				panic("Kernel resource shortage");
+		}
+	}
+
+lookup:
+	new_page = pinned = FALSE;
+	swap_vnode = NULL;
+	swap_offset = 0;
+	SpinLock( &unit->vtop_lock );
+	if ( VTOP_IN_MEMORY( vtop ) )
+		vp = VTOP_TO_VIRTUAL_PAGE( vtop );
+	else
+	{
+		vp = NULL;
+		swap_vnode = vtop->vnode;
+		swap_offset = vtop->swap_offset;
+	}
+	SpinUnlock( &unit->vtop_lock );
 	
 	/*! if a page is already allocated use it else allocate new page*/
-	if ( vd->unit->vtop_array[vtop_index].in_memory )
+	if ( vp != NULL )
 	{
-		vp = (VIRTUAL_PAGE_PTR) ( (VADDR)vd->unit->vtop_array[vtop_index].vpage & ~1 );
+		/*write to a shared page - give this unit its own copy*/
+		if ( access_type && (vd->protection & PROT_WRITE) && IS_COPY_ON_WRITE_PAGE(unit, vp) )
+		{
+			vp = BreakCopyOnWrite( virtual_map, unit, vtop_index, vp, aligned_va );
+			if ( vp == NULL )
+			{
+				kprintf("Unable to allocate PAGE during copy on write\n");
+				if ( va_map != NULL )
+					kfree( va_map );
+				if ( is_user_mode )
+					return ERROR_RETRY;
+				else
+					panic("Kernel resource shortage");
+			}
+		}
 	}
 	else
 	{
+		new_page = TRUE;
 		/*if the page is backed by file, get it from file system*/
-		if ( vd->unit->type == VM_UNIT_TYPE_FILE_MAPPED )
+		if ( unit->type == VM_UNIT_TYPE_FILE_MAPPED )
 		{
 			UINT32 file_offset;
-			assert(vd->unit->vnode!=NULL);
-			file_offset = vd->unit->offset + vd->offset_in_unit + PAGE_ALIGN(va-vd->start);
+			assert(unit->vnode!=NULL);
+			file_offset = unit->offset + vd->offset_in_unit + PAGE_ALIGN(va-vd->start);
 			assert( IS_PAGE_ALIGNED(file_offset) );
-			vp = GetVnodePage(vd->unit->vnode, file_offset); 
+			/*the pin keeps the page in the vnode until its mapping is recorded*/
+			vp = PinVnodePage(unit->vnode, file_offset); 
 			assert(vp!=NULL);
+			pinned = TRUE;
+			/*file page shared with readers should be unshared before it is mapped writable*/
+			if ( (vd->protection & PROT_WRITE) && vp->copy_on_write )
+				UnshareVirtualPage( vp );
 		} 
 		else
 		{
-			/*anonymous memory allocate memory and zero fill*/
-			zero_fill = TRUE;
 			vp = AllocateVirtualPages(1, VIRTUAL_PAGE_RANGE_TYPE_NORMAL);
+			/*ask the page out daemon to free some pages and try again*/
+			if ( vp == NULL && WaitForFreeVirtualPages(PAGE_OUT_WAIT_TIME) == ERROR_SUCCESS )
+				vp = AllocateVirtualPages(1, VIRTUAL_PAGE_RANGE_TYPE_NORMAL);
 			if ( vp == NULL )
 			{
 				kprintf("Unable to allocate PAGE during page fault\n");
+				if ( va_map != NULL )
+					kfree( va_map );
 				if ( is_user_mode )
 				{
 					/*! \todo make sure the process sleeps for some time*/
@@ -596,11 +1088,58 @@ retry:
 				else
 					panic("Kernel resource shortage");
 			}
+			if ( swap_vnode != NULL )
+			{
+				/*anonymous page was paged out - read it back from swap*/
+				if ( SwapInVirtualPage( swap_vnode, swap_offset, vp ) != ERROR_SUCCESS )
+				{
+					FreeVirtualPages(vp, 1);
+					if ( va_map != NULL )
+						kfree( va_map );
+					kprintf("Unable to read page from swap va = %p\n", va);
+					if ( is_user_mode )
+						return ERROR_IO_DEVICE;
+					else
+						panic("Swap read failed");
+				}
+			}
+			else
+			{
+				/*anonymous memory allocate memory and zero fill*/
+				zero_fill = TRUE;
+			}
 		}
-		SetVmUnitPage(vd->unit, vp, vtop_index);
 	}
 
-	CreatePhysicalMapping(virtual_map->physical_map, va, vp->physical_address, vd->protection);
+	SpinLock( &unit->vtop_lock );
+	/*somebody else faulted the page in, replaced it or evicted it while we were looking it up*/
+	if ( new_page )
+		installed = !VTOP_IN_MEMORY( vtop ) && vtop->vnode == swap_vnode && vtop->swap_offset == swap_offset;
+	else
+		installed = VTOP_IN_MEMORY( vtop ) && VTOP_TO_VIRTUAL_PAGE( vtop ) == vp;
+	if ( installed )
+	{
+		if ( new_page )
+			SetVmUnitPage(unit, vp, vtop_index);
+		/*shared page is mapped read only until it is written*/
+		CreatePhysicalMapping(virtual_map->physical_map, va, vp->physical_address, IS_COPY_ON_WRITE_PAGE(unit, vp) ? (vd->protection & ~PROT_WRITE) : vd->protection );
+		if ( va_map != NULL )
+			LinkVaMapToVirtualPage(vp, va_map, virtual_map->physical_map, aligned_va, unit, vtop_index);
+	}
+	SpinUnlock( &unit->vtop_lock );
+	
+	if ( pinned )
+		PutVnodePages( &vp, 1 );
+	if ( !installed )
+	{
+		if ( new_page && unit->type != VM_UNIT_TYPE_FILE_MAPPED )
+			FreeVirtualPages(vp, 1);
+		zero_fill = FALSE;
+		goto lookup;
+	}
+	/*the vtop entry no longer refers the swap slot*/
+	if ( swap_vnode != NULL )
+		ReleaseSwapSlot( swap_vnode, swap_offset );
 	
 	if( zero_fill )
 	{
@@ -9,6 +9,7 @@
 #include <kernel/mm/vm.h>
 #include <kernel/mm/pmem.h>
 #include <kernel/mm/kmem.h>
+#include <kernel/mm/virtual_page.h>
 
 /*! argument structure for enumerating vm descriptors*/
 typedef struct enumerate_descriptor_arg
@@ -92,6 +93,42 @@ VM_DESCRIPTOR_PTR CreateVmDescriptor(VIRTUAL_MAP_PTR vmap, VADDR start, VADDR en
 	return vd;
 }
 
+/*! Removes a vm descriptor from its map and frees it
+	The mapping records of the descriptor's pages are removed and the unit reference is dropped.
+	The page table entries should be removed by the caller.
+	\param vd - vm descriptor to free
+*/
+void FreeVmDescriptor(VM_DESCRIPTOR_PTR vd)
+{
+	VIRTUAL_MAP_PTR vmap = vd->virtual_map;
+	VM_UNIT_PTR unit = vd->unit;
+	VM_VTOP_PTR vtop;
+	VIRTUAL_PAGE_PTR vp;
+	VADDR va;
+	UINT32 vtop_index;
+
+	/*the page out daemon should not find this range through the pages anymore*/
+	vtop_index = vd->offset_in_unit / PAGE_SIZE;
+	for(va = vd->start; va < vd->end; va += PAGE_SIZE, vtop_index++)
+	{
+		SpinLock( &unit->vtop_lock );
+		vtop = &unit->vtop_array[vtop_index];
+		vp = VTOP_IN_MEMORY(vtop) ? VTOP_TO_VIRTUAL_PAGE(vtop) : NULL;
+		SpinUnlock( &unit->vtop_lock );
+		if ( vp != NULL )
+			RemoveVirtualPageMapping( vp, vmap->physical_map, va );
+	}
+
+	SpinLock( &vmap->lock );
+	RemoveNodeFromAvlTree( &vmap->descriptors, &vd->tree_node, 0, compare_vm_descriptor );
+	vmap->descriptor_count--;
+	vmap->reference_count--;
+	SpinUnlock( &vmap->lock );
+
+	FreeVmUnit( unit );
+	kfree( vd );
+}
+
 /*! Finds a free VM range and returns the starting address.
 	\param vmap - virtual map to search for free range
 	\param start - optional parameter to start the search (if 0 it is ignored)
@@ -7,6 +7,8 @@
 #include <kernel/mm/vm.h>
 #include <kernel/mm/kmem.h>
 #include <kernel/mm/pmem.h>
+#include <kernel/mm/virtual_page.h>
+#include <kernel/mm/page_out.h>
 #include <kernel/debug.h>
 
 /*! Initializes the given VM unit
@@ -56,24 +58,71 @@ VM_UNIT_PTR CreateVmUnit(VM_UNIT_TYPE type, VM_UNIT_FLAG flag, UINT32 size)
 	return vu;
 }
 
+/*! Drops a page reference of a unit which is going away
+	A page shared copy-on-write loses one sharer, a private page is freed. Pages which are under IO or
+	locked for IO are left alone.
+	\param vp - page owned by the unit
+*/
+static void ReleaseVmUnitPage(VIRTUAL_PAGE_PTR vp)
+{
+	BOOLEAN in_use;
+
+	SpinLock( &vm_data.lru_lock );
+	in_use = vp->busy || vp->wire_count;
+	SpinUnlock( &vm_data.lru_lock );
+	if ( in_use )
+		return;
+
+	/*a ubc page mapped copy-on-write belongs to the file, only the sharer reference is dropped*/
+	if ( vp->ubc )
+	{
+		SpinLock( &vp->lock );
+		if ( vp->copy_on_write )
+			vp->copy_on_write--;
+		SpinUnlock( &vp->lock );
+		return;
+	}
+	ReleaseVirtualPageCopyOnWrite( vp );
+}
+
 /*! Frees a given vm unit
+	When the last reference is dropped the pages owned by the unit and its swap slots are released.
 	\param unit - vm unit to free
 */
 void FreeVmUnit(VM_UNIT_PTR unit)
 {
+	UINT32 i, total_vtop;
+	VM_VTOP_PTR vtop;
+
 	assert( unit != NULL );
+	SpinLock( &unit->lock );
 	unit->reference_count--;
 	if( unit->reference_count > 0 )
+	{
+		SpinUnlock( &unit->lock );
 		return;
+	}
+	SpinUnlock( &unit->lock );
 	if( unit->type == VM_UNIT_TYPE_FILE_MAPPED )
 	{
 		/*\todo remove the unit from vnode and relese the vnode*/
 		return;
 	}
-	if ( unit->page_count )
+	
+	total_vtop = (unit->size / PAGE_SIZE) + (unit->size%PAGE_SIZE?1:0);
+	if ( !(unit->flag & VM_UNIT_FLAG_FOREIGN_PAGES) )
 	{
-		/*\todo remove the pages here*/
+		for(i=0; i<total_vtop; i++)
+		{
+			vtop = &unit->vtop_array[i];
+			if ( VTOP_IN_MEMORY(vtop) )
+				ReleaseVmUnitPage( VTOP_TO_VIRTUAL_PAGE(vtop) );
+			else if ( vtop->vnode != NULL )
+				ReleaseSwapSlot( vtop->vnode, vtop->swap_offset );
+		}
 	}
+	kfree( unit->vtop_array );
+	kfree( unit );
 }
 
 void SetVmUnitPage(VM_UNIT_PTR unit, VIRTUAL_PAGE_PTR vp, UINT32 vtop_index)
@@ -89,6 +138,7 @@ void SetVmUnitPage(VM_UNIT_PTR unit, VIRTUAL_PAGE_PTR vp, UINT32 vtop_index)
 VM_UNIT_PTR CopyVmUnit(VM_UNIT_PTR unit, VADDR start, VADDR end)
 {
 	VM_UNIT_PTR new_unit;
+	VIRTUAL_PAGE_PTR vp, copy;
 	UINT32 new_size;
 	int i, total_pages, old_start_index;
 	
@@ -105,11 +155,22 @@ VM_UNIT_PTR CopyVmUnit(VM_UNIT_PTR unit, VADDR start, VADDR end)
 	old_start_index = start/PAGE_SIZE;
 	for(i = 0; i < total_pages; i++)
 	{
-		new_unit->vtop_array[i].vpage = unit->vtop_array[old_start_index+i].vpage;
-		if (new_unit->vtop_array[i].in_memory)
+		new_unit->vtop_array[i] = unit->vtop_array[old_start_index+i];
+		if ( VTOP_IN_MEMORY(&new_unit->vtop_array[i]) )
 		{
+			vp = VTOP_TO_VIRTUAL_PAGE(&new_unit->vtop_array[i]);
 			new_unit->page_count++;
-			MarkPageForCOW( (VIRTUAL_PAGE_PTR)(((VADDR)new_unit->vtop_array[i].vpage) & ~1));
+			/*a file read shared the ubc page - the new unit has no mapping record, so a later file write
+			could not move it to the old contents; give it its own copy instead*/
+			if ( unit->type != VM_UNIT_TYPE_FILE_MAPPED && vp->ubc && (copy = DuplicateVirtualPage(vp)) != NULL )
+				new_unit->vtop_array[i].vpage = (VIRTUAL_PAGE_PTR) ( ((VADDR)copy) | 1 );
+			else
+				MarkPageForCOW( vp );
+		}
+		else if ( new_unit->vtop_array[i].vnode != NULL && unit->type != VM_UNIT_TYPE_FILE_MAPPED )
+		{
+			/*both units share the swapped out page*/
+			ReferenceSwapSlot( new_unit->vtop_array[i].vnode, new_unit->vtop_array[i].swap_offset );
 		}
 	}
 	if (new_unit->vnode)
@@ -11,6 +11,8 @@
 #include <kernel/parameter.h>
 #include <kernel/mm/kmem.h>
 #include <kernel/mm/virtual_page.h>
+#include <kernel/mm/page_out.h>
+#include <kernel/vfs/vfs.h>
 
 
 char * sys_kernel_cmd_line = NULL;
@@ -19,13 +21,37 @@ static COMPARISION_RESULT compare_kernel_parameter(char * data1, char * data2);
 static KERNEL_PARAMETER_PTR FindKernelParameter(char * parameter_name);
 
 extern UINT32 max_message_queue_length;
+extern UINT32 ipc_benchmark_messages;
+extern UINT32 ipc_test;
+extern UINT32 device_io_benchmark_bytes;
+extern UINT32 irp_benchmark_count;
+extern UINT32 kernel_symbol_test;
+extern UINT32 profiler_buffer_samples;
+extern UINT32 profiler_boot_seconds;
 
 /*! global kernel parameters*/
 static KERNEL_PARAMETER kernel_parameters[] = {
+	{"device_io_benchmark_bytes", &device_io_benchmark_bytes, UINT32Validator, {0, 1024*1024*1024, 0}, UINT32Assignor, NULL},
 	{"gdb_port", &sys_gdb_port, UINT32Validator, {0, 0xFFFF, 0}, UINT32Assignor, NULL},
+	{"ipc_benchmark_messages", &ipc_benchmark_messages, UINT32Validator, {0, 10*1024*1024, 0}, UINT32Assignor, NULL},
+	{"ipc_test", &ipc_test, UINT32Validator, {0, 1, 0}, UINT32Assignor, NULL},
+	{"irp_benchmark_count", &irp_benchmark_count, UINT32Validator, {0, 100*1024*1024, 0}, UINT32Assignor, NULL},
+	{"kernel_symbol_test", &kernel_symbol_test, UINT32Validator, {0, 1, 0}, UINT32Assignor, NULL},
 	{"kmem_reserved_mem_size", &kmem_reserved_mem_size, UINT32Validator, {0, 1024*1024*1024, 0}, UINT32Assignor, NULL},
+	{"ktrace_buffer_records", &ktrace_buffer_records, UINT32Validator, {0, 1024*1024, 0}, UINT32Assignor, NULL},
 	{"limit_pmem", &limit_physical_memory, UINT32Validator, {8, (UINT32)4*1024*1024, 0}, UINT32Assignor, NULL},
-	{"max_message_queue_length", &max_message_queue_length, UINT32Validator, {0, 1024, 0}, UINT32Assignor, NULL}
+	{"max_message_queue_length", &max_message_queue_length, UINT32Validator, {0, 1024, 0}, UINT32Assignor, NULL},
+	{"page_out_free_target", &page_out_free_target, UINT32Validator, {0, 1024*1024, 0}, UINT32Assignor, NULL},
+	{"page_out_interval", &page_out_interval, UINT32Validator, {10, 60*1000, 0}, UINT32Assignor, NULL},
+	{"page_out_scan_batch", &page_out_scan_batch, UINT32Validator, {1, 64*1024, 0}, UINT32Assignor, NULL},
+	{"page_out_test", &page_out_test, UINT32Validator, {0, 1, 0}, UINT32Assignor, NULL},
+	{"profiler_boot_seconds", &profiler_boot_seconds, UINT32Validator, {0, 24*60*60, 0}, UINT32Assignor, NULL},
+	{"profiler_buffer_samples", &profiler_buffer_samples, UINT32Validator, {1, 1024*1024, 0}, UINT32Assignor, NULL},
+	{"swap_memory_size", &swap_memory_size, UINT32Validator, {0, 1024*1024, 0}, UINT32Assignor, NULL},
+	{"ubc_dirty_background_ratio", &ubc_dirty_background_ratio, UINT32Validator, {1, 100, 0}, UINT32Assignor, NULL},
+	{"ubc_dirty_ratio", &ubc_dirty_ratio, UINT32Validator, {1, 100, 0}, UINT32Assignor, NULL},
+	{"ubc_flush_interval", &ubc_flush_interval, UINT32Validator, {100, 60*1000, 0}, UINT32Assignor, NULL},
+	{"ubc_flush_max_pages", &ubc_flush_max_pages, UINT32Validator, {1, UBC_FLUSH_BATCH_MAX, 0}, UINT32Assignor, NULL}
 };
 
 /*! Initializes the kernel parameter*/
@@ -6,8 +6,10 @@
 
 #include <ace.h>
 #include <kernel/time.h>
+#include <kernel/arch.h>
 #include <kernel/pit.h>
 #include <kernel/interrupt.h>
+#include <kernel/profiler.h>
 #include <kernel/pm/task.h>
 #include <kernel/pm/thread.h>
 #include <kernel/pm/scheduler.h>
@@ -40,11 +42,24 @@ ISR_RETURN_CODE LapicTimerHandler(INTERRUPT_INFO_PTR interrupt_info, void * arg)
 	assert( current_thread != NULL );
 	THREAD_CONTAINER_PTR tc = STRUCT_ADDRESS_FROM_MEMBER( current_thread, THREAD_CONTAINER, thread );
 	
+	/*Sample the interrupted instruction - a single test when the profiler is stopped*/
+	if ( profiler_enabled )
+		RecordProfilerSample( interrupt_info->regs->eip, (interrupt_info->regs->cs & 3) != 0 );
+	
 	/*Update current thread's kernel stack pointer*/
 	tc->kernel_stack_pointer = (BYTE *) ((UINT32) interrupt_info->regs) - sizeof(UINT32);
 	
 	/*Send EOI to the PIC*/
 	SendEndOfInterrupt( interrupt_info->interrupt_number );
+	
+	/*A DPC is running on this processor - dont preempt it, the thread gets a new quantum after the drain*/
+	if ( IsDpcQueueDraining() )
+	{
+		StartTimer( SCHEDULER_DEFAULT_QUANTUM, FALSE );
+		return ISR_END_PROCESSING;
+	}
+	/*ScheduleThread() does not return here, so run the pending DPCs before switching*/
+	DrainDpcQueue();
 
 	/*Select new thread to run*/
 	ScheduleThread( current_thread );
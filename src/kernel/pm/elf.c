@@ -428,38 +428,6 @@ static ELF_SYMBOL_PTR FindElfSymbolByName(ELF_SYMBOL_PTR symbol_table, UINT32 sy
 	return NULL;
 }
 
-/*! Searches for a given symbol name in the given symbol table
-	\param address 	- kernel address to look
-	\param offset	- offset from the symbol name will be updated here
-	\return on success - SYMBOL name 
-			on failure - NULL
-*/
-char * FindKernelSymbolByAddress(VADDR address, int * offset)
-{
-	int i;
-	ELF_SYMBOL_PTR symbol_table = (ELF_SYMBOL_PTR)kernel_reserve_range.symbol_va_start;
-	UINT32 total_symbols = (kernel_reserve_range.symbol_va_end-kernel_reserve_range.symbol_va_start)/sizeof(ELF_SYMBOL);
-	char * string_table = (char *)kernel_reserve_range.string_va_start;
-	
-	/*loop through kernel symbol table entries*/
-	for(i=0;i<total_symbols;i++)
-	{
-		/*if the given address lies within the symbol value return symbol name*/
-		if ( VALUE_WITH_IN_RANGE(symbol_table[i].st_value, symbol_table[i].st_value+symbol_table[i].st_size, address) )
-		{
-			/*if the caller wants offset from the symbol start, update it*/
-			if ( offset )
-				*offset = address-symbol_table[i].st_value;
-			
-			/*return the symbol name string*/
-			return string_table+symbol_table[i].st_name;
-		}
-	}
-	
-	/*no matching symbol found*/
-	return NULL;
-}
-
 /*! Returns common section size by summing up all the symbol's size of type common.
 	\param symbol_table - symbol table to search
 	\param symbol_table_size - size of the symbol table in bytes
@@ -555,8 +523,7 @@ static ERROR_CODE RelocateSection(ELF_SECTION_HEADER_PTR section_header, ELF_SYM
 				/*\todo - load the symbol value from the dynamic library*/
 				
 				/*search kernel symbols and update the symbol value.*/
-				symbol = FindElfSymbolByName( (ELF_SYMBOL_PTR)kernel_reserve_range.symbol_va_start, kernel_reserve_range.symbol_va_end-kernel_reserve_range.symbol_va_start, 
-												(char *)kernel_reserve_range.string_va_start, &string_table[ symbol_table[sym_index].st_name ] );
+				symbol = FindKernelSymbolByName( &string_table[ symbol_table[sym_index].st_name ] );
 				if ( symbol  )
 					symbol_value = symbol->st_value;
 				else
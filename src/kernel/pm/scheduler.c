@@ -24,6 +24,7 @@ static void DecrementSchedulerBonus(PRIORITY_QUEUE_PTR pqueue);
 static void PreemptThread(THREAD_PTR new_thread);
 static void RemoveThreadFromSchedulerQueue(THREAD_PTR rem_thread);
 static PROCESSOR_PTR SelectProcessorToRun(THREAD_PTR in_thread);
+static THREAD_PTR TakeHandoffThread(THREAD_PTR thread);
 
 static void idle_thread_function();
 
@@ -111,8 +112,13 @@ static void DecrementSchedulerBonus(PRIORITY_QUEUE_PTR pqueue)
 */
 static void PreemptThread(THREAD_PTR new_thread)
 {
-	THREAD_PTR current_thread = GetCurrentThread();
+	THREAD_PTR current_thread = GetCurrentThread(), handoff_thread;
 
+	/*the thread handed over by the current thread is not going to run now, so it should wait in the ready queue*/
+	handoff_thread = TakeHandoffThread( current_thread );
+	if ( handoff_thread != NULL && handoff_thread != new_thread )
+		AddThreadToSchedulerQueue( handoff_thread );
+	
 	new_thread->current_processor = current_thread->current_processor;
 	/*if current thread is terminating then it is now to free resources assoicated with it,
 	  because scheduler has done with it and it wont access any datastructure associated with it after this line*/
@@ -391,7 +397,10 @@ void ScheduleThread(THREAD_PTR in_thread)
 	{
 		if ( in_thread == current_thread ) /**Current thread is terminating/suspending - find another thread to run*/
 		{
-			new_thread = SelectThreadToRun(current_thread->priority_queue->priority);
+			/*switch directly to the thread handed over by the current thread if any*/
+			new_thread = TakeHandoffThread( current_thread );
+			if ( new_thread == NULL )
+				new_thread = SelectThreadToRun(current_thread->priority_queue->priority);
 			/*we should have got different thread - atleast idle thread*/
 			assert( new_thread != in_thread );
 			PreemptThread(new_thread);
@@ -432,6 +441,51 @@ void ScheduleThread(THREAD_PTR in_thread)
 	}
 }
 
+/*! Atomically takes the handoff thread of the given thread
+	\param thread - thread which may have a handoff thread
+	\return handoff thread or NULL
+*/
+static THREAD_PTR TakeHandoffThread(THREAD_PTR thread)
+{
+	THREAD_PTR handoff_thread = NULL;
+	/*xchg with memory operand is always locked*/
+	asm volatile("xchgl %0, %1"
+				:"+r"(handoff_thread), "+m"(thread->handoff_thread)
+				:
+				:"memory");
+	return handoff_thread;
+}
+
+/*! Makes the current thread switch directly to the given thread when it blocks next
+	The given thread should not be in any ready queue(see WakeUpWaitQueueForHandoff()). If the current thread 
+	does not block, the thread is added to the ready queue during the next scheduling decision.
+	\param thread - thread to run next
+*/
+void SetHandoffThread(THREAD_PTR thread)
+{
+	THREAD_PTR current_thread = GetCurrentThread(), previous;
+	
+	assert( thread != current_thread );
+	previous = thread;
+	asm volatile("xchgl %0, %1"
+				:"+r"(previous), "+m"(current_thread->handoff_thread)
+				:
+				:"memory");
+	/*only one thread can be handed over*/
+	if ( previous != NULL )
+		ScheduleThread( previous );
+}
+
+/*! Adds the pending handoff thread of the current thread to the ready queue*/
+void FlushHandoffThread()
+{
+	THREAD_PTR handoff_thread;
+	
+	handoff_thread = TakeHandoffThread( GetCurrentThread() );
+	if ( handoff_thread != NULL )
+		ScheduleThread( handoff_thread );
+}
+
 /*! Creates ready queue, initializes and returns it*/
 static READY_QUEUE_PTR CreateReadyQueue()
 {
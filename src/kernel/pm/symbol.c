@@ -0,0 +1,317 @@
+/*!
+	\file	kernel/pm/symbol.c
+	\brief	Kernel symbol lookup
+
+	The kernel ELF symbol table is unsorted, so a lookup has to scan all of it. At boot two indexes are built:
+	an array of the defined symbols sorted by address, searched with binary search for address to name
+	lookups(stack traces, profiling), and a hash of the global symbol names used to resolve the undefined
+	symbols of kernel modules. Until the indexes are built the lookups fall back to scanning the table.
+
+	A symbol covers the addresses from its value to value+size, both inclusive, as in the table scan - so an
+	unsized assembly label still resolves its own address. Symbols can nest(a label or a local object inside a
+	function), so each range in the index links to the closest earlier range which ends after it. An address
+	past the end of the range found by the binary search is looked up in that chain.
+*/
+#include <ace.h>
+#include <string.h>
+#include <ds/bits.h>
+#include <ds/hash.h>
+#include <ds/sort.h>
+#include <kernel/debug.h>
+#include <kernel/printf.h>
+#include <kernel/pit.h>
+#include <kernel/mm/vm.h>
+#include <kernel/mm/kmem.h>
+#include <kernel/pm/elf.h>
+
+/*! An address range in the sorted symbol index*/
+typedef struct kernel_symbol_range
+{
+	VADDR				start;				/*! address of the symbol*/
+	UINT32				size;				/*! size of the symbol in bytes*/
+	ELF_SYMBOL_PTR		symbol;				/*! symbol table entry*/
+	INT32				enclosing;			/*! closest earlier range which ends after this one, -1 if none*/
+}KERNEL_SYMBOL_RANGE, * KERNEL_SYMBOL_RANGE_PTR;
+
+/*! symbols sorted by address*/
+static KERNEL_SYMBOL_RANGE_PTR symbol_ranges = NULL;
+static UINT32 total_symbol_ranges = 0;
+
+/*! name hash - buckets and chains hold symbol table indexes, 0(the null symbol) ends a chain*/
+static UINT32 * symbol_name_buckets = NULL;
+static UINT32 * symbol_name_chain = NULL;
+static UINT32 symbol_name_bucket_mask = 0;
+
+/*! if non zero the symbol indexes are verified against the symbol table at boot*/
+UINT32 kernel_symbol_test = 0;
+
+/*! Returns TRUE if the symbol should be in the address index - file symbols have no address*/
+#define IS_INDEXED_SYMBOL(sym)	( ELF_ST_TYPE((sym)->st_info) != STT_FILE && (sym)->st_shndx != SHN_UNDEF )
+
+/*! Last address covered by a symbol range*/
+#define SYMBOL_RANGE_END(range)	( (range)->start + (range)->size )
+
+/*! Returns TRUE if the symbol can be used to resolve module symbols*/
+#define IS_EXPORTED_SYMBOL(sym)	( (ELF_ST_BIND((sym)->st_info) == STB_GLOBAL || ELF_ST_BIND((sym)->st_info) == STB_WEAK) \
+									&& (sym)->st_name != 0 && (sym)->st_shndx != SHN_UNDEF )
+
+/*! Orders symbol ranges by address - aliases are ordered by descending size and then by their position in the symbol table*/
+static COMPARISION_RESULT CompareSymbolRange(char * data1, char * data2)
+{
+	KERNEL_SYMBOL_RANGE_PTR r1 = (KERNEL_SYMBOL_RANGE_PTR)data1, r2 = (KERNEL_SYMBOL_RANGE_PTR)data2;
+
+	if ( r1->start != r2->start )
+		return r1->start > r2->start ? GREATER_THAN : LESS_THAN;
+	if ( r1->size != r2->size )
+		return r1->size < r2->size ? GREATER_THAN : LESS_THAN;
+	if ( r1->symbol != r2->symbol )
+		return r1->symbol > r2->symbol ? GREATER_THAN : LESS_THAN;
+	return EQUAL;
+}
+
+/*! Builds the sorted address index and the name hash of the kernel symbol table
+	Should be called after the kernel heap is initialized. Failure to allocate leaves the linear lookup in place.
+*/
+void InitKernelSymbolIndex()
+{
+	ELF_SYMBOL_PTR symbol_table = (ELF_SYMBOL_PTR)kernel_reserve_range.symbol_va_start;
+	UINT32 total_symbols = (kernel_reserve_range.symbol_va_end-kernel_reserve_range.symbol_va_start)/sizeof(ELF_SYMBOL);
+	char * string_table = (char *)kernel_reserve_range.string_va_start;
+	KERNEL_SYMBOL_RANGE_PTR ranges, temp_range;
+	UINT32 i, count, buckets, * bucket_array, * chain_array;
+
+	if ( symbol_table == NULL || total_symbols == 0 )
+		return;
+
+	/*address index*/
+	for(i=0, count=0; i<total_symbols; i++)
+		if ( IS_INDEXED_SYMBOL(&symbol_table[i]) )
+			count++;
+	ranges = kmalloc( sizeof(KERNEL_SYMBOL_RANGE) * (count+1), 0 );
+	if ( ranges != NULL )
+	{
+		for(i=0, count=0; i<total_symbols; i++)
+		{
+			if ( !IS_INDEXED_SYMBOL(&symbol_table[i]) )
+				continue;
+			ranges[count].start = symbol_table[i].st_value;
+			ranges[count].size = symbol_table[i].st_size;
+			ranges[count].symbol = &symbol_table[i];
+			count++;
+		}
+		/*the extra element is the temporary storage for the sort*/
+		temp_range = &ranges[count];
+		SortArray( (char *)ranges, (char *)temp_range, sizeof(KERNEL_SYMBOL_RANGE), count, CompareSymbolRange );
+		/*drop aliases - the largest symbol covers the others, a label at the start of a function resolves to the function*/
+		for(i=1, total_symbol_ranges=count ? 1 : 0; i<count; i++)
+		{
+			if ( ranges[i].start == ranges[total_symbol_ranges-1].start )
+				continue;
+			ranges[total_symbol_ranges++] = ranges[i];
+		}
+		/*link each range to the closest earlier range ending after it - the chain of a range skips only ranges which end before it*/
+		for(i=0; i<total_symbol_ranges; i++)
+		{
+			INT32 j = (INT32)i-1;
+			while( j >= 0 && SYMBOL_RANGE_END(&ranges[j]) <= SYMBOL_RANGE_END(&ranges[i]) )
+				j = ranges[j].enclosing;
+			ranges[i].enclosing = j;
+		}
+		symbol_ranges = ranges;
+	}
+
+	/*name hash - about two symbols per bucket*/
+	for(buckets=1; buckets < total_symbols/2; buckets <<= 1);
+	bucket_array = kmalloc( sizeof(UINT32) * buckets, 0 );
+	chain_array = kmalloc( sizeof(UINT32) * total_symbols, 0 );
+	if ( bucket_array == NULL || chain_array == NULL )
+	{
+		if ( bucket_array )
+			kfree( bucket_array );
+		if ( chain_array )
+			kfree( chain_array );
+		return;
+	}
+	memset( bucket_array, 0, sizeof(UINT32) * buckets );
+	chain_array[0] = 0;
+	/*insert in reverse so that a chain lists symbols in table order*/
+	for(i=total_symbols-1; i>0; i--)
+	{
+		UINT32 bucket;
+		chain_array[i] = 0;
+		if ( !IS_EXPORTED_SYMBOL(&symbol_table[i]) )
+			continue;
+		bucket = HashString( string_table + symbol_table[i].st_name ) & (buckets-1);
+		chain_array[i] = bucket_array[bucket];
+		bucket_array[bucket] = i;
+	}
+	symbol_name_chain = chain_array;
+	symbol_name_bucket_mask = buckets-1;
+	symbol_name_buckets = bucket_array;
+}
+
+/*! Searches the kernel symbol table linearly for the first symbol containing the given address
+	\param address - kernel address to look
+*/
+static ELF_SYMBOL_PTR FindKernelSymbolByAddressLinear(VADDR address)
+{
+	int i;
+	ELF_SYMBOL_PTR symbol_table = (ELF_SYMBOL_PTR)kernel_reserve_range.symbol_va_start;
+	UINT32 total_symbols = (kernel_reserve_range.symbol_va_end-kernel_reserve_range.symbol_va_start)/sizeof(ELF_SYMBOL);
+
+	/*loop through kernel symbol table entries*/
+	for(i=0;i<total_symbols;i++)
+	{
+		/*if the given address lies within the symbol value return it*/
+		if ( VALUE_WITH_IN_RANGE(symbol_table[i].st_value, symbol_table[i].st_value+symbol_table[i].st_size, address) )
+			return &symbol_table[i];
+	}
+	return NULL;
+}
+
+/*! Searches the sorted address index for the innermost symbol containing the given address*/
+static ELF_SYMBOL_PTR FindKernelSymbolByAddressIndexed(VADDR address)
+{
+	int low = 0, high = total_symbol_ranges-1, mid;
+
+	/*find the last symbol starting at or below the address*/
+	while( low <= high )
+	{
+		mid = low + (high-low)/2;
+		if ( symbol_ranges[mid].start <= address )
+			low = mid+1;
+		else
+			high = mid-1;
+	}
+	/*the address is past a nested symbol - try the symbols enclosing it*/
+	while( high >= 0 && SYMBOL_RANGE_END(&symbol_ranges[high]) < address )
+		high = symbol_ranges[high].enclosing;
+	if ( high < 0 )
+		return NULL;
+	return symbol_ranges[high].symbol;
+}
+
+/*! Searches for a given symbol name in the given symbol table
+	\param address 	- kernel address to look
+	\param offset	- offset from the symbol name will be updated here
+	\return on success - SYMBOL name
+			on failure - NULL
+*/
+char * FindKernelSymbolByAddress(VADDR address, int * offset)
+{
+	ELF_SYMBOL_PTR symbol;
+
+	if ( symbol_ranges != NULL )
+		symbol = FindKernelSymbolByAddressIndexed( address );
+	else
+		symbol = FindKernelSymbolByAddressLinear( address );
+
+	/*no matching symbol found*/
+	if ( symbol == NULL )
+		return NULL;
+
+	/*if the caller wants offset from the symbol start, update it*/
+	if ( offset )
+		*offset = address-symbol->st_value;
+
+	/*return the symbol name string*/
+	return (char *)kernel_reserve_range.string_va_start + symbol->st_name;
+}
+
+/*! Searches the kernel symbol table for a global symbol
+	\param symbol_name - symbol name to search
+	\return on success - symbol table entry
+			on failure - NULL
+*/
+ELF_SYMBOL_PTR FindKernelSymbolByName(char * symbol_name)
+{
+	ELF_SYMBOL_PTR symbol_table = (ELF_SYMBOL_PTR)kernel_reserve_range.symbol_va_start;
+	UINT32 total_symbols = (kernel_reserve_range.symbol_va_end-kernel_reserve_range.symbol_va_start)/sizeof(ELF_SYMBOL);
+	char * string_table = (char *)kernel_reserve_range.string_va_start;
+	UINT32 i;
+
+	assert( symbol_name != NULL );
+	if ( symbol_name_buckets == NULL )
+	{
+		for(i=0; i<total_symbols; i++)
+			if ( IS_EXPORTED_SYMBOL(&symbol_table[i]) && strcmp( string_table+symbol_table[i].st_name, symbol_name ) == 0 )
+				return &symbol_table[i];
+		return NULL;
+	}
+
+	for(i=symbol_name_buckets[ HashString(symbol_name) & symbol_name_bucket_mask ]; i!=0; i=symbol_name_chain[i])
+	{
+		if ( strcmp( string_table+symbol_table[i].st_name, symbol_name ) == 0 )
+			return &symbol_table[i];
+	}
+	return NULL;
+}
+
+/*! Resolves every kernel symbol through the indexes and through the linear scan and prints the mismatches and the time taken
+	The start, middle, end and the address after the end of every indexed symbol is looked up by address, every global
+	symbol by name. Overlapping symbols can resolve to different entries, so an address lookup is a mismatch only if
+	one of the lookups fails or the indexed one returns a symbol which does not contain the address.
+*/
+void VerifyKernelSymbolIndex()
+{
+	ELF_SYMBOL_PTR symbol_table = (ELF_SYMBOL_PTR)kernel_reserve_range.symbol_va_start;
+	UINT32 total_symbols = (kernel_reserve_range.symbol_va_end-kernel_reserve_range.symbol_va_start)/sizeof(ELF_SYMBOL);
+	char * string_table = (char *)kernel_reserve_range.string_va_start;
+	UINT32 i, j, lookups=0, address_mismatches=0, name_mismatches=0, start_ticks, linear_ms, indexed_ms;
+	ELF_SYMBOL_PTR expected, found;
+	VADDR address[4];
+
+	if ( symbol_ranges == NULL || symbol_name_buckets == NULL )
+	{
+		kprintf("Kernel symbol test: index not built\n");
+		return;
+	}
+
+	for(i=0; i<total_symbols; i++)
+	{
+		if ( IS_INDEXED_SYMBOL(&symbol_table[i]) )
+		{
+			address[0] = symbol_table[i].st_value;
+			address[1] = symbol_table[i].st_value + symbol_table[i].st_size/2;
+			address[2] = symbol_table[i].st_value + symbol_table[i].st_size;
+			address[3] = symbol_table[i].st_value + symbol_table[i].st_size + 1;
+			for(j=0; j<4; j++)
+			{
+				expected = FindKernelSymbolByAddressLinear( address[j] );
+				found = FindKernelSymbolByAddressIndexed( address[j] );
+				lookups++;
+				if ( (found == NULL) != (expected == NULL) 
+					|| ( found != NULL && !VALUE_WITH_IN_RANGE(found->st_value, found->st_value+found->st_size, address[j]) ) )
+				{
+					kprintf("Kernel symbol test: %p resolved to %s instead of %s\n", address[j],
+						found ? string_table+found->st_name : "(null)", expected ? string_table+expected->st_name : "(null)" );
+					address_mismatches++;
+				}
+			}
+		}
+		if ( IS_EXPORTED_SYMBOL(&symbol_table[i]) )
+		{
+			found = FindKernelSymbolByName( string_table+symbol_table[i].st_name );
+			if ( found == NULL || strcmp( string_table+found->st_name, string_table+symbol_table[i].st_name ) != 0 )
+			{
+				kprintf("Kernel symbol test: name %s not resolved\n", string_table+symbol_table[i].st_name );
+				name_mismatches++;
+			}
+		}
+	}
+
+	/*time the address lookups alone*/
+	start_ticks = timer_ticks;
+	for(i=0; i<total_symbols; i++)
+		if ( IS_INDEXED_SYMBOL(&symbol_table[i]) )
+			FindKernelSymbolByAddressLinear( symbol_table[i].st_value );
+	linear_ms = TICKS_TO_MILLISECONDS( timer_ticks - start_ticks );
+	start_ticks = timer_ticks;
+	for(i=0; i<total_symbols; i++)
+		if ( IS_INDEXED_SYMBOL(&symbol_table[i]) )
+			FindKernelSymbolByAddressIndexed( symbol_table[i].st_value );
+	indexed_ms = TICKS_TO_MILLISECONDS( timer_ticks - start_ticks );
+
+	kprintf("Kernel symbol test: %d symbols, %d indexed, %d address lookups (%d mismatches), %d name mismatches, linear %d ms, indexed %d ms\n",
+		total_symbols, total_symbol_ranges, lookups, address_mismatches, name_mismatches, linear_ms, indexed_ms );
+}
@@ -73,7 +73,14 @@ TASK_PTR CreateTask(char * exe_file_path, IMAGE_TYPE image_type, UINT32 creation
 		strcpy(task->kva_environment, environment);
 	}
 		
-	memset( &task->process_file_info, 0, sizeof(task->process_file_info) );
+	InitProcessFileInfo( &task->process_file_info );
+	task->io_ring = NULL;
+	/*the child shares the open files of the parent - files opened by the kernel for itself are not given to user tasks*/
+	if ( GetCurrentTask() != &kernel_task && (err = InheritFiles( GetCurrentTask(), task )) != ERROR_SUCCESS )
+	{
+		CloseAllFiles( task );
+		goto error;
+	}
 
 	if( image_type == IMAGE_TYPE_ELF_FILE  || image_type == IMAGE_TYPE_BIN_FILE)
 	{
@@ -138,6 +145,50 @@ error:
 done:
 	return task;
 }
+/*! Removes an exiting thread from its task and frees the process resources if it is the last thread of the task
+	\param thread - current thread, it is about to terminate
+	The TASK structure and the virtual map are not freed - the exiting thread is still running on the map and messages sent by the task refer to it for the credit.
+*/
+void DetachThreadFromTask(THREAD_PTR thread)
+{
+	TASK_PTR task = thread->task;
+	BOOLEAN last_thread = FALSE;
+	int i;
+
+	/*kernel task never exits*/
+	if ( task == &kernel_task )
+		return;
+
+	SpinLock( &task->lock );
+	if ( IsListEmpty( &thread->thread_queue ) )
+	{
+		task->thread_head = NULL;
+		last_thread = TRUE;
+	}
+	else
+	{
+		if ( task->thread_head == thread )
+			task->thread_head = STRUCT_ADDRESS_FROM_MEMBER( thread->thread_queue.next, THREAD, thread_queue );
+		RemoveFromList( &thread->thread_queue );
+	}
+	SpinUnlock( &task->lock );
+	if ( !last_thread )
+		return;
+
+	CloseAllFiles( task );
+	for(i=0; i<MESSAGE_QUEUES_PER_TASK; i++)
+		DestroyMessageQueue( &task->message_queue[i] );
+	if ( task->kva_command_line )
+	{
+		kfree( task->kva_command_line );
+		task->kva_command_line = NULL;
+	}
+	if ( task->kva_environment )
+	{
+		kfree( task->kva_environment );
+		task->kva_environment = NULL;
+	}
+}
 /*! Returns current task*/
 inline TASK_PTR GetCurrentTask()
 {
@@ -154,6 +205,8 @@ int TaskCacheConstructor(void * buffer)
 	
 	InitSpinLock( &task->lock );
 	task->reference_count = 0;
+	InitWaitQueue( &task->ipc_credit_wait_queue );
+	InitProcessFileInfo( &task->process_file_info );
 	
 	return 0;
 }
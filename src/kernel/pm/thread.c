@@ -94,6 +94,9 @@ void ExitThread()
 	THREAD_PTR cur_thread = GetCurrentThread();
 	assert(cur_thread->reference_count>0);
 	
+	/*the process resources are freed while the thread can still wait*/
+	DetachThreadFromTask( cur_thread );
+	
 	SpinLock( &cur_thread->lock );
 	cur_thread->state = THREAD_STATE_TERMINATE;
 	SpinUnlock( &cur_thread->lock );
@@ -118,7 +121,7 @@ void FreeThread(THREAD_PTR thread)
 	}
 	else
 	{
-		WakeUpEvent( &thread->thread_event, WAIT_EVENT_WAKE_UP_ALL );
+		WakeUpWaitQueue( &thread->thread_event, WAIT_EVENT_WAKE_UP_ALL );
 	}
 }
 
@@ -172,6 +175,9 @@ void InitBootThread(int boot_processor_id)
 	thread_container->kernel_stack_pointer = (BYTE *)((VADDR)(&thread_container->kernel_stack))+PAGE_SIZE;
 	
 	InitSpinLock( &boot_thread->lock );
+	InitWaitQueue( &boot_thread->thread_event );
+	InitWaitQueue( &boot_thread->ipc_reply_event );
+	boot_thread->ipc_priority = MESSAGE_PRIORITY_INHERIT;
 	boot_thread->state = THREAD_STATE_RUN;
 	
 	boot_thread->reference_count = 1;
@@ -195,29 +201,19 @@ void InitBootThread(int boot_processor_id)
  */
 ERROR_CODE WaitForThread(THREAD_PTR thread, int wait_time)
 {
-	ERROR_CODE ret = ERROR_SUCCESS;
-	WAIT_EVENT_PTR	my_wait_event;
-	UINT32 ret_time;
+	WAIT_EVENT my_wait_event;
 	
-	/* Wait for this message queue */
+	/* Wait for this thread */
 	SpinLock( &thread->lock );
 	thread->reference_count++;
-	my_wait_event = AddToEventQueue( &thread->thread_event );
 	SpinUnlock( &thread->lock );
+	InitWaitEventOnStack( &my_wait_event );
+	AddWaitEventToQueue( &thread->thread_event, &my_wait_event );
 
 	if(wait_time == MESSAGE_QUEUE_NO_WAIT)
 		wait_time = 0;
 
-	ret_time = WaitForEvent(my_wait_event, wait_time);
-
-	if(ret_time == 0) /* no event fired and we timeout out */
-		ret = ERROR_TIMEOUT;
-
-	assert(my_wait_event->fired == 1);
-
-	kfree(my_wait_event);
-	
-	return ret;
+	return WaitForWaitEvent( &my_wait_event, wait_time );
 }
 
 
@@ -229,6 +225,9 @@ int ThreadCacheConstructor( void *buffer)
 	
 	InitSpinLock( &thread_container->thread.lock );
 	InitList( &thread_container->thread.thread_queue );
+	InitWaitQueue( &thread_container->thread.thread_event );
+	InitWaitQueue( &thread_container->thread.ipc_reply_event );
+	thread_container->thread.ipc_priority = MESSAGE_PRIORITY_INHERIT;
 	thread_container->thread.current_processor = NULL;
 	thread_container->thread.state = THREAD_STATE_NEW;
 	thread_container->thread.reference_count = 1;
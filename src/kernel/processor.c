@@ -18,5 +18,6 @@ void InitProcessors()
 		processor[i].state = (i==master_processor_id)? PROCESSOR_STATE_ONLINE:PROCESSOR_STATE_OFFLINE;
 		processor[i].idle_thread = NULL;
 		processor[i].running_thread = NULL;
+		InitDpcQueue( &processor[i].dpc_queue );
 	}
 }
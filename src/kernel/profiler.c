@@ -0,0 +1,261 @@
+/*!
+\file	kernel/profiler.c
+\brief	Statistical sampling profiler
+
+	While the profiler is running the scheduler timer handler records the interrupted instruction, the
+	running thread and the processor into the processor's sample buffer. The buffer has a single writer,
+	the timer interrupt of the owning processor, so recording a sample takes no lock and never waits. When
+	a buffer is full further samples are counted as dropped. When the profiler is stopped the timer handler
+	only tests profiler_enabled.
+
+	DumpProfile() resolves the kernel samples to function names through the kernel symbol index and prints
+	the hottest functions through ktrace. The sampling rate is the scheduler timer rate of each processor.
+*/
+
+#include <ace.h>
+#include <string.h>
+#include <ds/sort.h>
+#include <sync/spinlock.h>
+#include <kernel/debug.h>
+#include <kernel/processor.h>
+#include <kernel/profiler.h>
+#include <kernel/mm/kmem.h>
+#include <kernel/pm/elf.h>
+#include <kernel/pm/task.h>
+#include <kernel/pm/thread.h>
+#include <kernel/pm/scheduler.h>
+#include <kernel/pm/timeout_queue.h>
+
+/*! Samples of one kernel function - used only while dumping*/
+typedef struct profiler_symbol
+{
+	char *		name;
+	UINT32		count;
+}PROFILER_SYMBOL, * PROFILER_SYMBOL_PTR;
+
+/*! set while the timer handler should record samples*/
+volatile BOOLEAN profiler_enabled = FALSE;
+/*! kernel parameter - samples per processor, takes effect when a buffer is allocated*/
+UINT32 profiler_buffer_samples = PROFILER_DEFAULT_BUFFER_SAMPLES;
+/*! kernel parameter - if non zero the system is profiled for this many seconds after boot*/
+UINT32 profiler_boot_seconds = 0;
+
+/*! sample buffer of each processor - buffers are never freed, so the timer handler of a processor can not
+	see a freed buffer even if it races with StopProfiler()*/
+static PROFILER_BUFFER profiler_buffers[MAX_PROCESSORS];
+/*! serializes StartProfiler() and StopProfiler()*/
+static SPIN_LOCK profiler_lock;
+/*! duration of the profile taken by ProfileSystem()*/
+static UINT32 profile_system_seconds;
+
+/*! Starts recording samples on all running processors
+	Samples of the previous run are discarded.
+	\return ERROR_BUSY if the profiler is already running, ERROR_NOT_ENOUGH_MEMORY if a buffer can not be allocated
+*/
+ERROR_CODE StartProfiler()
+{
+	PROFILER_BUFFER_PTR buffer;
+	int i;
+
+	SpinLock( &profiler_lock );
+	if ( profiler_enabled )
+	{
+		SpinUnlock( &profiler_lock );
+		return ERROR_BUSY;
+	}
+	for(i=0; i<count_running_processors; i++)
+	{
+		buffer = &profiler_buffers[i];
+		if ( buffer->samples == NULL )
+		{
+			buffer->samples = kmalloc( sizeof(PROFILER_SAMPLE) * profiler_buffer_samples, 0 );
+			if ( buffer->samples == NULL )
+			{
+				SpinUnlock( &profiler_lock );
+				return ERROR_NOT_ENOUGH_MEMORY;
+			}
+			buffer->size = profiler_buffer_samples;
+		}
+		buffer->count = 0;
+		buffer->dropped = 0;
+	}
+	/*the buffers should be reset before any processor sees the flag*/
+	COMPILER_BARRIER();
+	profiler_enabled = TRUE;
+	SpinUnlock( &profiler_lock );
+
+	return ERROR_SUCCESS;
+}
+
+/*! Stops recording samples - the recorded samples are kept until the next StartProfiler()
+*/
+void StopProfiler()
+{
+	SpinLock( &profiler_lock );
+	profiler_enabled = FALSE;
+	SpinUnlock( &profiler_lock );
+}
+
+/*! Records a sample in the current processor's buffer
+	Called from the scheduler timer interrupt with interrupts disabled.
+	\param eip - interrupted instruction
+	\param user_mode - TRUE if the processor was running user code
+*/
+void RecordProfilerSample(VADDR eip, BOOLEAN user_mode)
+{
+	PROCESSOR_PTR p = GET_CURRENT_PROCESSOR;
+	PROFILER_BUFFER_PTR buffer;
+	PROFILER_SAMPLE_PTR sample;
+	UINT32 count;
+
+	if ( p == NULL )
+		p = &processor[GetCurrentProcessorId()];
+	buffer = &profiler_buffers[p - processor];
+	count = buffer->count;
+	if ( buffer->samples == NULL || count >= buffer->size )
+	{
+		buffer->dropped++;
+		return;
+	}
+
+	sample = &buffer->samples[count];
+	sample->eip = eip;
+	sample->thread = GetCurrentThread();
+	sample->processor_id = p - processor;
+	sample->flags = user_mode ? PROFILER_SAMPLE_USER_MODE : 0;
+	/*publish the sample only after it is filled*/
+	COMPILER_BARRIER();
+	buffer->count = count + 1;
+}
+
+static COMPARISION_RESULT CompareAddress(char * data1, char * data2)
+{
+	VADDR a1 = *(VADDR *)data1, a2 = *(VADDR *)data2;
+
+	if ( a1 == a2 )
+		return EQUAL;
+	return a1 > a2 ? GREATER_THAN : LESS_THAN;
+}
+
+/*! Orders the symbols by descending sample count*/
+static COMPARISION_RESULT CompareSymbolCount(char * data1, char * data2)
+{
+	PROFILER_SYMBOL_PTR s1 = (PROFILER_SYMBOL_PTR)data1, s2 = (PROFILER_SYMBOL_PTR)data2;
+
+	if ( s1->count == s2->count )
+		return EQUAL;
+	return s1->count < s2->count ? GREATER_THAN : LESS_THAN;
+}
+
+/*! Prints the hottest kernel functions and the per processor sample counts through ktrace
+	Can be called while the profiler is running; only the samples recorded so far are considered.
+	\param top - number of functions to print, 0 means PROFILER_DEFAULT_TOP_SYMBOLS
+*/
+void DumpProfile(UINT32 top)
+{
+	PROFILER_BUFFER_PTR buffer;
+	PROFILER_SYMBOL_PTR symbols;
+	VADDR * addresses;
+	char * name, * last_name;
+	UINT32 i, j, count, total = 0, kernel = 0, user = 0, unknown = 0, dropped = 0, symbol_count = 0;
+	int offset;
+
+	if ( top == 0 )
+		top = PROFILER_DEFAULT_TOP_SYMBOLS;
+
+	ktrace("Profile: %s\n", profiler_enabled ? "running" : "stopped");
+	for(i=0; i<count_running_processors; i++)
+	{
+		buffer = &profiler_buffers[i];
+		ktrace("  processor %d: %d samples, %d dropped\n", i, buffer->count, buffer->dropped);
+		total += buffer->count;
+		dropped += buffer->dropped;
+	}
+	if ( total == 0 )
+		return;
+
+	/*one extra element for the sort's temporary storage*/
+	addresses = kmalloc( sizeof(VADDR) * (total+1), 0 );
+	symbols = kmalloc( sizeof(PROFILER_SYMBOL) * (total+1), 0 );
+	if ( addresses == NULL || symbols == NULL )
+	{
+		ktrace("Profile: not enough memory to aggregate %d samples\n", total);
+		goto done;
+	}
+
+	/*collect kernel samples - a buffer can grow while it is read, so stay within its snapshot*/
+	for(i=0; i<count_running_processors; i++)
+	{
+		buffer = &profiler_buffers[i];
+		count = buffer->count;
+		for(j=0; j<count && kernel+user<total; j++)
+		{
+			if ( buffer->samples[j].flags & PROFILER_SAMPLE_USER_MODE )
+				user++;
+			else
+				addresses[kernel++] = buffer->samples[j].eip;
+		}
+	}
+
+	/*after sorting the samples of a function are next to each other*/
+	SortArray( (char *)addresses, (char *)&addresses[kernel], sizeof(VADDR), kernel, CompareAddress );
+	last_name = NULL;
+	for(i=0; i<kernel; i++)
+	{
+		/*the same address resolves to the same function*/
+		if ( i == 0 || addresses[i] != addresses[i-1] )
+			name = FindKernelSymbolByAddress( addresses[i], &offset );
+		if ( name == NULL )
+		{
+			unknown++;
+			continue;
+		}
+		if ( name != last_name )
+		{
+			symbols[symbol_count].name = name;
+			symbols[symbol_count].count = 0;
+			symbol_count++;
+			last_name = name;
+		}
+		symbols[symbol_count-1].count++;
+	}
+	SortArray( (char *)symbols, (char *)&symbols[symbol_count], sizeof(PROFILER_SYMBOL), symbol_count, CompareSymbolCount );
+
+	ktrace("Profile: %d samples - kernel %d, user %d, unresolved %d, dropped %d\n", kernel+user, kernel, user, unknown, dropped);
+	ktrace("  samples   %%  function\n");
+	for(i=0; i<symbol_count && i<top; i++)
+		ktrace("  %7d %3d  %s\n", symbols[i].count, (symbols[i].count*100)/(kernel+user), symbols[i].name);
+
+done:
+	if ( addresses )
+		kfree( addresses );
+	if ( symbols )
+		kfree( symbols );
+}
+
+/*! Profiles the system for profile_system_seconds and dumps the result*/
+static void ProfilerThread()
+{
+	if ( StartProfiler() == ERROR_SUCCESS )
+	{
+		Sleep( profile_system_seconds * 1000 );
+		StopProfiler();
+		DumpProfile( 0 );
+	}
+	ExitThread();
+}
+
+/*! Profiles the system for the given time from a kernel thread and dumps the result through ktrace
+	\param seconds - duration of the profile
+*/
+ERROR_CODE ProfileSystem(UINT32 seconds)
+{
+	if ( seconds == 0 )
+		return ERROR_INVALID_PARAMETER;
+	if ( profiler_enabled )
+		return ERROR_BUSY;
+	profile_system_seconds = seconds;
+	if ( CreateThread( &kernel_task, ProfilerThread, SCHED_CLASS_HIGH, TRUE, NULL ) == NULL )
+		return ERROR_NOT_ENOUGH_MEMORY;
+	return ERROR_SUCCESS;
+}
@@ -12,6 +12,7 @@
 #include <kernel/system_call_handler.h>
 #include <kernel/pm/task.h>
 #include <kernel/vfs/vfs.h>
+#include <kernel/vfs/io_ring.h>
 
 /*! open a file
  * int open(const char *path, int oflag)
@@ -192,12 +193,74 @@ UINT32 syscall_fstatfs64(SYSTEM_CALL_ARGS_PTR sys_call_args, UINT32 *retval)
 	* retval = -1;
 	return 0;
 }
+/*! schedule file system updates
+ * void sync(void)
+ * Writes back the modified cached pages of all the mounted file systems.
+ * */
 UINT32 syscall_sync(SYSTEM_CALL_ARGS_PTR sys_call_args, UINT32 *retval)
 {
-	KTRACE("%p %p %p %p\n", sys_call_args->args[0], sys_call_args->args[1], sys_call_args->args[2], sys_call_args->args[3]);
-	* retval = -1;
+	SyncFileSystems();
+	* retval = 0;
 	return 0;
 }
+/*! synchronize changes to a file
+ * int fsync(int fildes)
+ * Upon successful completion, fsync() shall return 0. Otherwise, -1 shall be returned and errno set to indicate the error.
+ * [EBADF] - The fildes argument is not a valid descriptor.
+ * [EIO] - An I/O error occurred while reading from or writing to the file system.
+ * */
+UINT32 syscall_fsync(SYSTEM_CALL_ARGS_PTR sys_call_args, UINT32 *retval)
+{
+	ERROR_CODE err;
+	
+	err = SyncFile( GetCurrentTask(), sys_call_args->args[0] );
+	if ( err == ERROR_SUCCESS )
+	{
+		* retval = 0;
+		return 0;
+	}
+	* retval = -1;
+	return err == ERROR_INVALID_PARAMETER ? EBADF : EIO;
+}
+/*! creates the asynchronous io ring of the process
+ * void * io_ring_setup(unsigned entries)
+ * Upon successful completion, returns the address of the ring memory shared with the process(IO_RING_HEADER) otherwise, -1 shall be returned and errno set to indicate the error.
+ * [EINVAL] - entries is 0 or too big.
+ * [EBUSY] - the process already has an io ring.
+ * [ENOMEM] - not enough memory for the ring.
+ * */
+UINT32 syscall_io_ring_setup(SYSTEM_CALL_ARGS_PTR sys_call_args, UINT32 *retval)
+{
+	ERROR_CODE err;
+	VADDR va;
+	
+	err = CreateIoRing( GetCurrentTask(), sys_call_args->args[0], &va );
+	if ( err == ERROR_SUCCESS )
+	{
+		* retval = va;
+		return 0;
+	}
+	* retval = -1;
+	if ( err == ERROR_BUSY )
+		return EBUSY;
+	return err == ERROR_NOT_ENOUGH_MEMORY ? ENOMEM : EINVAL;
+}
+/*! submits the queued io ring entries and waits for completions
+ * int io_ring_enter(unsigned to_submit, unsigned min_complete)
+ * Upon successful completion, returns the number of submission entries taken; otherwise, -1 shall be returned and errno set to indicate the error.
+ * The call returns early without min_complete completions if no request is in flight.
+ * [EINVAL] - the process has no io ring.
+ * */
+UINT32 syscall_io_ring_enter(SYSTEM_CALL_ARGS_PTR sys_call_args, UINT32 *retval)
+{
+	ERROR_CODE err;
+	
+	err = EnterIoRing( GetCurrentTask(), sys_call_args->args[0], sys_call_args->args[1], retval );
+	if ( err == ERROR_SUCCESS )
+		return 0;
+	* retval = -1;
+	return EINVAL;
+}
 UINT32 syscall_rename(SYSTEM_CALL_ARGS_PTR sys_call_args, UINT32 *retval)
 {
 	KTRACE("%p %p %p %p\n", sys_call_args->args[0], sys_call_args->args[1], sys_call_args->args[2], sys_call_args->args[3]);
@@ -234,16 +297,61 @@ UINT32 syscall_poll(SYSTEM_CALL_ARGS_PTR sys_call_args, UINT32 *retval)
 	* retval = -1;
 	return 0;
 }
-UINT32 syscall_dup(SYSTEM_CALL_ARGS_PTR sys_call_args, UINT32 *retval)
+/*! Maps the error returned by DuplicateFile() to errno*/
+static UINT32 DuplicateFileErrorToErrno(ERROR_CODE err)
 {
-	KTRACE("%p %p %p %p\n", sys_call_args->args[0], sys_call_args->args[1], sys_call_args->args[2], sys_call_args->args[3]);
-	* retval = -1;
-	return 0;
+	switch( err )
+	{
+		case ERROR_RESOURCE_SHORTAGE:
+			return EMFILE;
+		case ERROR_NOT_ENOUGH_MEMORY:
+			return ENOMEM;
+		default:
+			return EBADF;
+	}
 }
+/*! duplicates an open file descriptor
+ * int dup(int fildes)
+ * Upon successful completion, returns the lowest numbered file descriptor not currently open, which shares the open file(and the file offset) with fildes.
+ * [EBADF] - fildes is not a valid open file descriptor.
+ * [EMFILE] - all file descriptors are in use.
+ */
+UINT32 syscall_dup(SYSTEM_CALL_ARGS_PTR sys_call_args, UINT32 *retval)
+{
+	ERROR_CODE err;
+	int file_id;
+	
+	err = DuplicateFile( GetCurrentTask(), sys_call_args->args[0], -1, &file_id );
+	if ( err != ERROR_SUCCESS )
+	{
+		* retval = -1;
+		return DuplicateFileErrorToErrno( err );
+	}
+	* retval = file_id;
+	return 0;
+}
+/*! duplicates an open file descriptor to the given file descriptor
+ * int dup2(int fildes, int fildes2)
+ * fildes2 is closed first if it is open. Upon successful completion, returns fildes2.
+ * [EBADF] - fildes is not a valid open file descriptor or fildes2 is out of range.
+ */
 UINT32 syscall_dup2(SYSTEM_CALL_ARGS_PTR sys_call_args, UINT32 *retval)
 {
-	KTRACE("%p %p %p %p\n", sys_call_args->args[0], sys_call_args->args[1], sys_call_args->args[2], sys_call_args->args[3]);
-	* retval = -1;
+	ERROR_CODE err;
+	int file_id;
+	
+	if ( (int)sys_call_args->args[1] < 0 )
+	{
+		* retval = -1;
+		return EBADF;
+	}
+	err = DuplicateFile( GetCurrentTask(), sys_call_args->args[0], sys_call_args->args[1], &file_id );
+	if ( err != ERROR_SUCCESS )
+	{
+		* retval = -1;
+		return DuplicateFileErrorToErrno( err );
+	}
+	* retval = file_id;
 	return 0;
 }
 UINT32 syscall_pipe(SYSTEM_CALL_ARGS_PTR sys_call_args, UINT32 *retval)
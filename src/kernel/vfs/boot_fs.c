@@ -22,13 +22,14 @@
 /*! Where to mount boot fs*/
 #define BOOT_FS_MOUNT_PATH		"/boot"
 
-#define BOOT_FS_TIME_OUT		5
+/*! number of messages the boot fs thread receives at once*/
+#define BOOT_FS_MESSAGE_BATCH	8
 
 /*! messages passed to boot fs is queued up here - It will be processed by boot fs thread*/
 MESSAGE_QUEUE boot_fs_message_queue;
 
 static void BootFsMessageReceiver();
-static void ProcessVfsMessage( MESSAGE_TYPE message_type, VFS_IPC vfs_id, IPC_ARG_TYPE arg2, IPC_ARG_TYPE arg3, IPC_ARG_TYPE arg4, IPC_ARG_TYPE arg5, IPC_ARG_TYPE arg6 );
+static void ProcessVfsMessage( THREAD_PTR reply_to, MESSAGE_TYPE message_type, VFS_IPC vfs_id, IPC_ARG_TYPE arg2, IPC_ARG_TYPE arg3, IPC_ARG_TYPE arg4, IPC_ARG_TYPE arg5, IPC_ARG_TYPE arg6 );
 static FILE_STAT_PARAM_PTR GetDirectoryEntries(void * fs_data, int inode, char * file_name, int max_entries, int * total_entries);
 static ERROR_CODE MapTarFile(long inode, long offset, void * va, long size);
 
@@ -63,6 +64,8 @@ void InitBootFs()
 		kprintf("%s\n", ERROR_CODE_AS_STRING(ret) );
 		panic( "boot_fs mount failed" );
 	}
+	/*boot modules are read only; file reads are served from ubc through file page mapping*/
+	GetMount( BOOT_FS_MOUNT_PATH )->read_only = 1;
 	
 	/*initialize the boot fs meta data*/
 	bootfs_tar_va = (void *)kernel_reserve_range.module_va_start;
@@ -71,20 +74,39 @@ void InitBootFs()
 
 /*! Boot fs thread
  * Processes VFS requests from VFS server and fulfills the requests
+ * The requests queued while the previous batch was processed are received together, with one wake up of the waiting senders.
  */
 static void BootFsMessageReceiver()
 {
+	IPC_MESSAGE messages[BOOT_FS_MESSAGE_BATCH];
+	IPC_ARG_TYPE * args;
+	UINT32 i, count;
 	ERROR_CODE err;
-	MESSAGE_TYPE type;	
-	IPC_ARG_TYPE arg1, arg2, arg3, arg4, arg5, arg6;
 
 	while ( 1 )
 	{
-		err = GetVfsMessage( &boot_fs_message_queue, BOOT_FS_TIME_OUT, &type, &arg1, &arg2, &arg3, &arg4, &arg5, &arg6 );
-		if ( err == ERROR_SUCCESS )
-			ProcessVfsMessage( type, (VFS_IPC)arg1, arg2, arg3, arg4, arg5, arg6 );
-		else
-			kprintf( "bootfs IPC message receive error : %d\n", err );
+		/*no receive buffer is given, so the payload of MESSAGE_TYPE_REFERENCE messages is handed over(see ReceiveMessageBatch())*/
+		memset( messages, 0, sizeof(messages) );
+		err = ReceiveMessageBatch( &boot_fs_message_queue, messages, BOOT_FS_MESSAGE_BATCH, &count, 0 );
+		if ( err != ERROR_SUCCESS )
+		{
+			/*vfs does not send vector messages - drop the message which can not be received*/
+			if ( err == ERROR_INVALID_PARAMETER )
+				SkipMessage( &boot_fs_message_queue );
+			if ( err != ERROR_NOT_FOUND )
+				kprintf( "bootfs IPC message receive error : %d\n", err );
+			continue;
+		}
+		for(i=0; i<count; i++)
+		{
+			args = messages[i].args;
+			if ( messages[i].status == ERROR_SUCCESS )
+				ProcessVfsMessage( messages[i].sender_thread, messages[i].type, (VFS_IPC)args[0], args[1], args[2], args[3], args[4], args[5] );
+			else
+				kprintf( "bootfs IPC message receive error : %d\n", messages[i].status );
+			if ( messages[i].type == MESSAGE_TYPE_REFERENCE )
+				kfree( args[IPC_ADDRESS_ARG_INDEX] );
+		}
 		
 		/*!\todo - process unregister/shutdown request and exit this thread*/
 	}
@@ -92,11 +114,12 @@ static void BootFsMessageReceiver()
 }
 
 /*! Processes a VFS message and take neccessary action(reply to the VFS)
+ * \param reply_to - sender thread of the message
  * \param message_type - message queue message type - value/reference/shared etc
  * \param vfs_id - VFS message type - mount/unmount/read/write etc
  * \param arg2-6 - Arguments to the message
  * */
-static void ProcessVfsMessage( MESSAGE_TYPE message_type, VFS_IPC vfs_id, IPC_ARG_TYPE arg2, IPC_ARG_TYPE arg3, IPC_ARG_TYPE arg4, IPC_ARG_TYPE arg5, IPC_ARG_TYPE arg6 )
+static void ProcessVfsMessage( THREAD_PTR reply_to, MESSAGE_TYPE message_type, VFS_IPC vfs_id, IPC_ARG_TYPE arg2, IPC_ARG_TYPE arg3, IPC_ARG_TYPE arg4, IPC_ARG_TYPE arg5, IPC_ARG_TYPE arg6 )
 {
 	FILE_STAT_PARAM_PTR de;
 	int total_entries;
@@ -108,53 +131,54 @@ static void ProcessVfsMessage( MESSAGE_TYPE message_type, VFS_IPC vfs_id, IPC_AR
 			assert( IPR_ARGUMENT_ADDRESS != NULL );
 			/*bootfs supports mounting only from boot device*/
 			if ( strcmp(IPR_ARGUMENT_ADDRESS, BOOT_FS_MOUNT_DEVICE) == 0 )
-				ReplyToLastMessage( MESSAGE_TYPE_VALUE, (IPC_ARG_TYPE)VFS_RETURN_CODE_SUCCESS, NULL, NULL, NULL, NULL, NULL );
+				ReplyToMessage( reply_to, MESSAGE_TYPE_VALUE, (IPC_ARG_TYPE)VFS_RETURN_CODE_SUCCESS, NULL, NULL, NULL, NULL, NULL );
 			else
-				ReplyToLastMessage( MESSAGE_TYPE_VALUE, (IPC_ARG_TYPE)VFS_RETURN_CODE_INVALID_PARAMETER, NULL, NULL, NULL, NULL, NULL  );
+				ReplyToMessage( reply_to, MESSAGE_TYPE_VALUE, (IPC_ARG_TYPE)VFS_RETURN_CODE_INVALID_PARAMETER, NULL, NULL, NULL, NULL, NULL  );
 			break;
 		case VFS_IPC_UNMOUNT:
 			/*boot mount cant be unmounted*/
-			ReplyToLastMessage( MESSAGE_TYPE_VALUE, (IPC_ARG_TYPE)VFS_RETURN_CODE_OPERATION_NOT_SUPPORTED, NULL, NULL, NULL, NULL, NULL  );
+			ReplyToMessage( reply_to, MESSAGE_TYPE_VALUE, (IPC_ARG_TYPE)VFS_RETURN_CODE_OPERATION_NOT_SUPPORTED, NULL, NULL, NULL, NULL, NULL  );
 			break;
 		case VFS_IPC_GET_DIR_ENTRIES:
 			assert( message_type == MESSAGE_TYPE_REFERENCE );
 			de_param = (DIRECTORY_ENTRY_PARAM_PTR )IPR_ARGUMENT_ADDRESS;
 			de = GetDirectoryEntries( arg2, -1, NULL, de_param->max_entries, &total_entries);
 			if( total_entries > 0 )
-				ReplyToLastMessage( MESSAGE_TYPE_REFERENCE, (IPC_ARG_TYPE)VFS_RETURN_CODE_SUCCESS, (IPC_ARG_TYPE)total_entries, NULL, NULL, de, (IPC_ARG_TYPE) (sizeof(FILE_STAT_PARAM)*total_entries));
+				ReplyToMessage( reply_to, MESSAGE_TYPE_REFERENCE, (IPC_ARG_TYPE)VFS_RETURN_CODE_SUCCESS, (IPC_ARG_TYPE)total_entries, NULL, NULL, de, (IPC_ARG_TYPE) (sizeof(FILE_STAT_PARAM)*total_entries));
 			else
-				ReplyToLastMessage( MESSAGE_TYPE_VALUE, (IPC_ARG_TYPE)VFS_RETURN_CODE_NOT_FOUND, NULL, NULL, NULL, NULL, NULL  );
+				ReplyToMessage( reply_to, MESSAGE_TYPE_VALUE, (IPC_ARG_TYPE)VFS_RETURN_CODE_NOT_FOUND, NULL, NULL, NULL, NULL, NULL  );
 			break;
 		case VFS_IPC_GET_FILE_STAT_PATH:
 			assert( message_type == MESSAGE_TYPE_REFERENCE );
 			de = GetDirectoryEntries( arg2, -1, IPR_ARGUMENT_ADDRESS, 1, NULL );
 			if( de )
-				ReplyToLastMessage( MESSAGE_TYPE_REFERENCE, (IPC_ARG_TYPE)VFS_RETURN_CODE_SUCCESS, (IPC_ARG_TYPE)1, NULL, NULL, de, (IPC_ARG_TYPE) sizeof(FILE_STAT_PARAM));
+				ReplyToMessage( reply_to, MESSAGE_TYPE_REFERENCE, (IPC_ARG_TYPE)VFS_RETURN_CODE_SUCCESS, (IPC_ARG_TYPE)1, NULL, NULL, de, (IPC_ARG_TYPE) sizeof(FILE_STAT_PARAM));
 			else
-				ReplyToLastMessage( MESSAGE_TYPE_VALUE, (IPC_ARG_TYPE)VFS_RETURN_CODE_NOT_FOUND, NULL, NULL, NULL, NULL, NULL  );
+				ReplyToMessage( reply_to, MESSAGE_TYPE_VALUE, (IPC_ARG_TYPE)VFS_RETURN_CODE_NOT_FOUND, NULL, NULL, NULL, NULL, NULL  );
 			break;
 		case VFS_IPC_GET_FILE_STAT_INODE:
 			assert( message_type == MESSAGE_TYPE_VALUE );
 			de = GetDirectoryEntries( arg2, (int)arg3, NULL, 1, NULL );
 			if( de )
-				ReplyToLastMessage( MESSAGE_TYPE_REFERENCE, (IPC_ARG_TYPE)VFS_RETURN_CODE_SUCCESS, (IPC_ARG_TYPE)1, NULL, NULL, de, (IPC_ARG_TYPE) sizeof(FILE_STAT_PARAM) );
+				ReplyToMessage( reply_to, MESSAGE_TYPE_REFERENCE, (IPC_ARG_TYPE)VFS_RETURN_CODE_SUCCESS, (IPC_ARG_TYPE)1, NULL, NULL, de, (IPC_ARG_TYPE) sizeof(FILE_STAT_PARAM) );
 			else
-				ReplyToLastMessage( MESSAGE_TYPE_VALUE, (IPC_ARG_TYPE)VFS_RETURN_CODE_NOT_FOUND, NULL, NULL, NULL, NULL, NULL  );
+				ReplyToMessage( reply_to, MESSAGE_TYPE_VALUE, (IPC_ARG_TYPE)VFS_RETURN_CODE_NOT_FOUND, NULL, NULL, NULL, NULL, NULL  );
 			break;
 		case VFS_IPC_MAP_FILE_PAGE:
 			if ( MapTarFile( (long)arg3, (long)arg4, IPR_ARGUMENT_ADDRESS, IPC_ARGUMENT_LENGTH ) == ERROR_SUCCESS )
-				ReplyToLastMessage( MESSAGE_TYPE_VALUE, (IPC_ARG_TYPE)VFS_RETURN_CODE_SUCCESS, NULL, NULL, NULL, NULL, NULL  );
+				ReplyToMessage( reply_to, MESSAGE_TYPE_VALUE, (IPC_ARG_TYPE)VFS_RETURN_CODE_SUCCESS, NULL, NULL, NULL, NULL, NULL  );
 			else
-				ReplyToLastMessage( MESSAGE_TYPE_VALUE, (IPC_ARG_TYPE)VFS_RETURN_CODE_NOT_FOUND, NULL, NULL, NULL, NULL, NULL  );
+				ReplyToMessage( reply_to, MESSAGE_TYPE_VALUE, (IPC_ARG_TYPE)VFS_RETURN_CODE_NOT_FOUND, NULL, NULL, NULL, NULL, NULL  );
 			break;
 		case VFS_IPC_WRITE_FILE:
 		case VFS_IPC_READ_FILE:
+			ReplyToMessage( reply_to, MESSAGE_TYPE_VALUE, (IPC_ARG_TYPE)VFS_RETURN_CODE_OPERATION_NOT_SUPPORTED, NULL, NULL, NULL, NULL, NULL  );
 			break;
 		case VFS_IPC_DELETE_FILE:
 		case VFS_IPC_MOVE:
 		case VFS_IPC_CREATE_SOFT_LINK:
 		case VFS_IPC_CREATE_HARD_LINK:
-			ReplyToLastMessage( MESSAGE_TYPE_VALUE, (IPC_ARG_TYPE)VFS_RETURN_CODE_INVALID_REQUEST, NULL, NULL, NULL, NULL, NULL  );
+			ReplyToMessage( reply_to, MESSAGE_TYPE_VALUE, (IPC_ARG_TYPE)VFS_RETURN_CODE_INVALID_REQUEST, NULL, NULL, NULL, NULL, NULL  );
 			break;
 	}
 }
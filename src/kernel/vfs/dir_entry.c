@@ -1,93 +1,435 @@
 /*!
     \file   kernel/vfs/dir_entry.c
     \brief  directory entry management
+
+	Directory entries are cached per path component. Each entry points to its parent and is hashed on
+	(parent, component name), so a path walk costs one hash probe per component and paths sharing a
+	prefix share the entries of the prefix. Every hash bucket has its own lock, so walks on different
+	CPUs only contend when they touch the same bucket.
+
+	Lookups which the file system reported as not existing are kept as negative entries. Negative
+	entries are valid only until the next mount/unmount.
+
+	A directory read returns the attributes of all the files in the directory. They are kept in the
+	child entries for a while, so opening those files creates the vnode without asking the FS again.
 */
 
 #include <ace.h>
 #include <string.h>
-#include <ds/lrulist.h>
+#include <ds/hash.h>
 #include <sync/spinlock.h>
+#include <kernel/debug.h>
+#include <kernel/pit.h>
 #include <kernel/mm/kmem.h>
 #include <kernel/vfs/vfs.h>
 
+/*! maximum number of lru entries scanned to find a free directory entry*/
+#define DIR_ENTRY_EVICT_SCAN		32
+
+/*! returns the hash bucket for the given hash value*/
+#define DIR_ENTRY_HASH_BUCKET(hash)	( &fs_control.dir_entry_hash_table[ ((hash) ^ ((hash) >> 16)) & (DIR_ENTRY_HASH_TABLE_SIZE-1) ] )
+
+/*! returns TRUE if the directory entry caches a path which does not exist*/
+#define IS_NEGATIVE_DIR_ENTRY(de)	( (de)->negative && (de)->generation == fs_control.dir_entry_generation )
+
+/*! returns TRUE if the attributes cached by a directory read can be used*/
+#define DIR_ENTRY_ATTRIBUTES_VALID(de)	( (de)->generation == fs_control.dir_entry_generation && (INT32)((de)->attribute_expire_ticks - timer_ticks) > 0 )
+
 /*! cache used by directory entry*/
 CACHE dir_entry_cache;
 
-COMPARISION_RESULT compare_dir_entry_name(struct binary_tree * node1, struct binary_tree * node2);
-static DIRECTORY_ENTRY_PTR SearchDirectoryEntryTree(char * file_path);
+static ERROR_CODE WalkDirectoryPath(char * file_path, DIRECTORY_ENTRY_PTR * result);
+static DIRECTORY_ENTRY_PTR LookupDirectoryEntry(DIRECTORY_ENTRY_PTR parent, char * name, int length);
+static DIRECTORY_ENTRY_PTR AllocateDirectoryEntry(DIRECTORY_ENTRY_PTR parent, char * name, int length, UINT32 hash);
+static void FreeDirectoryEntry(DIRECTORY_ENTRY_PTR de);
+static void EvictDirectoryEntry();
+
+/*! Initializes the directory entry hash table, lru list and the root entry*/
+void InitDirectoryEntryCache()
+{
+	int i;
+
+	for(i=0; i<DIR_ENTRY_HASH_TABLE_SIZE; i++)
+	{
+		InitSpinLock( &fs_control.dir_entry_hash_table[i].lock );
+		InitList( &fs_control.dir_entry_hash_table[i].head );
+	}
+	InitSpinLock( &fs_control.dir_entry_lru_lock );
+	InitList( &fs_control.dir_entry_lru_list );
+	fs_control.dir_entry_count = 0;
+	fs_control.dir_entry_generation = 0;
+
+	/*root entry is never hashed or evicted*/
+	DirEntryCacheConstructor( &fs_control.dir_entry_root );
+	fs_control.dir_entry_root.name = "/";
+	fs_control.dir_entry_root.reference_count = 1;
+}
 
 /*! Returns directory entry for a given file name/path
 	\param file_path - path for which directory entry is requested
-	\param result - directory entry will he updated here
+	\param result - directory entry will he updated here - the caller should call ReleaseDirectoryEntry() after using it
 */
 ERROR_CODE GetDirectoryEntry(char * file_path, DIRECTORY_ENTRY_PTR * result)
 {
 	ERROR_CODE ret;
 	DIRECTORY_ENTRY_PTR de;
-	LIST_PTR lru_node;
+	VNODE_PTR vnode;
 
-	assert(result);
+	assert( file_path != NULL );
+	assert( result );
 	*result = NULL;
-	/*search whether the directory entry is already cached*/
-	de = SearchDirectoryEntryTree( file_path );
-	if ( de )
+
+	ret = WalkDirectoryPath( file_path, &de );
+	if ( ret != ERROR_SUCCESS )
+		return ret;
+
+	/*the file system is path based, so only the leaf is resolved*/
+	if ( IS_NEGATIVE_DIR_ENTRY(de) )
+		ret = ERROR_INVALID_PATH;
+	else
 	{
-		/*lru management*/
-		ReferenceLruNode( &fs_control.dir_entry_lru_list, &de->lru );
+		ret = GetVnode( de, file_path, &vnode );
+		if ( ret == ERROR_INVALID_PATH )
+		{
+			de->generation = fs_control.dir_entry_generation;
+			de->negative = 1;
+		}
+		else if ( ret == ERROR_SUCCESS )
+			de->negative = 0;
 	}
-	else
+	if ( ret != ERROR_SUCCESS )
+	{
+		ReleaseDirectoryEntry( de );
+		return ret;
+	}
+
+	*result = de;
+	return ERROR_SUCCESS;
+}
+
+/*! Walks the given path one component at a time without asking the FS
+	\param file_path - path to walk
+	\param result - referenced directory entry of the last component
+*/
+static ERROR_CODE WalkDirectoryPath(char * file_path, DIRECTORY_ENTRY_PTR * result)
+{
+	DIRECTORY_ENTRY_PTR de, child;
+	char * component, * end;
+	int length;
+
+	de = &fs_control.dir_entry_root;
+	ReferenceDirectoryEntry( de );
+	component = file_path;
+	while( 1 )
 	{
-		/*allocate a directory entry */
-		lru_node = AllocateLruNode(&fs_control.dir_entry_lru_list);
-		if ( lru_node == NULL )
+		while ( *component == PATH_SEPARATOR )
+			component++;
+		if ( *component == 0 )
+			break;
+		end = strchr( component, PATH_SEPARATOR );
+		length = end ? end - component : strlen( component );
+		if ( length >= MAX_FILE_NAME || IS_NEGATIVE_DIR_ENTRY(de) )
+		{
+			ReleaseDirectoryEntry( de );
+			return ERROR_INVALID_PATH;
+		}
+		child = LookupDirectoryEntry( de, component, length );
+		ReleaseDirectoryEntry( de );
+		if ( child == NULL )
 			return ERROR_NOT_ENOUGH_MEMORY;
-		
-		de = STRUCT_ADDRESS_FROM_MEMBER(lru_node, DIRECTORY_ENTRY, lru );
-
-		/*copy the file path*/
-		de->name = kmalloc( strlen(file_path), KMEM_NO_FAIL );
-		strcpy(de->name, file_path);
-		
-		/*add it to the tree*/
-		InsertNodeIntoAvlTree( &fs_control.dir_entry_root, &de->name_tree, 0, compare_dir_entry_name );
+		de = child;
+		component += length;
 	}
-	
-	ret = GetVnode(de, &de->vnode);
-	
 	*result = de;
-	return ret;
+	return ERROR_SUCCESS;
 }
 
+/*! Caches the attributes returned by a directory read in the child directory entries
+	\param directory_path - directory which was read
+	\param entries - file stat of the files in the directory
+	\param count - number of entries
+*/
+void CacheDirectoryEntryAttributes(char * directory_path, FILE_STAT_PARAM_PTR entries, int count)
+{
+	DIRECTORY_ENTRY_PTR dir, de;
+	FILE_STAT_PARAM_PTR attributes, old_attributes;
+	char * name;
+	int i, length;
+
+	if ( WalkDirectoryPath( directory_path, &dir ) != ERROR_SUCCESS )
+		return;
+	for(i=0; i<count; i++)
+	{
+		name = entries[i].name;
+		while ( *name == PATH_SEPARATOR )
+			name++;
+		length = strlen( name );
+		if ( length == 0 || length >= MAX_FILE_NAME || strchr( name, PATH_SEPARATOR ) != NULL )
+			continue;
+
+		de = LookupDirectoryEntry( dir, name, length );
+		if ( de == NULL )
+			break;
+		/*entries having a vnode dont need the attributes*/
+		if ( de->vnode == NULL )
+		{
+			attributes = kmalloc( sizeof(FILE_STAT_PARAM), 0 );
+			if ( attributes != NULL )
+			{
+				memcpy( attributes, &entries[i], sizeof(FILE_STAT_PARAM) );
+				SpinLock( &de->lock );
+				old_attributes = de->attributes;
+				de->attributes = attributes;
+				de->attribute_expire_ticks = timer_ticks + MILLISECONDS_TO_TICKS( fs_param.vnode.attribute_cache_time );
+				de->generation = fs_control.dir_entry_generation;
+				de->negative = 0;
+				SpinUnlock( &de->lock );
+				if ( old_attributes != NULL )
+					kfree( old_attributes );
+			}
+		}
+		ReleaseDirectoryEntry( de );
+	}
+	ReleaseDirectoryEntry( dir );
+}
 
-/*! Internal function used to allocate a node for direntry lru list*/
-LIST_PTR AllocateDirEntryLruNode()
+/*! Returns the attributes cached by a directory read, if they are still valid
+	The attributes are removed from the directory entry and the caller should free them.
+	\param de - directory entry
+*/
+FILE_STAT_PARAM_PTR TakeDirectoryEntryAttributes(DIRECTORY_ENTRY_PTR de)
 {
-	DIRECTORY_ENTRY_PTR dir_ent;
-	dir_ent = AllocateBuffer( &dir_entry_cache, CACHE_ALLOC_SLEEP );
-	if ( dir_ent == NULL )
+	FILE_STAT_PARAM_PTR attributes;
+
+	SpinLock( &de->lock );
+	attributes = de->attributes;
+	de->attributes = NULL;
+	if ( attributes != NULL && !DIR_ENTRY_ATTRIBUTES_VALID(de) )
+	{
+		SpinUnlock( &de->lock );
+		kfree( attributes );
 		return NULL;
-	
-	return &dir_ent->lru;
+	}
+	SpinUnlock( &de->lock );
+	return attributes;
 }
 
-/*! Internal function used to reuse a node for direntry lru list*/
-void ReuseDirEntryLru(LIST_PTR node)
+/*! Takes a reference on a directory entry so that it wont be evicted
+	\param de - directory entry
+*/
+void ReferenceDirectoryEntry(DIRECTORY_ENTRY_PTR de)
 {
-	assert( node != NULL );
-	DIRECTORY_ENTRY_PTR dir_entry = STRUCT_ADDRESS_FROM_MEMBER( node, DIRECTORY_ENTRY, lru ) ;
-	RemoveNodeFromAvlTree( &fs_control.dir_entry_root, &dir_entry->name_tree, 0, compare_dir_entry_name);
-	kfree( dir_entry->name );
-	DirEntryCacheDestructor( dir_entry );
+	assert( de != NULL );
+	SpinLock( &de->lock );
+	de->reference_count++;
+	SpinUnlock( &de->lock );
 }
 
-/*! Internal function used to free a node from direntry lru list*/
-void FreeDirEntryLru(LIST_PTR node)
+/*! Releases a reference taken on a directory entry
+	Unreferenced entries stay in the cache until the lru evicts them.
+	\param de - directory entry
+*/
+void ReleaseDirectoryEntry(DIRECTORY_ENTRY_PTR de)
 {
-	assert( node != NULL );
-	DIRECTORY_ENTRY_PTR dir_entry = STRUCT_ADDRESS_FROM_MEMBER( node, DIRECTORY_ENTRY, lru ) ;
-	RemoveNodeFromAvlTree( &fs_control.dir_entry_root, &dir_entry->name_tree, 0, compare_dir_entry_name);
-	kfree( dir_entry->name );
-	FreeBuffer( dir_entry, &dir_entry_cache);
+	assert( de != NULL );
+	SpinLock( &de->lock );
+	assert( de->reference_count > 0 );
+	de->reference_count--;
+	SpinUnlock( &de->lock );
+}
+
+/*! Marks all the negative directory entries and attributes cached by directory reads as stale
+	Should be called when the name space changes(mount/unmount) or the FS reports a change.
+*/
+void InvalidateNegativeDirectoryEntries()
+{
+	SpinLock( &fs_control.dir_entry_lru_lock );
+	fs_control.dir_entry_generation++;
+	SpinUnlock( &fs_control.dir_entry_lru_lock );
+}
+
+/*! Returns hash value for a path component
+	\param parent - parent directory entry
+	\param name - path component(need not be null terminated)
+	\param length - length of the component
+*/
+static UINT32 HashDirectoryEntryName(DIRECTORY_ENTRY_PTR parent, char * name, int length)
+{
+	/*hash of the name mixed with the parent address*/
+	return HashBuffer( name, length ) ^ ( ((UINT32)parent >> 4) * 2654435761UL );
+}
+
+/*! Searches a hash bucket for the given component - bucket lock should be held
+	\param bucket - hash bucket
+	\param parent - parent directory entry
+	\param name - path component
+	\param length - length of the component
+	\param hash - hash of the component
+*/
+static DIRECTORY_ENTRY_PTR SearchDirectoryEntryBucket(DIR_ENTRY_HASH_BUCKET_PTR bucket, DIRECTORY_ENTRY_PTR parent, char * name, int length, UINT32 hash)
+{
+	LIST_PTR node;
+
+	LIST_FOR_EACH(node, &bucket->head)
+	{
+		DIRECTORY_ENTRY_PTR de = STRUCT_ADDRESS_FROM_MEMBER( node, DIRECTORY_ENTRY, hash_list );
+		if ( de->name_hash == hash && de->parent == parent && memcmp(de->name, name, length) == 0 && de->name[length] == 0 )
+			return de;
+	}
+	return NULL;
+}
+
+/*! Returns the child directory entry for the given component, creating it if it is not cached
+	\param parent - parent directory entry - caller should hold a reference
+	\param name - path component
+	\param length - length of the component
+	\return referenced directory entry or NULL if no memory
+*/
+static DIRECTORY_ENTRY_PTR LookupDirectoryEntry(DIRECTORY_ENTRY_PTR parent, char * name, int length)
+{
+	DIRECTORY_ENTRY_PTR de, new_de;
+	DIR_ENTRY_HASH_BUCKET_PTR bucket;
+	UINT32 hash;
+
+	hash = HashDirectoryEntryName( parent, name, length );
+	bucket = DIR_ENTRY_HASH_BUCKET( hash );
+
+	SpinLock( &bucket->lock );
+	de = SearchDirectoryEntryBucket( bucket, parent, name, length, hash );
+	if ( de )
+		ReferenceDirectoryEntry( de );
+	SpinUnlock( &bucket->lock );
+	if ( de )
+	{
+		de->referenced = 1;
+		return de;
+	}
+
+	/*not cached - allocate without holding the bucket lock*/
+	new_de = AllocateDirectoryEntry( parent, name, length, hash );
+	if ( new_de == NULL )
+		return NULL;
+
+	SpinLock( &bucket->lock );
+	/*another thread might have added the same entry meanwhile*/
+	de = SearchDirectoryEntryBucket( bucket, parent, name, length, hash );
+	if ( de == NULL )
+	{
+		de = new_de;
+		new_de = NULL;
+		/*child holds a reference on the parent*/
+		ReferenceDirectoryEntry( parent );
+		AddToList( &bucket->head, &de->hash_list );
+	}
+	ReferenceDirectoryEntry( de );
+	SpinUnlock( &bucket->lock );
+
+	if ( new_de )
+	{
+		kfree( new_de->name );
+		DirEntryCacheDestructor( new_de );
+		FreeBuffer( new_de, &dir_entry_cache );
+	}
+	else
+	{
+		SpinLock( &fs_control.dir_entry_lru_lock );
+		AddToList( &fs_control.dir_entry_lru_list, &de->lru );
+		fs_control.dir_entry_count++;
+		SpinUnlock( &fs_control.dir_entry_lru_lock );
+	}
+	return de;
+}
+
+/*! Allocates and initializes a directory entry, evicting an unused entry if the cache is full
+	\param parent - parent directory entry
+	\param name - path component
+	\param length - length of the component
+	\param hash - hash of the component
+*/
+static DIRECTORY_ENTRY_PTR AllocateDirectoryEntry(DIRECTORY_ENTRY_PTR parent, char * name, int length, UINT32 hash)
+{
+	DIRECTORY_ENTRY_PTR de;
+
+	if ( fs_control.dir_entry_count >= fs_param.dir_entry.lru_maximum )
+		EvictDirectoryEntry();
+
+	de = AllocateBuffer( &dir_entry_cache, CACHE_ALLOC_SLEEP );
+	if ( de == NULL )
+		return NULL;
+	de->name = kmalloc( length + 1, 0 );
+	if ( de->name == NULL )
+	{
+		FreeBuffer( de, &dir_entry_cache );
+		return NULL;
+	}
+	memcpy( de->name, name, length );
+	de->name[length] = 0;
+	de->name_hash = hash;
+	de->parent = parent;
+
+	return de;
+}
+
+/*! Frees an unhashed directory entry and drops the references it holds*/
+static void FreeDirectoryEntry(DIRECTORY_ENTRY_PTR de)
+{
+	assert( de != NULL );
+	assert( de->reference_count == 0 );
+
+	if ( de->vnode )
+		ReleaseVnode( de->vnode );
+	if ( de->attributes )
+		kfree( de->attributes );
+	if ( de->parent )
+		ReleaseDirectoryEntry( de->parent );
+	kfree( de->name );
+	DirEntryCacheDestructor( de );
+	FreeBuffer( de, &dir_entry_cache );
+}
+
+/*! Evicts one unreferenced directory entry from the lru tail
+	Recently used entries get a second chance and busy entries(open path walks or cached children) are skipped.
+*/
+static void EvictDirectoryEntry()
+{
+	DIRECTORY_ENTRY_PTR de, victim = NULL;
+	DIR_ENTRY_HASH_BUCKET_PTR bucket;
+	int scan;
+
+	SpinLock( &fs_control.dir_entry_lru_lock );
+	for(scan=0; scan<DIR_ENTRY_EVICT_SCAN && !IsListEmpty(&fs_control.dir_entry_lru_list); scan++)
+	{
+		de = STRUCT_ADDRESS_FROM_MEMBER( fs_control.dir_entry_lru_list.prev, DIRECTORY_ENTRY, lru );
+		RemoveFromList( &de->lru );
+		if ( de->referenced )
+		{
+			de->referenced = 0;
+			AddToList( &fs_control.dir_entry_lru_list, &de->lru );
+			continue;
+		}
+
+		/*unhash only if nobody is using it - once unhashed no new reference can be taken*/
+		bucket = DIR_ENTRY_HASH_BUCKET( de->name_hash );
+		SpinLock( &bucket->lock );
+		SpinLock( &de->lock );
+		if ( de->reference_count == 0 )
+		{
+			RemoveFromList( &de->hash_list );
+			victim = de;
+		}
+		SpinUnlock( &de->lock );
+		SpinUnlock( &bucket->lock );
+		if ( victim )
+		{
+			fs_control.dir_entry_count--;
+			break;
+		}
+		AddToList( &fs_control.dir_entry_lru_list, &de->lru );
+	}
+	SpinUnlock( &fs_control.dir_entry_lru_lock );
+
+	if ( victim )
+		FreeDirectoryEntry( victim );
 }
 
 /*! Internal function used to initialize the DirEntry structure*/
@@ -95,10 +437,11 @@ int DirEntryCacheConstructor(void * buffer)
 {
 	DIRECTORY_ENTRY_PTR dir_entry = (DIRECTORY_ENTRY_PTR)buffer;
 	memset(buffer, 0, sizeof(DIRECTORY_ENTRY) );
-	
+
+	InitSpinLock( &dir_entry->lock );
 	InitList( &dir_entry->lru );
-	InitAvlTreeNode( &dir_entry->name_tree, 0 );
-	
+	InitList( &dir_entry->hash_list );
+
 	return 0;
 }
 /*! Internal function used to clear the DirEntry structure*/
@@ -107,39 +450,3 @@ int DirEntryCacheDestructor(void * buffer)
 	DirEntryCacheConstructor(buffer);
 	return 0;
 }
-/*! Internal function used to compare to two avl tree nodes(dir entry)*/
-COMPARISION_RESULT compare_dir_entry_name(struct binary_tree * node1, struct binary_tree * node2)
-{
-	char * s1, * s2;
-	int result;
-	
-	assert( node1 != NULL );
-	assert( node2 != NULL );
-	
-	s1 = STRUCT_ADDRESS_FROM_MEMBER(STRUCT_ADDRESS_FROM_MEMBER(node1, AVL_TREE, bintree), DIRECTORY_ENTRY, name_tree)->name;
-	s2 = STRUCT_ADDRESS_FROM_MEMBER(STRUCT_ADDRESS_FROM_MEMBER(node2, AVL_TREE, bintree), DIRECTORY_ENTRY, name_tree)->name;
-	
-	result = strcmp(s1, s2);
-	if( result == 0 )
-		return EQUAL;
-	else if ( result < 0 )
-		return LESS_THAN;
-	else	
-		return GREATER_THAN;
-}
-
-/*! Search directory entry tree and returns the corresponding directory entry if present
-	\param file_path - file path to search
-	\return directory_entry
-*/
-static DIRECTORY_ENTRY_PTR SearchDirectoryEntryTree(char * file_path)
-{
-	DIRECTORY_ENTRY search;
-	AVL_TREE_PTR result;
-	
-	search.name = file_path;
-	result = SearchAvlTree( fs_control.dir_entry_root, &search.name_tree , compare_dir_entry_name );
-	if ( result == NULL )
-		return NULL;
-	return STRUCT_ADDRESS_FROM_MEMBER(result, DIRECTORY_ENTRY, name_tree);
-}
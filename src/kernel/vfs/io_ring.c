@@ -0,0 +1,379 @@
+/*!
+    \file   kernel/vfs/io_ring.c
+    \brief  asynchronous file io through submission/completion rings shared with the task
+
+	The task fills submission entries and calls EnterIoRing() to hand them over. Each request is copied into the kernel
+	and queued to the ring's worker threads - kernel threads created in the task on demand, so they can touch the user
+	buffers and file table directly. A worker does the io through the same path as read/write/fsync(ubc or the file
+	system task, devfs turns it into a device IRP) and posts the result in the completion ring. The task reaps the
+	completions from the shared memory without a system call and enters the kernel only to submit or to wait.
+*/
+
+#include <ace.h>
+#include <string.h>
+#include <libc/sys/errno.h>
+#include <kernel/debug.h>
+#include <kernel/mm/vm.h>
+#include <kernel/mm/kmem.h>
+#include <kernel/mm/virtual_page.h>
+#include <kernel/pm/task.h>
+#include <kernel/pm/thread.h>
+#include <kernel/pm/scheduler.h>
+#include <kernel/vfs/vfs.h>
+#include <kernel/vfs/io_ring.h>
+
+static void IoRingWorker();
+static void SubmitIoRingEntry(IO_RING_PTR ring, IO_RING_SUBMISSION_ENTRY_PTR entry);
+static void ExecuteIoRingRequest(IO_RING_PTR ring, IO_RING_REQUEST_PTR request);
+static void PostIoRingCompletion(IO_RING_PTR ring, UINT32 user_data, int result);
+
+/*! Releases the pages of the shared ring memory
+	\param vps - pages of the ring
+	\param count - number of pages
+*/
+static void FreeIoRingPages(VIRTUAL_PAGE_PTR * vps, UINT32 count)
+{
+	UINT32 i;
+
+	for(i=0; i<count; i++)
+	{
+		assert( vps[i]->wire_count > 0 );
+		vps[i]->wire_count--;
+		FreeVirtualPages( vps[i], 1 );
+	}
+}
+
+/*! Creates the io ring of the given task and maps the ring memory into it
+	\param task - task, should be the current task
+	\param entries - number of submission entries - rounded up to power of 2
+	\param user_va - output - address of the ring memory(IO_RING_HEADER) in the task
+*/
+ERROR_CODE CreateIoRing(TASK_PTR task, UINT32 entries, VADDR * user_va)
+{
+	IO_RING_PTR ring;
+	IO_RING_HEADER_PTR header;
+	VIRTUAL_PAGE_PTR * vps;
+	VADDR kva, uva;
+	UINT32 i, count, completion_entries, completion_offset, size;
+	ERROR_CODE ret = ERROR_NOT_ENOUGH_MEMORY;
+
+	assert( task != NULL && user_va != NULL );
+	if ( entries == 0 || entries > IO_RING_MAX_ENTRIES )
+		return ERROR_INVALID_PARAMETER;
+	if ( task->io_ring != NULL )
+		return ERROR_BUSY;
+	for(i=1; i<entries; i<<=1);
+	entries = i;
+	completion_entries = entries * IO_RING_COMPLETION_FACTOR;
+	completion_offset = sizeof(IO_RING_HEADER) + entries * sizeof(IO_RING_SUBMISSION_ENTRY);
+	size = PAGE_ALIGN_UP( completion_offset + completion_entries * sizeof(IO_RING_COMPLETION_ENTRY) );
+	count = size / PAGE_SIZE;
+
+	ring = kmalloc( sizeof(IO_RING), 0 );
+	vps = kmalloc( count * sizeof(VIRTUAL_PAGE_PTR), 0 );
+	if ( ring == NULL || vps == NULL )
+		goto error;
+
+	/*the pages are wired so that page out daemon leaves them alone*/
+	for(i=0; i<count; i++)
+	{
+		vps[i] = AllocateVirtualPages( 1, VIRTUAL_PAGE_RANGE_TYPE_NORMAL );
+		if ( vps[i] == NULL )
+		{
+			FreeIoRingPages( vps, i );
+			goto error;
+		}
+		vps[i]->wire_count++;
+	}
+	/*the kernel mapping is used by the workers and stays valid even if the task unmaps its view*/
+	kva = MapVirtualPages( &kernel_map, vps, count, PROT_READ | PROT_WRITE );
+	if ( kva == NULL )
+	{
+		FreeIoRingPages( vps, count );
+		goto error;
+	}
+	uva = MapVirtualPages( task->virtual_map, vps, count, PROT_READ | PROT_WRITE );
+	if ( uva == NULL )
+	{
+		FreeVirtualMemory( &kernel_map, kva, size, 0 );
+		FreeIoRingPages( vps, count );
+		goto error;
+	}
+	memset( (void *)kva, 0, size );
+
+	header = (IO_RING_HEADER_PTR)kva;
+	header->submission_entries = entries;
+	header->completion_entries = completion_entries;
+	header->submission_offset = sizeof(IO_RING_HEADER);
+	header->completion_offset = completion_offset;
+
+	memset( ring, 0, sizeof(IO_RING) );
+	InitSpinLock( &ring->lock );
+	ring->task = task;
+	ring->header = header;
+	ring->submissions = (IO_RING_SUBMISSION_ENTRY_PTR)( kva + header->submission_offset );
+	ring->completions = (IO_RING_COMPLETION_ENTRY_PTR)( kva + completion_offset );
+	ring->user_va = uva;
+	ring->size = size;
+	ring->submission_mask = entries - 1;
+	ring->completion_mask = completion_entries - 1;
+	InitList( &ring->pending_list );
+	InitWaitQueue( &ring->worker_wait_queue );
+	InitWaitQueue( &ring->completion_wait_queue );
+
+	SpinLock( &task->lock );
+	if ( task->io_ring == NULL )
+	{
+		task->io_ring = ring;
+		ring = NULL;
+	}
+	SpinUnlock( &task->lock );
+	/*another thread of the task created the ring meanwhile*/
+	if ( ring != NULL )
+	{
+		FreeVirtualMemory( task->virtual_map, uva, size, 0 );
+		FreeVirtualMemory( &kernel_map, kva, size, 0 );
+		FreeIoRingPages( vps, count );
+		ret = ERROR_BUSY;
+		goto error;
+	}
+	kfree( vps );
+
+	*user_va = uva;
+	return ERROR_SUCCESS;
+
+error:
+	if ( vps != NULL )
+		kfree( vps );
+	if ( ring != NULL )
+		kfree( ring );
+	return ret;
+}
+
+/*! Submits the queued submission entries and optionally waits for completions
+	\param task - task, should be the current task
+	\param to_submit - maximum number of submission entries to take
+	\param min_complete - wait until these many completions are available to reap
+	\param submitted - output - number of submission entries taken
+*/
+ERROR_CODE EnterIoRing(TASK_PTR task, UINT32 to_submit, UINT32 min_complete, UINT32 * submitted)
+{
+	IO_RING_PTR ring;
+	IO_RING_SUBMISSION_ENTRY entry;
+	WAIT_EVENT wait_event;
+	UINT32 head;
+
+	assert( task != NULL && submitted != NULL );
+	*submitted = 0;
+	ring = task->io_ring;
+	if ( ring == NULL )
+		return ERROR_INVALID_PARAMETER;
+
+	while( *submitted < to_submit )
+	{
+		SpinLock( &ring->lock );
+		head = ring->submission_head;
+		/*stop when the submission ring is empty or when the completion ring can not take the result*/
+		if ( head == ring->header->submission_tail ||
+			ring->completion_tail - ring->header->completion_head + ring->in_flight > ring->completion_mask )
+		{
+			SpinUnlock( &ring->lock );
+			break;
+		}
+		/*read the entry only after the tail which published it*/
+		MemoryBarrier();
+		entry = ring->submissions[ head & ring->submission_mask ];
+		ring->submission_head = head + 1;
+		ring->header->submission_head = ring->submission_head;
+		ring->in_flight++;
+		SpinUnlock( &ring->lock );
+
+		(*submitted)++;
+		SubmitIoRingEntry( ring, &entry );
+	}
+
+	/*wait until enough completions are available or nothing more is coming*/
+	while( min_complete > 0 )
+	{
+		if ( ring->completion_tail - ring->header->completion_head >= min_complete || ring->in_flight == 0 )
+			break;
+		InitWaitEventOnStack( &wait_event );
+		AddWaitEventToQueue( &ring->completion_wait_queue, &wait_event );
+		/*a request might have completed before the event was queued*/
+		MemoryBarrier();
+		if ( ring->completion_tail - ring->header->completion_head >= min_complete || ring->in_flight == 0 )
+			RemoveWaitEvent( &wait_event );
+		else
+			WaitForWaitEvent( &wait_event, 0 );
+	}
+
+	return ERROR_SUCCESS;
+}
+
+/*! Queues a submission entry to the workers - creates a worker if all of them are busy
+	\param ring - io ring
+	\param entry - copy of the submission entry
+*/
+static void SubmitIoRingEntry(IO_RING_PTR ring, IO_RING_SUBMISSION_ENTRY_PTR entry)
+{
+	IO_RING_REQUEST_PTR request;
+	BYTE create_worker, run_inline = FALSE;
+
+	switch( entry->opcode )
+	{
+		case IO_RING_OPCODE_NOP:
+			PostIoRingCompletion( ring, entry->user_data, 0 );
+			return;
+		case IO_RING_OPCODE_READ:
+		case IO_RING_OPCODE_WRITE:
+		case IO_RING_OPCODE_FSYNC:
+			break;
+		default:
+			PostIoRingCompletion( ring, entry->user_data, -EINVAL );
+			return;
+	}
+
+	request = kmalloc( sizeof(IO_RING_REQUEST), 0 );
+	if ( request == NULL )
+	{
+		PostIoRingCompletion( ring, entry->user_data, -ENOMEM );
+		return;
+	}
+	InitList( &request->list );
+	request->entry = *entry;
+
+	SpinLock( &ring->lock );
+	AddToListTail( &ring->pending_list, &request->list );
+	ring->pending_count++;
+	create_worker = ring->pending_count > ring->idle_workers && ring->worker_count < IO_RING_MAX_WORKERS;
+	if ( create_worker )
+		ring->worker_count++;
+	SpinUnlock( &ring->lock );
+
+	if ( create_worker && CreateThread( ring->task, IoRingWorker, SCHED_CLASS_MID, TRUE, NULL ) == NULL )
+	{
+		SpinLock( &ring->lock );
+		ring->worker_count--;
+		/*without any worker nobody would pick the request - do it here*/
+		if ( ring->worker_count == 0 )
+		{
+			RemoveFromList( &request->list );
+			ring->pending_count--;
+			run_inline = TRUE;
+		}
+		SpinUnlock( &ring->lock );
+		if ( run_inline )
+		{
+			ExecuteIoRingRequest( ring, request );
+			return;
+		}
+	}
+
+	MemoryBarrier();
+	if ( !IS_WAIT_QUEUE_EMPTY( &ring->worker_wait_queue ) )
+		WakeUpWaitQueue( &ring->worker_wait_queue, 0 );
+}
+
+/*! Does the io of a request and posts its completion
+	\param ring - io ring
+	\param request - request taken from the pending list - freed here
+*/
+static void ExecuteIoRingRequest(IO_RING_PTR ring, IO_RING_REQUEST_PTR request)
+{
+	IO_RING_SUBMISSION_ENTRY_PTR entry = &request->entry;
+	UINT32 count = 0;
+	ERROR_CODE err;
+	int result;
+
+	if ( entry->opcode == IO_RING_OPCODE_FSYNC )
+		err = SyncFile( ring->task, entry->file_id );
+	else
+		err = ReadWriteFileAt( entry->file_id, entry->offset, entry->length, entry->buffer, entry->opcode == IO_RING_OPCODE_WRITE, &count );
+
+	switch( err )
+	{
+		case ERROR_SUCCESS:
+			result = count;
+			break;
+		case ERROR_INVALID_PARAMETER:
+			result = -EBADF;
+			break;
+		case ERROR_NOT_SUPPORTED:
+			result = -EROFS;
+			break;
+		case ERROR_NOT_ENOUGH_MEMORY:
+			result = -ENOMEM;
+			break;
+		default:
+			result = -EIO;
+	}
+	PostIoRingCompletion( ring, entry->user_data, result );
+	kfree( request );
+}
+
+/*! Adds a completion entry to the ring and wakes up the threads waiting for it
+	\param ring - io ring
+	\param user_data - user_data of the submission entry
+	\param result - result of the request
+*/
+static void PostIoRingCompletion(IO_RING_PTR ring, UINT32 user_data, int result)
+{
+	IO_RING_COMPLETION_ENTRY_PTR completion;
+
+	SpinLock( &ring->lock );
+	completion = &ring->completions[ ring->completion_tail & ring->completion_mask ];
+	completion->user_data = user_data;
+	completion->result = result;
+	/*the entry should be visible before the task sees the new tail*/
+	MemoryBarrier();
+	ring->completion_tail++;
+	ring->header->completion_tail = ring->completion_tail;
+	assert( ring->in_flight > 0 );
+	ring->in_flight--;
+	SpinUnlock( &ring->lock );
+
+	MemoryBarrier();
+	if ( !IS_WAIT_QUEUE_EMPTY( &ring->completion_wait_queue ) )
+		WakeUpWaitQueue( &ring->completion_wait_queue, WAIT_EVENT_WAKE_UP_ALL );
+}
+
+/*! Worker thread of an io ring
+	Runs as a kernel thread of the ring's task and serves the pending requests one by one.
+*/
+static void IoRingWorker()
+{
+	IO_RING_PTR ring = GetCurrentTask()->io_ring;
+	IO_RING_REQUEST_PTR request;
+	WAIT_EVENT wait_event;
+
+	assert( ring != NULL );
+	while( 1 )
+	{
+		SpinLock( &ring->lock );
+		if ( !IsListEmpty( &ring->pending_list ) )
+		{
+			request = STRUCT_ADDRESS_FROM_MEMBER( ring->pending_list.next, IO_RING_REQUEST, list );
+			RemoveFromList( &request->list );
+			ring->pending_count--;
+			SpinUnlock( &ring->lock );
+
+			ExecuteIoRingRequest( ring, request );
+			continue;
+		}
+		ring->idle_workers++;
+		SpinUnlock( &ring->lock );
+
+		InitWaitEventOnStack( &wait_event );
+		AddWaitEventToQueue( &ring->worker_wait_queue, &wait_event );
+		/*a request might have been queued before the event was queued*/
+		MemoryBarrier();
+		if ( !IsListEmpty( &ring->pending_list ) )
+			RemoveWaitEvent( &wait_event );
+		else
+			WaitForWaitEvent( &wait_event, 0 );
+
+		SpinLock( &ring->lock );
+		ring->idle_workers--;
+		SpinUnlock( &ring->lock );
+	}
+}
@@ -7,57 +7,156 @@
 #include <string.h>
 #include <ds/bits.h>
 #include <ds/lrulist.h>
+#include <ds/radix_tree.h>
 #include <sync/spinlock.h>
 #include <kernel/debug.h>
 #include <kernel/mm/vm.h>
 #include <kernel/mm/virtual_page.h>
 #include <kernel/vfs/vfs.h>
 #include <kernel/mm/kmem.h>
+#include <kernel/mm/page_out.h>
+#include <kernel/mm/pmem.h>
 #include <kernel/pm/task.h>
+#include <kernel/pm/thread.h>
+#include <kernel/pm/scheduler.h>
+#include <kernel/wait_event.h>
 
-static COMPARISION_RESULT ubc_page_compare(BINARY_TREE_PTR node1, BINARY_TREE_PTR node2);
+/*! number of pages collected in one pass while releasing vnode pages*/
+#define UBC_RELEASE_BATCH			16
+
+/*! percentage of total memory pages which can be modified before the flusher is woken up*/
+UINT32 ubc_dirty_background_ratio = 10;
+/*! percentage of total memory pages which can be modified before the writers are throttled*/
+UINT32 ubc_dirty_ratio = 40;
+/*! how often the flusher writes back modified pages(in milliseconds)*/
+UINT32 ubc_flush_interval = 5000;
+/*! maximum pages written back in single file system request*/
+UINT32 ubc_flush_max_pages = 16;
+
+/*! total modified ubc pages in the system*/
+UINT32 ubc_dirty_pages = 0;
+UBC_STATISTICS ubc_statistics;
+
+/*! protects ubc_dirty_pages and throttle wait queue*/
+static SPIN_LOCK ubc_dirty_lock;
+/*! writers wait here when there are too many modified pages*/
+static WAIT_QUEUE ubc_throttle_wait_queue;
+
+/*! mounts waiting for their newly created flusher thread to pick them up*/
+static LIST flusher_start_list;
+static SPIN_LOCK flusher_start_lock;
+
+static RADIX_TREE_NODE_PTR AllocateUbcTreeNode();
+static void FreeUbcTreeNode(RADIX_TREE_NODE_PTR node);
+static VIRTUAL_PAGE_PTR GetVnodePageCore(VNODE_PTR vnode, VADDR offset, BOOLEAN fill, BOOLEAN pin);
+static void StartMountFlusher(MOUNTED_FILE_SYSTEM_PTR mount);
+static void WakeUpMountFlusher(MOUNTED_FILE_SYSTEM_PTR mount);
+static void UbcFlusher();
+static void ThrottleUbcWriter(VNODE_PTR vnode);
+static void UbcPagesCleaned(UINT32 count);
+
+/*! returns the number of modified pages allowed for the given ratio*/
+#define UBC_DIRTY_LIMIT(ratio)		( (vm_data.total_memory_pages / 100) * (ratio) )
+
+/*! Initializes the ubc write back data structures*/
+void InitUbc()
+{
+	InitSpinLock( &ubc_dirty_lock );
+	InitWaitQueue( &ubc_throttle_wait_queue );
+	InitSpinLock( &flusher_start_lock );
+	InitList( &flusher_start_list );
+	memset( &ubc_statistics, 0, sizeof(ubc_statistics) );
+}
+
+/*! Initializes the page tree of a vnode
+	\param vnode - vnode to initialize
+*/
+void InitVnodePageTree(VNODE_PTR vnode)
+{
+	InitRadixTree( &vnode->page_tree, AllocateUbcTreeNode, FreeUbcTreeNode );
+}
 
 /*! Returns virtual page corresponds to a vnode at file offset*/
 VIRTUAL_PAGE_PTR GetVnodePage(VNODE_PTR vnode, VADDR offset)
 {
-	VIRTUAL_PAGE_PTR vp = NULL;
+	return GetVnodePageCore( vnode, offset, TRUE, FALSE );
+}
+
+/*! Returns virtual page corresponds to a vnode at file offset with a pin on it
+	The pin keeps the page in the vnode until the caller records its mapping, release it by PutVnodePages()
+*/
+VIRTUAL_PAGE_PTR PinVnodePage(VNODE_PTR vnode, VADDR offset)
+{
+	return GetVnodePageCore( vnode, offset, TRUE, TRUE );
+}
+
+/*! Returns virtual page corresponds to a vnode at file offset, creating it if required
+	\param vnode - vnode of the file
+	\param offset - file offset
+	\param fill - if TRUE a new page is filled from the file else it is zeroed
+	\param pin - if TRUE the page is pinned and should be released by PutVnodePages()
+*/
+static VIRTUAL_PAGE_PTR GetVnodePageCore(VNODE_PTR vnode, VADDR offset, BOOLEAN fill, BOOLEAN pin)
+{
+	VIRTUAL_PAGE_PTR vp, existing;
+	ERROR_CODE ret;
+	void * va;
+	int result;
+	
 	offset = PAGE_ALIGN(offset);
 	/*search the tree for page with same offset*/
-	if ( vnode->page_tree_head != NULL )
+	SpinLock( &vnode->lock );
+	vp = LookupRadixTreeItem( &vnode->page_tree, UBC_PAGE_INDEX(offset) );
+	if ( vp != NULL && pin )
+		vp->wire_count++;
+	SpinUnlock( &vnode->lock );
+	if ( vp != NULL )
+		return vp;
+	
+	/*we dont have page already, allocate one and do the fs IO to fill the content*/
+	vp = AllocateVirtualPages(1, VIRTUAL_PAGE_RANGE_TYPE_NORMAL);
+	/*ask page out daemon to free some pages and try again*/
+	if ( vp == NULL && WaitForFreeVirtualPages(PAGE_OUT_WAIT_TIME) == ERROR_SUCCESS )
+		vp = AllocateVirtualPages(1, VIRTUAL_PAGE_RANGE_TYPE_NORMAL);
+	if ( vp == NULL )
+		return NULL;
+	vp->ubc = 1;
+	vp->ubc_info.vnode = vnode;
+	vp->ubc_info.offset = offset;
+	vp->ubc_info.loaded = 0;
+	vp->ubc_info.modified = 0;
+	
+	if ( fill )
+		ret = FillUbcPage(vnode, offset, vp);
+	else
 	{
-		VIRTUAL_PAGE search_key;
-		AVL_TREE_PTR result;
-		search_key.ubc_info.offset = offset;
-		result = SearchAvlTree( vnode->page_tree_head, &search_key.ubc_info.tree, ubc_page_compare);
-		if ( result )
-			vp = STRUCT_ADDRESS_FROM_MEMBER(result, VIRTUAL_PAGE, ubc_info.tree);
+		/*page is going to be overwritten or it is beyond end of file*/
+		va = MapPhysicalPageWindow( vp->physical_address );
+		memset( va, 0, PAGE_SIZE );
+		UnmapPhysicalPageWindow();
+		ret = ERROR_SUCCESS;
 	}
-	/*if we dont have page already, allocate one and do the fs IO to fill the content*/
-	if ( vp == NULL )
+	if( ret != ERROR_SUCCESS )
 	{
-		vp = AllocateVirtualPages(1, VIRTUAL_PAGE_RANGE_TYPE_NORMAL);
-		InitAvlTreeNode( &vp->ubc_info.tree, FALSE );
-		vp->ubc = 1;
-		vp->ubc_info.vnode = vnode;
-		vp->ubc_info.offset = offset;
-		vp->ubc_info.loaded = 0;
-		vp->ubc_info.modified = 0;
+		FreeVirtualPages(vp, 1);
+		return NULL;
 	}
-	assert(vp != NULL);
-	/*if the page is not yet filled with fs data, do it now*/
-	if( !vp->ubc_info.loaded )
+	
+	/*insert the page; if someone else loaded the same page meanwhile use that one*/
+	SpinLock( &vnode->lock );
+	result = InsertRadixTreeItem( &vnode->page_tree, UBC_PAGE_INDEX(offset), vp );
+	existing = result == 1 ? LookupRadixTreeItem( &vnode->page_tree, UBC_PAGE_INDEX(offset) ) : NULL;
+	if ( result == 0 )
 	{
-		ERROR_CODE ret;
-		ret = FillUbcPage(vnode, offset, vp);
-		if( ret != ERROR_SUCCESS )
-		{
-			FreeVirtualPages(vp, 1);
-			return NULL;
-		}
-		InsertNodeIntoAvlTree(&vnode->page_tree_head, &vp->ubc_info.tree, FALSE, ubc_page_compare);
 		vp->ubc_info.loaded = 1;
+		existing = vp;
 	}
-	return vp;
+	if ( existing != NULL && pin )
+		existing->wire_count++;
+	SpinUnlock( &vnode->lock );
+	if ( result != 0 )
+		FreeVirtualPages(vp, 1);
+	return existing;
 }
 
 /*! Fills a virtual page with content from file by doing a FS IO
@@ -67,59 +166,688 @@ VIRTUAL_PAGE_PTR GetVnodePage(VNODE_PTR vnode, VADDR offset)
 */
 ERROR_CODE FillUbcPage(VNODE_PTR vnode, VADDR offset, VIRTUAL_PAGE_PTR vp)
 {
+	assert( vp->ubc_info.vnode != NULL );
+	return TransferVnodePage(vnode, offset, vp->physical_address, FALSE);
+}
+
+/*! Writes a modified ubc page to the file by doing a FS IO
+	\param vnode - vnode of the file
+	\param offset - offset from starting of the file
+	\param vp - virtual page which contents should be written
+*/
+ERROR_CODE WriteUbcPage(VNODE_PTR vnode, VADDR offset, VIRTUAL_PAGE_PTR vp)
+{
+	assert( vp->ubc && vp->ubc_info.vnode == vnode && vp->ubc_info.offset == offset );
+	return WriteVnodePages( vnode, &vp, 1 );
+}
+
+/*! Writes a run of ubc pages at consecutive file offsets to the file in single FS request
+	\param vnode - vnode of the file
+	\param vps - pages to write, vps[i] should be at file offset vps[0]->ubc_info.offset + i*PAGE_SIZE
+	\param count - number of pages
+	
+	The pages are marked clean before the IO; if the page is modified during the IO the dirty bit is set again and it will be written in the next pass.
+	On failure the pages are marked modified again.
+*/
+ERROR_CODE WriteVnodePages(VNODE_PTR vnode, VIRTUAL_PAGE_PTR * vps, UINT32 count)
+{
+	MOUNTED_FILE_SYSTEM_PTR mount = vnode->mounted_fs;
 	FILE_SYSTEM_PTR fs;
 	VFS_RETURN_CODE fs_result;
+	VADDR offset, va;
+	UINT32 i, length, cleaned = 0;
+	ERROR_CODE ret;
+
+	assert( mount != NULL );
+	assert( count > 0 && count <= UBC_FLUSH_BATCH_MAX );
+	fs = mount->file_system;
+	offset = vps[0]->ubc_info.offset;
+	
+	for(i=0; i<count; i++)
+	{
+		assert( vps[i]->ubc && vps[i]->ubc_info.vnode == vnode && vps[i]->ubc_info.offset == offset + (i * PAGE_SIZE) );
+		GetVirtualPageMappingStatus( vps[i], PAGE_STATUS_DIRTY );
+		SpinLock( &vnode->lock );
+		if ( vps[i]->ubc_info.modified )
+		{
+			vps[i]->ubc_info.modified = 0;
+			ClearRadixTreeTag( &vnode->page_tree, UBC_PAGE_INDEX(vps[i]->ubc_info.offset), UBC_TAG_DIRTY );
+			vnode->dirty_pages--;
+			cleaned++;
+		}
+		SetRadixTreeTag( &vnode->page_tree, UBC_PAGE_INDEX(vps[i]->ubc_info.offset), UBC_TAG_WRITEBACK );
+		SpinUnlock( &vnode->lock );
+	}
+	UbcPagesCleaned( cleaned );
+	
+	/*dont extend the file with the unused part of the last page*/
+	length = count * PAGE_SIZE;
+	if ( offset + length > vnode->file_size )
+		length = vnode->file_size > offset ? vnode->file_size - offset : 0;
+	
+	ret = ERROR_SUCCESS;
+	if ( length > 0 )
+	{
+		/*hand over the whole run to the file system as a single buffer in its address space*/
+		va = MapVirtualPages( fs->task->virtual_map, vps, count, PROT_READ );
+		if ( va == NULL )
+			ret = ERROR_NOT_ENOUGH_MEMORY;
+		else
+		{
+			ret = CallMessage(fs->task, fs->message_queue, MESSAGE_TYPE_VALUE, (IPC_ARG_TYPE)VFS_IPC_WRITE_FILE, (IPC_ARG_TYPE)vnode->fs_data, (IPC_ARG_TYPE)vnode->inode_number, (IPC_ARG_TYPE)offset, (IPC_ARG_TYPE)va, (IPC_ARG_TYPE)length, 
+				MESSAGE_TYPE_VALUE, &fs_result, NULL, NULL, NULL, NULL, NULL, VFS_TIME_OUT);
+			if ( ret == ERROR_SUCCESS && fs_result != VFS_RETURN_CODE_SUCCESS )
+				ret = ERROR_IO_DEVICE;
+			FreeVirtualMemory( fs->task->virtual_map, va, count * PAGE_SIZE, 0 );
+		}
+		ubc_statistics.write_requests++;
+	}
+	
+	for(i=0; i<count; i++)
+	{
+		ClearVnodePageTag( vnode, vps[i], UBC_TAG_WRITEBACK );
+		if ( ret != ERROR_SUCCESS )
+			MarkVnodePageDirty( vnode, vps[i] );
+	}
+	if ( ret == ERROR_SUCCESS )
+	{
+		ubc_statistics.pages_written += count;
+		/*the file system updated the modified time - the size is kept by the ubc while pages are dirty*/
+		InvalidateVnodeAttributes( vnode );
+	}
+	else
+		ubc_statistics.write_failures++;
+	
+	return ret;
+}
+
+/*! Transfers a page between a file and physical memory by doing a FS IO
+	\param vnode - vnode of the file
+	\param offset - offset from starting of the file
+	\param physical_address - physical address of the page
+	\param write - if TRUE the page is written to the file else the page is filled from the file
+*/
+ERROR_CODE TransferVnodePage(VNODE_PTR vnode, VADDR offset, UINT32 physical_address, BOOLEAN write)
+{
+	FILE_SYSTEM_PTR fs;
+	VFS_RETURN_CODE fs_result;
+	MESSAGE_PRIORITY priority;
 	ERROR_CODE err;
-	assert( vp->ubc_info.vnode != NULL );
+	assert( vnode->mounted_fs != NULL );
 	fs = vnode->mounted_fs->file_system;
-	SendMessageCore(fs->task, fs->message_queue, MESSAGE_TYPE_SHARE_PA, (IPC_ARG_TYPE)VFS_IPC_MAP_FILE_PAGE, vnode->mounted_fs->fs_data, (IPC_ARG_TYPE)vnode->inode_number, (IPC_ARG_TYPE)offset, (IPC_ARG_TYPE)vp->physical_address, (IPC_ARG_TYPE)PAGE_SIZE, VFS_TIME_OUT);
-	err = WaitForReply(MESSAGE_TYPE_VALUE, &fs_result, NULL, NULL, NULL, NULL, NULL, VFS_TIME_OUT);
+	/*page faults should not wait behind the bulk IO queued to the file system*/
+	priority = SetMessagePriority( MESSAGE_PRIORITY_URGENT );
+	err = CallMessage(fs->task, fs->message_queue, MESSAGE_TYPE_SHARE_PA, (IPC_ARG_TYPE)(write ? VFS_IPC_WRITE_FILE : VFS_IPC_MAP_FILE_PAGE), vnode->mounted_fs->fs_data, (IPC_ARG_TYPE)vnode->inode_number, (IPC_ARG_TYPE)offset, (IPC_ARG_TYPE)physical_address, (IPC_ARG_TYPE)PAGE_SIZE, 
+		MESSAGE_TYPE_VALUE, &fs_result, NULL, NULL, NULL, NULL, NULL, VFS_TIME_OUT);
+	SetMessagePriority( priority );
 	if ( err != ERROR_SUCCESS || fs_result != VFS_RETURN_CODE_SUCCESS)
 		return ERROR_IO_DEVICE;
 	return err;
 }
 
+/*! Removes a ubc page from the vnode so that it can be freed
+	\param vnode - vnode of the page
+	\param vp - virtual page to remove
+	\return ERROR_BUSY if the page is pinned, modified or mapped
+*/
+ERROR_CODE RemoveVnodePage(VNODE_PTR vnode, VIRTUAL_PAGE_PTR vp)
+{
+	ERROR_CODE ret = ERROR_SUCCESS;
+	assert( vp->ubc && vp->ubc_info.vnode == vnode );
+	SpinLock( &vnode->lock );
+	/*a fault records the mapping before dropping its pin, so a mapping made through the vnode is seen here*/
+	if ( vp->wire_count || vp->ubc_info.modified || vp->va_map_list != NULL )
+		ret = ERROR_BUSY;
+	else if ( vp->ubc_info.loaded )
+	{
+		RemoveRadixTreeItem( &vnode->page_tree, UBC_PAGE_INDEX(vp->ubc_info.offset) );
+		vp->ubc_info.loaded = 0;
+	}
+	SpinUnlock( &vnode->lock );
+	return ret;
+}
+
 /*! Releases all page related to vnode
 	\param vnode - vnode for which pages has to be released
+	\return ERROR_BUSY if the vnode is referenced again by the flusher, the flusher will release it
 */
 ERROR_CODE ReleaseVnodePages(VNODE_PTR vnode)
 {
+	VIRTUAL_PAGE_PTR vps[UBC_RELEASE_BATCH];
+	UINT32 i, count;
+	
 	assert( vnode->reference_count == 0 );
 	
-	/*if vnode doesnt hae any page return success*/
-	if( vnode->page_tree_head == NULL)
-		return ERROR_SUCCESS;
+	/*write back the modified pages before dropping them*/
+	if ( vnode->mounted_fs != NULL )
+	{
+		SyncVnodePages( vnode );
+		SpinLock( &vnode->mounted_fs->flush_lock );
+		RemoveFromList( &vnode->dirty_list );
+		SpinUnlock( &vnode->mounted_fs->flush_lock );
+		if ( vnode->reference_count > 0 )
+			return ERROR_BUSY;
+	}
+	/*pages which could not be written are lost*/
+	if ( vnode->dirty_pages )
+	{
+		KTRACE("%d modified pages of inode %d are lost\n", vnode->dirty_pages, vnode->inode_number);
+		UbcPagesCleaned( vnode->dirty_pages );
+		vnode->dirty_pages = 0;
+	}
+	
+	/*remove all the pages, a batch at a time*/
+	do
+	{
+		count = GangLookupRadixTree( &vnode->page_tree, 0, (void **)vps, NULL, UBC_RELEASE_BATCH, RADIX_TREE_TAG_ANY );
+		for(i=0; i<count; i++)
+		{
+			RemoveRadixTreeItem( &vnode->page_tree, UBC_PAGE_INDEX(vps[i]->ubc_info.offset) );
+			/*page is still shared with readers - hand it over to them*/
+			SpinLock( &vps[i]->lock );
+			if ( vps[i]->copy_on_write )
+			{
+				vps[i]->ubc = 0;
+				vps[i]->copy_on_write--;
+				SpinUnlock( &vps[i]->lock );
+				continue;
+			}
+			SpinUnlock( &vps[i]->lock );
+			FreeVirtualPages(vps[i], 1);
+		}
+	}while( count > 0 );
+	
+	return ERROR_SUCCESS;
+}
 
-	/*remove all the pages*/
-	while( vnode->page_tree_head != NULL )
+/*! Collects cached pages of a vnode starting from the given offset in file order
+	\param vnode - vnode of the file
+	\param offset - file offset to start the search
+	\param vps - output - array of virtual pages found
+	\param count - size of the vps array
+	\param tag - return only pages with this tag(UBC_TAG_*) or RADIX_TREE_TAG_ANY
+	\return number of pages found
+	\note The pages are pinned and should be released by calling PutVnodePages()
+*/
+UINT32 FindVnodePages(VNODE_PTR vnode, VADDR offset, VIRTUAL_PAGE_PTR * vps, UINT32 count, int tag)
+{
+	UINT32 found, i;
+	SpinLock( &vnode->lock );
+	found = GangLookupRadixTree( &vnode->page_tree, UBC_PAGE_INDEX(offset), (void **)vps, NULL, count, tag );
+	for(i=0; i<found; i++)
+		vps[i]->wire_count++;
+	SpinUnlock( &vnode->lock );
+	return found;
+}
+
+/*! Collects a run of cached pages at consecutive file offsets starting from the given offset
+	This is used by read ahead and write back to process a range in single pass.
+	\param vnode - vnode of the file
+	\param offset - file offset of the first page
+	\param vps - output - vps[i] is the page at offset + i*PAGE_SIZE
+	\param count - size of the vps array
+	\param tag - return only pages with this tag(UBC_TAG_*) or RADIX_TREE_TAG_ANY
+	\return number of pages in the run
+	\note The pages are pinned and should be released by calling PutVnodePages()
+*/
+UINT32 FindContiguousVnodePages(VNODE_PTR vnode, VADDR offset, VIRTUAL_PAGE_PTR * vps, UINT32 count, int tag)
+{
+	UINT32 found, i;
+	SpinLock( &vnode->lock );
+	found = GangLookupRadixTreeContiguous( &vnode->page_tree, UBC_PAGE_INDEX(offset), (void **)vps, count, tag );
+	for(i=0; i<found; i++)
+		vps[i]->wire_count++;
+	SpinUnlock( &vnode->lock );
+	return found;
+}
+
+/*! Releases the pin taken on ubc pages by FindVnodePages()/FindContiguousVnodePages()
+	\param vps - array of virtual pages
+	\param count - number of pages in the array
+*/
+void PutVnodePages(VIRTUAL_PAGE_PTR * vps, UINT32 count)
+{
+	UINT32 i;
+	for(i=0; i<count; i++)
 	{
-		AVL_TREE_PTR node = vnode->page_tree_head;
-		VIRTUAL_PAGE_PTR vp = STRUCT_ADDRESS_FROM_MEMBER(node, VIRTUAL_PAGE, ubc_info.tree);
+		VNODE_PTR vnode = vps[i]->ubc_info.vnode;
+		SpinLock( &vnode->lock );
+		assert( vps[i]->wire_count > 0 );
+		vps[i]->wire_count--;
+		SpinUnlock( &vnode->lock );
+	}
+}
+
+/*! Sets a tag on a ubc page in the vnode page tree
+	\param vnode - vnode of the page
+	\param vp - virtual page
+	\param tag - UBC_TAG_*
+*/
+void SetVnodePageTag(VNODE_PTR vnode, VIRTUAL_PAGE_PTR vp, int tag)
+{
+	assert( vp->ubc && vp->ubc_info.vnode == vnode );
+	SpinLock( &vnode->lock );
+	SetRadixTreeTag( &vnode->page_tree, UBC_PAGE_INDEX(vp->ubc_info.offset), tag );
+	SpinUnlock( &vnode->lock );
+}
+
+/*! Clears a tag on a ubc page in the vnode page tree
+	\param vnode - vnode of the page
+	\param vp - virtual page
+	\param tag - UBC_TAG_*
+*/
+void ClearVnodePageTag(VNODE_PTR vnode, VIRTUAL_PAGE_PTR vp, int tag)
+{
+	assert( vp->ubc && vp->ubc_info.vnode == vnode );
+	SpinLock( &vnode->lock );
+	ClearRadixTreeTag( &vnode->page_tree, UBC_PAGE_INDEX(vp->ubc_info.offset), tag );
+	SpinUnlock( &vnode->lock );
+}
+
+/*! Marks a ubc page as modified so that it will be written back to the file
+	\param vnode - vnode of the page
+	\param vp - virtual page
+*/
+void MarkVnodePageDirty(VNODE_PTR vnode, VIRTUAL_PAGE_PTR vp)
+{
+	MOUNTED_FILE_SYSTEM_PTR mount = vnode->mounted_fs;
+	BOOLEAN first_dirty_page;
+	UINT32 dirty_pages;
+	
+	assert( vp->ubc && vp->ubc_info.vnode == vnode );
+	/*nothing can be written back on a read only mount*/
+	if ( mount == NULL || mount->read_only )
+		return;
+	
+	SpinLock( &vnode->lock );
+	if ( vp->ubc_info.modified || !vp->ubc_info.loaded )
+	{
+		SpinUnlock( &vnode->lock );
+		return;
+	}
+	vp->ubc_info.modified = 1;
+	SetRadixTreeTag( &vnode->page_tree, UBC_PAGE_INDEX(vp->ubc_info.offset), UBC_TAG_DIRTY );
+	first_dirty_page = ( vnode->dirty_pages++ == 0 );
+	SpinUnlock( &vnode->lock );
+	
+	SpinLock( &ubc_dirty_lock );
+	dirty_pages = ++ubc_dirty_pages;
+	ubc_statistics.pages_dirtied++;
+	SpinUnlock( &ubc_dirty_lock );
+	
+	/*let the flusher know about the vnode*/
+	if ( first_dirty_page )
+	{
+		SpinLock( &mount->flush_lock );
+		if ( IsListEmpty( &vnode->dirty_list ) )
+			AddToListTail( &mount->dirty_vnode_list, &vnode->dirty_list );
+		SpinUnlock( &mount->flush_lock );
+	}
+	if ( !mount->flusher_started )
+		StartMountFlusher( mount );
+	else if ( dirty_pages > UBC_DIRTY_LIMIT(ubc_dirty_background_ratio) )
+		WakeUpMountFlusher( mount );
+}
+
+/*! Writes back all the modified pages of a vnode, contiguous pages are written in single request
+	\param vnode - vnode to flush
+	\return ERROR_SUCCESS if all the modified pages are written
+*/
+ERROR_CODE FlushVnodePages(VNODE_PTR vnode)
+{
+	VIRTUAL_PAGE_PTR vps[UBC_FLUSH_BATCH_MAX];
+	MOUNTED_FILE_SYSTEM_PTR mount = vnode->mounted_fs;
+	UINT32 count, max_pages;
+	VADDR offset = 0;
+	ERROR_CODE ret = ERROR_SUCCESS;
+	
+	max_pages = ubc_flush_max_pages;
+	if ( max_pages == 0 || max_pages > UBC_FLUSH_BATCH_MAX )
+		max_pages = UBC_FLUSH_BATCH_MAX;
+	
+	while ( ret == ERROR_SUCCESS )
+	{
+		/*find the next modified page and then the modified pages following it*/
+		if ( FindVnodePages( vnode, offset, vps, 1, UBC_TAG_DIRTY ) == 0 )
+			break;
+		offset = vps[0]->ubc_info.offset;
+		PutVnodePages( vps, 1 );
+		count = FindContiguousVnodePages( vnode, offset, vps, max_pages, UBC_TAG_DIRTY );
+		if ( count == 0 )
+			continue;
 		
-		RemoveNodeFromAvlTree(  &vnode->page_tree_head, node, 0, ubc_page_compare);
+		ret = WriteVnodePages( vnode, vps, count );
+		PutVnodePages( vps, count );
 		
-		FreeVirtualPages(vp, 1);
+		offset += count * PAGE_SIZE;
+		/*end of file offset range*/
+		if ( offset == 0 )
+			break;
 	}
 	
-	return ERROR_SUCCESS;
+	/*remove the vnode from the mount dirty list if it is clean*/
+	if ( mount != NULL )
+	{
+		SpinLock( &mount->flush_lock );
+		if ( vnode->dirty_pages == 0 )
+			RemoveFromList( &vnode->dirty_list );
+		SpinUnlock( &mount->flush_lock );
+	}
+	return ret;
+}
+
+/*! Writes back all the modified pages of a vnode including the pages modified through a mapping
+	\param vnode - vnode to sync
+*/
+ERROR_CODE SyncVnodePages(VNODE_PTR vnode)
+{
+	VIRTUAL_PAGE_PTR vps[UBC_RELEASE_BATCH];
+	UINT32 i, count;
+	VADDR offset = 0;
+	
+	/*pages modified through a mapping are known only from the page table dirty bit*/
+	do
+	{
+		count = FindVnodePages( vnode, offset, vps, UBC_RELEASE_BATCH, RADIX_TREE_TAG_ANY );
+		for(i=0; i<count; i++)
+		{
+			if ( GetVirtualPageMappingStatus( vps[i], 0 ) & PAGE_STATUS_DIRTY )
+				MarkVnodePageDirty( vnode, vps[i] );
+		}
+		if ( count > 0 )
+			offset = vps[count-1]->ubc_info.offset + PAGE_SIZE;
+		PutVnodePages( vps, count );
+	}while( count == UBC_RELEASE_BATCH && offset != 0 );
+	
+	return FlushVnodePages( vnode );
+}
+
+/*! Writes back modified pages of all the vnodes in a mount
+	\param mount - mounted file system
+	\return ERROR_SUCCESS if all the modified pages are written
+*/
+ERROR_CODE FlushMountPages(MOUNTED_FILE_SYSTEM_PTR mount)
+{
+	VNODE_PTR vnode;
+	LIST_PTR list;
+	UINT32 i, count = 0;
+	ERROR_CODE ret = ERROR_SUCCESS;
+	
+	SpinLock( &mount->flush_lock );
+	LIST_FOR_EACH( list, &mount->dirty_vnode_list )
+		count++;
+	/*visit each vnode once; visited vnode is moved to the tail so that a busy file doesnt starve others*/
+	for(i=0; i<count && !IsListEmpty( &mount->dirty_vnode_list ); i++)
+	{
+		vnode = STRUCT_ADDRESS_FROM_MEMBER( mount->dirty_vnode_list.next, VNODE, dirty_list );
+		RemoveFromList( &vnode->dirty_list );
+		AddToListTail( &mount->dirty_vnode_list, &vnode->dirty_list );
+		ReferenceVnode( vnode, NULL );
+		SpinUnlock( &mount->flush_lock );
+		
+		if ( FlushVnodePages( vnode ) != ERROR_SUCCESS )
+			ret = ERROR_IO_DEVICE;
+		ReleaseVnode( vnode );
+		
+		SpinLock( &mount->flush_lock );
+	}
+	SpinUnlock( &mount->flush_lock );
+	
+	return ret;
+}
+
+/*! Stops the flusher thread of a mount and waits for it to exit
+	\param mount - mounted file system
+*/
+void StopMountFlusher(MOUNTED_FILE_SYSTEM_PTR mount)
+{
+	WAIT_EVENT event;
+	
+	SpinLock( &mount->flush_lock );
+	mount->flusher_stop = 1;
+	while ( mount->flusher_started )
+	{
+		WakeUpWaitQueue( &mount->flusher_wait_queue, WAIT_EVENT_WAKE_UP_ALL );
+		InitWaitEventOnStack( &event );
+		AddWaitEventToQueue( &mount->flusher_wait_queue, &event );
+		SpinUnlock( &mount->flush_lock );
+		
+		WaitForWaitEvent( &event, VFS_TIME_OUT );
+		
+		SpinLock( &mount->flush_lock );
+	}
+	SpinUnlock( &mount->flush_lock );
+}
+
+/*! Creates flusher thread for a mount
+	\param mount - mounted file system
+*/
+static void StartMountFlusher(MOUNTED_FILE_SYSTEM_PTR mount)
+{
+	THREAD_CONTAINER_PTR tc;
+	
+	SpinLock( &mount->flush_lock );
+	if ( mount->flusher_started || mount->flusher_stop )
+	{
+		SpinUnlock( &mount->flush_lock );
+		return;
+	}
+	mount->flusher_started = 1;
+	SpinUnlock( &mount->flush_lock );
+	
+	/*thread start routine cant take an argument, so the mount is handed over through the start list*/
+	SpinLock( &flusher_start_lock );
+	AddToListTail( &flusher_start_list, &mount->flusher_start_list );
+	SpinUnlock( &flusher_start_lock );
+	
+	tc = CreateThread( &kernel_task, UbcFlusher, SCHED_CLASS_HIGH, TRUE, NULL );
+	if ( tc == NULL )
+	{
+		KTRACE("Unable to create flusher for %s\n", mount->mount_name);
+		SpinLock( &flusher_start_lock );
+		RemoveFromList( &mount->flusher_start_list );
+		SpinUnlock( &flusher_start_lock );
+		mount->flusher_started = 0;
+	}
+}
+
+/*! Wakes up the flusher thread of a mount before its interval
+	\param mount - mounted file system
+*/
+static void WakeUpMountFlusher(MOUNTED_FILE_SYSTEM_PTR mount)
+{
+	SpinLock( &mount->flush_lock );
+	if ( !IS_WAIT_QUEUE_EMPTY( &mount->flusher_wait_queue ) )
+	{
+		ubc_statistics.flusher_wakeups++;
+		WakeUpWaitQueue( &mount->flusher_wait_queue, WAIT_EVENT_WAKE_UP_ALL );
+	}
+	SpinUnlock( &mount->flush_lock );
+}
+
+/*! Flusher thread - writes back modified pages of a mount periodically or when there are too many modified pages
+*/
+static void UbcFlusher()
+{
+	MOUNTED_FILE_SYSTEM_PTR mount;
+	WAIT_EVENT event;
+	
+	SpinLock( &flusher_start_lock );
+	assert( !IsListEmpty( &flusher_start_list ) );
+	mount = STRUCT_ADDRESS_FROM_MEMBER( flusher_start_list.next, MOUNTED_FILE_SYSTEM, flusher_start_list );
+	RemoveFromList( &mount->flusher_start_list );
+	SpinUnlock( &flusher_start_lock );
+	
+	/*write back is background IO - it should not delay the other requests to the file system*/
+	SetMessagePriority( MESSAGE_PRIORITY_LOW );
+	
+	SpinLock( &mount->flush_lock );
+	mount->flusher_thread = GetCurrentThread();
+	while ( !mount->flusher_stop )
+	{
+		InitWaitEventOnStack( &event );
+		AddWaitEventToQueue( &mount->flusher_wait_queue, &event );
+		SpinUnlock( &mount->flush_lock );
+		
+		WaitForWaitEvent( &event, ubc_flush_interval );
+		
+		FlushMountPages( mount );
+		
+		SpinLock( &mount->flush_lock );
+	}
+	/*let the unmount know that the flusher is gone*/
+	mount->flusher_thread = NULL;
+	mount->flusher_started = 0;
+	WakeUpWaitQueue( &mount->flusher_wait_queue, WAIT_EVENT_WAKE_UP_ALL );
+	SpinUnlock( &mount->flush_lock );
+	
+	ExitThread();
+}
+
+/*! Makes the current thread wait while there are too many modified pages in the system
+	\param vnode - vnode which is going to be written
+*/
+static void ThrottleUbcWriter(VNODE_PTR vnode)
+{
+	WAIT_EVENT event;
+	UINT32 i;
+	
+	/*flusher should never wait for itself*/
+	if ( vnode->mounted_fs->flusher_thread == GetCurrentThread() )
+		return;
+	
+	for(i=0; i<UBC_THROTTLE_RETRIES && ubc_dirty_pages > UBC_DIRTY_LIMIT(ubc_dirty_ratio); i++)
+	{
+		if ( i == 0 )
+			ubc_statistics.writers_throttled++;
+		WakeUpMountFlusher( vnode->mounted_fs );
+		
+		InitWaitEventOnStack( &event );
+		SpinLock( &ubc_dirty_lock );
+		AddWaitEventToQueue( &ubc_throttle_wait_queue, &event );
+		SpinUnlock( &ubc_dirty_lock );
+		WaitForWaitEvent( &event, UBC_THROTTLE_WAIT_TIME );
+	}
 }
 
-/*! internal function to compare two ubc pages - the comparision key is offset in the file*/
-static COMPARISION_RESULT ubc_page_compare(BINARY_TREE_PTR node1, BINARY_TREE_PTR node2)
+/*! Updates the global modified page count after pages are cleaned and wakes up throttled writers
+	\param count - number of pages cleaned
+*/
+static void UbcPagesCleaned(UINT32 count)
 {
-	VIRTUAL_PAGE_PTR vp1, vp2;
+	if ( count == 0 )
+		return;
+	SpinLock( &ubc_dirty_lock );
+	assert( ubc_dirty_pages >= count );
+	ubc_dirty_pages -= count;
+	if ( !IS_WAIT_QUEUE_EMPTY( &ubc_throttle_wait_queue ) && ubc_dirty_pages <= UBC_DIRTY_LIMIT(ubc_dirty_ratio) )
+		WakeUpWaitQueue( &ubc_throttle_wait_queue, WAIT_EVENT_WAKE_UP_ALL );
+	SpinUnlock( &ubc_dirty_lock );
+}
+
+/*! Reads/Writes a file through ubc
+	\param vnode - vnode of the file
+	\param offset - file offset
+	\param count - number of bytes to read/write
+	\param buffer - buffer to place the read/write contents
+	\param is_write - TRUE for write
+	\param result - total bytes read/written
 	
-	assert( node1 != NULL );
-	assert( node2 != NULL );
+	Written pages are only marked modified, they are written back to the file system by the flusher.
+*/
+ERROR_CODE ReadWriteVnode(VNODE_PTR vnode, UINT32 offset, long count, void * buffer, int is_write, UINT32 * result)
+{
+	VIRTUAL_PAGE_PTR vp;
+	BYTE * va;
+	UINT32 page_offset, length;
+	BOOLEAN fill, user_buffer;
+	ERROR_CODE ret = ERROR_SUCCESS;
 	
-	vp1 = STRUCT_ADDRESS_FROM_MEMBER(node1, VIRTUAL_PAGE, ubc_info.tree.bintree);
-	vp2 = STRUCT_ADDRESS_FROM_MEMBER(node2, VIRTUAL_PAGE, ubc_info.tree.bintree);
+	assert( result != NULL );
+	* result = 0;
+	if ( count <= 0 )
+		return ERROR_SUCCESS;
+	/*pages are remapped only if the whole buffer is user memory*/
+	user_buffer = (VADDR)buffer < KERNEL_MAP_START_VA && (VADDR)buffer + count > (VADDR)buffer 
+		&& (VADDR)buffer + count <= KERNEL_MAP_START_VA;
+	if ( is_write )
+		ThrottleUbcWriter( vnode );
+	else
+	{
+		if ( offset >= vnode->file_size )
+			return ERROR_SUCCESS;
+		if ( count > vnode->file_size - offset )
+			count = vnode->file_size - offset;
+	}
 	
-	if ( vp1->ubc_info.offset > vp2->ubc_info.offset )
-		return GREATER_THAN;
-	else if (vp1->ubc_info.offset < vp2->ubc_info.offset )
-		return LESS_THAN;
-	else 
-		return EQUAL;
+	while ( *result < count )
+	{
+		page_offset = offset & (PAGE_SIZE-1);
+		length = PAGE_SIZE - page_offset;
+		if ( length > count - *result )
+			length = count - *result;
+		
+		/*no need to read the page from the file if it is going to be overwritten fully or if it is beyond end of the file*/
+		fill = !is_write || ( length < PAGE_SIZE && PAGE_ALIGN(offset) < vnode->file_size );
+		vp = GetVnodePageCore( vnode, offset, fill, TRUE );
+		if ( vp == NULL )
+		{
+			ret = ERROR_IO_DEVICE;
+			break;
+		}
+		
+		/*whole page read into a page aligned user buffer - share the page instead of copying it*/
+		if ( !is_write && length == PAGE_SIZE && IS_PAGE_ALIGNED((BYTE *)buffer + *result) 
+			&& user_buffer
+			&& MapVirtualPageCopyOnWrite( GetCurrentVirtualMap(), (VADDR)buffer + *result, vp ) == ERROR_SUCCESS )
+		{
+			ubc_statistics.pages_remapped++;
+			PutVnodePages( &vp, 1 );
+			offset += length;
+			*result += length;
+			continue;
+		}
+		/*readers sharing the page should keep the old contents*/
+		if ( is_write && vp->copy_on_write && UnshareVirtualPage( vp ) != ERROR_SUCCESS )
+		{
+			PutVnodePages( &vp, 1 );
+			ret = ERROR_NOT_ENOUGH_MEMORY;
+			break;
+		}
+		
+		/*the caller buffer may fault, so the page is copied through a copy window instead of the physical page window*/
+		va = MapPhysicalPageCopyWindow( vp->physical_address );
+		if ( is_write )
+			memcpy( va + page_offset, (BYTE *)buffer + *result, length );
+		else
+			memcpy( (BYTE *)buffer + *result, va + page_offset, length );
+		UnmapPhysicalPageCopyWindow( va );
+		if ( is_write )
+		{
+			SpinLock( &vnode->lock );
+			if ( offset + length > vnode->file_size )
+				vnode->file_size = offset + length;
+			SpinUnlock( &vnode->lock );
+			MarkVnodePageDirty( vnode, vp );
+		}
+		PutVnodePages( &vp, 1 );
+		
+		offset += length;
+		*result += length;
+	}
+	
+	/*partial transfer is not an error*/
+	return *result > 0 ? ERROR_SUCCESS : ret;
 }
 
+/*! allocates a node for vnode page tree*/
+static RADIX_TREE_NODE_PTR AllocateUbcTreeNode()
+{
+	return (RADIX_TREE_NODE_PTR) kmalloc( sizeof(RADIX_TREE_NODE), 0 );
+}
+
+/*! frees a node of vnode page tree*/
+static void FreeUbcTreeNode(RADIX_TREE_NODE_PTR node)
+{
+	kfree( node );
+}
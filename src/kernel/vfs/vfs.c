@@ -18,6 +18,7 @@ FS_PARAM fs_param = {
 	.vnode.free_slabs_threshold 	= 10,
 	.vnode.min_buffers				= 100,
 	.vnode.max_buffers				= 500,
+	.vnode.attribute_cache_time		= 3000,
 
 	.dir_entry.lru_maximum 				= 200,
 	.dir_entry.free_slabs_threshold 	= 10,
@@ -27,23 +28,22 @@ FS_PARAM fs_param = {
 
 
 void InitBootFs();
-static OPEN_FILE_INFO_PTR GetFreeOpenFileInfo(TASK_PTR task, int * id);
-static inline ERROR_CODE FileIdToOpenFileInfo(TASK_PTR task, int file_id, PROCESS_FILE_INFO_PTR * pf_info, OPEN_FILE_INFO_PTR * op);
+static ERROR_CODE AllocateFileId(TASK_PTR task, OPEN_FILE_INFO_PTR op, int file_id, int * result);
+static OPEN_FILE_INFO_PTR FreeFileId(TASK_PTR task, int file_id);
+static ERROR_CODE ReadWriteOpenFile(OPEN_FILE_INFO_PTR op, UINT32 offset, long count, void * buffer, int is_write, UINT32 * result);
 
 /*! Initialize vfs layer*/
 void InitVfs()
 {
-	int i;
-
 	InitSpinLock( &fs_control.lock );
 	fs_control.registered_file_systems = NULL;
 	fs_control.mounted_file_system_head = NULL;
 
-	InitLruList( &fs_control.dir_entry_lru_list, fs_param.dir_entry.lru_maximum, AllocateDirEntryLruNode, ReuseDirEntryLru, FreeDirEntryLru );
-	fs_control.dir_entry_root = NULL;
+	InitDirectoryEntryCache();
+
+	InitVnodeHashTable();
 
-	for (i=0;i<VNODE_HASH_TABLE_SIZE;i++)
-		InitList( &fs_control.vnode_hash_table[i] );
+	InitUbc();
 
 	InitBootFs();
 }
@@ -167,10 +167,9 @@ ERROR_CODE MountFileSystem(char * fs_name, char * device, char * mount_path )
 	if ( fs == NULL )
 		return ERROR_NOT_FOUND;
 	
-	/*Send message to the file system to mount*/
-	SendMessageCore( fs->task, fs->message_queue, MESSAGE_TYPE_REFERENCE, VFS_IPC_MOUNT, 0, NULL, NULL, (IPC_ARG_TYPE)device,(IPC_ARG_TYPE)strlen(device), VFS_MOUNT_TIME_OUT);
-	/*Wait for FS to complete the mount operation*/
-	ret = WaitForReply( MESSAGE_TYPE_VALUE, &fs_result, NULL, NULL, NULL, NULL, NULL, VFS_MOUNT_TIME_OUT );
+	/*Send message to the file system to mount and wait for FS to complete the mount operation*/
+	ret = CallMessage( fs->task, fs->message_queue, MESSAGE_TYPE_REFERENCE, VFS_IPC_MOUNT, 0, NULL, NULL, (IPC_ARG_TYPE)device,(IPC_ARG_TYPE)strlen(device), 
+		MESSAGE_TYPE_VALUE, &fs_result, NULL, NULL, NULL, NULL, NULL, VFS_MOUNT_TIME_OUT );
 	if ( ret != ERROR_SUCCESS )
 		return ret;
 	if ( fs_result != VFS_RETURN_CODE_SUCCESS)
@@ -183,6 +182,15 @@ ERROR_CODE MountFileSystem(char * fs_name, char * device, char * mount_path )
 	strcpy(mount->mount_device, device);
 	mount->file_system = fs;
 	mount->root_entry = NULL;
+	mount->read_only = 0;
+	mount->flags = 0;
+	InitSpinLock(&mount->flush_lock);
+	InitList(&mount->dirty_vnode_list);
+	InitList(&mount->flusher_start_list);
+	mount->flusher_thread = NULL;
+	InitWaitQueue( &mount->flusher_wait_queue );
+	mount->flusher_started = 0;
+	mount->flusher_stop = 0;
 	InitList(&mount->list);
 
 	SpinLock( &fs_control.lock );
@@ -195,6 +203,8 @@ ERROR_CODE MountFileSystem(char * fs_name, char * device, char * mount_path )
 	SpinUnlock( &fs_control.lock );
 
 	fs->count++;
+	/*paths under the new mount might have been cached as not existing*/
+	InvalidateNegativeDirectoryEntries();
 	return ERROR_SUCCESS;
 }
 
@@ -252,16 +262,24 @@ ERROR_CODE UnmountFileSystem(char * mount_path)
 	if ( mount == NULL )
 		return ERROR_NOT_FOUND;
 
-	/*Send message to the file system to unmount*/
-	SendMessageCore( mount->file_system->task, mount->file_system->message_queue, MESSAGE_TYPE_REFERENCE, (IPC_ARG_TYPE) VFS_IPC_UNMOUNT, NULL, NULL, NULL, mount_path,(IPC_ARG_TYPE)strlen(mount_path), VFS_MOUNT_TIME_OUT);
-	/*Wait for FS to complete the unmount operation*/
-	ret = WaitForReply( MESSAGE_TYPE_VALUE, &fs_result, NULL, NULL, NULL, NULL, NULL, VFS_MOUNT_TIME_OUT );
+	/*write back the cached data before the file system goes away*/
+	ret = FlushMountPages(mount);
+	if ( ret != ERROR_SUCCESS )
+		return ret;
+	/*drop the cached vnodes while the file system can still take the write back*/
+	PurgeMountVnodes(mount);
+
+	/*Send message to the file system to unmount and wait for FS to complete the unmount operation*/
+	ret = CallMessage( mount->file_system->task, mount->file_system->message_queue, MESSAGE_TYPE_REFERENCE, (IPC_ARG_TYPE) VFS_IPC_UNMOUNT, NULL, NULL, NULL, mount_path,(IPC_ARG_TYPE)strlen(mount_path), 
+		MESSAGE_TYPE_VALUE, &fs_result, NULL, NULL, NULL, NULL, NULL, VFS_MOUNT_TIME_OUT );
 	if ( ret != ERROR_SUCCESS )
 		return ret;
 
 	if ( fs_result != VFS_RETURN_CODE_SUCCESS)
 		return ERROR_BUSY;
 
+	StopMountFlusher(mount);
+
 	mount->file_system->count--;
 	assert( mount->file_system->count > 0 );
 
@@ -278,6 +296,7 @@ ERROR_CODE UnmountFileSystem(char * mount_path)
 	SpinUnlock( &fs_control.lock );
 
 	kfree(mount);
+	InvalidateNegativeDirectoryEntries();
 
 	return ERROR_SUCCESS;
 }
@@ -308,17 +327,28 @@ ERROR_CODE OpenFile(TASK_PTR task, char * file_path, VFS_ACCESS_TYPE access, VFS
 	if ( ret != ERROR_SUCCESS )
 		return ret;
 
-	/*get a free file info and fill it*/
-	open_file_info = GetFreeOpenFileInfo(task, file_id);
-	if ( open_file_info == NULL )
-		return ERROR_RESOURCE_SHORTAGE;
-
 	assert( directory_entry->vnode!= NULL );
+	/*create an open file info and install it in the lowest free file id*/
+	open_file_info = kmalloc( sizeof(OPEN_FILE_INFO), 0 );
+	if ( open_file_info == NULL )
+		ret = ERROR_NOT_ENOUGH_MEMORY;
+	else
+	{
+		InitSpinLock( &open_file_info->lock );
+		open_file_info->reference_count = 1;
+		open_file_info->vnode = directory_entry->vnode;
+		open_file_info->mode = open_flag;
+		open_file_info->file_offset = 0;
+		ret = AllocateFileId( task, open_file_info, -1, file_id );
+		if ( ret != ERROR_SUCCESS )
+			kfree( open_file_info );
+	}
+	if ( ret != ERROR_SUCCESS )
+		ReleaseVnode( directory_entry->vnode );
 	//KTRACE("open_file_info %s %p %p\n", file_path, open_file_info, directory_entry->vnode);
-	open_file_info->vnode = directory_entry->vnode;
-	open_file_info->mode = open_flag;
+	ReleaseDirectoryEntry( directory_entry );
 
-	return ERROR_SUCCESS;
+	return ret;
 }
 
 /*! Reads/Writes a file content of given size into the buffer
@@ -330,42 +360,137 @@ ERROR_CODE OpenFile(TASK_PTR task, char * file_path, VFS_ACCESS_TYPE access, VFS
 ERROR_CODE ReadWriteFile(int file_id, long count, void * buffer, int is_write, UINT32 * result)
 {
 	ERROR_CODE ret;
-	VFS_RETURN_CODE fs_result;
-	TASK_PTR task;
-	VNODE_PTR vnode;
-	MOUNTED_FILE_SYSTEM_PTR mounted_fs;
 	OPEN_FILE_INFO_PTR op;
 
 	assert( result );
-	/*basic error checking*/
 	* result = 0;
-	if ( file_id < 0 || file_id >= MAX_OPEN_FILE )
+	op = GetOpenFileInfo( GetCurrentTask(), file_id );
+	if ( op == NULL )
+		return ERROR_INVALID_PARAMETER;
+
+	ret = ReadWriteOpenFile( op, op->file_offset, count, buffer, is_write, result );
+
+	/*move the file pointer*/
+	SpinLock( &op->lock );
+	op->file_offset += (*result);
+	SpinUnlock( &op->lock );
+	ReleaseOpenFileInfo( op );
+
+	return ret;
+}
+
+/*! Reads/Writes a file content at the given offset without using or moving the file pointer
+ * \param file_id - file id of the file on which read/write operation should be performed
+ * \param offset - file offset to start the read/write
+ * \param count - number of bytes to read/write
+ * \param buffer - buffer to place the read/write contents
+ * \param result - total bytes read/writen to the buffer
+ * */
+ERROR_CODE ReadWriteFileAt(int file_id, UINT32 offset, long count, void * buffer, int is_write, UINT32 * result)
+{
+	ERROR_CODE ret;
+	OPEN_FILE_INFO_PTR op;
+
+	assert( result );
+	* result = 0;
+	op = GetOpenFileInfo( GetCurrentTask(), file_id );
+	if ( op == NULL )
 		return ERROR_INVALID_PARAMETER;
 
-	task = GetCurrentTask();
-	op = &task->process_file_info.open_file_info[file_id];
+	ret = ReadWriteOpenFile( op, offset, count, buffer, is_write, result );
+	ReleaseOpenFileInfo( op );
 
-	vnode = GetVnodeFromFile( file_id );
+	return ret;
+}
+
+/*! Does the read/write of ReadWriteFile() and ReadWriteFileAt()
+ * \param op - open file info of the file
+ * \param offset - file offset to start the read/write
+ * \param count - number of bytes to read/write
+ * \param buffer - buffer to place the read/write contents
+ * \param result - total bytes read/writen to the buffer
+ * */
+static ERROR_CODE ReadWriteOpenFile(OPEN_FILE_INFO_PTR op, UINT32 offset, long count, void * buffer, int is_write, UINT32 * result)
+{
+	ERROR_CODE ret;
+	VFS_RETURN_CODE fs_result;
+	VNODE_PTR vnode;
+	MOUNTED_FILE_SYSTEM_PTR mounted_fs;
+
+	vnode = op->vnode;
 	if ( vnode == NULL ) {
 		KTRACE("vnode is null\n");
 		return ERROR_INVALID_PARAMETER;
 	}
 	mounted_fs = vnode->mounted_fs;
 
+	if ( is_write && mounted_fs->read_only )
+		return ERROR_NOT_SUPPORTED;
+
+	/*cached files are read/written through ubc and written back to the file system later*/
+	if ( IS_VNODE_CACHED(vnode) )
+		return ReadWriteVnode( vnode, offset, count, buffer, is_write, result );
+
 	/*Send message to the file system to read/write the file*/
-	SendMessageCore( mounted_fs->file_system->task, mounted_fs->file_system->message_queue, MESSAGE_TYPE_VALUE, (IPC_ARG_TYPE) (is_write?VFS_IPC_WRITE_FILE:VFS_IPC_READ_FILE), (IPC_ARG_TYPE)vnode->fs_data, (IPC_ARG_TYPE)vnode->inode_number, (IPC_ARG_TYPE)op->file_offset, (IPC_ARG_TYPE)buffer, (IPC_ARG_TYPE)count, VFS_TIME_OUT);
-	ret = WaitForReply(MESSAGE_TYPE_VALUE, &fs_result, result, NULL, NULL, NULL, NULL, VFS_TIME_OUT );
+	ret = CallMessage( mounted_fs->file_system->task, mounted_fs->file_system->message_queue, MESSAGE_TYPE_VALUE, (IPC_ARG_TYPE) (is_write?VFS_IPC_WRITE_FILE:VFS_IPC_READ_FILE), (IPC_ARG_TYPE)vnode->fs_data, (IPC_ARG_TYPE)vnode->inode_number, (IPC_ARG_TYPE)offset, (IPC_ARG_TYPE)buffer, (IPC_ARG_TYPE)count, 
+		MESSAGE_TYPE_VALUE, &fs_result, result, NULL, NULL, NULL, NULL, VFS_TIME_OUT );
 	if ( ret != ERROR_SUCCESS || fs_result != VFS_RETURN_CODE_SUCCESS ) {
 		KTRACE("ret %s %d\n", ERROR_CODE_AS_STRING(ret), fs_result);
+		* result = 0;
 		return ret;
 	}
-
-	/*move the file pointer*/
-	op->file_offset += (*result);
+	/*the file system changed the size and time of the file*/
+	if ( is_write )
+		InvalidateVnodeAttributes( vnode );
 
 	return ERROR_SUCCESS;
 }
 
+/*! Writes back the modified cached pages of the given file to the file system
+	\param task - task
+	\param file_id - file to sync
+*/
+ERROR_CODE SyncFile(TASK_PTR task, int file_id)
+{
+	OPEN_FILE_INFO_PTR op;
+	ERROR_CODE err = ERROR_SUCCESS;
+
+	op = GetOpenFileInfo( task, file_id );
+	if ( op == NULL )
+		return ERROR_INVALID_PARAMETER;
+
+	assert( op->vnode != NULL );
+	if ( IS_VNODE_CACHED(op->vnode) )
+		err = SyncVnodePages( op->vnode );
+	ReleaseOpenFileInfo( op );
+
+	return err;
+}
+
+/*! Writes back the modified cached pages of all the mounted file systems
+	\return ERROR_SUCCESS if all the mounts are written back
+*/
+ERROR_CODE SyncFileSystems()
+{
+	MOUNTED_FILE_SYSTEM_PTR mount;
+	ERROR_CODE ret = ERROR_SUCCESS;
+	LIST_PTR list;
+
+	mount = fs_control.mounted_file_system_head;
+	if ( mount == NULL )
+		return ERROR_SUCCESS;
+	/*\todo - mounts are not reference counted, an unmount during the sync is not handled*/
+	if ( FlushMountPages(mount) != ERROR_SUCCESS )
+		ret = ERROR_IO_DEVICE;
+	LIST_FOR_EACH(list, &fs_control.mounted_file_system_head->list )
+	{
+		mount = STRUCT_ADDRESS_FROM_MEMBER( list, MOUNTED_FILE_SYSTEM, list );
+		if ( FlushMountPages(mount) != ERROR_SUCCESS )
+			ret = ERROR_IO_DEVICE;
+	}
+	return ret;
+}
+
 /*! Returns size of the given file
 	\param task - task
 	\param file_id - file for which size information needed
@@ -373,17 +498,18 @@ ERROR_CODE ReadWriteFile(int file_id, long count, void * buffer, int is_write, U
 */
 ERROR_CODE GetFileSize(TASK_PTR task, int file_id, long * result)
 {
-	PROCESS_FILE_INFO_PTR pf_info;
 	OPEN_FILE_INFO_PTR op;
-	ERROR_CODE err;
 
 	*result = 0;
-	err = FileIdToOpenFileInfo( task, file_id, &pf_info, &op);
-	if ( err != ERROR_SUCCESS )
-		return err;
+	op = GetOpenFileInfo( task, file_id );
+	if ( op == NULL )
+		return ERROR_INVALID_PARAMETER;
 
 	assert( op->vnode != NULL );
+	/*if the FS cant be reached the cached size is returned*/
+	RevalidateVnodeAttributes( op->vnode );
 	*result = op->vnode->file_size;
+	ReleaseOpenFileInfo( op );
 
 	return ERROR_SUCCESS;
 }
@@ -394,24 +520,123 @@ ERROR_CODE GetFileSize(TASK_PTR task, int file_id, long * result)
 */
 ERROR_CODE CloseFile(TASK_PTR task, int file_id)
 {
-	PROCESS_FILE_INFO_PTR pf_info;
+	OPEN_FILE_INFO_PTR op;
+
+	op = FreeFileId( task, file_id );
+	if ( op == NULL )
+		return ERROR_INVALID_PARAMETER;
+
+	/*the vnode is released when the last file id sharing the open file info is closed*/
+	ReleaseOpenFileInfo( op );
+
+	return ERROR_SUCCESS;
+}
+
+/*! Duplicates a file id - both the file ids share the same open file info(and file pointer)
+	\param task - task
+	\param file_id - file id to duplicate
+	\param new_file_id - file id to use, if it is already opened it is closed first; -1 to use the lowest free file id
+	\param result - new file id is updated here
+*/
+ERROR_CODE DuplicateFile(TASK_PTR task, int file_id, int new_file_id, int * result)
+{
 	OPEN_FILE_INFO_PTR op;
 	ERROR_CODE err;
 
-	err = FileIdToOpenFileInfo(task, file_id, &pf_info, &op);
+	assert( result != NULL );
+	*result = -1;
+	if ( new_file_id < -1 || new_file_id >= MAX_OPEN_FILE )
+		return ERROR_INVALID_PARAMETER;
+	op = GetOpenFileInfo( task, file_id );
+	if ( op == NULL )
+		return ERROR_INVALID_PARAMETER;
+	if ( file_id == new_file_id )
+	{
+		ReleaseOpenFileInfo( op );
+		*result = file_id;
+		return ERROR_SUCCESS;
+	}
+
+	/*the reference taken by the lookup is passed to the new file id*/
+	err = AllocateFileId( task, op, new_file_id, result );
 	if ( err != ERROR_SUCCESS )
-		return err;
+		ReleaseOpenFileInfo( op );
 
-	/*!\todo flush the buffers if any*/
-	ReleaseVnode(op->vnode);
+	return err;
+}
 
-	/*mark the slot as free*/
-	ClearBitInBitArray(pf_info->bitmap, file_id);
-	memset( op, 0, sizeof(OPEN_FILE_INFO) );
+/*! Makes the child share all the open files of the parent - used to create a process with inherited file ids
+	The open file info is not copied, so the parent and the child share the file pointers.
+	\param parent - task whose files are inherited
+	\param child - new task, should not have any open file
+*/
+ERROR_CODE InheritFiles(TASK_PTR parent, TASK_PTR child)
+{
+	PROCESS_FILE_INFO_PTR pf_info = &parent->process_file_info;
+	FILE_TABLE_CHUNK_PTR chunk;
+	UINT32 c, i;
+
+	for(c=0; c<FILE_TABLE_CHUNKS; c++)
+	{
+		if ( pf_info->chunks[c] == NULL )
+			continue;
+		chunk = kmalloc( sizeof(FILE_TABLE_CHUNK), 0 );
+		if ( chunk == NULL )
+			return ERROR_NOT_ENOUGH_MEMORY;
+
+		SpinLock( &pf_info->lock );
+		memcpy( chunk, pf_info->chunks[c], sizeof(FILE_TABLE_CHUNK) );
+		for(i=0; i<FILE_TABLE_CHUNK_SIZE; i++)
+		{
+			if ( GetBitFromBitArray( &chunk->bitmap, i ) )
+			{
+				SpinLock( &chunk->open_file_info[i]->lock );
+				chunk->open_file_info[i]->reference_count++;
+				SpinUnlock( &chunk->open_file_info[i]->lock );
+			}
+		}
+		SpinUnlock( &pf_info->lock );
+
+		SpinLock( &child->process_file_info.lock );
+		assert( child->process_file_info.chunks[c] == NULL );
+		child->process_file_info.chunks[c] = chunk;
+		if ( chunk->bitmap == 0xFFFFFFFF )
+			SetBitInBitArray( child->process_file_info.full_bitmap, c );
+		SpinUnlock( &child->process_file_info.lock );
+	}
 
 	return ERROR_SUCCESS;
 }
 
+/*! Closes all the open files of a process and frees its file table - used when the process exits
+	\param task - task whose files are closed, none of its threads should be using the file table
+*/
+void CloseAllFiles(TASK_PTR task)
+{
+	PROCESS_FILE_INFO_PTR pf_info = &task->process_file_info;
+	FILE_TABLE_CHUNK_PTR chunk;
+	UINT32 c, i;
+
+	for(c=0; c<FILE_TABLE_CHUNKS; c++)
+	{
+		SpinLock( &pf_info->lock );
+		chunk = pf_info->chunks[c];
+		pf_info->chunks[c] = NULL;
+		ClearBitInBitArray( pf_info->full_bitmap, c );
+		SpinUnlock( &pf_info->lock );
+		if ( chunk == NULL )
+			continue;
+
+		/*releasing the last reference can write back the vnode, so it is done outside the lock*/
+		for(i=0; i<FILE_TABLE_CHUNK_SIZE; i++)
+		{
+			if ( GetBitFromBitArray( &chunk->bitmap, i ) )
+				ReleaseOpenFileInfo( chunk->open_file_info[i] );
+		}
+		kfree( chunk );
+	}
+}
+
 /*! Reads a directory entry of a directory and fill it in buffer
 	\param directory_path - directory to read
 	\param buffer - buffer to fill resulting directory entries
@@ -454,6 +679,7 @@ ERROR_CODE ReadDirectory(char * directory_path, FILE_STAT_PARAM_PTR buffer, int
 		DIRECTORY_ENTRY_PARAM de_param;
 		VFS_RETURN_CODE fs_result;
 		DIRECTORY_ENTRY_PTR de=NULL;
+		int i;
 
 		mount = GetMount(directory_path);
 		if ( mount == NULL )
@@ -462,112 +688,238 @@ ERROR_CODE ReadDirectory(char * directory_path, FILE_STAT_PARAM_PTR buffer, int
 		if ( ret != ERROR_SUCCESS )
 			return ret;
 		de_param.directory_inode = de->inode_number;
+		/*only the inode number is needed - the directory entry keeps the vnode cached*/
+		ReleaseVnode( de->vnode );
+		ReleaseDirectoryEntry( de );
 		de_param.after_inode = 0;
 		de_param.max_entries = max_entries;
-		/*Send message to the file system to unmount*/
-		SendMessageCore(mount->file_system->task, mount->file_system->message_queue, MESSAGE_TYPE_REFERENCE, (IPC_ARG_TYPE)VFS_IPC_GET_DIR_ENTRIES, mount->fs_data, NULL, NULL, &de_param,(IPC_ARG_TYPE)sizeof(de_param) , VFS_MOUNT_TIME_OUT);
-		/*Wait for FS to complete the unmount operation*/
-		ret = WaitForReply( MESSAGE_TYPE_REFERENCE, &fs_result, total_entries, NULL, NULL, buffer, (IPC_ARG_TYPE)  (sizeof(FILE_STAT_PARAM)*max_entries), VFS_MOUNT_TIME_OUT );
+		/*Send message to the file system to get the directory entries and wait for the reply*/
+		ret = CallMessage(mount->file_system->task, mount->file_system->message_queue, MESSAGE_TYPE_REFERENCE, (IPC_ARG_TYPE)VFS_IPC_GET_DIR_ENTRIES, mount->fs_data, NULL, NULL, &de_param,(IPC_ARG_TYPE)sizeof(de_param), 
+			MESSAGE_TYPE_REFERENCE, &fs_result, total_entries, NULL, NULL, buffer, (IPC_ARG_TYPE)  (sizeof(FILE_STAT_PARAM)*max_entries), VFS_MOUNT_TIME_OUT );
 		if ( ret != ERROR_SUCCESS )
 			return ret;
 
 		if ( fs_result != VFS_RETURN_CODE_SUCCESS)
 			return ERROR_BUSY;
 
+		/*directory read returns the file attributes too - cache them for the following opens*/
+		if ( *total_entries > max_entries )
+			*total_entries = max_entries;
+		for(i=0; i<*total_entries; i++)
+			UpdateVnodeAttributes( mount, &buffer[i] );
+		CacheDirectoryEntryAttributes( directory_path, buffer, *total_entries );
 	}
 	return ERROR_SUCCESS;
 }
 
-/*! Returns a free open file info from the process
+/*! Initializes the file table of a process
+	\param pf_info - process file info
+*/
+void InitProcessFileInfo(PROCESS_FILE_INFO_PTR pf_info)
+{
+	memset( pf_info, 0, sizeof(PROCESS_FILE_INFO) );
+	InitSpinLock( &pf_info->lock );
+}
+
+/*! Installs an open file info in the file table of the process
 	\param task - task
-	\param id - the resulting file_id
+	\param op - open file info to install - the caller's reference is passed to the file table
+	\param file_id - file id to use, if it is already opened it is closed; -1 to use the lowest free file id
+	\param result - the resulting file id
 */
-static OPEN_FILE_INFO_PTR GetFreeOpenFileInfo(TASK_PTR task, int * id)
+static ERROR_CODE AllocateFileId(TASK_PTR task, OPEN_FILE_INFO_PTR op, int file_id, int * result)
 {
 	PROCESS_FILE_INFO_PTR pf_info;
-	UINT32 i;
+	FILE_TABLE_CHUNK_PTR chunk, new_chunk = NULL;
+	OPEN_FILE_INFO_PTR replaced = NULL;
+	UINT32 c, i;
 
 	pf_info = &task->process_file_info;
+retry:
+	SpinLock( &pf_info->lock );
+	if ( file_id == -1 )
+	{
+		/*find the first chunk having a free slot - chunks not yet allocated are free*/
+		if ( FindFirstClearBitInBitArray( pf_info->full_bitmap, FILE_TABLE_CHUNKS, &c ) != 0 )
+		{
+			SpinUnlock( &pf_info->lock );
+			if ( new_chunk != NULL )
+				kfree( new_chunk );
+			return ERROR_RESOURCE_SHORTAGE;
+		}
+	}
+	else
+		c = file_id / FILE_TABLE_CHUNK_SIZE;
 
-	/*find a free open file slot*/
-	if ( FindFirstClearBitInBitArray( pf_info->bitmap, MAX_OPEN_FILE, &i ) != 0 )
-		return NULL;
+	chunk = pf_info->chunks[c];
+	if ( chunk == NULL )
+	{
+		/*allocate the chunk without holding the lock and try again*/
+		if ( new_chunk == NULL )
+		{
+			SpinUnlock( &pf_info->lock );
+			new_chunk = kmalloc( sizeof(FILE_TABLE_CHUNK), 0 );
+			if ( new_chunk == NULL )
+				return ERROR_NOT_ENOUGH_MEMORY;
+			memset( new_chunk, 0, sizeof(FILE_TABLE_CHUNK) );
+			goto retry;
+		}
+		chunk = pf_info->chunks[c] = new_chunk;
+		new_chunk = NULL;
+	}
+
+	if ( file_id == -1 )
+	{
+		if ( FindFirstClearBitInBitArray( &chunk->bitmap, FILE_TABLE_CHUNK_SIZE, &i ) != 0 )
+			panic("file table chunk is full");
+	}
+	else
+	{
+		i = file_id % FILE_TABLE_CHUNK_SIZE;
+		if ( GetBitFromBitArray( &chunk->bitmap, i ) )
+			replaced = chunk->open_file_info[i];
+	}
 
 	/*mark the slot as used*/
-	SetBitInBitArray(pf_info->bitmap, i);
+	SetBitInBitArray( &chunk->bitmap, i );
+	chunk->open_file_info[i] = op;
+	if ( chunk->bitmap == 0xFFFFFFFF )
+		SetBitInBitArray( pf_info->full_bitmap, c );
+	SpinUnlock( &pf_info->lock );
+
+	if ( new_chunk != NULL )
+		kfree( new_chunk );
+	if ( replaced != NULL )
+		ReleaseOpenFileInfo( replaced );
+
+	*result = (c * FILE_TABLE_CHUNK_SIZE) + i;
+	return ERROR_SUCCESS;
+}
 
-	/*update the id which we consumed*/
-	if ( id )
-		*id = i;
+/*! Removes a file id from the file table of the process
+	\param task - task
+	\param file_id - opened file id
+	\return open file info of the file id - the file table's reference is passed to the caller
+			NULL if the file id is not opened
+*/
+static OPEN_FILE_INFO_PTR FreeFileId(TASK_PTR task, int file_id)
+{
+	PROCESS_FILE_INFO_PTR pf_info;
+	FILE_TABLE_CHUNK_PTR chunk;
+	OPEN_FILE_INFO_PTR op = NULL;
+	UINT32 c, i;
+
+	if ( file_id < 0 || file_id >= MAX_OPEN_FILE )
+		return NULL;
+	c = file_id / FILE_TABLE_CHUNK_SIZE;
+	i = file_id % FILE_TABLE_CHUNK_SIZE;
 
-	return &pf_info->open_file_info[i];
+	pf_info = &task->process_file_info;
+	SpinLock( &pf_info->lock );
+	chunk = pf_info->chunks[c];
+	if ( chunk != NULL && GetBitFromBitArray( &chunk->bitmap, i ) )
+	{
+		op = chunk->open_file_info[i];
+		chunk->open_file_info[i] = NULL;
+		ClearBitInBitArray( &chunk->bitmap, i );
+		ClearBitInBitArray( pf_info->full_bitmap, c );
+	}
+	SpinUnlock( &pf_info->lock );
+
+	return op;
 }
 
-/*! Converts file id to process file info and open file info
+/*! Returns the open file info of the given file id
 	\param task - task
 	\param file_id - opened file id
-	\param pf_info - process file info is returned here
-	\param op - open file info is updated here
+	\return open file info with a reference - the caller should release it by calling ReleaseOpenFileInfo()
+			NULL if the file id is not opened
 */
-static inline ERROR_CODE FileIdToOpenFileInfo(TASK_PTR task, int file_id, PROCESS_FILE_INFO_PTR * pf_info, OPEN_FILE_INFO_PTR * op)
+OPEN_FILE_INFO_PTR GetOpenFileInfo(TASK_PTR task, int file_id)
 {
-	assert( pf_info != NULL );
-	assert( op != NULL );
+	PROCESS_FILE_INFO_PTR pf_info;
+	FILE_TABLE_CHUNK_PTR chunk;
+	OPEN_FILE_INFO_PTR op = NULL;
+	UINT32 i;
 
-	if ( file_id<0 || file_id > MAX_OPEN_FILE )
-		return ERROR_INVALID_PARAMETER;
+	if ( file_id < 0 || file_id >= MAX_OPEN_FILE )
+		return NULL;
+	i = file_id % FILE_TABLE_CHUNK_SIZE;
 
-	*pf_info = &task->process_file_info;
+	pf_info = &task->process_file_info;
+	SpinLock( &pf_info->lock );
+	chunk = pf_info->chunks[file_id / FILE_TABLE_CHUNK_SIZE];
+	if ( chunk != NULL && GetBitFromBitArray( &chunk->bitmap, i ) )
+	{
+		op = chunk->open_file_info[i];
+		SpinLock( &op->lock );
+		op->reference_count++;
+		SpinUnlock( &op->lock );
+	}
+	SpinUnlock( &pf_info->lock );
 
-	/*if the file is not opened return error*/
-	if (  GetBitFromBitArray((*pf_info)->bitmap, file_id) == 0 )
-		return ERROR_INVALID_PARAMETER;
+	return op;
+}
 
-	*op = &(*pf_info)->open_file_info[file_id];
+/*! Releases a reference to open file info, the vnode is released when the last reference goes
+	\param op - open file info
+*/
+void ReleaseOpenFileInfo(OPEN_FILE_INFO_PTR op)
+{
+	int references;
 
-	return ERROR_SUCCESS;
+	assert( op != NULL );
+	SpinLock( &op->lock );
+	assert( op->reference_count > 0 );
+	references = --op->reference_count;
+	SpinUnlock( &op->lock );
+	if ( references > 0 )
+		return;
+
+	/*modified pages are written back by the flusher or when the last reference is released*/
+	ReleaseVnode( op->vnode );
+	kfree( op );
 }
 
 /*! Helper function to receive a VFS message - Used by file systems
  *  It blocks until a message arrives in the message queue and fills the given parameters based on the message
  * \param message_queue - message queue on which to wait to receive a message
- * \param wait_time - timeout value or receive operation.
+ * \param wait_time - timeout value or receive operation - not used, the receive is retried until a message arrives
  * \param type - output param - message type that is received
  * \param arg1 - arg6 - ouput params - message parameters
  * \note It dynamically allocates memory to receive MESSAGE_TYPE_REFERENCE messages, these messages can be freed by calling FreeVfsMessage()
  */
 ERROR_CODE GetVfsMessage(MESSAGE_QUEUE_PTR message_queue, UINT32 wait_time, MESSAGE_TYPE_PTR type, IPC_ARG_TYPE_PTR arg1, IPC_ARG_TYPE_PTR arg2, IPC_ARG_TYPE_PTR arg3, IPC_ARG_TYPE_PTR arg4, IPC_ARG_TYPE_PTR arg5, IPC_ARG_TYPE_PTR arg6)
 {
+	IPC_MESSAGE message;
+	UINT32 count;
 	ERROR_CODE err;
-	char * buf;
-	UINT32 length = 0;
 
-	/*may be this loop can be removed?*/
+	/*the message is taken out of the queue in one step - a peek followed by a receive could receive a different message, 
+	  since an urgent message can be queued ahead of the peeked one in between*/
 	while (1)
 	{
-		err = GetNextMessageInfo( message_queue, type, &length, 0 );
+		/*no receive buffer is given, so the kernel copy of a MESSAGE_TYPE_REFERENCE message is handed over(see ReceiveMessageBatch())*/
+		memset( &message, 0, sizeof(message) );
+		err = ReceiveMessageBatch( message_queue, &message, 1, &count, 0 );
 		if ( err == ERROR_SUCCESS )
 			break;
+		/*file systems do not receive vector messages - skip the message*/
+		if ( err == ERROR_INVALID_PARAMETER )
+			SkipMessage( message_queue );
 	}
-	/*if the message type is by reference then allocate memory and receive the message*/
-	if ( *type == MESSAGE_TYPE_REFERENCE ) 
-	{
-		buf = kmalloc(length, 0);
-		if ( buf == NULL )
-			return ERROR_NOT_ENOUGH_MEMORY;
-		err = ReceiveMessageCore( message_queue, arg1, arg2, arg3, arg4, buf, (IPC_ARG_TYPE)length, wait_time );
-		if ( err == ERROR_SUCCESS )
-		{
-			*(char **)IPR_ARGUMENT_ADDRESS = buf;
-			*(long *)IPC_ARGUMENT_LENGTH = length;
-		}
-	}
-	else if ( *type == MESSAGE_TYPE_VALUE || *type == MESSAGE_TYPE_SHARE )
-		err = ReceiveMessageCore( message_queue, arg1, arg2, arg3, arg4, arg5, arg6, wait_time );
-	else/*skip the message*/
-		err = ReceiveMessageCore( message_queue, NULL, NULL, NULL, NULL, NULL, NULL, wait_time );
-
-	return err;
+	if ( message.status != ERROR_SUCCESS )
+		return message.status;
+
+	*type = message.type;
+	*arg1 = message.args[IPC_ARG_INDEX_1];
+	*arg2 = message.args[IPC_ARG_INDEX_2];
+	*arg3 = message.args[IPC_ARG_INDEX_3];
+	*arg4 = message.args[IPC_ARG_INDEX_4];
+	*arg5 = message.args[IPC_ARG_INDEX_5];
+	*arg6 = message.args[IPC_ARG_INDEX_6];
+	
+	return ERROR_SUCCESS;
 }
 /*! Helper functions to free a message previously received using GetVfsMessage - Used by file systems */
 void FreeVfsMessage(MESSAGE_TYPE * type, IPC_ARG_TYPE * arg1, IPC_ARG_TYPE * arg2, IPC_ARG_TYPE * arg3, IPC_ARG_TYPE * arg4, IPC_ARG_TYPE * arg5, IPC_ARG_TYPE * arg6)
@@ -8,6 +8,8 @@
 #include <ds/lrulist.h>
 #include <sync/spinlock.h>
 #include <kernel/debug.h>
+#include <kernel/pit.h>
+#include <kernel/mm/kmem.h>
 #include <kernel/vfs/vfs.h>
 #include <kernel/pm/task.h>
 
@@ -15,6 +17,9 @@
 CACHE vnode_cache;
 
 static ERROR_CODE GetFileStat(MOUNTED_FILE_SYSTEM_PTR mount, UINT32 inode, char * file, FILE_STAT_PARAM_PTR fsp);
+static void FreeVnode(VNODE_PTR vnode);
+static void SetVnodeAttributes(VNODE_PTR vnode, FILE_STAT_PARAM_PTR fsp);
+static void ReclaimVnode();
 
 /*! Internal function used to initialize the Vnode structure*/
 int VnodeCacheConstructor(void * buffer)
@@ -23,6 +28,9 @@ int VnodeCacheConstructor(void * buffer)
 	memset(buffer, 0, sizeof(VNODE) );
 	
 	InitList( &vnode->hash_table_list );
+	InitList( &vnode->lru_list );
+	InitList( &vnode->dirty_list );
+	InitVnodePageTree( vnode );
 	
 	return 0;
 }
@@ -33,6 +41,28 @@ int VnodeCacheDestructor(void * buffer)
 	return 0;
 }
 
+/*! returns TRUE if the attributes of the vnode can be used without asking the FS*/
+#define VNODE_ATTRIBUTES_VALID(vnode)	( (INT32)((vnode)->attribute_expire_ticks - timer_ticks) > 0 )
+
+/*! returns the vnode hash table bucket index for the given mount and inode*/
+#define VNODE_HASH(mount, inode, size)	( ( ((UINT32)(mount) >> 4) ^ ((UINT32)(inode) * 2654435761UL) ) & ((size)-1) )
+
+/*! Initializes the vnode hash table and lru*/
+void InitVnodeHashTable()
+{
+	int i;
+	
+	InitSeqLock( &fs_control.vnode_hash_lock );
+	fs_control.vnode_hash_table = kmalloc( VNODE_HASH_TABLE_SIZE * sizeof(LIST), KMEM_NO_FAIL );
+	for(i=0; i<VNODE_HASH_TABLE_SIZE; i++)
+		InitList( &fs_control.vnode_hash_table[i] );
+	fs_control.vnode_hash_size = VNODE_HASH_TABLE_SIZE;
+	fs_control.vnode_count = 0;
+	
+	InitSpinLock( &fs_control.vnode_lru_lock );
+	InitList( &fs_control.vnode_lru_list );
+}
+
 /*! References a vnode so that it will hold
 	\param vnode - vnode to be referenced
 	\param de - directory entry associated if any
@@ -40,28 +70,264 @@ int VnodeCacheDestructor(void * buffer)
 void ReferenceVnode(VNODE_PTR vnode, DIRECTORY_ENTRY_PTR de)
 {
 	assert( vnode!= NULL );
+	SpinLock( &vnode->lock );
 	vnode->reference_count++;
+	SpinUnlock( &vnode->lock );
 	if ( de )
 		vnode->directory_entry = de;
 }
 /*! Releases a vnode
+	A hashed vnode is not freed when the last reference goes away, it is kept in the lru so that its
+	pages can be reused if the file is opened again.
 	\param vnode - vnode to be released
 */
 void ReleaseVnode(VNODE_PTR vnode)
 {
+	BOOLEAN busy, cached = FALSE;
+	
 	assert( vnode!= NULL );
 	
+	SpinLock( &vnode->lock );
+	assert( vnode->reference_count > 0 );
 	vnode->reference_count--;
+	busy = vnode->reference_count > 0;
+	SpinUnlock( &vnode->lock );
+	if( busy )
+		return;
 	
-	if( vnode->reference_count > 0 )
+	SpinLock( &fs_control.vnode_lru_lock );
+	SpinLock( &vnode->lock );
+	/*lookup might have found it meanwhile*/
+	busy = vnode->reference_count > 0;
+	if ( !busy && vnode->hashed )
+	{
+		RemoveFromList( &vnode->lru_list );
+		AddToList( &fs_control.vnode_lru_list, &vnode->lru_list );
+		cached = TRUE;
+	}
+	SpinUnlock( &vnode->lock );
+	SpinUnlock( &fs_control.vnode_lru_lock );
+	
+	if ( cached )
+	{
+		if ( fs_control.vnode_count > fs_param.vnode.max_buffers )
+			ReclaimVnode();
+	}
+	else if ( !busy )
+		FreeVnode( vnode );
+}
+
+/*! Writes back and frees an unreferenced vnode which is not in the hash table
+	\param vnode - vnode to be freed
+*/
+static void FreeVnode(VNODE_PTR vnode)
+{
+	assert( !vnode->hashed );
+	/*flusher might have referenced the vnode while its pages are written back*/
+	if ( ReleaseVnodePages(vnode) != ERROR_SUCCESS )
 		return;
-		
-	ReleaseVnodePages(vnode);
 	FreeBuffer( vnode, &vnode_cache );
 }
-void AddVnodeToHashTable(VNODE_PTR vnode)
+
+/*! Removes a vnode from the hash table - caller should hold the hash write lock and the vnode lock*/
+static void UnhashVnode(VNODE_PTR vnode)
+{
+	assert( vnode->hashed );
+	RemoveFromList( &vnode->hash_table_list );
+	vnode->hashed = 0;
+	fs_control.vnode_count--;
+}
+
+/*! Searches the vnode hash table without taking any lock
+	Vnode buffers are never given back by the vnode cache, so a vnode found in the chain can be locked
+	even if it was freed meanwhile; it is used only if it is still hashed with the same identity.
+	\param mount - mounted file system
+	\param inode - inode number
+	\return referenced vnode or NULL
+*/
+static VNODE_PTR LookupVnode(MOUNTED_FILE_SYSTEM_PTR mount, UINT32 inode)
+{
+	LIST_PTR head, node;
+	VNODE_PTR vnode;
+	unsigned long sequence;
+	
+retry:
+	sequence = ReadSeqBegin( &fs_control.vnode_hash_lock );
+	head = &fs_control.vnode_hash_table[ VNODE_HASH(mount, inode, fs_control.vnode_hash_size) ];
+	vnode = NULL;
+	for( node = head->next; node != head; node = node->next )
+	{
+		/*dont follow a chain which is being modified*/
+		if ( ReadSeqRetry( &fs_control.vnode_hash_lock, sequence ) )
+			goto retry;
+		vnode = STRUCT_ADDRESS_FROM_MEMBER( node, VNODE, hash_table_list );
+		if ( vnode->mounted_fs == mount && vnode->inode_number == inode )
+			break;
+		vnode = NULL;
+	}
+	if ( vnode == NULL )
+	{
+		if ( ReadSeqRetry( &fs_control.vnode_hash_lock, sequence ) )
+			goto retry;
+		return NULL;
+	}
+	
+	SpinLock( &vnode->lock );
+	if ( !vnode->hashed || vnode->mounted_fs != mount || vnode->inode_number != inode )
+	{
+		SpinUnlock( &vnode->lock );
+		goto retry;
+	}
+	vnode->reference_count++;
+	SpinUnlock( &vnode->lock );
+	return vnode;
+}
+
+/*! Doubles the vnode hash table
+	The old table is not freed since lockless lookups might still be walking it; the table only grows
+	upto VNODE_HASH_TABLE_MAX_SIZE, so the wasted memory is bounded.
+*/
+static void GrowVnodeHashTable()
 {
+	LIST_PTR table, old_table;
+	UINT32 i, size;
+	
+	size = fs_control.vnode_hash_size * 2;
+	if ( size > VNODE_HASH_TABLE_MAX_SIZE )
+		return;
+	table = kmalloc( size * sizeof(LIST), 0 );
+	if ( table == NULL )
+		return;
+	for(i=0; i<size; i++)
+		InitList( &table[i] );
 	
+	WriteSeqLock( &fs_control.vnode_hash_lock );
+	/*somebody else might have grown it meanwhile*/
+	if ( fs_control.vnode_hash_size * 2 != size )
+	{
+		WriteSeqUnlock( &fs_control.vnode_hash_lock );
+		kfree( table );
+		return;
+	}
+	old_table = fs_control.vnode_hash_table;
+	for(i=0; i<fs_control.vnode_hash_size; i++)
+	{
+		while( !IsListEmpty( &old_table[i] ) )
+		{
+			VNODE_PTR vnode = STRUCT_ADDRESS_FROM_MEMBER( old_table[i].next, VNODE, hash_table_list );
+			RemoveFromList( &vnode->hash_table_list );
+			AddToList( &table[ VNODE_HASH(vnode->mounted_fs, vnode->inode_number, size) ], &vnode->hash_table_list );
+		}
+	}
+	fs_control.vnode_hash_table = table;
+	fs_control.vnode_hash_size = size;
+	WriteSeqUnlock( &fs_control.vnode_hash_lock );
+}
+
+/*! Adds a new vnode to the hash table
+	\param vnode - new vnode with mounted_fs and inode_number filled
+	\return the given vnode or the already hashed vnode(referenced) if another thread added the same inode meanwhile
+*/
+VNODE_PTR AddVnodeToHashTable(VNODE_PTR vnode)
+{
+	LIST_PTR head, node;
+	BOOLEAN grow;
+	
+	assert( vnode != NULL && !vnode->hashed );
+	
+	WriteSeqLock( &fs_control.vnode_hash_lock );
+	head = &fs_control.vnode_hash_table[ VNODE_HASH(vnode->mounted_fs, vnode->inode_number, fs_control.vnode_hash_size) ];
+	LIST_FOR_EACH( node, head )
+	{
+		VNODE_PTR existing = STRUCT_ADDRESS_FROM_MEMBER( node, VNODE, hash_table_list );
+		if ( existing->mounted_fs == vnode->mounted_fs && existing->inode_number == vnode->inode_number )
+		{
+			SpinLock( &existing->lock );
+			existing->reference_count++;
+			SpinUnlock( &existing->lock );
+			WriteSeqUnlock( &fs_control.vnode_hash_lock );
+			return existing;
+		}
+	}
+	vnode->hashed = 1;
+	AddToList( head, &vnode->hash_table_list );
+	fs_control.vnode_count++;
+	grow = fs_control.vnode_count > 2 * fs_control.vnode_hash_size;
+	WriteSeqUnlock( &fs_control.vnode_hash_lock );
+	
+	if ( grow )
+		GrowVnodeHashTable();
+	return vnode;
+}
+
+/*! Frees the least recently used unreferenced vnode*/
+static void ReclaimVnode()
+{
+	VNODE_PTR vnode, victim = NULL;
+	
+	SpinLock( &fs_control.vnode_lru_lock );
+	while( victim == NULL && !IsListEmpty( &fs_control.vnode_lru_list ) )
+	{
+		vnode = STRUCT_ADDRESS_FROM_MEMBER( fs_control.vnode_lru_list.prev, VNODE, lru_list );
+		RemoveFromList( &vnode->lru_list );
+		
+		WriteSeqLock( &fs_control.vnode_hash_lock );
+		SpinLock( &vnode->lock );
+		/*a referenced vnode is added back to the lru when it is released*/
+		if ( vnode->reference_count == 0 )
+		{
+			UnhashVnode( vnode );
+			victim = vnode;
+		}
+		SpinUnlock( &vnode->lock );
+		WriteSeqUnlock( &fs_control.vnode_hash_lock );
+	}
+	SpinUnlock( &fs_control.vnode_lru_lock );
+	
+	if ( victim )
+		FreeVnode( victim );
+}
+
+/*! Removes all the vnodes of a mount from the vnode hash table
+	Unreferenced vnodes are freed immediately, the others are freed when their last reference goes away.
+	\param mount - mounted file system which is going away
+*/
+void PurgeMountVnodes(MOUNTED_FILE_SYSTEM_PTR mount)
+{
+	LIST free_list;
+	LIST_PTR node, next;
+	VNODE_PTR vnode;
+	UINT32 i;
+	
+	InitList( &free_list );
+	SpinLock( &fs_control.vnode_lru_lock );
+	WriteSeqLock( &fs_control.vnode_hash_lock );
+	for(i=0; i<fs_control.vnode_hash_size; i++)
+	{
+		LIST_FOR_EACH_SAFE( node, next, &fs_control.vnode_hash_table[i] )
+		{
+			vnode = STRUCT_ADDRESS_FROM_MEMBER( node, VNODE, hash_table_list );
+			if ( vnode->mounted_fs != mount )
+				continue;
+			SpinLock( &vnode->lock );
+			UnhashVnode( vnode );
+			if ( vnode->reference_count == 0 )
+			{
+				RemoveFromList( &vnode->lru_list );
+				AddToList( &free_list, &vnode->lru_list );
+			}
+			SpinUnlock( &vnode->lock );
+		}
+	}
+	WriteSeqUnlock( &fs_control.vnode_hash_lock );
+	SpinUnlock( &fs_control.vnode_lru_lock );
+	
+	while( !IsListEmpty( &free_list ) )
+	{
+		vnode = STRUCT_ADDRESS_FROM_MEMBER( free_list.next, VNODE, lru_list );
+		RemoveFromList( &vnode->lru_list );
+		FreeVnode( vnode );
+	}
 }
 
 /*! Get vnode from the given file id
@@ -70,30 +336,35 @@ void AddVnodeToHashTable(VNODE_PTR vnode)
 */
 VNODE_PTR GetVnodeFromFile(int file_id)
 {
-	TASK_PTR task;
 	OPEN_FILE_INFO_PTR op;
-	if( file_id < 0 || file_id >= MAX_OPEN_FILE )
-		return NULL;
+	VNODE_PTR vnode;
 	
-	task = GetCurrentTask();
-	op = &task->process_file_info.open_file_info[file_id];
+	op = GetOpenFileInfo( GetCurrentTask(), file_id );
+	if ( op == NULL )
+		return NULL;
+	vnode = op->vnode;
+	ReleaseOpenFileInfo( op );
 	
-	return op->vnode;
+	return vnode;
 }
 
 /*! Returns a vnode for a given directory entry
+	The directory entry keeps its own reference on the vnode, so the vnode stays cached as long as the entry.
 	\param de - directory entry for which vnode needs to be created/returned
-	\param result - resulting vnode will be placed here
+	\param file_path - full path of the directory entry - file system is queried using this path
+	\param result - resulting vnode will be placed here - the caller gets a reference
 */
-ERROR_CODE GetVnode(DIRECTORY_ENTRY_PTR de, VNODE_PTR * result)
+ERROR_CODE GetVnode(DIRECTORY_ENTRY_PTR de, char * file_path, VNODE_PTR * result)
 {
-	VNODE_PTR vnode;
+	VNODE_PTR vnode, new_vnode;
+	FILE_STAT_PARAM_PTR attributes;
 	char * file;
 	MOUNTED_FILE_SYSTEM_PTR mount;
 	FILE_STAT_PARAM fsp;
 	ERROR_CODE ret;
 	
 	assert( de!=NULL );
+	assert( file_path!=NULL );
 	assert( result!=NULL );
 	
 	*result = NULL;
@@ -101,43 +372,75 @@ ERROR_CODE GetVnode(DIRECTORY_ENTRY_PTR de, VNODE_PTR * result)
 	if ( vnode == NULL)
 	{
 		UINT32 inode = -1;
-		/*\todo - check if it in hash table?*/
 
-		/*create new vnode*/
-		vnode = AllocateBuffer( &vnode_cache, 0 );
-		if( de->mounted_fs == NULL )
+		/*get the file name without mount name*/
+		file = strchr(&file_path[1], PATH_SEPARATOR);
+		if( file == NULL )
+			file = "/";
+		
+		/*get the mounted file system*/
+		mount = GetMount(file_path);
+		if ( mount == NULL)
+			return ERROR_INVALID_PATH;
+		
+		/*use the attributes from a recent directory read, else reterive the file information from fs*/
+		attributes = TakeDirectoryEntryAttributes( de );
+		if ( attributes != NULL )
 		{
-			/*get the file name without mount name*/
-			file = strchr(&de->name[1], PATH_SEPARATOR);
-			if( file == NULL )
-				file = "/";
+			memcpy( &fsp, attributes, sizeof(FILE_STAT_PARAM) );
+			kfree( attributes );
+		}
+		else
+		{
+			ret = GetFileStat(mount, inode, file, &fsp);
+			if ( ret != ERROR_SUCCESS )
+				return ret;
+		}
+		
+		/*the inode might be cached already through another path*/
+		vnode = LookupVnode( mount, fsp.inode );
+		if ( vnode == NULL )
+		{
+			if ( fs_control.vnode_count >= fs_param.vnode.max_buffers )
+				ReclaimVnode();
 			
-			/*get the mounted file system*/
-			mount = GetMount(de->name);
-			if ( mount == NULL)
-			{
-				FreeBuffer(vnode, &vnode_cache);
-				return ERROR_INVALID_PATH;	
-			}
+			/*create new vnode*/
+			vnode = AllocateBuffer( &vnode_cache, 0 );
+			if ( vnode == NULL )
+				return ERROR_NOT_ENOUGH_MEMORY;
+			SetVnodeAttributes( vnode, &fsp );
+			vnode->inode_number = fsp.inode;
+			vnode->mounted_fs = mount;
+			vnode->reference_count = 1;
+			
+			new_vnode = vnode;
+			vnode = AddVnodeToHashTable( new_vnode );
+			/*lost the race - lockless lookups might touch vnode buffers, so dont reinitialize it*/
+			if ( vnode != new_vnode )
+				FreeBuffer( new_vnode, &vnode_cache );
 		}
 		
-		/*reterive the file information from fs*/
-		ret = GetFileStat(mount, inode, file, &fsp);
-		if ( ret != ERROR_SUCCESS )
+		/*the reference taken above belongs to the directory entry*/
+		SpinLock( &de->lock );
+		if ( de->vnode == NULL )
+		{
+			de->vnode = vnode;
+			de->inode_number = vnode->inode_number;
+			de->mounted_fs = mount;
+			de->fs_data = vnode->fs_data;
+			SpinUnlock( &de->lock );
+		}
+		else
 		{
-			FreeBuffer(vnode, &vnode_cache);
-			return ret;	
+			/*another thread resolved the same entry meanwhile*/
+			SpinUnlock( &de->lock );
+			ReleaseVnode( vnode );
+			vnode = de->vnode;
 		}
-		vnode->created_time = fsp.created_time;
-		vnode->file_size = fsp.file_size;
-		vnode->fs_data = fsp.fs_data;
-		vnode->inode_number = fsp.inode;
-		vnode->modified_time = fsp.modified_time;
-		vnode->mounted_fs = mount;
-		AddVnodeToHashTable( vnode );
 	}
+	else
+		RevalidateVnodeAttributes( vnode );
 	ReferenceVnode(vnode, de);
-	de->vnode = vnode;
 	
 	*result = vnode;
 	return ERROR_SUCCESS;
@@ -158,14 +461,90 @@ static ERROR_CODE GetFileStat(MOUNTED_FILE_SYSTEM_PTR mount, UINT32 inode, char
 	assert( fsp != NULL );
 	
 	/*Send message to the file system to get the stat for a file*/
-	if ( inode >=0 )
-		SendMessageCore(mount->file_system->task, mount->file_system->message_queue, MESSAGE_TYPE_REFERENCE, (IPC_ARG_TYPE) VFS_IPC_GET_FILE_STAT_PATH, mount->fs_data, NULL, NULL, file, (IPC_ARG_TYPE)strlen(file)+1, VFS_TIME_OUT);
+	if ( file != NULL )
+		ret = CallMessage(mount->file_system->task, mount->file_system->message_queue, MESSAGE_TYPE_REFERENCE, (IPC_ARG_TYPE) VFS_IPC_GET_FILE_STAT_PATH, mount->fs_data, NULL, NULL, file, (IPC_ARG_TYPE)strlen(file)+1, 
+			MESSAGE_TYPE_REFERENCE, &fs_result, NULL, NULL, NULL, fsp, (IPC_ARG_TYPE) sizeof(FILE_STAT_PARAM), VFS_TIME_OUT );
 	else
-		SendMessageCore(mount->file_system->task, mount->file_system->message_queue, MESSAGE_TYPE_VALUE, (IPC_ARG_TYPE) VFS_IPC_GET_FILE_STAT_INODE, mount->fs_data, NULL, NULL, (IPC_ARG_TYPE)inode, NULL, VFS_TIME_OUT);
-	ret = WaitForReply(MESSAGE_TYPE_REFERENCE, &fs_result, NULL, NULL, NULL, fsp, (IPC_ARG_TYPE) sizeof(FILE_STAT_PARAM), VFS_TIME_OUT );
-	if ( ret != ERROR_SUCCESS || fs_result != VFS_RETURN_CODE_SUCCESS )
+		ret = CallMessage(mount->file_system->task, mount->file_system->message_queue, MESSAGE_TYPE_VALUE, (IPC_ARG_TYPE) VFS_IPC_GET_FILE_STAT_INODE, mount->fs_data, NULL, NULL, (IPC_ARG_TYPE)inode, NULL, 
+			MESSAGE_TYPE_REFERENCE, &fs_result, NULL, NULL, NULL, fsp, (IPC_ARG_TYPE) sizeof(FILE_STAT_PARAM), VFS_TIME_OUT );
+	if ( ret != ERROR_SUCCESS )
+		return ret;
+	if ( fs_result != VFS_RETURN_CODE_SUCCESS )
 		return ERROR_INVALID_PATH;
 	
 	return ERROR_SUCCESS;
 }
 
+/*! Fills the attributes of a vnode from a file stat and restarts the attribute cache timer
+	\param vnode - vnode
+	\param fsp - file stat returned by the FS
+*/
+static void SetVnodeAttributes(VNODE_PTR vnode, FILE_STAT_PARAM_PTR fsp)
+{
+	vnode->created_time = fsp->created_time;
+	vnode->file_size = fsp->file_size;
+	vnode->mode = fsp->mode;
+	vnode->fs_data = fsp->fs_data;
+	vnode->modified_time = fsp->modified_time;
+	vnode->attribute_expire_ticks = timer_ticks + MILLISECONDS_TO_TICKS( fs_param.vnode.attribute_cache_time );
+}
+
+/*! Fetches the attributes of a vnode again from the FS if the cached ones expired
+	\param vnode - referenced vnode
+*/
+ERROR_CODE RevalidateVnodeAttributes(VNODE_PTR vnode)
+{
+	FILE_STAT_PARAM fsp;
+	BOOLEAN fetched = FALSE;
+	ERROR_CODE ret;
+	
+	assert( vnode != NULL );
+	if ( VNODE_ATTRIBUTES_VALID(vnode) || vnode->mounted_fs == NULL )
+		return ERROR_SUCCESS;
+	
+	/*size of a file having unwritten pages is known only to the ubc*/
+	if ( vnode->dirty_pages == 0 )
+	{
+		ret = GetFileStat( vnode->mounted_fs, vnode->inode_number, NULL, &fsp );
+		if ( ret != ERROR_SUCCESS )
+			return ret;
+		fetched = TRUE;
+	}
+	SpinLock( &vnode->lock );
+	if ( fetched && vnode->dirty_pages == 0 )
+		SetVnodeAttributes( vnode, &fsp );
+	else
+		vnode->attribute_expire_ticks = timer_ticks + MILLISECONDS_TO_TICKS( fs_param.vnode.attribute_cache_time );
+	SpinUnlock( &vnode->lock );
+	
+	return ERROR_SUCCESS;
+}
+
+/*! Refreshes the attributes of a cached vnode from a file stat returned by a directory read
+	\param mount - mounted file system of the directory
+	\param fsp - file stat of a file in the directory
+*/
+void UpdateVnodeAttributes(MOUNTED_FILE_SYSTEM_PTR mount, FILE_STAT_PARAM_PTR fsp)
+{
+	VNODE_PTR vnode;
+	
+	vnode = LookupVnode( mount, fsp->inode );
+	if ( vnode == NULL )
+		return;
+	SpinLock( &vnode->lock );
+	if ( vnode->dirty_pages == 0 )
+		SetVnodeAttributes( vnode, fsp );
+	SpinUnlock( &vnode->lock );
+	ReleaseVnode( vnode );
+}
+
+/*! Marks the cached attributes of a vnode as stale, so that they are fetched again on next use
+	Called after a file system request which changes the file attributes returns.
+	\param vnode - referenced vnode
+*/
+void InvalidateVnodeAttributes(VNODE_PTR vnode)
+{
+	SpinLock( &vnode->lock );
+	vnode->attribute_expire_ticks = timer_ticks;
+	SpinUnlock( &vnode->lock );
+}
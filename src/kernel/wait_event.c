@@ -8,25 +8,24 @@
 #include <kernel/debug.h>
 #include <kernel/interrupt.h>
 #include <kernel/wait_event.h>
-#include <kernel/mm/kmem.h>
 #include <kernel/pm/scheduler.h>
 #include <kernel/pm/timeout_queue.h>
 #include <kernel/pm/thread.h>
 
 static void ClearRelatedWaitEvents(WAIT_EVENT_PTR event);
+static void FireWaitEvent(WAIT_EVENT_PTR wait_event, THREAD_PTR * handoff);
+static void WakeUpEventCore(WAIT_EVENT_PTR *event, int flag, THREAD_PTR * handoff);
+static void EnqueueWaitEvent(WAIT_EVENT_PTR *wait_queue, WAIT_EVENT_PTR wait_event);
+static BYTE DetachWaitEvent(WAIT_EVENT_PTR event);
+static void RemoveEventFromQueue(WAIT_EVENT_PTR search_wait_event, WAIT_EVENT_PTR *wait_queue);
 
 /*!
-\brief	Creates and adds an event to the wait queue.
+\brief	Adds the given event at the end of the wait queue.
 \param	wait_queue	Wait queue inside which the thread has to wait.
+\param	wait_event	Event to add
 */
-WAIT_EVENT_PTR AddToEventQueue(WAIT_EVENT_PTR *wait_queue)
+static void EnqueueWaitEvent(WAIT_EVENT_PTR *wait_queue, WAIT_EVENT_PTR wait_event)
 {
-	WAIT_EVENT_PTR wait_event = kmalloc(sizeof(WAIT_EVENT), KMEM_NO_FAIL);
-	wait_event->thread = GetCurrentThread();
-	InitList( &(wait_event->in_queue) );
-	InitList( &(wait_event->thread_events) );
-	wait_event->fired = 0;
-
 	assert( wait_queue != NULL );
 	
 	if(*wait_queue == NULL)
@@ -35,65 +34,215 @@ WAIT_EVENT_PTR AddToEventQueue(WAIT_EVENT_PTR *wait_queue)
 	{
 		AddToListTail( &((*wait_queue)->in_queue), &(wait_event->in_queue) );
 	}
+}
 
-	return wait_event;
+/*!
+\brief	Initializes a wait queue.
+\param	wait_queue	Wait queue to initialize
+*/
+void InitWaitQueue(WAIT_QUEUE_PTR wait_queue)
+{
+	InitSpinLock( &wait_queue->lock );
+	wait_queue->head = NULL;
 }
 
+/*!
+\brief	Initializes a wait event owned by the caller for the current thread.
+		The event is usually a local variable, so waiting on it needs no memory allocation. 
+		It must be waited on with WaitForWaitEvent() or removed with RemoveWaitEvent() before it goes out of scope.
+\param	event	Event to initialize
+*/
+void InitWaitEventOnStack(WAIT_EVENT_PTR event)
+{
+	event->thread = GetCurrentThread();
+	event->fired = 0;
+	event->queue = NULL;
+	InitList( &(event->in_queue) );
+	InitList( &(event->thread_events) );
+}
 
 /*!
-\brief	Waits for a particular event to fire until specified timeout.
-\param	event		Event on which we have to wait
-\param	timeout		Units in milli secobds; If =0, no timeout, block until the event happens; >0, block until either event fires up or the timeout happens.
-Returns >0(remaining time) if event happened before timeout or 0 on failure(timeout happenned and no event showed up)
+\brief	Adds an event initialized by InitWaitEventOnStack() to a wait queue.
+		To wait for multiple events, link them with ADD_MULTIPLE_WAIT_EVENTS() before adding them to their queues.
+\param	wait_queue	Wait queue inside which the thread has to wait.
+\param	event		Event to add
 */
-UINT32 WaitForEvent(WAIT_EVENT_PTR event, UINT32 timeout)
+void AddWaitEventToQueue(WAIT_QUEUE_PTR wait_queue, WAIT_EVENT_PTR event)
 {
-	int ret_timeout;
-	THREAD_PTR my_thread;
+	assert( event->queue == NULL );
+	SpinLock( &wait_queue->lock );
+	EnqueueWaitEvent( &wait_queue->head, event );
+	event->queue = wait_queue;
+	SpinUnlock( &wait_queue->lock );
+}
 
-	assert( event->thread == GetCurrentThread() );	/* This is necessary to avoid rogue threads inducing sleep to innocent threads */
+/*!
+\brief	Waits for an event added by AddWaitEventToQueue() or any of its related events to fire.
+		All the related events are removed from their queues before returning, so they can go out of scope after this call.
+\param	event		Event on which we have to wait
+\param	timeout		Units in milli seconds; If =0, block until the event happens
+\return	ERROR_SUCCESS if the event or a related event fired(check the fired field to find out which one), ERROR_TIMEOUT otherwise
+*/
+ERROR_CODE WaitForWaitEvent(WAIT_EVENT_PTR event, UINT32 timeout)
+{
+	/* This is necessary to avoid rogue threads inducing sleep to innocent threads; the event might have fired already */
+	assert( event->thread == NULL || event->thread == GetCurrentThread() );
 	
-	if(timeout > 0) /* Wait until the event fires up or the timeout expires */
+	if ( timeout > 0 )
 	{
-		ret_timeout = Sleep(timeout); /* This will block for the specified time */
-		if(ret_timeout > 0) /* We woke up because, some other event finished */
-		{
-			/* Removes the registered timeout event from timout queue */
-			if (RemoveFromTimeoutQueue() == -1)
-				panic("timeout queue corrupted\n");
-			return ret_timeout;
-		}
-		else /* Timeout happenned and no event fired up. */
+		/* Sleep() returns the remaining time if the event fired before the timeout, the timeout is not needed anymore */
+		if ( Sleep( timeout ) > 0 && RemoveFromTimeoutQueue() == -1 )
+			panic("timeout queue corrupted\n");
+	}
+	else
+	{
+		/* wake ups which are not for this event(EVENT_FIRED state left by earlier waits) should not end the wait */
+		do
 		{
-			my_thread = (THREAD_PTR)(event->thread);
-			if(my_thread != NULL) /* Nobody has yet cleared the events */
-			{
-				SpinLock( &(my_thread->wait_event_queue_lock) );
-				ClearRelatedWaitEvents(event);
-				event->thread = NULL;
-				SpinUnlock( &(my_thread->wait_event_queue_lock) );
-			}
-			return 0;
-		}
+			PauseThread();
+		}while( event->thread != NULL );
+	}
+	
+	return RemoveWaitEvent( event ) ? ERROR_SUCCESS : ERROR_TIMEOUT;
+}
+
+/*!
+\brief	Removes an event and its related events from their wait queues without waiting.
+		After this call nobody refers the events.
+\param	event		Event added by AddWaitEventToQueue()
+\return	TRUE if the event or any of its related events has fired
+*/
+BOOLEAN RemoveWaitEvent(WAIT_EVENT_PTR event)
+{
+	LIST_PTR node;
+	BYTE fired;
+	
+	fired = DetachWaitEvent( event );
+	LIST_FOR_EACH( node, &(event->thread_events) )
+		fired |= DetachWaitEvent( STRUCT_ADDRESS_FROM_MEMBER(node, WAIT_EVENT, thread_events) );
+	
+	return fired ? TRUE : FALSE;
+}
+
+/*!
+\brief	Makes an event dormant and removes it from its wait queue.
+\param	event	Event to remove
+\return	1 if the event has fired
+*/
+static BYTE DetachWaitEvent(WAIT_EVENT_PTR event)
+{
+	THREAD_PTR my_thread = GetCurrentThread();
+	WAIT_QUEUE_PTR wait_queue;
+	
+	/* wakers check the thread under this lock, so after this nobody will fire the event */
+	SpinLock( &(my_thread->wait_event_queue_lock) );
+	event->thread = NULL;
+	wait_queue = event->queue;
+	SpinUnlock( &(my_thread->wait_event_queue_lock) );
+	
+	/* a waker might still be using the event - it holds the queue lock till it is done */
+	if ( wait_queue != NULL )
+	{
+		SpinLock( &wait_queue->lock );
+		if ( event->queue == wait_queue )
+			RemoveEventFromQueue( event, &wait_queue->head );
+		SpinUnlock( &wait_queue->lock );
+	}
+	
+	return event->fired;
+}
+
+/*!
+\brief	Wakes up the threads waiting on a wait queue.
+\param	wait_queue	Wake up threads waiting on this queue.
+\param	flag		If it contains WAIT_EVENT_WAKE_UP_ALL, wake up all threads waiting on this queue, else wake up only 1st thread in queue.
+*/
+void WakeUpWaitQueue(WAIT_QUEUE_PTR wait_queue, int flag)
+{
+	SpinLock( &wait_queue->lock );
+	WakeUpEventCore( &wait_queue->head, flag, NULL );
+	SpinUnlock( &wait_queue->lock );
+}
+
+/*!
+\brief	Same as WakeUpWaitQueue() but one of the blocked threads is not added to the ready queue.
+		The caller should switch to the returned thread using SetHandoffThread() or make it ready by calling ScheduleThread().
+\param	wait_queue	Wake up threads waiting on this queue.
+\param	flag		WAIT_EVENT_WAKE_UP_ALL or 0
+\return thread which is woken up but not made ready or NULL
+*/
+THREAD_PTR WakeUpWaitQueueForHandoff(WAIT_QUEUE_PTR wait_queue, int flag)
+{
+	THREAD_PTR handoff = NULL;
+	
+	SpinLock( &wait_queue->lock );
+	WakeUpEventCore( &wait_queue->head, flag, &handoff );
+	SpinUnlock( &wait_queue->lock );
+	
+	return handoff;
+}
+
+/*!
+\brief	Fires a wait event and wakes up its thread
+\param	wait_event	Event which is removed from the wait queue
+\param	handoff		If not NULL and it does not have a thread yet, a blocked thread is put here instead of making it ready
+*/
+static void FireWaitEvent(WAIT_EVENT_PTR wait_event, THREAD_PTR * handoff)
+{
+	THREAD_PTR thread;
+	
+	thread = (THREAD_PTR)(wait_event->thread);
+	if(thread == NULL)
+	{
+		wait_event->queue = NULL;
+		return;
 	}
-	else /* Wait until the event fires up */
+	
+	SpinLock( &(thread->wait_event_queue_lock) );
+	/* The waiter might have timed out or a related event might have fired meanwhile */
+	if( wait_event->thread == NULL )
+	{
+		wait_event->queue = NULL;
+		SpinUnlock( &(thread->wait_event_queue_lock) );
+		return;
+	}
+	ClearRelatedWaitEvents(wait_event);
+	wait_event->fired = 1;
+	wait_event->thread = NULL;
+	/* This should be the last access to the event - the waiter can return once it sees this */
+	wait_event->queue = NULL;
+	SpinUnlock( &(thread->wait_event_queue_lock) );
+
+	SpinLock( &(thread->lock) );
+	if(thread->state == THREAD_STATE_RUN)
 	{
-		PauseThread();
-		return 0;
+		thread->state = THREAD_STATE_EVENT_FIRED;	/* An intermediate state to instruct the thread not to sleep or block */
+		SpinUnlock( &(thread->lock) );
+	}
+	else if( handoff != NULL && *handoff == NULL && thread->state == THREAD_STATE_WAITING )
+	{
+		/* The thread is claimed by the caller - ResumeThread() ignores it in this state */
+		thread->state = THREAD_STATE_TRANSITION;
+		SpinUnlock( &(thread->lock) );
+		*handoff = thread;
+	}
+	else
+	{
+		SpinUnlock( &(thread->lock) );
+		ResumeThread(thread);
 	}
 }
 
 /*!
-\brief	Wake up any other threads blocking on this event.
+\brief	Wakes up the threads waiting on the event queue
 \param	event	Wake up threads waiting on this event.
 \param	flag	If it contains WAIT_EVENT_WAKE_UP_ALL, wake up all threads waiting on this event, else wake up only 1st thread in queue.
-Before entering here a lock should be taken for this wait event queue
+\param	handoff	If not NULL, one blocked thread is returned here instead of making it ready
 */
-void WakeUpEvent(WAIT_EVENT_PTR *event, int flag)
+static void WakeUpEventCore(WAIT_EVENT_PTR *event, int flag, THREAD_PTR * handoff)
 {
 	LIST_PTR temp_list1, temp_list2, head_list;
 	WAIT_EVENT_PTR temp_wait_event;
-	THREAD_PTR thread;
 
 	assert( event!=NULL );
 	/*if no one is waiting return*/
@@ -109,27 +258,7 @@ void WakeUpEvent(WAIT_EVENT_PTR *event, int flag)
 				continue;
 			temp_wait_event = STRUCT_ADDRESS_FROM_MEMBER(temp_list1, WAIT_EVENT, in_queue);
 			RemoveFromList( &(temp_wait_event->in_queue) );
-			thread = (THREAD_PTR)(temp_wait_event->thread);
-			if(thread != NULL)
-			{
-				SpinLock( &(thread->wait_event_queue_lock) );
-				ClearRelatedWaitEvents(temp_wait_event);
-				temp_wait_event->thread = NULL;
-				SpinUnlock( &(thread->wait_event_queue_lock) );
-				temp_wait_event->fired = 1;
-
-				SpinLock( &(thread->lock) );
-				if(thread->state == THREAD_STATE_RUN)
-				{
-					thread->state = THREAD_STATE_EVENT_FIRED;	/* An intermediate state to instruct the thread not to sleep or block */
-					SpinUnlock( &(thread->lock) );
-				}
-				else
-				{
-					SpinUnlock( &(thread->lock) );
-					ResumeThread(thread);
-				}
-			}
+			FireWaitEvent( temp_wait_event, handoff );
 		}
 		temp_wait_event = *event;
 		*event = NULL; /* This is the queue pointer from the structure. The wait_event is still active and should be freed after the thread is woken up*/
@@ -138,59 +267,35 @@ void WakeUpEvent(WAIT_EVENT_PTR *event, int flag)
 	{
 		temp_wait_event = *event;
 		if(!IsListEmpty(head_list))
+		{
+			*event = STRUCT_ADDRESS_FROM_MEMBER(head_list->next, WAIT_EVENT, in_queue);
 			RemoveFromList(head_list);
+		}
 		else
 			*event = NULL;
 		
 	}
 
 	/* Now wake up the first thread in wait event queue, because we had skipped that in the previous loop */
-	thread = (THREAD_PTR)(temp_wait_event->thread);
-	if(thread != NULL)
-	{
-		SpinLock( &(thread->wait_event_queue_lock) );
-		ClearRelatedWaitEvents(temp_wait_event);
-		temp_wait_event->thread = NULL;
-		SpinUnlock( &(thread->wait_event_queue_lock) );
-		temp_wait_event->fired = 1;
-
-		SpinLock( &(thread->lock) );
-		if(thread->state == THREAD_STATE_RUN)
-		{
-			thread->state = THREAD_STATE_EVENT_FIRED;	/* An intermediate state to instruct the thread not to sleep or block */
-			SpinUnlock( &(thread->lock) );
-		}
-		else
-		{
-			SpinUnlock( &(thread->lock) );
-			ResumeThread(thread);
-		}
-	}
+	FireWaitEvent( temp_wait_event, handoff );
 }
 
 /*!
  * \brief	Clears related threade events.
  * \param	event	Wait event for which the related thread events are to be cleared
- * Note: Only the THREAD pointer in event is made NULL and the event is disengaged from the thread events LIST.
+ * Note: Only the THREAD pointer in event is made NULL. The events are kept in the thread events LIST so that the 
+ * waiter can find and remove them from their queues(see RemoveWaitEvent()).
  */
 static void ClearRelatedWaitEvents(WAIT_EVENT_PTR event)
 {
 	WAIT_EVENT_PTR temp_wait_event;
-	LIST_PTR temp_list1, temp_list2, head_list;
+	LIST_PTR temp_list;
 
-	head_list = &(event->thread_events);
-	LIST_FOR_EACH_REMOVAL(temp_list1, temp_list2, head_list )
+	LIST_FOR_EACH(temp_list, &(event->thread_events) )
 	{
-		if(temp_list1 == head_list)
-			continue;
-		temp_wait_event = STRUCT_ADDRESS_FROM_MEMBER(temp_list1, WAIT_EVENT, thread_events);
-		RemoveFromList( &(temp_wait_event->thread_events) );
+		temp_wait_event = STRUCT_ADDRESS_FROM_MEMBER(temp_list, WAIT_EVENT, thread_events);
 		temp_wait_event->thread = NULL;
 	}
-
-	//temp_wait_event = STRUCT_ADDRESS_FROM_MEMBER(head_list, WAIT_EVENT, thread_events);
-	//RemoveFromList( &(temp_wait_event->thread_events) );
-	//temp_wait_event->thread = NULL;
 }
 
 
@@ -200,7 +305,7 @@ static void ClearRelatedWaitEvents(WAIT_EVENT_PTR event)
  * \param	wait_queue	Queue from which the event is to be removed
  * NOTE: IN queue lock in the parent structure has to be taken before entering this function.
  */
-void RemoveEventFromQueue(WAIT_EVENT_PTR search_wait_event, WAIT_EVENT_PTR *wait_queue)
+static void RemoveEventFromQueue(WAIT_EVENT_PTR search_wait_event, WAIT_EVENT_PTR *wait_queue)
 {
 	LIST_PTR temp1;
 	WAIT_EVENT_PTR temp_event;
@@ -208,12 +313,17 @@ void RemoveEventFromQueue(WAIT_EVENT_PTR search_wait_event, WAIT_EVENT_PTR *wait
 	assert( search_wait_event != NULL );
 	assert( wait_queue != NULL );
 	assert( *wait_queue != NULL );
+	search_wait_event->queue = NULL;
 	if(*wait_queue == search_wait_event)
 	{
 		if( IsListEmpty( &(search_wait_event->in_queue) ) )
 			*wait_queue = NULL;
 		else
-			RemoveFromList( &((*wait_queue)->in_queue) );
+		{
+			/* the next event becomes the head */
+			*wait_queue = STRUCT_ADDRESS_FROM_MEMBER(search_wait_event->in_queue.next, WAIT_EVENT, in_queue);
+			RemoveFromList( &(search_wait_event->in_queue) );
+		}
 
 		return;
 	}
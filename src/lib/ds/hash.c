@@ -0,0 +1,36 @@
+/*!
+	\file	hash.c
+	\brief	String and buffer hash functions - FNV-1a, http://www.isthe.com/chongo/tech/comp/fnv/
+		The hashes are not stable across releases, they should not be stored.
+*/
+#include <ace.h>
+#include <ds/hash.h>
+
+#define FNV_OFFSET_BASIS	2166136261UL
+#define FNV_PRIME			16777619UL
+
+/*! Returns hash value of a null terminated string
+	\param string - string to hash
+*/
+UINT32 HashString(char * string)
+{
+	UINT32 hash = FNV_OFFSET_BASIS;
+
+	while( *string )
+		hash = ( hash ^ (BYTE)*string++ ) * FNV_PRIME;
+	return hash;
+}
+
+/*! Returns hash value of a buffer
+	\param buffer - bytes to hash, need not be null terminated
+	\param length - number of bytes
+*/
+UINT32 HashBuffer(void * buffer, UINT32 length)
+{
+	UINT32 hash = FNV_OFFSET_BASIS;
+	BYTE * data = (BYTE *)buffer;
+
+	while( length-- )
+		hash = ( hash ^ *data++ ) * FNV_PRIME;
+	return hash;
+}
@@ -0,0 +1,469 @@
+/*!
+	\file		radix_tree.c
+	\brief		Radix tree indexed by a 32 bit key with per slot tags
+
+	Each level of the tree consumes RADIX_TREE_MAP_SHIFT bits of the key, items are stored only in the leaf nodes(height 1).
+	The tree grows in height on demand and shrinks back when the upper slots become empty.
+	Every node keeps a bitmap per tag, a bit in a interior node is set if any item below that slot has the tag.
+	So tagged lookups can skip untagged subtrees without visiting them.
+
+	The tree does not do any locking, the caller is responsible for serializing access.
+*/
+
+#include <string.h>
+#include <assert.h>
+#include <ds/radix_tree.h>
+
+#define TAG_WORD(offset)	( (offset) / BITS_PER_LONG )
+#define TAG_MASK(offset)	( 1UL << ((offset) % BITS_PER_LONG) )
+
+/*! state carried across the recursive gang lookup*/
+typedef struct gang_lookup_context
+{
+	UINT32		first_index;		/*! lookup starts from this index*/
+	UINT32		next_index;			/*! next index expected - used only for contiguous lookup*/
+	void **		results;			/*! output array of items*/
+	UINT32 *	indexes;			/*! output array of item indexes - optional*/
+	UINT32		max_items;			/*! size of the output arrays*/
+	UINT32		found;				/*! number of items found so far*/
+	int			tag;				/*! tag to match or RADIX_TREE_TAG_ANY*/
+	BYTE		contiguous:1,		/*! stop at the first hole*/
+				done:1;				/*! lookup is completed*/
+}GANG_LOOKUP_CONTEXT, * GANG_LOOKUP_CONTEXT_PTR;
+
+static inline int TestNodeTag(RADIX_TREE_NODE_PTR node, int tag, UINT32 offset)
+{
+	return ( node->tags[tag][TAG_WORD(offset)] & TAG_MASK(offset) ) ? 1 : 0;
+}
+static inline void SetNodeTag(RADIX_TREE_NODE_PTR node, int tag, UINT32 offset)
+{
+	node->tags[tag][TAG_WORD(offset)] |= TAG_MASK(offset);
+}
+static inline void ClearNodeTag(RADIX_TREE_NODE_PTR node, int tag, UINT32 offset)
+{
+	node->tags[tag][TAG_WORD(offset)] &= ~TAG_MASK(offset);
+}
+/*! returns 1 if any slot in the node has the given tag*/
+static int AnyNodeTag(RADIX_TREE_NODE_PTR node, int tag)
+{
+	int i;
+	for(i=0; i<RADIX_TREE_TAG_LONGS; i++)
+		if ( node->tags[tag][i] )
+			return 1;
+	return 0;
+}
+
+/*! returns the maximum index a tree of given height can hold*/
+static UINT32 MaxIndexForHeight(UINT32 height)
+{
+	if ( height * RADIX_TREE_MAP_SHIFT >= BITS_PER_LONG )
+		return RADIX_TREE_MAX_INDEX;
+	return (1UL << (height * RADIX_TREE_MAP_SHIFT)) - 1;
+}
+
+/*! returns slot offset of the given index at the given height*/
+static inline UINT32 SlotOffset(UINT32 index, UINT32 height)
+{
+	return ( index >> ((height-1) * RADIX_TREE_MAP_SHIFT) ) & RADIX_TREE_MAP_MASK;
+}
+
+/*! allocates and clears a node using the tree's allocator*/
+static RADIX_TREE_NODE_PTR AllocateRadixTreeNode(RADIX_TREE_PTR tree)
+{
+	RADIX_TREE_NODE_PTR node;
+	node = tree->AllocateNode();
+	if ( node != NULL )
+		memset( node, 0, sizeof(RADIX_TREE_NODE) );
+	return node;
+}
+
+/*! Increases the height of the tree until the given index fits
+	\param tree - radix tree
+	\param index - index which should fit in the tree
+	\return 0 on success, -1 if node allocation failed
+*/
+static int ExtendRadixTree(RADIX_TREE_PTR tree, UINT32 index)
+{
+	RADIX_TREE_NODE_PTR node;
+	UINT32 height = tree->height ? tree->height : 1;
+	int tag;
+
+	while ( index > MaxIndexForHeight(height) )
+		height++;
+
+	/*empty tree - just create the root at required height*/
+	if ( tree->root == NULL )
+	{
+		tree->root = AllocateRadixTreeNode(tree);
+		if ( tree->root == NULL )
+			return -1;
+		tree->height = height;
+		return 0;
+	}
+	/*push the existing root down as first child of new root*/
+	while ( tree->height < height )
+	{
+		node = AllocateRadixTreeNode(tree);
+		if ( node == NULL )
+			return -1;
+		node->slots[0] = tree->root;
+		node->count = 1;
+		for(tag=0; tag<RADIX_TREE_MAX_TAGS; tag++)
+			if ( AnyNodeTag(tree->root, tag) )
+				SetNodeTag(node, tag, 0);
+		tree->root = node;
+		tree->height++;
+	}
+	return 0;
+}
+
+/*! Walks from root to the leaf node for the given index and records the path
+	\param tree - radix tree
+	\param index - index to search
+	\param path - output - nodes from root to leaf
+	\param offsets - output - slot offset used in each node of the path
+	\return item at the index or NULL if not present
+*/
+static void * GetRadixTreePath(RADIX_TREE_PTR tree, UINT32 index, RADIX_TREE_NODE_PTR * path, UINT32 * offsets)
+{
+	RADIX_TREE_NODE_PTR node;
+	UINT32 height, level;
+
+	if ( tree->root == NULL || index > MaxIndexForHeight(tree->height) )
+		return NULL;
+	node = tree->root;
+	for(height=tree->height, level=0; height>0; height--, level++)
+	{
+		path[level] = node;
+		offsets[level] = SlotOffset(index, height);
+		if ( height == 1 )
+			break;
+		node = node->slots[ offsets[level] ];
+		if ( node == NULL )
+			return NULL;
+	}
+	return path[level]->slots[ offsets[level] ];
+}
+
+/*! Clears the tag at leaf and propagates it upwards while the nodes has no other tagged slot*/
+static void ClearTagOnPath(RADIX_TREE_NODE_PTR * path, UINT32 * offsets, int levels, int tag)
+{
+	int level;
+	for(level=levels-1; level>=0; level--)
+	{
+		if ( !TestNodeTag(path[level], tag, offsets[level]) )
+			break;
+		ClearNodeTag(path[level], tag, offsets[level]);
+		if ( AnyNodeTag(path[level], tag) )
+			break;
+	}
+}
+
+/*! Initializes a radix tree
+	\param tree - radix tree to initialize
+	\param AllocateNode - function pointer to allocate a new node for the tree
+	\param FreeNode - function pointer to free a node of the tree
+*/
+void InitRadixTree(RADIX_TREE_PTR tree, RADIX_TREE_NODE_PTR (*AllocateNode)(), void (*FreeNode)(RADIX_TREE_NODE_PTR node))
+{
+	assert( tree != NULL );
+	tree->height = 0;
+	tree->root = NULL;
+	tree->AllocateNode = AllocateNode;
+	tree->FreeNode = FreeNode;
+}
+
+/*! Inserts an item into the radix tree
+	\param tree - radix tree
+	\param index - key of the item
+	\param item - item to insert, should not be NULL
+	\return 0 on success, 1 if an item already exists at the index, -1 if node allocation failed
+*/
+int InsertRadixTreeItem(RADIX_TREE_PTR tree, UINT32 index, void * item)
+{
+	RADIX_TREE_NODE_PTR node, child;
+	UINT32 height, offset;
+
+	assert( tree != NULL && item != NULL );
+
+	if ( tree->root == NULL || index > MaxIndexForHeight(tree->height) )
+	{
+		if ( ExtendRadixTree(tree, index) != 0 )
+			return -1;
+	}
+
+	node = tree->root;
+	for(height=tree->height; height>1; height--)
+	{
+		offset = SlotOffset(index, height);
+		child = node->slots[offset];
+		if ( child == NULL )
+		{
+			child = AllocateRadixTreeNode(tree);
+			if ( child == NULL )
+				return -1;
+			node->slots[offset] = child;
+			node->count++;
+		}
+		node = child;
+	}
+
+	offset = SlotOffset(index, 1);
+	if ( node->slots[offset] != NULL )
+		return 1;
+	node->slots[offset] = item;
+	node->count++;
+
+	return 0;
+}
+
+/*! Returns the item at the given index or NULL if the index is not present
+	\param tree - radix tree
+	\param index - key of the item
+*/
+void * LookupRadixTreeItem(RADIX_TREE_PTR tree, UINT32 index)
+{
+	RADIX_TREE_NODE_PTR node;
+	UINT32 height;
+
+	assert( tree != NULL );
+
+	if ( tree->root == NULL || index > MaxIndexForHeight(tree->height) )
+		return NULL;
+	node = tree->root;
+	for(height=tree->height; height>1; height--)
+	{
+		node = node->slots[ SlotOffset(index, height) ];
+		if ( node == NULL )
+			return NULL;
+	}
+	return node->slots[ SlotOffset(index, 1) ];
+}
+
+/*! Removes the item at the given index from the tree. Nodes which become empty are freed.
+	\param tree - radix tree
+	\param index - key of the item
+	\return removed item or NULL if the index is not present
+*/
+void * RemoveRadixTreeItem(RADIX_TREE_PTR tree, UINT32 index)
+{
+	RADIX_TREE_NODE_PTR path[RADIX_TREE_MAX_HEIGHT], node;
+	UINT32 offsets[RADIX_TREE_MAX_HEIGHT];
+	void * item;
+	int level, tag;
+
+	assert( tree != NULL );
+
+	item = GetRadixTreePath(tree, index, path, offsets);
+	if ( item == NULL )
+		return NULL;
+
+	for(tag=0; tag<RADIX_TREE_MAX_TAGS; tag++)
+		ClearTagOnPath(path, offsets, tree->height, tag);
+
+	/*clear the slot and free the nodes which became empty*/
+	level = tree->height - 1;
+	path[level]->slots[ offsets[level] ] = NULL;
+	path[level]->count--;
+	for(; level>=0 && path[level]->count == 0; level--)
+	{
+		tree->FreeNode( path[level] );
+		if ( level > 0 )
+		{
+			path[level-1]->slots[ offsets[level-1] ] = NULL;
+			path[level-1]->count--;
+		}
+		else
+		{
+			tree->root = NULL;
+			tree->height = 0;
+		}
+	}
+
+	/*shrink the tree if only the first slot of root is used*/
+	while ( tree->height > 1 && tree->root->count == 1 && tree->root->slots[0] != NULL )
+	{
+		node = tree->root;
+		tree->root = node->slots[0];
+		tree->height--;
+		tree->FreeNode( node );
+	}
+
+	return item;
+}
+
+/*! Sets a tag on the item at the given index
+	\param tree - radix tree
+	\param index - key of the item
+	\param tag - tag to set
+	\return the tagged item or NULL if the index is not present
+*/
+void * SetRadixTreeTag(RADIX_TREE_PTR tree, UINT32 index, int tag)
+{
+	RADIX_TREE_NODE_PTR path[RADIX_TREE_MAX_HEIGHT];
+	UINT32 offsets[RADIX_TREE_MAX_HEIGHT];
+	void * item;
+	int level;
+
+	assert( tree != NULL && tag >= 0 && tag < RADIX_TREE_MAX_TAGS );
+
+	item = GetRadixTreePath(tree, index, path, offsets);
+	if ( item == NULL )
+		return NULL;
+	for(level=tree->height-1; level>=0; level--)
+	{
+		if ( TestNodeTag(path[level], tag, offsets[level]) )
+			break;
+		SetNodeTag(path[level], tag, offsets[level]);
+	}
+	return item;
+}
+
+/*! Clears a tag on the item at the given index
+	\param tree - radix tree
+	\param index - key of the item
+	\param tag - tag to clear
+	\return the item or NULL if the index is not present
+*/
+void * ClearRadixTreeTag(RADIX_TREE_PTR tree, UINT32 index, int tag)
+{
+	RADIX_TREE_NODE_PTR path[RADIX_TREE_MAX_HEIGHT];
+	UINT32 offsets[RADIX_TREE_MAX_HEIGHT];
+	void * item;
+
+	assert( tree != NULL && tag >= 0 && tag < RADIX_TREE_MAX_TAGS );
+
+	item = GetRadixTreePath(tree, index, path, offsets);
+	if ( item == NULL )
+		return NULL;
+	ClearTagOnPath(path, offsets, tree->height, tag);
+	return item;
+}
+
+/*! Returns 1 if the item at the given index has the tag, 0 otherwise
+	\param tree - radix tree
+	\param index - key of the item
+	\param tag - tag to test
+*/
+int GetRadixTreeTag(RADIX_TREE_PTR tree, UINT32 index, int tag)
+{
+	RADIX_TREE_NODE_PTR path[RADIX_TREE_MAX_HEIGHT];
+	UINT32 offsets[RADIX_TREE_MAX_HEIGHT];
+	int level;
+
+	assert( tree != NULL && tag >= 0 && tag < RADIX_TREE_MAX_TAGS );
+
+	if ( GetRadixTreePath(tree, index, path, offsets) == NULL )
+		return 0;
+	level = tree->height - 1;
+	return TestNodeTag(path[level], tag, offsets[level]);
+}
+
+/*! Returns 1 if any item in the tree has the given tag*/
+int IsRadixTreeTagged(RADIX_TREE_PTR tree, int tag)
+{
+	assert( tree != NULL && tag >= 0 && tag < RADIX_TREE_MAX_TAGS );
+	if ( tree->root == NULL )
+		return 0;
+	return AnyNodeTag(tree->root, tag);
+}
+
+/*! Recursively collects items from a node in index order
+	\param node - current node
+	\param height - height of the current node(1 for leaf)
+	\param base - first index covered by the node
+	\param ctx - lookup state
+*/
+static void GangLookupNode(RADIX_TREE_NODE_PTR node, UINT32 height, UINT32 base, GANG_LOOKUP_CONTEXT_PTR ctx)
+{
+	UINT32 shift = (height-1) * RADIX_TREE_MAP_SHIFT;
+	UINT32 offset, index;
+	void * slot;
+
+	offset = 0;
+	if ( ctx->first_index > base )
+		offset = (ctx->first_index - base) >> shift;
+
+	for(; offset < RADIX_TREE_MAP_SIZE && !ctx->done; offset++)
+	{
+		slot = node->slots[offset];
+		if ( slot == NULL || ( ctx->tag != RADIX_TREE_TAG_ANY && !TestNodeTag(node, ctx->tag, offset) ) )
+		{
+			/*a missing subtree is a hole in the range*/
+			if ( ctx->contiguous )
+				ctx->done = 1;
+			continue;
+		}
+		index = base + (offset << shift);
+		if ( height > 1 )
+		{
+			GangLookupNode( slot, height-1, index, ctx );
+			continue;
+		}
+		if ( ctx->contiguous && index != ctx->next_index )
+		{
+			ctx->done = 1;
+			break;
+		}
+		ctx->results[ctx->found] = slot;
+		if ( ctx->indexes )
+			ctx->indexes[ctx->found] = index;
+		ctx->found++;
+		ctx->next_index = index + 1;
+		if ( ctx->found == ctx->max_items || index == RADIX_TREE_MAX_INDEX )
+			ctx->done = 1;
+	}
+}
+
+static UINT32 GangLookupRadixTreeCore(RADIX_TREE_PTR tree, UINT32 first_index, void ** results, UINT32 * indexes, UINT32 max_items, int tag, BOOLEAN contiguous)
+{
+	GANG_LOOKUP_CONTEXT ctx;
+
+	assert( tree != NULL && results != NULL );
+	assert( tag == RADIX_TREE_TAG_ANY || (tag >= 0 && tag < RADIX_TREE_MAX_TAGS) );
+
+	if ( tree->root == NULL || max_items == 0 || first_index > MaxIndexForHeight(tree->height) )
+		return 0;
+
+	ctx.first_index = first_index;
+	ctx.next_index = first_index;
+	ctx.results = results;
+	ctx.indexes = indexes;
+	ctx.max_items = max_items;
+	ctx.found = 0;
+	ctx.tag = tag;
+	ctx.contiguous = contiguous ? 1 : 0;
+	ctx.done = 0;
+
+	GangLookupNode( tree->root, tree->height, 0, &ctx );
+
+	return ctx.found;
+}
+
+/*! Collects up to max_items items whose index is greater than or equal to first_index, in ascending index order
+	\param tree - radix tree
+	\param first_index - starting index
+	\param results - output - array of items
+	\param indexes - output(optional) - index of each returned item
+	\param max_items - size of the output arrays
+	\param tag - return only items having this tag, RADIX_TREE_TAG_ANY to return all items
+	\return number of items returned
+*/
+UINT32 GangLookupRadixTree(RADIX_TREE_PTR tree, UINT32 first_index, void ** results, UINT32 * indexes, UINT32 max_items, int tag)
+{
+	return GangLookupRadixTreeCore(tree, first_index, results, indexes, max_items, tag, FALSE);
+}
+
+/*! Collects a run of items at consecutive indexes starting from first_index.
+	The lookup stops at the first index which is not present(or not tagged) so results[i] is the item at first_index+i.
+	\param tree - radix tree
+	\param first_index - starting index
+	\param results - output - array of items
+	\param max_items - size of the output array
+	\param tag - return only items having this tag, RADIX_TREE_TAG_ANY to return all items
+	\return number of items returned
+*/
+UINT32 GangLookupRadixTreeContiguous(RADIX_TREE_PTR tree, UINT32 first_index, void ** results, UINT32 max_items, int tag)
+{
+	return GangLookupRadixTreeCore(tree, first_index, results, NULL, max_items, tag, TRUE);
+}
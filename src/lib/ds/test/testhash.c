@@ -0,0 +1,46 @@
+#include <ace.h>
+#include <stdio.h>
+#include <string.h>
+#include <ds/hash.h>
+
+void exit(int status);
+
+/*published FNV-1a 32 bit test vectors*/
+struct
+{
+	char * string;
+	UINT32 hash;
+}vectors[] = {
+	{"", 0x811c9dc5UL},
+	{"a", 0xe40c292cUL},
+	{"foobar", 0xbf9cf968UL},
+};
+
+int main(int argc, char* argv[])
+{
+	int i;
+	UINT32 hash;
+
+	for(i=0; i<sizeof(vectors)/sizeof(vectors[0]); i++)
+	{
+		hash = HashString( vectors[i].string );
+		if ( hash != vectors[i].hash )
+		{
+			printf("HashString(\"%s\") returned %lx expected %lx\n", vectors[i].string, hash, vectors[i].hash );
+			exit(1);
+		}
+		hash = HashBuffer( vectors[i].string, strlen(vectors[i].string) );
+		if ( hash != vectors[i].hash )
+		{
+			printf("HashBuffer(\"%s\") returned %lx expected %lx\n", vectors[i].string, hash, vectors[i].hash );
+			exit(2);
+		}
+	}
+	/*a buffer is hashed only till the given length*/
+	if ( HashBuffer( "foobar", 3 ) != HashString( "foo" ) )
+	{
+		printf("HashBuffer() hashed beyond the given length\n");
+		exit(3);
+	}
+	return 0;
+}
@@ -0,0 +1,183 @@
+#include <ace.h>
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <malloc.h>
+#include <ds/radix_tree.h>
+
+int rand();
+void srand(unsigned int seed);
+void exit(int status);
+
+#define MAX_ITEMS		2000
+#define RUN_LENGTH		100
+#define TAG_DIRTY		0
+#define TAG_WRITEBACK	1
+
+RADIX_TREE tree;
+UINT32 keys[MAX_ITEMS];
+int total_nodes = 0;
+
+RADIX_TREE_NODE_PTR AllocateNode()
+{
+	RADIX_TREE_NODE_PTR node;
+	node = (RADIX_TREE_NODE_PTR) malloc( sizeof(RADIX_TREE_NODE) );
+	if ( node == NULL )
+	{
+		perror("RADIX_TREE_NODE allocation failed");
+		return NULL;
+	}
+	total_nodes++;
+	return node;
+}
+void FreeNode(RADIX_TREE_NODE_PTR node)
+{
+	assert( node != NULL );
+	total_nodes--;
+	free(node);
+}
+
+static int compare_keys(const void * a, const void * b)
+{
+	UINT32 x = *(UINT32 *)a, y = *(UINT32 *)b;
+	return x < y ? -1 : (x > y ? 1 : 0);
+}
+
+/*returns 1 if key is already in the keys array*/
+static int key_exists(UINT32 key, int count)
+{
+	int i;
+	for(i=0; i<count; i++)
+		if ( keys[i] == key )
+			return 1;
+	return 0;
+}
+
+int main(int argc, char* argv[])
+{
+	void * results[MAX_ITEMS];
+	UINT32 indexes[MAX_ITEMS];
+	UINT32 i, found, total;
+
+	printf("Radix Tree Test Program\n");
+	srand( time(NULL) );
+	InitRadixTree( &tree, AllocateNode, FreeNode );
+
+	/*a contiguous run followed by random keys, including the largest key*/
+	for(i=0; i<RUN_LENGTH; i++)
+		keys[i] = 1000 + i;
+	keys[i++] = RADIX_TREE_MAX_INDEX;
+	for(; i<MAX_ITEMS; i++)
+	{
+		do{
+			keys[i] = ( ((UINT32)rand() << 8) ^ (UINT32)rand() ) & RADIX_TREE_MAX_INDEX;
+		}while( key_exists(keys[i], i) );
+	}
+	printf("Inserting %d keys\n", MAX_ITEMS);
+	for(i=0; i<MAX_ITEMS; i++)
+	{
+		if ( InsertRadixTreeItem( &tree, keys[i], &keys[i] ) != 0 )
+		{
+			printf("InsertRadixTreeItem(%lu) failed\n", keys[i]);
+			exit(1);
+		}
+	}
+	if ( InsertRadixTreeItem( &tree, keys[0], &keys[0] ) != 1 )
+	{
+		printf("InsertRadixTreeItem() accepted duplicate key\n");
+		exit(1);
+	}
+	for(i=0; i<MAX_ITEMS; i++)
+	{
+		if ( LookupRadixTreeItem( &tree, keys[i] ) != &keys[i] )
+		{
+			printf("LookupRadixTreeItem(%lu) failed\n", keys[i]);
+			exit(2);
+		}
+	}
+
+	/*tag every other key in the run*/
+	for(i=0; i<RUN_LENGTH; i+=2)
+		SetRadixTreeTag( &tree, keys[i], TAG_DIRTY );
+	SetRadixTreeTag( &tree, RADIX_TREE_MAX_INDEX, TAG_DIRTY );
+	if ( !IsRadixTreeTagged( &tree, TAG_DIRTY ) || IsRadixTreeTagged( &tree, TAG_WRITEBACK ) )
+	{
+		printf("IsRadixTreeTagged() failed\n");
+		exit(3);
+	}
+	for(i=0; i<RUN_LENGTH; i++)
+	{
+		if ( GetRadixTreeTag( &tree, keys[i], TAG_DIRTY ) != !(i%2) )
+		{
+			printf("GetRadixTreeTag(%lu) failed\n", keys[i]);
+			exit(3);
+		}
+	}
+	found = GangLookupRadixTree( &tree, 0, results, indexes, MAX_ITEMS, TAG_DIRTY );
+	if ( found != RUN_LENGTH/2 + 1 || indexes[found-1] != RADIX_TREE_MAX_INDEX )
+	{
+		printf("Tagged GangLookupRadixTree() returned %lu items\n", found);
+		exit(4);
+	}
+	for(i=0; i<RUN_LENGTH; i+=2)
+		ClearRadixTreeTag( &tree, keys[i], TAG_DIRTY );
+	ClearRadixTreeTag( &tree, RADIX_TREE_MAX_INDEX, TAG_DIRTY );
+	if ( IsRadixTreeTagged( &tree, TAG_DIRTY ) )
+	{
+		printf("ClearRadixTreeTag() did not propagate\n");
+		exit(4);
+	}
+
+	/*contiguous lookup should return exactly the run*/
+	found = GangLookupRadixTreeContiguous( &tree, 1000, results, MAX_ITEMS, RADIX_TREE_TAG_ANY );
+	for(i=0; i<found; i++)
+		assert( *(UINT32 *)results[i] == 1000 + i );
+	if ( found < RUN_LENGTH )
+	{
+		printf("GangLookupRadixTreeContiguous() returned %lu items\n", found);
+		exit(5);
+	}
+
+	/*gang lookup in chunks should return all keys in sorted order*/
+	qsort( keys, MAX_ITEMS, sizeof(UINT32), compare_keys );
+	total = 0;
+	do{
+		found = GangLookupRadixTree( &tree, total ? indexes[0] + 1 : 0, results, indexes, 1, RADIX_TREE_TAG_ANY );
+		if ( found && indexes[0] != keys[total] )
+		{
+			printf("GangLookupRadixTree() returned %lu expected %lu\n", indexes[0], keys[total]);
+			exit(6);
+		}
+		total += found;
+	}while( found && indexes[0] != RADIX_TREE_MAX_INDEX );
+	if ( total != MAX_ITEMS )
+	{
+		printf("GangLookupRadixTree() returned %lu items expected %d\n", total, MAX_ITEMS);
+		exit(6);
+	}
+
+	/*remove everything - all the nodes should be freed*/
+	printf("Removing %d keys\n", MAX_ITEMS);
+	for(i=0; i<MAX_ITEMS; i++)
+	{
+		if ( RemoveRadixTreeItem( &tree, keys[i] ) == NULL )
+		{
+			printf("RemoveRadixTreeItem(%lu) failed\n", keys[i]);
+			exit(7);
+		}
+		if ( LookupRadixTreeItem( &tree, keys[i] ) != NULL )
+		{
+			printf("LookupRadixTreeItem(%lu) found removed key\n", keys[i]);
+			exit(7);
+		}
+	}
+	if ( total_nodes != 0 || tree.root != NULL )
+	{
+		printf("%d nodes leaked\n", total_nodes);
+		exit(8);
+	}
+
+	printf("Radix tree test passed\n");
+	return 0;
+}
@@ -1,17 +1,42 @@
 #include <stdlib.h>
 #include <string.h>
+#include "string_word.h"
+
+/*! memchr() and memcmp() switch to word scanning at this size*/
+#define MEM_SCAN_SMALL_SIZE	8
 
 void* memchr(const void *s, int c, size_t n)
 {
-        if (n)
+        const unsigned char *p = s;
+        unsigned char cc = c;
+        MEM_WORD pattern, w;
+
+        if ( n >= MEM_SCAN_SMALL_SIZE )
+        {
+                /*align, then look for a byte equal to c - it turns into a zero byte after the xor*/
+                while( !IS_WORD_ALIGNED(p) )
+                {
+                        if (*p == cc)
+                                return (void*) p;
+                        p++;
+                        n--;
+                }
+                pattern = REPEAT_BYTE(cc);
+                while( n >= MEM_WORD_SIZE )
+                {
+                        w = *(const MEM_WORD *)p ^ pattern;
+                        if ( HAS_ZERO_BYTE(w) )
+                                break;
+                        p += MEM_WORD_SIZE;
+                        n -= MEM_WORD_SIZE;
+                }
+        }
+        /*find the exact byte in the matching word or in the tail*/
+        while( n-- )
         {
-        const char *p = s;
-        char cc = c;
-        do {
                 if (*p == cc)
                         return (void*) p;
                 p++;
-        } while (--n != 0);
         }
         return 0;
 }
@@ -19,31 +44,77 @@ void* memchr(const void *s, int c, size_t n)
 
 int memcmp(const void *s1, const void *s2, size_t n)
 {
-  if (n != 0)
-  {
-    const unsigned char *p1 = s1, *p2 = s2;
+  const unsigned char *p1 = s1, *p2 = s2;
 
-    do {
-      if (*p1++ != *p2++)
-        return (*--p1 - *--p2);
-    } while (--n != 0);
+  if (n >= MEM_SCAN_SMALL_SIZE)
+  {
+    /*skip the equal words - only s1 is aligned, x86 loads the unaligned s2 words within the buffer*/
+    while ( !IS_WORD_ALIGNED(p1) )
+    {
+      if (*p1 != *p2)
+        return (*p1 - *p2);
+      p1++, p2++, n--;
+    }
+    while ( n >= MEM_WORD_SIZE && *(const MEM_WORD *)p1 == *(const MEM_WORD *)p2 )
+    {
+      p1 += MEM_WORD_SIZE;
+      p2 += MEM_WORD_SIZE;
+      n -= MEM_WORD_SIZE;
+    }
+  }
+  /*the differing byte is found byte by byte, so the result does not depend on the byte order*/
+  while (n-- != 0)
+  {
+    if (*p1 != *p2)
+      return (*p1 - *p2);
+    p1++, p2++;
   }
   return 0;
 }
 
 
+/*! copies smaller than this are done byte by byte - aligning and setting up the string instructions costs more*/
+#define MEM_SMALL_SIZE		16
+
+/*! copies count words from src to dest, the pointers are advanced past the copied area*/
+#define REP_MOVSD(dest, src, count)			\
+	asm volatile( "cld; rep movsl"			\
+		: "+D"(dest), "+S"(src), "+c"(count) : : "memory" )
+
+/*! stores count copies of the word value at dest, the pointer is advanced past the filled area*/
+#define REP_STOSD(dest, value, count)		\
+	asm volatile( "cld; rep stosl"			\
+		: "+D"(dest), "+c"(count) : "a"(value) : "memory" )
+
 /*The  memcpy()  function  copies  n bytes from memory area src to memory
   area dest.  The memory areas should not overlap.  Use memmove(3) if the
   memory areas do overlap.
   RETURN VALUE:     The memcpy() function returns a pointer to dest.
+  
+  Small copies are done byte by byte. Bigger copies align the destination to a word and copy the bulk
+  with rep movsd - the copy is done in ascending order, so memmove() uses it when dest is below src.
  */
 void* memcpy(void *dest, const void *src, size_t n)
 {
-    int i;
-    for(i=0; i<n; i++)
+    char * d = dest;
+    const char * s = src;
+    size_t words;
+
+    if ( n >= MEM_SMALL_SIZE )
     {
-        ((char*)dest)[i] = ((char*)src)[i];
+        /*align the destination - unaligned stores are costlier than unaligned loads*/
+        while( !IS_WORD_ALIGNED(d) )
+        {
+            *d++ = *s++;
+            n--;
+        }
+        words = n / MEM_WORD_SIZE;
+        n &= MEM_WORD_MASK;
+        REP_MOVSD(d, s, words);
     }
+    while( n-- )
+        *d++ = *s++;
+    
     return dest;
 }
 
@@ -56,25 +127,51 @@ void* memcpy(void *dest, const void *src, size_t n)
 */
 void* memmove(void *dest, void *src, size_t n)
 {
-    long int i;
+    char * d;
+    const char * s;
 
-    if((char*)src == (char*)dest)
+    if((char*)src == (char*)dest || n == 0)
     {
         ;// Nothing dest copy!
     }
-    else if((char*)src > (char*)dest)
+    else if((char*)src > (char*)dest || (char*)src + n <= (char*)dest)
     {
-        for(i = 0; i < n; i++)
-        {
-            ((char*)dest)[i] = ((char*)src)[i];
-        }
+        /*ascending copy never overwrites a source byte before reading it*/
+        memcpy( dest, src, n );
     }
     else
     {
-        for(i = n-1; i >= 0; i--)
+        /*overlapping with dest above src - copy from the end*/
+        d = (char*)dest + n;
+        s = (char*)src + n;
+        if ( n >= MEM_SMALL_SIZE )
         {
-            ((char*)dest)[i] = ((char*)src)[i];
+            while( !IS_WORD_ALIGNED(d) )
+            {
+                *--d = *--s;
+                n--;
+            }
+            /*unrolled word copy - the direction flag is not touched since an interrupt handler might not expect it set*/
+            while( n >= 4*MEM_WORD_SIZE )
+            {
+                d -= 4*MEM_WORD_SIZE;
+                s -= 4*MEM_WORD_SIZE;
+                ((MEM_WORD *)d)[3] = ((const MEM_WORD *)s)[3];
+                ((MEM_WORD *)d)[2] = ((const MEM_WORD *)s)[2];
+                ((MEM_WORD *)d)[1] = ((const MEM_WORD *)s)[1];
+                ((MEM_WORD *)d)[0] = ((const MEM_WORD *)s)[0];
+                n -= 4*MEM_WORD_SIZE;
+            }
+            while( n >= MEM_WORD_SIZE )
+            {
+                d -= MEM_WORD_SIZE;
+                s -= MEM_WORD_SIZE;
+                *(MEM_WORD *)d = *(const MEM_WORD *)s;
+                n -= MEM_WORD_SIZE;
+            }
         }
+        while( n-- )
+            *--d = *--s;
     }
     return dest;
 }
@@ -88,10 +185,25 @@ void* memmove(void *dest, void *src, size_t n)
  */
 void* memset(void *s, int c, size_t n)
 {
-    int i;
-    for(i=0; i<n; i++) {
-        ((char*)s)[i] = c;
+    unsigned char * d = s;
+    MEM_WORD value;
+    size_t words;
+
+    if ( n >= MEM_SMALL_SIZE )
+    {
+        while( !IS_WORD_ALIGNED(d) )
+        {
+            *d++ = c;
+            n--;
+        }
+        /*replicate the byte in all the bytes of a word*/
+        value = REPEAT_BYTE(c);
+        words = n / MEM_WORD_SIZE;
+        n &= MEM_WORD_MASK;
+        REP_STOSD(d, value, words);
     }
+    while( n-- )
+        *d++ = c;
+    
     return s;
 }
-
@@ -6,6 +6,7 @@
 #include <stdlib.h>
 #include <ctype.h>
 #include <string.h>
+#include "string_word.h"
 
 
 /*!Returns the number of occurence of a character in a string
@@ -315,12 +316,27 @@ int strcmp ( const char *s1, const char *s2 )
 		return -1;
 	if( s2==NULL )
 		return 1;
-	while ( s1 && s2 && *s1 && *s2 && *s1 == *s2 )
+	/*compare a word at a time when both strings can be aligned together - reading only aligned words of both
+	strings never touches the page after the terminating zero*/
+	if ( ( (size_t)s1 & MEM_WORD_MASK ) == ( (size_t)s2 & MEM_WORD_MASK ) )
+	{
+		while ( !IS_WORD_ALIGNED(s1) )
+		{
+			if ( *s1 == 0 || *s1 != *s2 )
+				return * ( unsigned const char * ) s1 - * ( unsigned const char * ) ( s2 );
+			s1++;
+			s2++;
+		}
+		while ( *(const MEM_WORD *)s1 == *(const MEM_WORD *)s2 && !HAS_ZERO_BYTE( *(const MEM_WORD *)s1 ) )
+		{
+			s1 += MEM_WORD_SIZE;
+			s2 += MEM_WORD_SIZE;
+		}
+	}
+	/*find the differing byte or the end*/
+	while ( *s1 && *s1 == *s2 )
 	{
-		if ( *s1 == 0 )
-			return 0;
 		s1++;
-
 		s2++;
 	}
 
@@ -475,7 +491,15 @@ size_t strlen ( const char *str )
 {
 	const char *s;
 
-	for ( s = str; *s; ++s )
+	/*align, then skip the words without a zero byte - an aligned word does not cross a page boundary*/
+	for ( s = str; !IS_WORD_ALIGNED(s); ++s )
+	{
+		if ( *s == 0 )
+			return ( s-str );
+	}
+	while ( !HAS_ZERO_BYTE( *(const MEM_WORD *)s ) )
+		s += MEM_WORD_SIZE;
+	for ( ; *s; ++s )
 	{
 		;
 	}
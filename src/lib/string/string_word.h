@@ -0,0 +1,28 @@
+/*!
+  \file     string_word.h
+  \brief	Helpers to scan and copy memory a word at a time - private to the string library
+  
+  Only aligned words are read beyond the bytes the caller asked for. An aligned word never spans two pages,
+  so a scan for a terminating zero can not fault on the page after the string.
+*/
+
+#ifndef _STRING_WORD_H
+#define _STRING_WORD_H
+
+/*! word used for the bulk of an operation - may alias any object, since the callers pass arbitrary memory*/
+typedef unsigned int __attribute__((__may_alias__)) MEM_WORD;
+#define MEM_WORD_SIZE		sizeof(MEM_WORD)
+#define MEM_WORD_MASK		(MEM_WORD_SIZE-1)
+
+/*! true if the pointer is word aligned*/
+#define IS_WORD_ALIGNED(p)	( ((size_t)(p) & MEM_WORD_MASK) == 0 )
+
+/*! the given byte in all the bytes of a word*/
+#define REPEAT_BYTE(c)		( (MEM_WORD)(unsigned char)(c) * 0x01010101U )
+
+/*! non zero if any byte of the word is zero
+	Subtracting 1 from every byte borrows into bit 7 only for a zero byte(or a byte above 0x80, which ~x filters out)
+*/
+#define HAS_ZERO_BYTE(x)	( ((x) - 0x01010101U) & ~(x) & 0x80808080U )
+
+#endif
@@ -1,6 +1,9 @@
 #include <assert.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <unistd.h>
 void exit(int status);
 
 void _assert(const char *msg, const char *file, int line)
@@ -10,6 +13,257 @@ void _assert(const char *msg, const char *file, int line)
 }
 
 #define ARRAY_COUNT 	20
+
+/*! maximum length and misalignment used by the mem* correctness sweep*/
+#define MEM_TEST_MAX_LENGTH		300
+#define MEM_TEST_MAX_ALIGN		8
+#define MEM_TEST_BUFFER_SIZE	(MEM_TEST_MAX_LENGTH + 2*MEM_TEST_MAX_ALIGN + 64)
+/*! size and iteration count of the throughput benchmark*/
+#define MEM_BENCH_SIZE			(64*1024)
+#define MEM_BENCH_ITERATIONS	2000
+
+/*byte at a time versions - the reference for the correctness sweep and the baseline for the benchmark*/
+static void* byte_memcpy(void *dest, const void *src, size_t n)
+{
+	size_t i;
+	for(i=0; i<n; i++)
+		((char*)dest)[i] = ((char*)src)[i];
+	return dest;
+}
+static void* byte_memmove(void *dest, void *src, size_t n)
+{
+	long i;
+	if( (char*)src > (char*)dest )
+	{
+		for(i=0; i<n; i++)
+			((char*)dest)[i] = ((char*)src)[i];
+	}
+	else
+	{
+		for(i=n-1; i>=0; i--)
+			((char*)dest)[i] = ((char*)src)[i];
+	}
+	return dest;
+}
+static void* byte_memset(void *s, int c, size_t n)
+{
+	size_t i;
+	for(i=0; i<n; i++)
+		((char*)s)[i] = c;
+	return s;
+}
+
+static unsigned char mem_src[MEM_TEST_BUFFER_SIZE], mem_dest[MEM_TEST_BUFFER_SIZE], mem_expected[MEM_TEST_BUFFER_SIZE];
+
+static void fill_pattern(unsigned char * buf, int size, int seed)
+{
+	int i;
+	for(i=0; i<size; i++)
+		buf[i] = (unsigned char)(i * 7 + seed);
+}
+
+/*! Compares the mem* functions against the byte loops for every combination of source/destination alignment and length
+	The bytes around the destination are checked too, so an overrun is caught.
+*/
+static void test_mem_functions()
+{
+	int src_align, dest_align, len, c;
+	void * ret;
+
+	printf("memcpy/memset/memmove :: ");
+	for(src_align=0; src_align<MEM_TEST_MAX_ALIGN; src_align++)
+	{
+		for(dest_align=0; dest_align<MEM_TEST_MAX_ALIGN; dest_align++)
+		{
+			for(len=0; len<=MEM_TEST_MAX_LENGTH; len++)
+			{
+				fill_pattern( mem_src, MEM_TEST_BUFFER_SIZE, 1 );
+				fill_pattern( mem_dest, MEM_TEST_BUFFER_SIZE, 2 );
+				fill_pattern( mem_expected, MEM_TEST_BUFFER_SIZE, 2 );
+				byte_memcpy( mem_expected + MEM_TEST_MAX_ALIGN + dest_align, mem_src + src_align, len );
+				ret = memcpy( mem_dest + MEM_TEST_MAX_ALIGN + dest_align, mem_src + src_align, len );
+				assert( ret == mem_dest + MEM_TEST_MAX_ALIGN + dest_align );
+				assert( memcmp( mem_dest, mem_expected, MEM_TEST_BUFFER_SIZE ) == 0 );
+
+				c = (len * 31 + src_align) & 0xFF;
+				byte_memset( mem_expected + MEM_TEST_MAX_ALIGN + dest_align, c, len );
+				ret = memset( mem_dest + MEM_TEST_MAX_ALIGN + dest_align, c, len );
+				assert( ret == mem_dest + MEM_TEST_MAX_ALIGN + dest_align );
+				assert( memcmp( mem_dest, mem_expected, MEM_TEST_BUFFER_SIZE ) == 0 );
+
+				/*overlapping moves in both directions within the same buffer*/
+				fill_pattern( mem_dest, MEM_TEST_BUFFER_SIZE, 3 );
+				fill_pattern( mem_expected, MEM_TEST_BUFFER_SIZE, 3 );
+				byte_memmove( mem_expected + src_align, mem_expected + MEM_TEST_MAX_ALIGN + dest_align, len );
+				memmove( mem_dest + src_align, mem_dest + MEM_TEST_MAX_ALIGN + dest_align, len );
+				assert( memcmp( mem_dest, mem_expected, MEM_TEST_BUFFER_SIZE ) == 0 );
+				byte_memmove( mem_expected + MEM_TEST_MAX_ALIGN + dest_align, mem_expected + src_align, len );
+				ret = memmove( mem_dest + MEM_TEST_MAX_ALIGN + dest_align, mem_dest + src_align, len );
+				assert( ret == mem_dest + MEM_TEST_MAX_ALIGN + dest_align );
+				assert( memcmp( mem_dest, mem_expected, MEM_TEST_BUFFER_SIZE ) == 0 );
+			}
+		}
+	}
+	printf("passed\n");
+}
+
+static size_t byte_strlen(const char *str)
+{
+	const char *s;
+	for ( s = str; *s; ++s )
+		;
+	return ( s-str );
+}
+static int byte_strcmp(const char *s1, const char *s2)
+{
+	while ( *s1 && *s1 == *s2 )
+		s1++, s2++;
+	return * ( unsigned const char * ) s1 - * ( unsigned const char * ) s2;
+}
+static void* byte_memchr(const void *s, int c, size_t n)
+{
+	const unsigned char *p = s;
+	for( ; n; n--, p++ )
+		if ( *p == (unsigned char)c )
+			return (void*) p;
+	return 0;
+}
+static int byte_memcmp(const void *s1, const void *s2, size_t n)
+{
+	const unsigned char *p1 = s1, *p2 = s2;
+	for( ; n; n--, p1++, p2++ )
+		if ( *p1 != *p2 )
+			return *p1 - *p2;
+	return 0;
+}
+#define SIGN(x)		( (x) > 0 ? 1 : ( (x) < 0 ? -1 : 0 ) )
+
+/*! Compares strlen/strcmp/memchr/memcmp against the byte loops for every alignment, length and position of the difference/match
+	Bytes above 0x80 are used too, since they can fool a zero byte test that does not mask with ~x.
+*/
+static void test_scan_functions()
+{
+	int src_align, dest_align, len, pos;
+	char * s1, * s2;
+
+	printf("strlen/strcmp/memchr/memcmp :: ");
+	for(src_align=0; src_align<MEM_TEST_MAX_ALIGN; src_align++)
+	{
+		for(dest_align=0; dest_align<MEM_TEST_MAX_ALIGN; dest_align++)
+		{
+			for(len=0; len<=MEM_TEST_MAX_LENGTH; len++)
+			{
+				s1 = (char *)mem_src + src_align;
+				s2 = (char *)mem_dest + dest_align;
+				fill_pattern( mem_src, MEM_TEST_BUFFER_SIZE, 0x81 );
+				memset( s1, 0x80, len / 2 );
+				for(pos=0; pos<len; pos++)
+					if ( s1[pos] == 0 )
+						s1[pos] = 1;
+				s1[len] = 0;
+				byte_memcpy( s2, s1, len + 1 );
+				
+				assert( strlen( s1 ) == len );
+				assert( strcmp( s1, s2 ) == 0 );
+				assert( memcmp( s1, s2, len ) == 0 );
+				assert( memchr( s1, 0, len + 1 ) == s1 + len );
+				assert( memchr( s1, 0, len ) == NULL );
+				for(pos=0; pos<len; pos++)
+				{
+					assert( memchr( s1, s1[pos], len ) == byte_memchr( s1, s1[pos], len ) );
+					/*differ at pos in both directions, and end s2 early at pos*/
+					s2[pos]++;
+					assert( SIGN( strcmp( s1, s2 ) ) == SIGN( byte_strcmp( s1, s2 ) ) );
+					assert( SIGN( strcmp( s2, s1 ) ) == SIGN( byte_strcmp( s2, s1 ) ) );
+					assert( SIGN( memcmp( s1, s2, len ) ) == SIGN( byte_memcmp( s1, s2, len ) ) );
+					assert( SIGN( memcmp( s2, s1, len ) ) == SIGN( byte_memcmp( s2, s1, len ) ) );
+					s2[pos] = 0;
+					assert( strcmp( s1, s2 ) > 0 && strcmp( s2, s1 ) < 0 );
+					s2[pos] = s1[pos];
+				}
+			}
+		}
+	}
+	printf("passed\n");
+}
+
+/*! Returns a page followed by an inaccessible page*/
+static char * map_guarded_page(long page_size)
+{
+	char * pages;
+
+	pages = mmap( NULL, 2*page_size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0 );
+	assert( pages != MAP_FAILED );
+	assert( mprotect( pages + page_size, page_size, PROT_NONE ) == 0 );
+	memset( pages, 'a', page_size );
+	return pages;
+}
+
+/*! Places strings at the end of a page followed by an inaccessible page - a scan that reads past the terminating zero faults*/
+static void test_scan_page_boundary()
+{
+	long page_size = sysconf(_SC_PAGESIZE);
+	char * page1, * page2, * s, * t;
+	int len;
+
+	printf("strlen/strcmp/memchr/memcmp at page boundary :: ");
+	page1 = map_guarded_page( page_size );
+	page2 = map_guarded_page( page_size );
+	for(len=0; len<MEM_TEST_MAX_ALIGN*2; len++)
+	{
+		s = page1 + page_size - len - 1;
+		s[len] = 0;
+		assert( strlen( s ) == len );
+		assert( memchr( s, 0, len + 1 ) == s + len );
+		/*same alignment as s, and ending at the other guard page*/
+		t = page2 + page_size - len - 1;
+		t[len] = 0;
+		assert( strcmp( s, t ) == 0 );
+		assert( memcmp( s, t, len + 1 ) == 0 );
+		/*different alignment from s*/
+		t = page2 + page_size - len - 2;
+		assert( strcmp( s, t ) != 0 || len == 0 );
+		s[len] = t[len] = 'a';
+	}
+	munmap( page1, 2*page_size );
+	munmap( page2, 2*page_size );
+	printf("passed\n");
+}
+
+/*! Prints the time taken by the mem* functions and the byte loops to process the same amount of data*/
+static void benchmark_mem_functions()
+{
+	static unsigned char src[MEM_BENCH_SIZE], dest[MEM_BENCH_SIZE];
+	clock_t start;
+	volatile size_t sink;						/*keeps the compiler from dropping calls whose result is unused*/
+	double byte_time, word_time;
+	int i;
+
+	#define BENCHMARK(name, byte_call, word_call)	\
+		start = clock();							\
+		for(i=0; i<MEM_BENCH_ITERATIONS; i++)		\
+			sink = (size_t)byte_call;				\
+		byte_time = (double)(clock() - start) / CLOCKS_PER_SEC;	\
+		start = clock();							\
+		for(i=0; i<MEM_BENCH_ITERATIONS; i++)		\
+			sink = (size_t)word_call;				\
+		word_time = (double)(clock() - start) / CLOCKS_PER_SEC;	\
+		printf( "%-8s byte loop %8.3fs word %8.3fs (%d x %d bytes)\n", name, byte_time, word_time, MEM_BENCH_ITERATIONS, MEM_BENCH_SIZE );
+
+	BENCHMARK( "memcpy", byte_memcpy(dest, src, MEM_BENCH_SIZE), memcpy(dest, src, MEM_BENCH_SIZE) );
+	BENCHMARK( "memset", byte_memset(dest, i, MEM_BENCH_SIZE), memset(dest, i, MEM_BENCH_SIZE) );
+	BENCHMARK( "memmove", byte_memmove(dest+1, dest, MEM_BENCH_SIZE-1), memmove(dest+1, dest, MEM_BENCH_SIZE-1) );
+	memset( src, 'a', MEM_BENCH_SIZE );
+	src[MEM_BENCH_SIZE-1] = 0;
+	memcpy( dest, src, MEM_BENCH_SIZE );
+	BENCHMARK( "strlen", byte_strlen((char *)src), strlen((char *)src) );
+	BENCHMARK( "strcmp", byte_strcmp((char *)src, (char *)dest), strcmp((char *)src, (char *)dest) );
+	BENCHMARK( "memchr", byte_memchr(src, 0, MEM_BENCH_SIZE), memchr(src, 0, MEM_BENCH_SIZE) );
+	BENCHMARK( "memcmp", byte_memcmp(src, dest, MEM_BENCH_SIZE), memcmp(src, dest, MEM_BENCH_SIZE) );
+	#undef BENCHMARK
+	(void)sink;
+}
+
 int main(int argc, char* argv[])
 {
 	int i, count;
@@ -46,6 +300,11 @@ int main(int argc, char* argv[])
 		printf( "%+10s %20uld %#20ulx %#20ulo\n", num[i], val, val, val);
 	}
 	
+	test_mem_functions();
+	test_scan_functions();
+	test_scan_page_boundary();
+	benchmark_mem_functions();
+	
 	return 0;
 }
 
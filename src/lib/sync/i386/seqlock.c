@@ -0,0 +1,62 @@
+/*!
+	\file		seqlock.c
+	\brief		Sequence lock for Ace
+	Note - i386 does not reorder loads with other loads or stores with other stores, so only the
+	compiler has to be stopped from moving the accesses.
+*/
+#include <ace.h>
+#include <sync/seqlock.h>
+
+/*!	InitSeqLock - initialize the sequence lock
+	\param seq_lock - Pointer to the sequence lock
+*/
+void InitSeqLock(SEQ_LOCK_PTR seq_lock)
+{
+	InitSpinLock( &seq_lock->lock );
+	seq_lock->sequence = 0;
+}
+
+/*!	WriteSeqLock - Starts an update - readers started before will retry
+	\param seq_lock - Pointer to the sequence lock
+*/
+void WriteSeqLock(SEQ_LOCK_PTR seq_lock)
+{
+	SpinLock( &seq_lock->lock );
+	seq_lock->sequence++;
+	COMPILER_BARRIER();
+}
+
+/*!	WriteSeqUnlock - Completes an update
+	\param seq_lock - Pointer to the sequence lock
+*/
+void WriteSeqUnlock(SEQ_LOCK_PTR seq_lock)
+{
+	COMPILER_BARRIER();
+	seq_lock->sequence++;
+	SpinUnlock( &seq_lock->lock );
+}
+
+/*!	ReadSeqBegin - Starts a lockless read - waits if an update is in progress
+	\param seq_lock - Pointer to the sequence lock
+	\return sequence to be passed to ReadSeqRetry()
+*/
+unsigned long ReadSeqBegin(SEQ_LOCK_PTR seq_lock)
+{
+	unsigned long sequence;
+	
+	while( (sequence = seq_lock->sequence) & 1 )
+		asm volatile("pause");
+	COMPILER_BARRIER();
+	return sequence;
+}
+
+/*!	ReadSeqRetry - Checks whether the data read after ReadSeqBegin() is consistent
+	\param seq_lock - Pointer to the sequence lock
+	\param sequence - value returned by ReadSeqBegin()
+	\return non-zero if a writer changed the data and the read should be retried
+*/
+int ReadSeqRetry(SEQ_LOCK_PTR seq_lock, unsigned long sequence)
+{
+	COMPILER_BARRIER();
+	return seq_lock->sequence != sequence;
+}
@@ -80,6 +80,14 @@ inline void SpinUnlock(SPIN_LOCK_PTR pSpinLock)
 
 	assert( result == 1 );
 }
+/*! 	MemoryBarrier - orders all the memory reads and writes before this point against the ones after it
+	Locked instruction is used because i386 does not have mfence.
+*/
+void MemoryBarrier()
+{
+	asm volatile("lock; addl $0, (%%esp)" : : : "memory");
+}
+
 /*! 	BitSpinLock - Spin to get a bit lock until timeout occurs
 	\param pBitData - Pointer to the bit lock array
 	\param iPos - Bit Position